@@ -0,0 +1,758 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  Microbenchmarks for the hot paths of the library.  The same source is
+  built against each library variant (bench_aml_static, bench_aml_debug,
+  bench_aml_memory, and bench_aml_static_jemalloc/_mimalloc when those are
+  installed) so that the results can be compared directly.
+
+    bench_aml [--out file] [--filter text] [--reps n] [--scale f]
+              [--threads n] [--list]
+
+  Results are written as one JSON document (to stdout by default).  Inputs
+  come from a fixed seed, so every run does the same work.  Each benchmark
+  runs once to warm up and then --reps times; the minimum and median are
+  reported.
+*/
+
+#include "a-memory-library/aml_alloc.h"
+#include "a-memory-library/aml_buffer.h"
+#include "a-memory-library/aml_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef AML_BENCH_VARIANT
+#define AML_BENCH_VARIANT "unknown"
+#endif
+#ifndef AML_BENCH_MALLOC
+#define AML_BENCH_MALLOC "system"
+#endif
+
+/* allocations are made in batches of this many and then freed */
+#define BATCH 1024
+/* the size distributions repeat after this many (a multiple of BATCH) */
+#define SIZES 4096
+#define MAX_REPS 64
+
+/* --- options --- */
+
+static const char *filter = NULL;
+static int reps = 5;
+static double scale = 1.0;
+static int max_threads = 1;
+static int list_only = 0;
+
+static FILE *out;
+static int results = 0;
+
+/* results are added here so the work isn't optimized away */
+static _Atomic uint64_t sink;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void) {
+  /* xorshift64*, fixed seed */
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* --- the runner --- */
+
+/* runs ops operations and returns something derived from the work */
+typedef uint64_t (*bench_fn_t)(void *arg, size_t ops);
+
+typedef struct {
+  const char *name;
+  /* a JSON object describing the inputs */
+  const char *params;
+  bench_fn_t fn;
+  void *arg;
+  /* operations per repetition (per thread) */
+  size_t ops;
+  /* bytes processed by an operation, 0 if throughput isn't meaningful */
+  size_t bytes;
+  /* ops is rounded down to a multiple of this (fn works in batches) */
+  size_t batch;
+} bench_t;
+
+typedef struct {
+  const bench_t *b;
+  size_t ops;
+  atomic_int *go;
+} bench_thread_t;
+
+static void *bench_thread(void *p) {
+  bench_thread_t *t = (bench_thread_t *)p;
+  while (!atomic_load_explicit(t->go, memory_order_acquire))
+    ;
+  sink += t->b->fn(t->b->arg, t->ops);
+  return NULL;
+}
+
+/* wall time in ns for one repetition on threads threads */
+static double run_once(const bench_t *b, size_t ops, int threads) {
+  if (threads == 1) {
+    double start = now_ns();
+    sink += b->fn(b->arg, ops);
+    return now_ns() - start;
+  }
+  pthread_t tids[threads];
+  bench_thread_t args[threads];
+  atomic_int go = 0;
+  for (int i = 0; i < threads; i++) {
+    args[i].b = b;
+    args[i].ops = ops;
+    args[i].go = &go;
+    pthread_create(tids + i, NULL, bench_thread, args + i);
+  }
+  double start = now_ns();
+  atomic_store_explicit(&go, 1, memory_order_release);
+  for (int i = 0; i < threads; i++)
+    pthread_join(tids[i], NULL);
+  return now_ns() - start;
+}
+
+static void bench_run(const bench_t *b, int threads) {
+  if (filter && !strstr(b->name, filter))
+    return;
+  if (list_only) {
+    printf("%s %s threads=%d\n", b->name, b->params, threads);
+    return;
+  }
+  size_t batch = b->batch ? b->batch : 1;
+  size_t ops = (size_t)(b->ops * scale);
+  if (ops < batch)
+    ops = batch;
+  ops -= ops % batch;
+
+  run_once(b, ops, threads);
+  double ns[MAX_REPS];
+  for (int i = 0; i < reps; i++)
+    ns[i] = run_once(b, ops, threads) / (double)(ops * threads);
+  qsort(ns, reps, sizeof(double), cmp_double);
+  double median = reps & 1 ? ns[reps / 2]
+                           : (ns[reps / 2 - 1] + ns[reps / 2]) / 2.0;
+
+  fprintf(out, "%s\n    {\"name\": \"%s\", \"params\": %s, \"threads\": %d, "
+               "\"ops\": %zu, \"ns_per_op\": {\"min\": %.3f, \"median\": %.3f, "
+               "\"max\": %.3f}, \"mops_per_s\": %.3f",
+          results ? "," : "", b->name, b->params, threads, ops * threads,
+          ns[0], median, ns[reps - 1], 1e3 / median);
+  if (b->bytes)
+    fprintf(out, ", \"mb_per_s\": %.1f",
+            (double)b->bytes * 1e9 / median / (1024.0 * 1024.0));
+  fprintf(out, "}");
+  fflush(out);
+  results++;
+  fprintf(stderr, "%-32s %-40s %3d thr %10.2f ns/op\n", b->name, b->params,
+          threads, median);
+}
+
+/* runs b on 1, 2, 4, ... max_threads threads */
+static void bench_run_threads(const bench_t *b) {
+  int t;
+  for (t = 1; t < max_threads; t <<= 1)
+    bench_run(b, t);
+  bench_run(b, max_threads);
+}
+
+/* --- allocation --- */
+
+typedef struct {
+  const char *name;
+  size_t sizes[SIZES];
+  /* the most bytes any batch allocates (rounded up like the pool rounds) */
+  size_t batch_bytes;
+} dist_t;
+
+static dist_t dists[3];
+
+static void dist_setup(dist_t *d, const char *name, size_t lo, size_t hi,
+                       int log_uniform) {
+  d->name = name;
+  for (size_t i = 0; i < SIZES; i++) {
+    size_t s;
+    if (log_uniform) {
+      /* pick a power of two, then a size within it */
+      size_t span = 0;
+      while ((lo << (span + 1)) <= hi)
+        span++;
+      size_t base = lo << (rng() % (span + 1));
+      s = base + rng() % base;
+      if (s > hi)
+        s = hi;
+    } else
+      s = lo + rng() % (hi - lo + 1);
+    d->sizes[i] = s;
+  }
+  d->batch_bytes = 0;
+  for (size_t b = 0; b < SIZES; b += BATCH) {
+    size_t total = 0;
+    for (size_t i = 0; i < BATCH; i++)
+      total += (d->sizes[b + i] + 7) & ~(size_t)7;
+    if (total > d->batch_bytes)
+      d->batch_bytes = total;
+  }
+}
+
+static uint64_t b_malloc(void *arg, size_t ops) {
+  const dist_t *d = (const dist_t *)arg;
+  char *p[BATCH];
+  uint64_t sum = 0;
+  for (size_t done = 0; done < ops; done += BATCH) {
+    for (size_t i = 0; i < BATCH; i++) {
+      p[i] = (char *)malloc(d->sizes[(done + i) & (SIZES - 1)]);
+      p[i][0] = (char)i;
+    }
+    for (size_t i = 0; i < BATCH; i++) {
+      sum += (unsigned char)p[i][0];
+      free(p[i]);
+    }
+  }
+  return sum;
+}
+
+static uint64_t b_aml_malloc(void *arg, size_t ops) {
+  const dist_t *d = (const dist_t *)arg;
+  char *p[BATCH];
+  uint64_t sum = 0;
+  for (size_t done = 0; done < ops; done += BATCH) {
+    for (size_t i = 0; i < BATCH; i++) {
+      p[i] = (char *)aml_malloc(d->sizes[(done + i) & (SIZES - 1)]);
+      p[i][0] = (char)i;
+    }
+    for (size_t i = 0; i < BATCH; i++) {
+      sum += (unsigned char)p[i][0];
+      aml_free(p[i]);
+    }
+  }
+  return sum;
+}
+
+typedef struct {
+  const dist_t *d;
+  /* the size the pool is created with */
+  size_t pool_size;
+} pool_arg_t;
+
+#define POOL_ALLOC 0
+#define POOL_UALLOC 1
+#define POOL_AALLOC 2
+
+/* kind is a constant in each caller, so each gets its own loop */
+static inline uint64_t pool_loop(const pool_arg_t *a, size_t ops, int kind) {
+  aml_pool_t *pool = aml_pool_init(a->pool_size);
+  uint64_t sum = 0;
+  for (size_t done = 0; done < ops; done += BATCH) {
+    for (size_t i = 0; i < BATCH; i++) {
+      size_t len = a->d->sizes[(done + i) & (SIZES - 1)];
+      char *p;
+      if (kind == POOL_ALLOC)
+        p = (char *)aml_pool_alloc(pool, len);
+      else if (kind == POOL_UALLOC)
+        p = (char *)aml_pool_ualloc(pool, len);
+      else
+        p = (char *)aml_pool_aalloc(pool, 64, len);
+      p[0] = (char)i;
+      sum += (unsigned char)p[0];
+    }
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+static uint64_t b_pool_alloc(void *arg, size_t ops) {
+  return pool_loop((const pool_arg_t *)arg, ops, POOL_ALLOC);
+}
+
+static uint64_t b_pool_ualloc(void *arg, size_t ops) {
+  return pool_loop((const pool_arg_t *)arg, ops, POOL_UALLOC);
+}
+
+static uint64_t b_pool_aalloc(void *arg, size_t ops) {
+  return pool_loop((const pool_arg_t *)arg, ops, POOL_AALLOC);
+}
+
+typedef struct {
+  size_t pool_size;
+  size_t alloc_size;
+} save_arg_t;
+
+/* save, allocate 8 times, restore */
+static uint64_t b_pool_save_restore(void *arg, size_t ops) {
+  const save_arg_t *a = (const save_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(a->pool_size);
+  aml_pool_marker_t m;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    aml_pool_save(pool, &m);
+    for (size_t j = 0; j < 8; j++) {
+      char *p = (char *)aml_pool_alloc(pool, a->alloc_size);
+      p[0] = (char)j;
+      sum += (unsigned char)p[0];
+    }
+    aml_pool_restore(pool, &m);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+static char pool_params[3][2][128];
+static char save_params[2][128];
+
+static void alloc_benchmarks(void) {
+  dist_setup(&dists[0], "small", 8, 64, 0);
+  dist_setup(&dists[1], "mixed", 8, 1024, 1);
+  dist_setup(&dists[2], "large", 1024, 65536, 1);
+
+  static char params[3][64];
+  static pool_arg_t pool_args[3][2];
+  for (int i = 0; i < 3; i++) {
+    snprintf(params[i], sizeof(params[i]), "{\"sizes\": \"%s\"}",
+             dists[i].name);
+    bench_t b = {"malloc_free", params[i], b_malloc, dists + i, 2000000, 0,
+                 BATCH};
+    bench_run_threads(&b);
+    b.name = "aml_malloc_free";
+    b.fn = b_aml_malloc;
+    bench_run_threads(&b);
+  }
+
+  static const char *pool_names[3] = {"pool_alloc", "pool_ualloc",
+                                      "pool_aalloc64"};
+  static const bench_fn_t pool_fns[3] = {b_pool_alloc, b_pool_ualloc,
+                                         b_pool_aalloc};
+  for (int i = 0; i < 3; i++) {
+    /* fit: a batch fits in the first block.  grow: the pool starts small and
+       grows through new blocks in every batch. */
+    pool_args[i][0].d = dists + i;
+    pool_args[i][0].pool_size = dists[i].batch_bytes + BATCH * 64 + 4096;
+    pool_args[i][1].d = dists + i;
+    pool_args[i][1].pool_size = 4096;
+    for (int g = 0; g < 2; g++) {
+      snprintf(pool_params[i][g], sizeof(pool_params[i][g]),
+               "{\"sizes\": \"%s\", \"pool\": \"%s\"}", dists[i].name,
+               g ? "grow" : "fit");
+      for (int k = 0; k < 3; k++) {
+        bench_t b = {pool_names[k], pool_params[i][g], pool_fns[k],
+                     &pool_args[i][g], 4000000, 0, BATCH};
+        if (k == POOL_ALLOC)
+          bench_run_threads(&b);
+        else
+          bench_run(&b, 1);
+      }
+    }
+  }
+
+  /* within the current block, and crossing into new blocks every cycle */
+  static save_arg_t save_args[2] = {{1 << 16, 32}, {1024, 256}};
+  for (int i = 0; i < 2; i++) {
+    snprintf(save_params[i], sizeof(save_params[i]),
+             "{\"pool\": \"%s\", \"alloc_size\": %zu, \"allocs\": 8}",
+             i ? "across_blocks" : "in_block", save_args[i].alloc_size);
+    bench_t b = {"pool_save_restore", save_params[i], b_pool_save_restore,
+                 save_args + i, 1000000, 0, 1};
+    bench_run(&b, 1);
+  }
+}
+
+/* --- aml_buffer --- */
+
+/* the buffers are cleared whenever they pass this size */
+#define BUFFER_LIMIT (1024 * 1024)
+
+static uint64_t b_buffer_appendc(void *arg, size_t ops) {
+  (void)arg;
+  aml_buffer_t *bh = aml_buffer_init(16);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    aml_buffer_appendc(bh, (char)('a' + (i & 15)));
+    if (aml_buffer_length(bh) >= BUFFER_LIMIT) {
+      sum += aml_buffer_length(bh);
+      aml_buffer_clear(bh);
+    }
+  }
+  aml_buffer_destroy(bh);
+  return sum;
+}
+
+static uint64_t b_buffer_appends(void *arg, size_t ops) {
+  (void)arg;
+  aml_buffer_t *bh = aml_buffer_init(16);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    aml_buffer_appends(bh, "0123456789abcdef");
+    if (aml_buffer_length(bh) >= BUFFER_LIMIT) {
+      sum += aml_buffer_length(bh);
+      aml_buffer_clear(bh);
+    }
+  }
+  aml_buffer_destroy(bh);
+  return sum;
+}
+
+static uint64_t b_buffer_append_chunk(void *arg, size_t ops) {
+  const char *chunk = (const char *)arg;
+  aml_buffer_t *bh = aml_buffer_init(16);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    aml_buffer_append(bh, chunk, 4096);
+    if (aml_buffer_length(bh) >= 16 * BUFFER_LIMIT) {
+      sum += aml_buffer_length(bh);
+      aml_buffer_clear(bh);
+    }
+  }
+  aml_buffer_destroy(bh);
+  return sum;
+}
+
+static uint64_t b_buffer_append_u64(void *arg, size_t ops) {
+  (void)arg;
+  aml_buffer_t *bh = aml_buffer_init(16);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    aml_buffer_append_u64(bh, (uint64_t)i * 2654435761u);
+    aml_buffer_appendc(bh, ',');
+    if (aml_buffer_length(bh) >= BUFFER_LIMIT) {
+      sum += aml_buffer_length(bh);
+      aml_buffer_clear(bh);
+    }
+  }
+  aml_buffer_destroy(bh);
+  return sum;
+}
+
+static uint64_t b_buffer_appendf(void *arg, size_t ops) {
+  (void)arg;
+  aml_buffer_t *bh = aml_buffer_init(16);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    aml_buffer_appendf(bh, "%llu,", (unsigned long long)i * 2654435761u);
+    if (aml_buffer_length(bh) >= BUFFER_LIMIT) {
+      sum += aml_buffer_length(bh);
+      aml_buffer_clear(bh);
+    }
+  }
+  aml_buffer_destroy(bh);
+  return sum;
+}
+
+/* the buffer is rebuilt from nothing each time (growth dominates) */
+static uint64_t b_buffer_grow(void *arg, size_t ops) {
+  (void)arg;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i += BATCH) {
+    aml_buffer_t *bh = aml_buffer_init(16);
+    for (size_t j = 0; j < BATCH; j++)
+      aml_buffer_appends(bh, "0123456789abcdef");
+    sum += aml_buffer_length(bh);
+    aml_buffer_destroy(bh);
+  }
+  return sum;
+}
+
+static void buffer_benchmarks(void) {
+  static char chunk[4096];
+  memset(chunk, 'x', sizeof(chunk));
+  bench_t b[] = {
+      {"buffer_appendc", "{\"bytes\": 1}", b_buffer_appendc, NULL, 20000000, 1,
+       1},
+      {"buffer_appends", "{\"bytes\": 16}", b_buffer_appends, NULL, 10000000,
+       16, 1},
+      {"buffer_append", "{\"bytes\": 4096}", b_buffer_append_chunk, chunk,
+       200000, 4096, 1},
+      {"buffer_append_u64", "{}", b_buffer_append_u64, NULL, 5000000, 0, 1},
+      {"buffer_appendf", "{\"format\": \"%llu,\"}", b_buffer_appendf, NULL,
+       2000000, 0, 1},
+      {"buffer_grow", "{\"appends\": 1024, \"bytes\": 16}", b_buffer_grow,
+       NULL, 2000000, 16, BATCH},
+  };
+  for (size_t i = 0; i < sizeof(b) / sizeof(b[0]); i++)
+    bench_run(b + i, 1);
+}
+
+/* --- split and base64 --- */
+
+typedef struct {
+  char *text;
+  size_t length;
+} text_arg_t;
+
+static uint64_t b_split(void *arg, size_t ops) {
+  const text_arg_t *t = (const text_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(t->length * 2);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    size_t n;
+    aml_pool_split(pool, &n, ',', t->text);
+    sum += n;
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+static uint64_t b_split2(void *arg, size_t ops) {
+  const text_arg_t *t = (const text_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(t->length * 2);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    size_t n;
+    aml_pool_split2(pool, &n, ',', t->text);
+    sum += n;
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+static uint64_t b_split_with_escape(void *arg, size_t ops) {
+  const text_arg_t *t = (const text_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(t->length * 2);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    size_t n;
+    aml_pool_split_with_escape(pool, &n, ',', '\\', t->text);
+    sum += n;
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+/* split and then intern the fields, which repeat (see text_benchmarks) */
+static uint64_t b_split_intern(void *arg, size_t ops) {
+  const text_arg_t *t = (const text_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(t->length * 3);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    size_t n;
+    char **parts = aml_pool_split(pool, &n, ',', t->text);
+    aml_pool_intern_all(pool, parts, n);
+    sum += aml_pool_intern_count(pool);
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+static uint64_t b_base64_encode(void *arg, size_t ops) {
+  const text_arg_t *t = (const text_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(t->length * 2);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    char *e = aml_pool_base64_encode(pool, (unsigned char *)t->text, t->length);
+    sum += (unsigned char)e[0];
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+static uint64_t b_base64_decode(void *arg, size_t ops) {
+  const text_arg_t *t = (const text_arg_t *)arg;
+  aml_pool_t *pool = aml_pool_init(t->length * 2);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ops; i++) {
+    size_t n;
+    unsigned char *d = aml_pool_base64_decode(pool, &n, t->text);
+    sum += n + (d ? d[0] : 0);
+    aml_pool_clear(pool);
+  }
+  aml_pool_destroy(pool);
+  return sum;
+}
+
+#define TEXT_LENGTH (1024 * 1024)
+
+static void text_benchmarks(void) {
+  /* comma separated fields of 0 to 15 characters, some with escaped commas */
+  static text_arg_t csv, binary, encoded;
+  csv.text = (char *)malloc(TEXT_LENGTH + 1);
+  size_t n = 0;
+  while (n < TEXT_LENGTH - 32) {
+    size_t len = rng() % 16;
+    for (size_t i = 0; i < len; i++)
+      csv.text[n++] = (char)('a' + rng() % 26);
+    if (rng() % 8 == 0) {
+      csv.text[n++] = '\\';
+      csv.text[n++] = ',';
+    }
+    csv.text[n++] = ',';
+  }
+  csv.text[n] = 0;
+  csv.length = n;
+
+  /* fields drawn from a vocabulary of 1000 words, like tags or hostnames */
+  static text_arg_t words;
+  words.text = (char *)malloc(TEXT_LENGTH + 1);
+  n = 0;
+  while (n < TEXT_LENGTH - 32)
+    n += snprintf(words.text + n, 32, "host-%u.example,",
+                  (unsigned)(rng() % 1000));
+  words.text[n] = 0;
+  words.length = n;
+
+  binary.length = TEXT_LENGTH;
+  binary.text = (char *)malloc(binary.length);
+  for (size_t i = 0; i < binary.length; i++)
+    binary.text[i] = (char)rng();
+
+  aml_pool_t *pool = aml_pool_init(4 * TEXT_LENGTH);
+  encoded.text = aml_pool_base64_encode(pool, (unsigned char *)binary.text,
+                                        binary.length);
+  encoded.length = strlen(encoded.text);
+
+  static char split_params[128];
+  snprintf(split_params, sizeof(split_params),
+           "{\"bytes\": %zu, \"kernel\": \"%s\"}", csv.length,
+           aml_split_kernel());
+  static char b64_params[2][64];
+  snprintf(b64_params[0], sizeof(b64_params[0]), "{\"bytes\": %zu}",
+           binary.length);
+  snprintf(b64_params[1], sizeof(b64_params[1]), "{\"bytes\": %zu}",
+           encoded.length);
+
+  /* an operation is a pass over the whole input */
+  bench_t b[] = {
+      {"split", split_params, b_split, &csv, 100, csv.length, 1},
+      {"split2", split_params, b_split2, &csv, 100, csv.length, 1},
+      {"split_with_escape", split_params, b_split_with_escape, &csv, 100,
+       csv.length, 1},
+      {"split_intern", "{\"words\": 1000}", b_split_intern, &words, 100,
+       words.length, 1},
+      {"base64_encode", b64_params[0], b_base64_encode, &binary, 100,
+       binary.length, 1},
+      {"base64_decode", b64_params[1], b_base64_decode, &encoded, 100,
+       encoded.length, 1},
+  };
+  for (size_t i = 0; i < sizeof(b) / sizeof(b[0]); i++)
+    bench_run(b + i, 1);
+  aml_pool_destroy(pool);
+  free(binary.text);
+  free(csv.text);
+  free(words.text);
+}
+
+/* --- main --- */
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--out file] [--filter text] [--reps n] [--scale f]\n"
+          "          [--threads n] [--list]\n"
+          "  --out      write the JSON results to file (default stdout)\n"
+          "  --filter   only run benchmarks whose name contains text\n"
+          "  --reps     timed repetitions of each benchmark (default 5)\n"
+          "  --scale    multiply the number of operations (default 1.0)\n"
+          "  --threads  the most threads for the scaling runs (default: the\n"
+          "             number of CPUs, up to 16)\n"
+          "  --list     print the benchmarks without running them\n",
+          prog);
+}
+
+static const char *defines(void) {
+  return ""
+#ifdef _AML_DEBUG_
+         "\"_AML_DEBUG_\""
+#ifdef _AML_SAMPLE_
+         ", "
+#endif
+#endif
+#ifdef _AML_SAMPLE_
+         "\"_AML_SAMPLE_\""
+#endif
+      ;
+}
+
+int main(int argc, char **argv) {
+  const char *out_file = NULL;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  max_threads = cpus < 1 ? 1 : cpus > 16 ? 16 : (int)cpus;
+
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!strcmp(a, "--list"))
+      list_only = 1;
+    else if (v && !strcmp(a, "--out"))
+      out_file = argv[++i];
+    else if (v && !strcmp(a, "--filter"))
+      filter = argv[++i];
+    else if (v && !strcmp(a, "--reps"))
+      reps = atoi(argv[++i]);
+    else if (v && !strcmp(a, "--scale"))
+      scale = atof(argv[++i]);
+    else if (v && !strcmp(a, "--threads"))
+      max_threads = atoi(argv[++i]);
+    else {
+      usage(argv[0]);
+      return strcmp(a, "--help") && strcmp(a, "-h") ? 1 : 0;
+    }
+  }
+  if (reps < 1 || reps > MAX_REPS || scale <= 0.0 || max_threads < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  out = stdout;
+  if (out_file && !list_only) {
+    out = fopen(out_file, "w");
+    if (!out) {
+      perror(out_file);
+      return 1;
+    }
+  }
+
+  if (!list_only) {
+    fprintf(out,
+            "{\n  \"library\": \"a-memory-library\",\n"
+            "  \"variant\": \"%s\",\n  \"malloc\": \"%s\",\n"
+            "  \"defines\": [%s],\n"
+            "  \"compiler\": \"%s\",\n  \"cpus\": %ld,\n"
+            "  \"timestamp\": %lld,\n  \"repetitions\": %d,\n"
+            "  \"scale\": %g,\n  \"results\": [",
+            AML_BENCH_VARIANT, AML_BENCH_MALLOC, defines(),
+#if defined(__clang__)
+            "clang " __clang_version__,
+#elif defined(__GNUC__)
+            "gcc " __VERSION__,
+#else
+            "unknown",
+#endif
+            cpus, (long long)time(NULL), reps, scale);
+  }
+
+  alloc_benchmarks();
+  buffer_benchmarks();
+  text_benchmarks();
+
+  if (!list_only) {
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+      fclose(out);
+  }
+  return 0;
+}
@@ -74,14 +74,29 @@ case "$COMMAND" in
     echo "   View HTML report: open '$COVERAGE_FILE'"
     ;;
 
+  bench)
+    pick_generator
+    BENCH_BUILD_DIR="build-bench"
+    echo "--- Running Benchmarks (Generator: $GENERATOR) ---"
+
+    cmake -S . -B "$BENCH_BUILD_DIR" -G "$GENERATOR" \
+      -DCMAKE_BUILD_TYPE=Release \
+      -DA_BUILD_BENCHMARKS=ON
+
+    cmake --build "$BENCH_BUILD_DIR" -j
+    cmake --build "$BENCH_BUILD_DIR" --target run_benchmarks
+
+    echo "✅ Benchmarks complete. Results are in '$BENCH_BUILD_DIR/benchmarks/results/'."
+    ;;
+
   clean)
     echo "--- Cleaning Build Directories ---"
-    rm -rf "$BUILD_DIR" "build-coverage"
+    rm -rf "$BUILD_DIR" "build-coverage" "build-bench"
     echo "✅ Clean complete."
     ;;
 
   *)
-    echo "Usage: $0 [build|install|coverage|clean]" >&2
+    echo "Usage: $0 [build|install|coverage|bench|clean]" >&2
     exit 1
     ;;
 esac
@@ -21,6 +21,12 @@
 extern "C" {
 #endif
 
+/* _AML_SAMPLE_ turns on the sampling heap profiler (see aml_sample_dump).
+   Full tracking (_AML_DEBUG_) takes precedence if both are defined. */
+#if defined(_AML_SAMPLE_) && !defined(_AML_DEBUG_)
+#define _AML_SAMPLING_
+#endif
+
 #ifdef _AML_DEBUG_
 #define aml_dump(out) _aml_dump(out)
 
@@ -38,21 +44,93 @@ extern "C" {
 #define aml_strdupa2(p) _aml_strdupa2_d(aml_file_line(), p)
 #define aml_dup(p, len) _aml_dup_d(aml_file_line(), p, len)
 #define aml_free(p) _aml_free_d(aml_file_line(), p)
+#define aml_aligned_alloc(alignment, len)                                     \
+  _aml_aligned_alloc_d(aml_file_line(), alignment, len)
+#define aml_aligned_free(p) _aml_aligned_free_d(aml_file_line(), p)
+#elif defined(_AML_SAMPLING_)
+#define aml_dump(out) aml_sample_dump(out)
+
+#define aml_alloc_log(filename) _aml_alloc_log(filename)
+
+#define aml_malloc(len) _aml_malloc_s(aml_file_line(), len)
+#define aml_zalloc(len) _aml_calloc_s(aml_file_line(), len)
+#define aml_calloc(num_items, size) _aml_calloc_s(aml_file_line(), num_items*size)
+#define aml_realloc(p, len) _aml_realloc_s(aml_file_line(), p, len)
+#define aml_strdup(p) _aml_strdup_s(aml_file_line(), p)
+#define aml_strdupf(p, ...) _aml_strdupf_s(aml_file_line(), p, __VA_ARGS__)
+#define aml_strdupvf(p, args) _aml_strdupvf_s(aml_file_line(), p, args)
+#define aml_strdupa(p) _aml_strdupa_s(aml_file_line(), p)
+#define aml_strdupan(p, n) _aml_strdupan_s(aml_file_line(), p, n)
+#define aml_strdupa2(p) _aml_strdupa2_s(aml_file_line(), p)
+#define aml_dup(p, len) _aml_dup_s(aml_file_line(), p, len)
+#define aml_free(p) _aml_free_s(p)
+#define aml_aligned_alloc(alignment, len)                                     \
+  _aml_aligned_alloc_s(aml_file_line(), alignment, len)
+#define aml_aligned_free(p) _aml_aligned_free_s(p)
 #else
 #define aml_dump(out) ;
 #define aml_alloc_log(filename) ;
-#define aml_malloc(len) malloc(len)
-#define aml_zalloc(len) calloc(1, len)
-#define aml_calloc(num_items, size) calloc(num_items, size)
-#define aml_realloc(p, len) realloc(p, len)
-#define aml_strdup(p) strdup(p)
+#define aml_malloc(len) _aml_alloc_backend.malloc_fn(len)
+#define aml_zalloc(len) _aml_calloc(1, len)
+#define aml_calloc(num_items, size) _aml_calloc(num_items, size)
+#define aml_realloc(p, len) _aml_alloc_backend.realloc_fn(p, len)
+#define aml_strdup(p) _aml_strdup(p)
 #define aml_strdupf(p, ...) _aml_strdupf(p, __VA_ARGS__)
 #define aml_strdupvf(p, args) _aml_strdupvf(p, args)
 #define aml_strdupa(p) _aml_strdupa(p)
 #define aml_strdupan(p, n) _aml_strdupan(p, n)
 #define aml_strdupa2(p) _aml_strdupa2(p)
 #define aml_dup(p, len) _aml_dup(p, len)
-#define aml_free(p) free(p)
+#define aml_free(p) _aml_alloc_backend.free_fn(p)
+#define aml_aligned_alloc(alignment, len) _aml_aligned_alloc(alignment, len)
+#define aml_aligned_free(p) _aml_alloc_backend.free_fn(p)
+#endif
+
+/* The allocator underneath everything in the library: aml_malloc and
+   friends in release builds, the tracked allocations of debug and sampling
+   builds (below their headers), and the blocks of pools and buffers.  The
+   default is libc.
+
+   aml_alloc_set_backend copies the table given to it, NULL restores the
+   default.  malloc_fn, free_fn, realloc_fn and aligned_alloc_fn are
+   required.  Like free, free_fn must accept NULL and memory from
+   aligned_alloc_fn (as free does for posix_memalign).  usable_size_fn may be
+   NULL, otherwise it returns the number of bytes which can be used at a
+   pointer from malloc_fn or realloc_fn (which buffers grow into).
+
+   The backend has to be set before the library allocates anything (and
+   before other threads start), as memory must go back to the backend which
+   allocated it. */
+typedef struct {
+  void *(*malloc_fn)(size_t len);
+  void (*free_fn)(void *p);
+  void *(*realloc_fn)(void *p, size_t len);
+  /* alignment is a power of two and at least sizeof(void *) */
+  void *(*aligned_alloc_fn)(size_t alignment, size_t len);
+  size_t (*usable_size_fn)(void *p);
+} aml_alloc_backend_t;
+
+void aml_alloc_set_backend(const aml_alloc_backend_t *backend);
+const aml_alloc_backend_t *aml_alloc_get_backend(void);
+
+/* the current backend, use the functions above to change it */
+extern aml_alloc_backend_t _aml_alloc_backend;
+
+/* aml_aligned_alloc(alignment, len) returns len bytes aligned to alignment
+   (a power of two, smaller values are raised to sizeof(void *)), which must
+   be released with aml_aligned_free (not aml_free or aml_realloc, debug and
+   sampling builds put their header in front of the aligned address). */
+
+/* _aml_malloc_for allocates len bytes on behalf of caller.  Containers use it
+   for the memory they allocate internally so that the sampling profiler
+   charges it to the site which created the container.  caller is only
+   evaluated in sampling builds. */
+#ifdef _AML_SAMPLING_
+#define _aml_malloc_for(caller, len) _aml_malloc_s(caller, len)
+#define _aml_realloc_for(caller, p, len) _aml_realloc_s(caller, p, len)
+#else
+#define _aml_malloc_for(caller, len) aml_malloc(len)
+#define _aml_realloc_for(caller, p, len) aml_realloc(p, len)
 #endif
 
 void _aml_dump(FILE *out);
@@ -96,8 +174,66 @@ static inline void *_aml_dup_d(const char *caller,
   return r;
 }
 
+/* The sampling heap profiler.  When built with _AML_SAMPLE_, roughly one
+   allocation per sampling interval bytes (a Poisson process over bytes
+   allocated) is recorded against its call site.  The cost for allocations
+   which aren't sampled is a 16 byte header and a thread local counter.
+   Pools and buffers attribute their blocks to the site which created them.
+
+   aml_sample_set_interval sets the mean number of bytes between samples
+   (default 512KB).  aml_sample_set_backtrace(true) also records a backtrace
+   the first time each site is sampled.  aml_sample_dump (which is what
+   aml_dump and the aml_alloc_log thread use in this mode) writes the sites
+   ordered by estimated live bytes. */
+void aml_sample_set_interval(size_t bytes);
+void aml_sample_set_backtrace(bool enabled);
+void aml_sample_dump(FILE *out);
+
+typedef struct {
+  const char *caller;
+  /* estimated bytes and allocations which are still live */
+  size_t live_bytes;
+  size_t live_allocations;
+  /* estimated bytes and allocations since the process started */
+  size_t total_bytes;
+  size_t total_allocations;
+  /* the number of samples taken at this site */
+  size_t samples;
+} aml_sample_site_t;
+
+/* aml_sample_sites calls cb for each site which has been sampled. */
+typedef void (*aml_sample_site_cb)(void *arg, const aml_sample_site_t *site);
+void aml_sample_sites(aml_sample_site_cb cb, void *arg);
+
+void *_aml_malloc_s(const char *caller, size_t len);
+void *_aml_calloc_s(const char *caller, size_t len);
+void *_aml_realloc_s(const char *caller, void *p, size_t len);
+char *_aml_strdup_s(const char *caller, const char *p);
+char *_aml_strdupf_s(const char *caller, const char *p, ...);
+char *_aml_strdupvf_s(const char *caller, const char *p, va_list args);
+char **_aml_strdupa_s(const char *caller, char **a);
+char **_aml_strdupan_s(const char *caller, char **a, size_t n);
+char **_aml_strdupa2_s(const char *caller, char **a);
+void _aml_free_s(void *p);
+
+static inline void *_aml_dup_s(const char *caller, const void *p, size_t len) {
+  void *r = _aml_malloc_s(caller, len);
+  memcpy(r, p, len);
+  return r;
+}
+
+void *_aml_aligned_alloc_d(const char *caller, size_t alignment, size_t len);
+void _aml_aligned_free_d(const char *caller, void *p);
+void *_aml_aligned_alloc_s(const char *caller, size_t alignment, size_t len);
+void _aml_aligned_free_s(void *p);
+
+/* the release versions, which go straight to the backend */
+void *_aml_calloc(size_t num_items, size_t size);
+char *_aml_strdup(const char *p);
+void *_aml_aligned_alloc(size_t alignment, size_t len);
+
 static inline void *_aml_dup(const void *p, size_t len) {
-  void *r = malloc(len);
+  void *r = _aml_alloc_backend.malloc_fn(len);
   memcpy(r, p, len);
   return r;
 }
@@ -106,8 +242,26 @@ static inline
 void _aml_free(void *p) {
 #ifdef _AML_DEBUG_
     _aml_free_d(aml_file_line(), p);
+#elif defined(_AML_SAMPLING_)
+    _aml_free_s(p);
+#else
+    _aml_alloc_backend.free_fn(p);
+#endif
+}
+
+/* The number of bytes which can be used at p, a block of len bytes from
+   aml_malloc or aml_realloc.  Debug and sampling builds record the length
+   which was asked for, so there it is always len. */
+static inline size_t _aml_usable_size(void *p, size_t len) {
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+  (void)p;
+  return len;
 #else
-    free(p);
+  size_t (*fn)(void *) = _aml_alloc_backend.usable_size_fn;
+  if (!fn || !p)
+    return len;
+  size_t n = fn(p);
+  return n > len ? n : len;
 #endif
 }
 
@@ -20,6 +20,8 @@
 
 #include "a-memory-library/aml_alloc.h"
 #include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_numa.h"
+#include "a-memory-library/aml_trace.h"
 
 #include <stdarg.h>
 #include <stdbool.h>
@@ -33,13 +35,24 @@ extern "C" {
 struct aml_buffer_s;
 typedef struct aml_buffer_s aml_buffer_t;
 
+/* a buffer which grows reserves this percentage of the length it needs on
+   top of it (see aml_buffer_set_growth) */
+#define AML_BUFFER_DEFAULT_GROWTH 50
+/* heap buffers of at least this size are moved to an anonymous mapping and
+   grown with mremap, so they are never copied again (see
+   aml_buffer_set_mmap_threshold) */
+#define AML_BUFFER_MMAP_THRESHOLD (32 * 1024 * 1024)
+/* aml_buffer_append_fd reads in steps of at least this many bytes when it
+   can't tell how much there is to read */
+#define AML_BUFFER_READ_SIZE 65536
+
 /* aml_buffer_init creates a buffer with an initial size of size.  The buffer
    will grow as needed, but if you know the size that is generally needed,
    it may be more efficient to initialize it to that size.
 
    aml_buffer_t *aml_buffer_init(size_t size);
 */
-#ifdef _AML_DEBUG_
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
 #define aml_buffer_init(size)                                                   \
   _aml_buffer_init(size, aml_file_line_func("aml_buffer"));
 aml_buffer_t *_aml_buffer_init(size_t size, const char *caller);
@@ -73,6 +86,40 @@ static inline void aml_buffer_reset(aml_buffer_t *h, size_t max_size);
    will retain the original data in the buffer for up to length bytes. */
 static inline void *aml_buffer_resize(aml_buffer_t *h, size_t length);
 
+/* make room for at least size bytes (plus a zero terminator) without
+   changing the length */
+static inline void aml_buffer_reserve(aml_buffer_t *h, size_t size);
+
+/* the number of bytes the buffer can hold before it has to grow */
+static inline size_t aml_buffer_capacity(aml_buffer_t *h);
+
+/* give back the memory beyond the length.  A pool buffer can only shrink if
+   it is the pool's last allocation. */
+void aml_buffer_shrink_to_fit(aml_buffer_t *h);
+
+/* like aml_buffer_shrink_to_fit, keeping room for keep_bytes (or the length
+   if that is more).  An empty buffer trimmed to 0 frees its memory.  Returns
+   the number of bytes given back to the system (a pool buffer's go back to
+   its pool, so it returns 0). */
+size_t aml_buffer_trim(aml_buffer_t *h, size_t keep_bytes);
+
+/* When the buffer has to grow to hold length bytes, it grows to
+   length + length * percent / 100.  Larger values copy less often when
+   appending in small pieces and leave more unused memory behind. */
+static inline void aml_buffer_set_growth(aml_buffer_t *h, size_t percent);
+
+/* heap buffers which grow to threshold bytes or more are moved to their own
+   mapping which is resized with mremap (in place or by remapping pages, not
+   by copying) from then on.  0 turns this off.  Pool buffers ignore it. */
+static inline void aml_buffer_set_mmap_threshold(aml_buffer_t *h,
+                                                 size_t threshold);
+
+/* place the buffer's mapping on a NUMA node (or AML_NUMA_LOCAL, see
+   aml_numa.h).  This applies once the buffer reaches the mmap threshold, a
+   buffer which is already mapped is moved to the node now.  Heap data below
+   the threshold is left where malloc put it. */
+void aml_buffer_set_numa(aml_buffer_t *h, int node);
+
 /* shrink the buffer by length bytes, if the buffer is not length bytes, buffer
    will be cleared. */
 static inline void *aml_buffer_shrink_by(aml_buffer_t *h, size_t length);
@@ -137,6 +184,55 @@ static inline void *aml_buffer_append_alloc(aml_buffer_t *h, size_t length);
 /* same as append_alloc except memory is not necessarily aligned */
 static inline void *aml_buffer_append_ualloc(aml_buffer_t *h, size_t length);
 
+/* append data encoded as base64 (see aml_pool_base64_encode) */
+void aml_buffer_append_base64(aml_buffer_t *h, const void *data, size_t length);
+
+/* append the bytes which the base64 text b64 (length bytes long) decodes to.
+   If b64 isn't valid, false is returned and the buffer is left unchanged. */
+bool aml_buffer_append_base64_decode(aml_buffer_t *h, const char *b64,
+                                     size_t length);
+
+/* append the decimal digits of v */
+void aml_buffer_append_u64(aml_buffer_t *h, uint64_t v);
+void aml_buffer_append_i64(aml_buffer_t *h, int64_t v);
+
+/* append v as lowercase hex without a prefix or leading zeros */
+void aml_buffer_append_hex(aml_buffer_t *h, uint64_t v);
+
+/* append the shortest digits which strtod reads back as v (almost always, and
+   never digits which read back as anything else).  Numbers from 1e-6 up to
+   1e21 are written without an exponent, like JavaScript does, so 5.0 is "5".
+   NaN and infinity are written as nan, inf and -inf. */
+void aml_buffer_append_double(aml_buffer_t *h, double v);
+
+/* append s (len bytes) as a quoted JSON string.  Quotes, backslashes and
+   control characters are escaped, other bytes (including UTF-8) are copied. */
+void aml_buffer_append_json_string(aml_buffer_t *h, const char *s,
+                                   size_t len);
+
+/* append s (len bytes) as a CSV field.  A field which has delim, a quote or
+   a line break in it is quoted and its quotes are doubled (RFC 4180). */
+void aml_buffer_append_csv_field(aml_buffer_t *h, const char *s, size_t len,
+                                 char delim);
+
+/* read from fd until the end of the file and append what was read.  The
+   bytes are read straight into the buffer; for regular files the buffer is
+   sized from fstat up front so it doesn't have to grow.  Returns false if a
+   read fails (the bytes which were read before remain). */
+bool aml_buffer_append_fd(aml_buffer_t *h, int fd);
+
+/* like aml_buffer_append_fd, for the file named filename */
+bool aml_buffer_append_file(aml_buffer_t *h, const char *filename);
+
+/* one read of up to max bytes from fd (a socket or pipe, for example)
+   appended to the buffer.  Returns what read returned: the number of bytes
+   appended, 0 at the end of the file or -1 on error. */
+ssize_t aml_buffer_read_fd(aml_buffer_t *h, int fd, size_t max);
+
+/* write the whole buffer to fd, retrying partial writes.  Returns false if a
+   write fails (which includes EAGAIN on a non-blocking fd). */
+bool aml_buffer_write_fd(aml_buffer_t *h, int fd);
+
 /* resize the buffer and return a pointer to the beginning of the buffer.  This
    will NOT retain the original data in the buffer for up to length bytes. */
 static inline void *aml_buffer_alloc(aml_buffer_t *h, size_t length);
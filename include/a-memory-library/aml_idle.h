@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  The idle registry gives back the memory of pools and buffers which have
+  gone quiet.  After a spike, thousands of per-connection pools and buffers
+  each hold on to the blocks they grew into (aml_pool_clear keeps the primary
+  block, aml_buffer_clear keeps the capacity).  Registered objects are
+  trimmed (aml_pool_trim, aml_buffer_trim) once they have been idle for a
+  while, by aml_idle_release or a background thread.
+
+    aml_idle_t *idle = aml_idle_add_pool(conn->pool, 4096);
+    ...
+    aml_idle_unpark(idle);          // a request arrived
+    handle_request(conn);
+    aml_pool_clear(conn->pool);
+    aml_idle_park(idle);            // waiting for the next one
+    ...
+    aml_idle_remove(idle);          // before destroying the pool
+    aml_pool_destroy(conn->pool);
+
+  Pools and buffers aren't thread-safe, so the registry only touches an
+  object while its owner has parked it.  Parking records the time, and an
+  object parked for at least the idle interval is trimmed once.  Unparking
+  waits if the object is being trimmed at that moment.  Nothing is added to
+  the allocation paths: the cost is one clock read in aml_idle_park and an
+  atomic in each of park and unpark.
+
+  An object starts out unparked.  Parking, unparking and removal belong to
+  the owner of the object, aml_idle_release may be called from any thread.
+*/
+
+#ifndef _aml_idle_H
+#define _aml_idle_H
+
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_buffer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct aml_idle_s;
+typedef struct aml_idle_s aml_idle_t;
+
+/* Register a pool or buffer.  When it is trimmed, keep_bytes is passed to
+   aml_pool_trim or aml_buffer_trim.  The object must be removed before it
+   is destroyed. */
+aml_idle_t *aml_idle_add_pool(aml_pool_t *pool, size_t keep_bytes);
+aml_idle_t *aml_idle_add_buffer(aml_buffer_t *buffer, size_t keep_bytes);
+void aml_idle_remove(aml_idle_t *e);
+
+/* the owner is done with the object for now */
+void aml_idle_park(aml_idle_t *e);
+/* the owner is about to use the object again */
+void aml_idle_unpark(aml_idle_t *e);
+
+/* Trim every object which has been parked for at least idle_ms
+   milliseconds (and hasn't been trimmed since it was parked).  Returns the
+   number of bytes given back.  The registry is locked during the walk, so
+   objects can't be added or removed until it finishes. */
+size_t aml_idle_release(uint64_t idle_ms);
+
+/* Run aml_idle_release(idle_ms) every period_ms milliseconds on a
+   background thread until aml_idle_stop.  Calling it again changes the
+   intervals.  Returns false if the thread couldn't be started. */
+bool aml_idle_start(uint64_t idle_ms, uint64_t period_ms);
+void aml_idle_stop(void);
+
+/* the number of registered objects and of those which are trimmed */
+size_t aml_idle_count(void);
+size_t aml_idle_trimmed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
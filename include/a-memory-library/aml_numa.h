@@ -0,0 +1,63 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  Small NUMA helpers used by pools (AML_POOL_NUMA, see aml_pool_init_ex) and
+  buffers (aml_buffer_set_numa), and available to callers.  They use the
+  mbind, get_mempolicy and getcpu system calls directly, so libnuma isn't
+  needed.  Memory is bound with MPOL_PREFERRED: pages come from the chosen
+  node while it has free memory and from other nodes after that, rather
+  than failing.
+
+  On systems without NUMA support (or other than Linux) the calls still
+  work: nodes are reported as unknown and binding does nothing.
+*/
+
+#ifndef _aml_numa_H
+#define _aml_numa_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* no node preference */
+#define AML_NUMA_NONE (-1)
+/* the node of the thread which allocates the memory (when it is
+   allocated) */
+#define AML_NUMA_LOCAL (-2)
+
+/* nodes at or above this aren't supported */
+#define AML_NUMA_MAX_NODES 64
+
+/* the node of the CPU the calling thread is running on, -1 if unknown */
+int aml_numa_current_node(void);
+
+/* the number of NUMA nodes (1 if unknown) */
+int aml_numa_node_count(void);
+
+/* the node holding the page which contains p, -1 if unknown or the page
+   hasn't been touched */
+int aml_numa_node_of(const void *p);
+
+/* Prefer node (or AML_NUMA_LOCAL) for the pages in [p, p + len), moving
+   pages which already exist.  p must be page aligned.  Returns false if the
+   range couldn't be bound (AML_NUMA_NONE resets the policy). */
+bool aml_numa_bind(void *p, size_t len, int node);
+
+/* Map *len bytes (rounded up to a multiple of the page size, *len is set to
+   the rounded size) bound to node.  The memory is zero.  Aborts if the
+   memory can't be mapped. */
+void *aml_numa_alloc(size_t *len, int node);
+
+/* release memory from aml_numa_alloc (len as returned by it) */
+void aml_numa_free(void *p, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,7 +24,8 @@
   freed if the memory used by the pool exceeded the initial size assigned to it
   during initialization.  In this case, the extra blocks will be freed before
   the counter is reset.  It is normally best to set the initial size so that
-  overflowing doesn't happen, except in rare circumstances.  The memory that was
+  overflowing doesn't happen, except in rare circumstances (or to let the pool
+  find that size with aml_pool_set_adaptive).  The memory that was
   previously allocated prior to a clear will still possibly be valid, but
   shouldn't be relied upon.
 */
@@ -39,6 +40,7 @@
 #include <stdint.h>
 
 #include "a-memory-library/aml_alloc.h"
+#include "a-memory-library/aml_trace.h"
 
 // #ifndef _AML_USE_MALLOC_
 // #define _AML_USE_MALLOC_
@@ -52,7 +54,7 @@ struct aml_pool_s;
 typedef struct aml_pool_s aml_pool_t;
 
 /* aml_pool_init will create a working space of size bytes */
-#ifdef _AML_DEBUG_
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
 #define aml_pool_init(size) _aml_pool_init(size, aml_file_line_func("aml_pool"))
 aml_pool_t *_aml_pool_init(size_t size, const char *caller);
 #else
@@ -60,6 +62,58 @@ aml_pool_t *_aml_pool_init(size_t size, const char *caller);
 aml_pool_t *_aml_pool_init(size_t size);
 #endif
 
+/* Flags for aml_pool_options_t */
+/* back the reservation with explicit huge pages (MAP_HUGETLB).  If huge pages
+   aren't available, normal pages are used instead. */
+#define AML_POOL_HUGETLB 1
+/* ask the kernel to use transparent huge pages (MADV_HUGEPAGE) */
+#define AML_POOL_HUGEPAGE 2
+/* aml_pool_clear releases the unused tail with MADV_DONTNEED.  The released
+   pages read back as zero, so zalloc/calloc can skip the memset. */
+#define AML_POOL_CLEAR_DONTNEED 4
+/* aml_pool_clear releases the unused tail with MADV_FREE (cheaper, but the
+   pages can no longer be assumed to be zero) */
+#define AML_POOL_CLEAR_FREE 8
+/* place the pool's memory on the NUMA node given by numa_node (see
+   aml_numa.h).  The pool is mmap backed (the reservation is the initial size
+   if reserve_size is 0) and its growth blocks are mapped and bound to the
+   node one at a time. */
+#define AML_POOL_NUMA 16
+
+typedef struct {
+  /* Reserve this many bytes of address space with mmap and commit it as the
+     pool advances.  If 0, the pool is malloc backed (like aml_pool_init). */
+  size_t reserve_size;
+  /* The granularity of commits (rounded up to the page size).  If 0, 1MB is
+     used. */
+  size_t commit_size;
+  /* The number of bytes at the start of the reservation which aml_pool_clear
+     keeps resident when releasing the tail. */
+  size_t retain_size;
+  /* AML_POOL_* flags */
+  uint32_t flags;
+  /* the node for AML_POOL_NUMA, or AML_NUMA_LOCAL for the node of the
+     thread which commits or grows the pool (pages are placed as the pool
+     reaches them, so this is normally the thread which owns the pool) */
+  int numa_node;
+} aml_pool_options_t;
+
+/* aml_pool_init_ex is like aml_pool_init, except that the pool can be backed
+   by a large mmap reservation.  size is the amount committed up front and is
+   also used as the minimum growth size if the reservation is exhausted.
+   Fresh pages are known to be zero, so aml_pool_zalloc and aml_pool_calloc
+   skip the memset on memory which has never been handed out.  opts may be
+   NULL, in which case this is the same as aml_pool_init. */
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+#define aml_pool_init_ex(size, opts)                                           \
+  _aml_pool_init_ex(size, opts, aml_file_line_func("aml_pool"))
+aml_pool_t *_aml_pool_init_ex(size_t size, const aml_pool_options_t *opts,
+                              const char *caller);
+#else
+#define aml_pool_init_ex(size, opts) _aml_pool_init_ex(size, opts)
+aml_pool_t *_aml_pool_init_ex(size_t size, const aml_pool_options_t *opts);
+#endif
+
 /* aml_pool_pool_init creates a pool from another pool.  This can be useful for
    having a repeated clearing mechanism inside a larger pool.  Ideally, this
    pool should be sized right as the clear function can't free nodes. */
@@ -68,12 +122,40 @@ aml_pool_t *aml_pool_pool_init(aml_pool_t *pool, size_t initial_size);
 
 /* aml_pool_clear will make all of the pool's memory reusable.  If the
   initial block was exceeded and additional blocks were added, those blocks
-  will be freed. */
+  will be freed.  For mmap backed pools, the pages beyond retain_size are
+  released if AML_POOL_CLEAR_DONTNEED or AML_POOL_CLEAR_FREE was set. */
 void aml_pool_clear(aml_pool_t *h);
 
+/* aml_pool_trim gives memory the pool isn't using back to the system without
+  touching anything allocated from it.  The whole pages of the current
+  block's free space beyond keep_bytes are released with MADV_DONTNEED (the
+  block keeps its size and the pages come back, zeroed, as they are used).
+  If nothing has been allocated since a clear and keep_bytes fits in the
+  initial block, a primary block which was grown by aml_pool_set_adaptive is
+  freed and the pool goes back to its initial block.  Returns the number of
+  bytes released.  Pools created with aml_pool_pool_init have nothing to
+  give back. */
+size_t aml_pool_trim(aml_pool_t *h, size_t keep_bytes);
+
 /* aml_pool_destroy frees up all memory associated with the pool object */
 void aml_pool_destroy(aml_pool_t *h);
 
+/* aml_pool_adopt hands everything allocated from src over to dst without
+  copying it.  src's blocks are spliced into dst and freed by dst's next
+  clear or destroy (or a restore to a marker saved before the adoption), so
+  memory from src stays valid after src is cleared or destroyed.  src is
+  left empty and ready for use, with a new primary block of the same size.
+  The cleanups registered with src move to dst.  The work is proportional
+  to the number of blocks, not the bytes in them.
+
+  The initial block of a pool shares one allocation with the handle.  If it
+  holds data, dst keeps a reference to that allocation, which is freed by
+  whichever of dst's clear and src's destroy comes last.
+
+  Returns false (and does nothing) if dst is src, either pool was created
+  with aml_pool_pool_init or is a NUMA pool, or src is mmap backed. */
+bool aml_pool_adopt(aml_pool_t *dst, aml_pool_t *src);
+
 struct aml_pool_marker_s;
 typedef struct aml_pool_marker_s aml_pool_marker_t;
 
@@ -89,6 +171,57 @@ static inline void aml_pool_restore(aml_pool_t *h, aml_pool_marker_t *cp);
    original block size for the new block (effectively doubling memory usage). */
 void aml_pool_set_minimum_growth_size(aml_pool_t *h, size_t size);
 
+/* Growth policies.  When the current block is exhausted, the growth policy
+   decides the size of the next block.  A request which is larger than that
+   block is given its own node which is kept apart from the block being
+   bumped, so the rest of the current block continues to serve smaller
+   allocations.  Those nodes are freed by clear/restore like any other. */
+
+/* every new block is minimum_growth_size bytes (the default) */
+void aml_pool_set_fixed_growth(aml_pool_t *h);
+
+/* each new block is twice the size of the previous one, starting at
+   minimum_growth_size and never exceeding max_block_size (0 means no cap).
+   aml_pool_clear starts over at minimum_growth_size. */
+void aml_pool_set_geometric_growth(aml_pool_t *h, size_t max_block_size);
+
+/* cb returns the size of the next block given the request (len) and the size
+   of the last block which was added (0 if none have been added since the pool
+   was last cleared).  Returning 0 uses minimum_growth_size. */
+typedef size_t (*aml_pool_growth_cb)(void *arg, size_t len,
+                                     size_t last_block_size);
+void aml_pool_set_growth_callback(aml_pool_t *h, aml_pool_growth_cb cb,
+                                  void *arg);
+
+/* aml_pool_set_adaptive lets the pool size itself.  aml_pool_clear records
+   how much memory each cycle needed.  Once several recent cycles have
+   overflowed the primary block, it is replaced by one large enough for the
+   p99 of the recent cycles (plus some headroom), so that the steady state is
+   a single block with no growth.  If usage later falls well below the primary
+   block, it is shrunk again (never below the initial size).  A single
+   outlier doesn't cause the pool to grow.  max_size caps the primary block;
+   0 turns adaptive sizing off.  This has no effect on pools created with
+   aml_pool_pool_init or mmap backed pools, which don't need it. */
+void aml_pool_set_adaptive(aml_pool_t *h, size_t max_size);
+
+/* aml_pool_add_cleanup arranges for cb(arg) to be called the next time the
+  pool is cleared or destroyed, which is how resources other than memory can
+  share the pool's lifetime.  Callbacks run most recent first, before any
+  memory is released.  aml_pool_restore doesn't run them. */
+typedef void (*aml_pool_cleanup_cb)(void *arg);
+void aml_pool_add_cleanup(aml_pool_t *h, aml_pool_cleanup_cb cb, void *arg);
+
+/* aml_pool_load_file returns the contents of filename (and its length in
+  *len) for as long as the pool lives, or NULL if it can't be read.  Regular
+  files of at least AML_POOL_MMAP_FILE_MIN bytes are mapped read-only
+  rather than copied and the mapping is removed by the next clear or
+  destroy.  Smaller files and other kinds of files (pipes, /proc) are read
+  into the pool and are zero terminated, a mapping isn't guaranteed to be.
+  The contents must not be modified. */
+#define AML_POOL_MMAP_FILE_MIN (64 * 1024)
+const void *aml_pool_load_file(aml_pool_t *h, const char *filename,
+                               size_t *len);
+
 /* aml_pool_alloc allocates len uninitialized bytes which are aligned. */
 static inline void *aml_pool_alloc(aml_pool_t *h, size_t len);
 
@@ -111,6 +244,21 @@ static inline void *aml_pool_zalloc(aml_pool_t *h, size_t len);
 /* aml_pool_alloc allocates len zero'd bytes which are aligned. */
 static inline void *aml_pool_calloc(aml_pool_t *h, size_t num_items, size_t size);
 
+/* aml_pool_try_extend resizes the allocation at p from old_len to len bytes
+   without moving it.  This only works for the most recent allocation (p +
+   old_len is where the next allocation would start) when the current block
+   has room, otherwise false is returned and nothing changes.  Shrinking
+   gives the bytes back to the pool. */
+static inline bool aml_pool_try_extend(aml_pool_t *h, void *p, size_t old_len,
+                                       size_t len);
+
+/* aml_pool_realloc resizes p in place if it can (see aml_pool_try_extend).
+   Otherwise it allocates len aligned bytes and copies the first old_len (or
+   len if smaller) bytes over.  The old bytes aren't reusable until the pool
+   is cleared.  p may be NULL. */
+static inline void *aml_pool_realloc(aml_pool_t *h, void *p, size_t old_len,
+                                     size_t len);
+
 /* aml_pool_strdup allocates a copy of the string p.  The memory will be
   unaligned.  If you need the memory to be aligned, consider using aml_pool_dup
   like char *s = aml_pool_dup(pool, p, strlen(p)+1); */
@@ -133,6 +281,17 @@ static inline void *aml_pool_dup(aml_pool_t *h, const void *data, size_t len);
 /* aml_pool_dup allocates a copy of the data.  The memory will be unaligned. */
 static inline void *aml_pool_udup(aml_pool_t *h, const void *data, size_t len);
 
+/* zero terminated strings formatted like the aml_buffer_append_u64, _i64,
+   _hex, _double, _json_string and _csv_field functions.  The result is
+   written in place and the pool only keeps the bytes which were used. */
+char *aml_pool_u64(aml_pool_t *h, uint64_t v);
+char *aml_pool_i64(aml_pool_t *h, int64_t v);
+char *aml_pool_hex(aml_pool_t *h, uint64_t v);
+char *aml_pool_double(aml_pool_t *h, double v);
+char *aml_pool_json_string(aml_pool_t *h, const char *s, size_t len);
+char *aml_pool_csv_field(aml_pool_t *h, const char *s, size_t len,
+                         char delim);
+
 /* aml_pool_size returns the number of bytes that have been allocated from any
   of the alloc calls above.  */
 size_t aml_pool_size(aml_pool_t *h);
@@ -143,6 +302,45 @@ size_t aml_pool_size(aml_pool_t *h);
 */
 size_t aml_pool_used(aml_pool_t *h);
 
+/* Pool statistics are tracked when the library is built with
+   _AML_POOL_STATS_ (cmake -DA_BUILD_ENABLE_POOL_STATS=ON for the static and
+   shared variants).  They are meant for sizing aml_pool_init from production
+   data. */
+typedef struct {
+  /* the size passed to aml_pool_init */
+  size_t initial_size;
+  /* the bytes obtained by the pool (same as aml_pool_used) */
+  size_t used;
+  /* bytes handed out since the last clear and the most ever handed out
+     between clears */
+  size_t bytes;
+  size_t high_water;
+  /* the number of times the current block was exhausted and the number of
+     those which were given a node of their own */
+  size_t grow_count;
+  size_t large_count;
+  /* bytes skipped to align allocations */
+  size_t alignment_waste;
+  /* bytes left at the end of blocks which were abandoned when growing */
+  size_t tail_waste;
+  /* the number of calls to aml_pool_clear */
+  size_t clears;
+} aml_pool_stats_t;
+
+/* aml_pool_stats fills out with the statistics for the pool.  If the library
+   wasn't built with _AML_POOL_STATS_, out is zeroed and false is returned. */
+bool aml_pool_stats(aml_pool_t *h, aml_pool_stats_t *out);
+
+/* aml_pool_stats_foreach calls cb for every live pool created with
+   aml_pool_init or aml_pool_init_ex (sub-pools are not included).  The
+   registry is locked during the walk, so cb must not create or destroy pools.
+   Pools which belong to other threads may be in the middle of an update, so
+   their numbers are approximate.  This does nothing without _AML_POOL_STATS_.
+*/
+typedef void (*aml_pool_stats_cb)(void *arg, aml_pool_t *pool,
+                                  const aml_pool_stats_t *stats);
+void aml_pool_stats_foreach(aml_pool_stats_cb cb, void *arg);
+
 /* split a string into N pieces using delimiter.  The array that is returned
    will always be valid with a NULL string at the end if p is NULL. num_splits
    can be NULL if the number of returning pieces is not desired. */
@@ -182,6 +380,16 @@ char **aml_pool_split_with_escape2(aml_pool_t *h, size_t *num_splits, char delim
 char **aml_pool_split_with_escape2f(aml_pool_t *h, size_t *num_splits, char delim, char escape,
                                     const char *p, ...);
 
+/* The split functions walk the string once, finding delimiters (and escape
+   characters) 64 bytes at a time with a vector kernel (SSE2 or AVX2 on x86,
+   NEON on ARM) chosen from the CPU's features the first time they are
+   called.  aml_split_kernel returns the name of the kernel in use.
+   aml_split_use selects a kernel by name ("scalar", "sse2", "avx2" or
+   "neon") and returns false if it isn't available, NULL restores the
+   default. */
+const char *aml_split_kernel(void);
+bool aml_split_use(const char *kernel);
+
 /* duplicate all of the strings in arr AND the NULL terminated pointer array.  */
 char **aml_pool_strdupa(aml_pool_t *pool, char **arr);
 
@@ -191,15 +399,52 @@ char **aml_pool_strdupan(aml_pool_t *pool, char **arr, size_t num);
 /* Duplicate the NULL terminated pointer array. */
 char **aml_pool_strdupa2(aml_pool_t *pool, char **arr);
 
+/* aml_pool_intern returns the pool's one copy of the len bytes at s (zero
+  terminated), adding it the first time it is seen.  Strings interned into
+  the same pool are equal exactly when their pointers are, so == can stand in
+  for strcmp.  The set of strings lives in the pool and starts over when the
+  pool is cleared (or restored to a marker saved before strings were last
+  added, after which strings interned earlier may be copied again).  The
+  strings must not be modified. */
+const char *aml_pool_intern(aml_pool_t *h, const char *s, size_t len);
+
+/* like aml_pool_intern for a zero terminated string */
+static inline const char *aml_pool_interns(aml_pool_t *h, const char *s);
+
+/* replace each of the n strings in arr (such as the result of aml_pool_split)
+   with its interned copy.  NULL entries are skipped. */
+void aml_pool_intern_all(aml_pool_t *h, char **arr, size_t n);
+
+/* the number of distinct strings interned since the set started over */
+size_t aml_pool_intern_count(aml_pool_t *h);
+
+/* the length and hash of an interned string, kept in front of its bytes */
+static inline size_t aml_pool_intern_length(const char *s);
+static inline uint64_t aml_pool_intern_hash(const char *s);
+
 /* aml_pool_base64_encode encodes data into base64.  The result will be
    null terminated base64 string which represents data. */
 char *aml_pool_base64_encode(aml_pool_t *pool, const unsigned char *data, size_t data_len);
 
 /* aml_pool_base64_decode decodes a base64 string into binary data.  The result
    will be null terminated.  The length of the binary data will be returned in
-   out_len. */
+   out_len.  Padding is optional.  NULL is returned if b64 isn't valid base64. */
 unsigned char *aml_pool_base64_decode(aml_pool_t *pool, size_t *out_len, const char *b64);
 
+/* same as aml_pool_base64_decode except b64 is len bytes long (and doesn't
+   need to be null terminated) */
+unsigned char *aml_pool_base64_decoden(aml_pool_t *pool, size_t *out_len,
+                                       const char *b64, size_t len);
+
+/* The base64 functions use vector kernels (SSSE3, AVX2 or AVX-512 VBMI on
+   x86, NEON on ARM) chosen from the CPU's features the first time they are
+   called, and fall back to scalar code.  aml_base64_kernel returns the name
+   of the kernel in use.  aml_base64_use selects a kernel by name ("scalar",
+   "ssse3", "avx2", "avx512vbmi" or "neon") and returns false if it isn't
+   available, NULL restores the default. */
+const char *aml_base64_kernel(void);
+bool aml_base64_use(const char *kernel);
+
 #include "a-memory-library/impl/aml_pool.h"
 
 #ifdef __cplusplus
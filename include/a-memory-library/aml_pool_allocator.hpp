@@ -0,0 +1,195 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_pool_allocator_HPP
+#define _aml_pool_allocator_HPP
+
+/*
+  C++ adapters for aml_pool.  Everything here is a thin inline layer over
+  aml_pool_alloc, so a container using a pool allocates by bumping the
+  pool's pointer and frees by clearing or destroying the pool.
+
+    aml::pool_allocator<T>  an Allocator for the standard containers
+
+      std::vector<int, aml::pool_allocator<int>> v{aml::pool_allocator<int>(pool)};
+
+    aml::pool_resource      a std::pmr::memory_resource (C++17)
+
+      aml::pool_resource res(pool);
+      std::pmr::vector<std::pmr::string> names(&res);
+
+    aml::pool_scope         saves the pool on construction and restores it
+                            when it goes out of scope
+
+    aml::make<T>(pool, args...), aml::make_array<T>(pool, n)
+                            construct objects in the pool
+
+  Destructors are never run for memory in the pool.  Objects which own
+  something other than pool memory (a std::string using the global
+  allocator, a file) must be destroyed by the caller before the pool is
+  cleared or restored.
+*/
+
+#if __cplusplus < 201703L
+#error "aml_pool_allocator.hpp requires C++17"
+#endif
+
+#include "a-memory-library/aml_pool.h"
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define AML_POOL_HAS_PMR 1
+#endif
+
+namespace aml {
+
+namespace detail {
+/* The alignment is known when this is compiled, so only one of the
+   branches is kept.  aml_pool_alloc aligns to sizeof(size_t). */
+template <std::size_t Align>
+inline void *pool_alloc(aml_pool_t *pool, std::size_t bytes) {
+  if constexpr (Align == 1)
+    return aml_pool_ualloc(pool, bytes);
+  else if constexpr (Align <= sizeof(std::size_t))
+    return aml_pool_alloc(pool, bytes);
+  else
+    return aml_pool_aalloc(pool, Align, bytes);
+}
+
+inline void *pool_alloc(aml_pool_t *pool, std::size_t bytes,
+                        std::size_t align) {
+  if (align <= sizeof(std::size_t))
+    return aml_pool_alloc(pool, bytes);
+  return aml_pool_aalloc(pool, align, bytes);
+}
+
+/* the most recent allocation is given back, anything else stays in the pool
+   until it is cleared */
+inline void pool_free(aml_pool_t *pool, void *p, std::size_t bytes) noexcept {
+  aml_pool_try_extend(pool, p, bytes, 0);
+}
+} // namespace detail
+
+template <class T> class pool_allocator {
+public:
+  using value_type = T;
+  /* containers take their pool with them when they are assigned or
+     swapped */
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::false_type;
+
+  explicit pool_allocator(aml_pool_t *pool) noexcept : pool_(pool) {}
+  template <class U>
+  pool_allocator(const pool_allocator<U> &other) noexcept
+      : pool_(other.pool()) {}
+
+  T *allocate(std::size_t n) {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      throw std::bad_array_new_length();
+    return static_cast<T *>(
+        detail::pool_alloc<alignof(T)>(pool_, n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) noexcept {
+    detail::pool_free(pool_, p, n * sizeof(T));
+  }
+
+  aml_pool_t *pool() const noexcept { return pool_; }
+
+private:
+  aml_pool_t *pool_;
+};
+
+template <class T, class U>
+inline bool operator==(const pool_allocator<T> &a,
+                       const pool_allocator<U> &b) noexcept {
+  return a.pool() == b.pool();
+}
+
+template <class T, class U>
+inline bool operator!=(const pool_allocator<T> &a,
+                       const pool_allocator<U> &b) noexcept {
+  return a.pool() != b.pool();
+}
+
+#ifdef AML_POOL_HAS_PMR
+class pool_resource : public std::pmr::memory_resource {
+public:
+  explicit pool_resource(aml_pool_t *pool) noexcept : pool_(pool) {}
+
+  aml_pool_t *pool() const noexcept { return pool_; }
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t align) override {
+    return detail::pool_alloc(pool_, bytes, align);
+  }
+
+  void do_deallocate(void *p, std::size_t bytes, std::size_t) override {
+    detail::pool_free(pool_, p, bytes);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    const pool_resource *o = dynamic_cast<const pool_resource *>(&other);
+    return o && o->pool_ == pool_;
+  }
+
+  aml_pool_t *pool_;
+};
+#endif
+
+/* everything allocated from the pool while the scope is alive is released
+   when it ends */
+class pool_scope {
+public:
+  explicit pool_scope(aml_pool_t *pool) noexcept : pool_(pool) {
+    aml_pool_save(pool_, &marker_);
+  }
+  ~pool_scope() { aml_pool_restore(pool_, &marker_); }
+
+  pool_scope(const pool_scope &) = delete;
+  pool_scope &operator=(const pool_scope &) = delete;
+
+  aml_pool_t *pool() const noexcept { return pool_; }
+
+private:
+  aml_pool_t *pool_;
+  aml_pool_marker_t marker_;
+};
+
+/* construct a T in the pool */
+template <class T, class... Args>
+inline T *make(aml_pool_t *pool, Args &&...args) {
+  void *p = detail::pool_alloc<alignof(T)>(pool, sizeof(T));
+  return ::new (p) T(std::forward<Args>(args)...);
+}
+
+/* n value-initialized Ts in the pool */
+template <class T> inline T *make_array(aml_pool_t *pool, std::size_t n) {
+  if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+    throw std::bad_array_new_length();
+  if constexpr (std::is_trivially_default_constructible_v<T> &&
+                alignof(T) <= sizeof(std::size_t)) {
+    /* zalloc skips memory the pool knows is zero */
+    return static_cast<T *>(aml_pool_zalloc(pool, n * sizeof(T)));
+  } else {
+    T *r =
+        static_cast<T *>(detail::pool_alloc<alignof(T)>(pool, n * sizeof(T)));
+    for (std::size_t i = 0; i < n; i++)
+      ::new (static_cast<void *>(r + i)) T();
+    return r;
+  }
+}
+
+} // namespace aml
+
+#endif
@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  The aml_pool_cache is an opt-in cache of recycled pool blocks.  Without it,
+  every aml_pool_clear or aml_pool_restore frees the blocks that were added
+  when the pool overflowed its initial block, and the next time the pool
+  overflows, _aml_pool_alloc_grow mallocs them again.  Once the cache is
+  enabled, those blocks are parked instead of freed and the grow path takes
+  from the cache before calling malloc.
+
+  Blocks are bucketed by size (powers of two).  Each thread keeps a small free
+  list per bucket which is accessed without any synchronization.  When a
+  thread's list is full (or the thread exits), blocks are pushed onto a global
+  depot using a single compare and swap so that a block freed on one thread
+  can be picked up by another.  The total number of bytes held by the cache
+  (all threads plus the depot) is bounded by the cap passed to
+  aml_pool_cache_enable.
+
+  Only heap-backed pools use the cache.  Pools created with aml_pool_pool_init
+  never free blocks, so there is nothing to recycle.  The blocks of NUMA
+  pools (AML_POOL_NUMA) are kept on separate lists for each node, so a block
+  is only reused on the node it was bound to.
+*/
+
+#ifndef _aml_pool_cache_H
+#define _aml_pool_cache_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  /* number of grow requests that were satisfied from the cache */
+  size_t hits;
+  /* number of grow requests that had to call malloc while enabled */
+  size_t misses;
+  /* number of blocks parked in the cache instead of being freed */
+  size_t parked;
+  /* number of blocks freed because the cache was full or disabled */
+  size_t dropped;
+  /* bytes and blocks currently held by the cache (all threads) */
+  size_t cached_bytes;
+  size_t cached_blocks;
+  /* the cap passed to aml_pool_cache_enable (0 if disabled) */
+  size_t max_bytes;
+} aml_pool_cache_stats_t;
+
+/* aml_pool_cache_enable turns on block recycling for all heap-backed pools.
+   max_bytes is the maximum number of bytes the cache may hold across all
+   threads.  Calling it with 0 disables the cache and releases what the
+   calling thread and the global depot hold. */
+void aml_pool_cache_enable(size_t max_bytes);
+
+/* aml_pool_cache_trim frees cached blocks until at most max_bytes remain.
+   Blocks owned by the calling thread and the global depot are released.
+   Other threads' private lists are only reachable by those threads (they
+   are flushed to the depot when the thread exits). */
+void aml_pool_cache_trim(size_t max_bytes);
+
+/* aml_pool_cache_stats fills out with the current counters. */
+void aml_pool_cache_stats(aml_pool_cache_stats_t *out);
+
+/* used internally */
+
+/* A recycled block of at least *len bytes is returned if one is available
+   (and *len is set to its actual size), otherwise NULL is returned, *len is
+   left alone and the caller should allocate *len bytes. */
+void *_aml_pool_cache_alloc(size_t *len);
+
+/* Park a block of len bytes.  Returns false if the block wasn't accepted and
+   should be freed by the caller. */
+bool _aml_pool_cache_release(void *block, size_t len);
+
+/* like the above for blocks mapped with aml_numa_alloc on node.  Those which
+   aren't accepted should be released with aml_numa_free. */
+void *_aml_pool_cache_alloc_node(size_t *len, int node);
+bool _aml_pool_cache_release_node(void *block, size_t len, int node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
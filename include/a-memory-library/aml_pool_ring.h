@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  The aml_pool_ring holds K generations of aml_pool_t for pipelines where a
+  later stage still reads what an earlier stage allocated.  Work for a
+  request allocates from the current generation, and aml_pool_ring_advance
+  moves on to the next one.  Advancing clears the oldest generation, so
+  memory allocated in epoch e stays valid until the ring advances to epoch
+  e + K, i.e. through K - 1 further advances.
+
+    aml_pool_ring_t *ring = aml_pool_ring_init(3, 64 * 1024);
+    for (;;) {
+      aml_pool_t *pool = aml_pool_ring_current(ring);
+      result_t *r = parse(pool, next_request());
+      hand_to_next_stage(r);          // may still be read two advances later
+      aml_pool_ring_advance(ring);
+    }
+
+  The generations share a list of spare blocks.  The blocks which a
+  generation grew into are kept when it is cleared and reused as any
+  generation grows again, so a ring which has warmed up allocates and frees
+  nothing (only the pool pointer bumps).  See aml_pool_ring_set_max_spare to
+  bound what is kept.
+
+  If stage N+1 runs on another thread, it can hold a generation open: the
+  producer calls aml_pool_ring_retain(ring, epoch) before handing the results
+  off, and the reader calls aml_pool_ring_release(ring, epoch) when it is
+  done.  aml_pool_ring_advance waits until a generation has no readers
+  before clearing it (aml_pool_ring_try_advance returns false instead).
+
+  Allocation, advance and the other calls belong to the producer thread.
+  Only aml_pool_ring_release (and aml_pool_ring_epoch) may be called from
+  other threads.
+*/
+
+#ifndef _aml_pool_ring_H
+#define _aml_pool_ring_H
+
+#include "a-memory-library/aml_alloc.h"
+#include "a-memory-library/aml_pool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct aml_pool_ring_s;
+typedef struct aml_pool_ring_s aml_pool_ring_t;
+
+/* the most generations a ring may have */
+#define AML_POOL_RING_MAX_GENERATIONS 64
+
+/* aml_pool_ring_init creates a ring of generations pools (1 to
+   AML_POOL_RING_MAX_GENERATIONS), each created with aml_pool_init(size).
+   The first epoch is 0.
+
+   aml_pool_ring_t *aml_pool_ring_init(size_t generations, size_t size);
+*/
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+#define aml_pool_ring_init(generations, size)                                  \
+  _aml_pool_ring_init(generations, size, aml_file_line_func("aml_pool_ring"))
+aml_pool_ring_t *_aml_pool_ring_init(size_t generations, size_t size,
+                                     const char *caller);
+#else
+#define aml_pool_ring_init(generations, size)                                  \
+  _aml_pool_ring_init(generations, size)
+aml_pool_ring_t *_aml_pool_ring_init(size_t generations, size_t size);
+#endif
+
+/* destroy the ring and every generation (there must be no readers) */
+void aml_pool_ring_destroy(aml_pool_ring_t *r);
+
+/* the pool of the current generation */
+static inline aml_pool_t *aml_pool_ring_current(aml_pool_ring_t *r);
+
+/* the current epoch (the number of advances so far) */
+static inline uint64_t aml_pool_ring_epoch(aml_pool_ring_t *r);
+
+/* the number of generations */
+static inline size_t aml_pool_ring_generations(aml_pool_ring_t *r);
+
+/* Retire the current epoch and start the next one, clearing the generation
+   which was allocated from K epochs ago.  If it has readers, this waits for
+   them to release it.  Returns the new current pool. */
+aml_pool_t *aml_pool_ring_advance(aml_pool_ring_t *r);
+
+/* like aml_pool_ring_advance, except that it returns NULL (and doesn't
+   advance) if the oldest generation still has readers */
+aml_pool_t *aml_pool_ring_try_advance(aml_pool_ring_t *r);
+
+/* Add a reader to the generation of epoch, which must not have been
+   recycled yet (it is at most K - 1 epochs old).  Called by the producer,
+   typically for the current epoch before handing its results to another
+   thread. */
+void aml_pool_ring_retain(aml_pool_ring_t *r, uint64_t epoch);
+
+/* remove a reader added by aml_pool_ring_retain (any thread) */
+void aml_pool_ring_release(aml_pool_ring_t *r, uint64_t epoch);
+
+/* Spare blocks beyond max_bytes are freed instead of kept (the default is
+   to keep them all).  Lowering it frees the excess immediately. */
+void aml_pool_ring_set_max_spare(aml_pool_ring_t *r, size_t max_bytes);
+
+typedef struct {
+  uint64_t epoch;
+  /* blocks waiting to be reused by a generation */
+  size_t spare_blocks;
+  size_t spare_bytes;
+  /* blocks a generation grew into which were reused, and which had to be
+     newly allocated */
+  size_t reused;
+  size_t misses;
+} aml_pool_ring_stats_t;
+
+void aml_pool_ring_stats(aml_pool_ring_t *r, aml_pool_ring_stats_t *out);
+
+#include "a-memory-library/impl/aml_pool_ring.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
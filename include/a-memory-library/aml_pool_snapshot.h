@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_pool_snapshot_H
+#define _aml_pool_snapshot_H
+
+/*
+  Pool snapshots write what has been allocated from a pool to a file as one
+  image which is later mapped back with mmap instead of being rebuilt.
+  Mapping is nearly free (pages are read as they are touched) and a
+  read-only mapping shares the page cache between processes.
+
+  The image is the pool's memory byte for byte, so pointers inside it have
+  to survive being mapped at another address.  They are stored as
+  aml_rel_ptr_t, an offset from the pointer itself to its target, which is
+  valid wherever the memory lives (in the pool while building, in the
+  mapping after).
+
+  A pool can be written as long as everything allocated from it is in one
+  contiguous block: a pool which hasn't grown or, more usefully, an mmap
+  backed pool (aml_pool_init_ex) which hasn't outgrown its reservation.
+  Reserving far more address space than the data needs costs nothing.
+
+  The image starts with a versioned header holding the length, the root
+  object and a checksum of the data.  The header is always checked when a
+  snapshot is mapped, the checksum only with AML_POOL_SNAPSHOT_VERIFY (that
+  reads every page).
+*/
+
+#include "a-memory-library/aml_pool.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A pointer stored as the distance from itself to its target, 0 is NULL
+   (so it can't point at itself). */
+typedef int64_t aml_rel_ptr_t;
+
+static inline void aml_rel_ptr_set(aml_rel_ptr_t *p, const void *target);
+static inline void *aml_rel_ptr_get(const aml_rel_ptr_t *p);
+
+/* the format written by this version of the library */
+#define AML_POOL_SNAPSHOT_VERSION 1
+
+/* Write everything allocated from h to path as a snapshot whose root is
+   root (which must be in the pool, or NULL).  The file is written next to
+   path and renamed over it, so readers never see half an image.  Returns
+   false if the pool's memory isn't contiguous or the file can't be
+   written. */
+bool aml_pool_write_snapshot(aml_pool_t *h, const void *root,
+                             const char *path);
+
+struct aml_pool_snapshot_s;
+typedef struct aml_pool_snapshot_s aml_pool_snapshot_t;
+
+/* the mapping is private and writable, pages are copied as they are
+   written (otherwise the memory is read-only) */
+#define AML_POOL_SNAPSHOT_WRITABLE 1
+/* check the data against the checksum in the header */
+#define AML_POOL_SNAPSHOT_VERIFY 2
+
+/* Map a snapshot written by aml_pool_write_snapshot.  Returns NULL if the
+   file can't be mapped or isn't a valid snapshot of this version. */
+aml_pool_snapshot_t *aml_pool_map_snapshot(const char *path, uint32_t flags);
+
+/* unmap the snapshot and destroy its pool (if any) */
+void aml_pool_snapshot_unmap(aml_pool_snapshot_t *s);
+
+/* the root given to aml_pool_write_snapshot, at its mapped address */
+void *aml_pool_snapshot_root(aml_pool_snapshot_t *s);
+
+/* the mapped data and its length */
+void *aml_pool_snapshot_data(aml_pool_snapshot_t *s);
+size_t aml_pool_snapshot_length(aml_pool_snapshot_t *s);
+
+/* true if p points into the mapped data */
+bool aml_pool_snapshot_contains(aml_pool_snapshot_t *s, const void *p);
+
+/* the initial size of the pool from aml_pool_snapshot_pool */
+#define AML_POOL_SNAPSHOT_POOL_SIZE (16 * 1024)
+
+/* A pool layered on the snapshot for new objects, created the first time
+   this is called and destroyed with the snapshot.  Its objects can point
+   into the snapshot and (with AML_POOL_SNAPSHOT_WRITABLE) the snapshot's
+   objects can be changed to point to them, as aml_rel_ptr_t works between
+   any two addresses. */
+aml_pool_t *aml_pool_snapshot_pool(aml_pool_snapshot_t *s);
+
+#include "a-memory-library/impl/aml_pool_snapshot.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
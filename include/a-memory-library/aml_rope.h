@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_rope_H
+#define _aml_rope_H
+
+/*
+  The aml_rope object is a segmented version of the aml_buffer.  Bytes are
+  appended to a chain of segments and bytes which have been appended never
+  move, so growing the rope never copies it.  A buffer which is allocated
+  from a pool leaves every block it outgrows behind in the pool, a rope
+  only ever adds segments.
+
+  The segments start at the size given to aml_rope_init and double with each
+  new segment up to a maximum (see aml_rope_set_max_segment_size), so a
+  large rope doesn't need a large number of segments.  aml_rope_iovec
+  describes the segments for writev or sendmsg.  aml_rope_data makes the
+  contents contiguous (copying them once into a single segment) for callers
+  which need that.
+
+  Cleared ropes keep their segments for reuse.
+*/
+
+#include "a-memory-library/aml_alloc.h"
+#include "a-memory-library/aml_pool.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct aml_rope_s;
+typedef struct aml_rope_s aml_rope_t;
+
+/* the size of the first segment if 0 is given */
+#define AML_ROPE_DEFAULT_SEGMENT_SIZE 4096
+/* segments stop doubling at this size unless the first one is larger */
+#define AML_ROPE_MAX_SEGMENT_SIZE (1024 * 1024)
+
+/* aml_rope_init creates a rope whose first segment is segment_size bytes.
+
+   aml_rope_t *aml_rope_init(size_t segment_size);
+*/
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+#define aml_rope_init(size)                                                    \
+  _aml_rope_init(size, aml_file_line_func("aml_rope"))
+aml_rope_t *_aml_rope_init(size_t segment_size, const char *caller);
+#else
+#define aml_rope_init(size) _aml_rope_init(size)
+aml_rope_t *_aml_rope_init(size_t segment_size);
+#endif
+
+/* like above, except allocated with a pool (no need to destroy) */
+aml_rope_t *aml_rope_pool_init(aml_pool_t *pool, size_t segment_size);
+
+/* destroy the rope */
+void aml_rope_destroy(aml_rope_t *h);
+
+/* new segments double in size up to max_size.  Setting this to the first
+   segment's size gives fixed size segments.  A single append which is
+   larger still gets a segment of its own size. */
+void aml_rope_set_max_segment_size(aml_rope_t *h, size_t max_size);
+
+/* clear the rope, keeping its segments */
+void aml_rope_clear(aml_rope_t *h);
+
+/* the number of bytes in the rope */
+static inline size_t aml_rope_length(aml_rope_t *h);
+
+/* the number of segments which hold data */
+size_t aml_rope_segments(aml_rope_t *h);
+
+/* fill up to max entries of iov with the segments which hold data and return
+   the number of entries used.  The entries are valid until the rope is
+   changed. */
+size_t aml_rope_iovec(aml_rope_t *h, struct iovec *iov, size_t max);
+
+/* write the whole rope to fd with writev (no copying), retrying partial
+   writes.  Returns false if a write fails. */
+bool aml_rope_write_fd(aml_rope_t *h, int fd);
+
+/* copy the contents of the rope to dest (which must have room for
+   aml_rope_length bytes) */
+void aml_rope_copy(aml_rope_t *h, void *dest);
+
+/* Returns the contents as one zero terminated block.  If there is more than
+   one segment, they are copied into a single new segment (once, later calls
+   without more appends are free).  Appends continue after the data, and the
+   result is valid until the next change to the rope. */
+char *aml_rope_data(aml_rope_t *h);
+
+/* append bytes to the rope */
+static inline void aml_rope_append(aml_rope_t *h, const void *data,
+                                   size_t length);
+
+/* append a string to the rope */
+static inline void aml_rope_appends(aml_rope_t *h, const char *s);
+
+/* append a character to the rope */
+static inline void aml_rope_appendc(aml_rope_t *h, char ch);
+
+/* append length contiguous bytes to the rope and return a pointer to them so
+   that they can be filled in */
+static inline void *aml_rope_append_alloc(aml_rope_t *h, size_t length);
+
+/* append a formatted string to the rope */
+void aml_rope_appendvf(aml_rope_t *h, const char *fmt, va_list args);
+static inline void aml_rope_appendf(aml_rope_t *h, const char *fmt, ...);
+
+#include "a-memory-library/impl/aml_rope.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  Scratch arenas give code which isn't handed a pool arena speed temporary
+  memory.  Each thread has two pools which are created the first time they
+  are needed and kept until the thread exits.  A scope saves a marker on one
+  of them and restoring the marker ends it, so a scope costs about as much as
+  aml_pool_save and aml_pool_restore.
+
+    char *join_path(aml_pool_t *out, const char *a, const char *b) {
+      aml_scratch_t s = aml_scratch_begin(out);
+      char *tmp = aml_pool_strdupf(s.pool, "%s/%s", a, b);
+      char *r = aml_pool_strdup(out, normalize(tmp));
+      aml_scratch_end(&s);
+      return r;
+    }
+
+  Scopes nest as long as they end in the reverse order they began.  The
+  conflict argument is the pool the caller wants results in.  If that pool
+  is itself one of the thread's scratch arenas (the caller is inside a scope
+  of its own), the other arena is used, so ending the scope doesn't release
+  the results.  Pass NULL when nothing allocated in the scope has to outlive
+  it.
+
+  Memory from a scope is only valid until aml_scratch_end and only on the
+  calling thread.  A scope which overflows the arena's block allocates more
+  blocks, and ending it frees them (see aml_pool_cache to recycle them).
+*/
+
+#ifndef _aml_scratch_H
+#define _aml_scratch_H
+
+#include "a-memory-library/aml_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the initial size of each of the thread's arenas */
+#ifndef AML_SCRATCH_SIZE
+#define AML_SCRATCH_SIZE (64 * 1024)
+#endif
+
+typedef struct {
+  aml_pool_t *pool;
+  aml_pool_marker_t marker;
+} aml_scratch_t;
+
+/* aml_scratch_begin starts a scope on one of the calling thread's arenas
+   which isn't conflict. */
+aml_scratch_t aml_scratch_begin(aml_pool_t *conflict);
+
+/* aml_scratch_end releases everything allocated from s.pool since the scope
+   began. */
+void aml_scratch_end(aml_scratch_t *s);
+
+/* aml_scratch_release destroys the calling thread's arenas (no scope may be
+   open).  Threads do this when they exit, except for the main thread, which
+   should call it before a debug build reports leaked memory. */
+void aml_scratch_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
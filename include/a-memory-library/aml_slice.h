@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  An aml_slice_t is a view of len bytes at p.  The functions here split a
+  buffer into slices which point into the buffer itself, so unlike the
+  aml_pool_split family, the input is neither copied nor modified and
+  doesn't need to be null terminated.  The slices are only valid as long as
+  the buffer is.
+
+  aml_slice_iter_t walks the pieces one at a time without allocating
+  anything.  The aml_pool_*_slices functions collect all of the pieces into
+  an array allocated from the pool.  A slice can be turned into a null
+  terminated string with aml_pool_slice_strdup when one is needed.
+
+  Splitting finds delimiters with the same vector kernels as aml_pool_split
+  (see aml_split_use).
+*/
+
+#ifndef _aml_slice_H
+#define _aml_slice_H
+
+#include "a-memory-library/aml_pool.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  const char *p;
+  size_t len;
+} aml_slice_t;
+
+static inline aml_slice_t aml_slice(const char *p, size_t len);
+/* a slice of the null terminated string s (without the terminator) */
+static inline aml_slice_t aml_slice_str(const char *s);
+
+/* true if the slices have the same bytes */
+static inline bool aml_slice_eq(aml_slice_t a, aml_slice_t b);
+/* true if the slice has the same bytes as the null terminated string s */
+static inline bool aml_slice_eq_str(aml_slice_t a, const char *s);
+
+/* The iterator.  Its fields are private. */
+typedef struct {
+  const char *p;
+  const char *ep;
+  const char *block;
+  uint64_t mask;
+  /* bitmap of the delimiters if there are more than four */
+  uint64_t set[4];
+  char delim[4];
+  uint8_t flags;
+} aml_slice_iter_t;
+
+/* Split len bytes at p on delim, keeping empty pieces like aml_pool_split.
+   "a,,b," splits into "a", "", "b" and "".  An empty buffer is one empty
+   piece and a NULL p has none. */
+void aml_slice_split_init(aml_slice_iter_t *it, const char *p, size_t len,
+                          char delim);
+
+/* Split len bytes at p on any of the characters in delims (which is null
+   terminated), dropping empty pieces like strtok.  " a  b\n" tokenized on
+   " \n" is "a" and "b".  Up to four delimiters are found with the vector
+   kernels, more than that a byte at a time. */
+void aml_slice_tokenize_init(aml_slice_iter_t *it, const char *p, size_t len,
+                             const char *delims);
+
+/* Sets *out to the next piece and returns true, or returns false once there
+   are no more pieces. */
+bool aml_slice_next(aml_slice_iter_t *it, aml_slice_t *out);
+
+/* The array versions return the pieces followed by one {NULL, 0} slice.
+   num can be NULL if the number of pieces is not desired. */
+aml_slice_t *aml_pool_split_slices(aml_pool_t *h, size_t *num, char delim,
+                                   const char *p, size_t len);
+
+/* same as aml_pool_split_slices except empty pieces are dropped */
+aml_slice_t *aml_pool_split_slices2(aml_pool_t *h, size_t *num, char delim,
+                                    const char *p, size_t len);
+
+aml_slice_t *aml_pool_tokenize_slices(aml_pool_t *h, size_t *num,
+                                      const char *delims, const char *p,
+                                      size_t len);
+
+/* a null terminated copy of the slice */
+static inline char *aml_pool_slice_strdup(aml_pool_t *h, aml_slice_t s);
+
+/* copies of the first num slices as a NULL terminated array of strings (the
+   same result as aml_pool_split, made only when it is needed) */
+char **aml_pool_slice_strdupa(aml_pool_t *h, const aml_slice_t *slices,
+                              size_t num);
+
+#include "a-memory-library/impl/aml_slice.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
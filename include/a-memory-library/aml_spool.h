@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  The aml_spool is a shared (thread-safe) version of the aml_pool.  Any number
+  of threads may allocate from the same spool concurrently.  The common case
+  is a single atomic add to reserve bytes from the current block.  If a block
+  is exhausted, a new one is installed with a compare and swap, so allocation
+  never takes a lock.
+
+  Threads which make many small allocations can reserve a private chunk of
+  the spool (aml_spool_chunk_t) with one atomic and then allocate from that
+  chunk without any atomics at all.
+
+  Like the pool, memory isn't freed individually.  aml_spool_clear and
+  aml_spool_destroy behave like aml_pool_clear and aml_pool_destroy and must
+  not be called while other threads are allocating from the spool.
+*/
+
+#ifndef _aml_spool_H
+#define _aml_spool_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "a-memory-library/aml_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct aml_spool_s;
+typedef struct aml_spool_s aml_spool_t;
+
+/* aml_spool_init will create a shared working space of size bytes */
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+#define aml_spool_init(size)                                                   \
+  _aml_spool_init(size, aml_file_line_func("aml_spool"))
+aml_spool_t *_aml_spool_init(size_t size, const char *caller);
+#else
+#define aml_spool_init(size) _aml_spool_init(size)
+aml_spool_t *_aml_spool_init(size_t size);
+#endif
+
+/* aml_spool_clear will make all of the spool's memory reusable.  Blocks which
+   were added beyond the initial block are freed.  Chunks obtained before the
+   clear are refilled on their next use. */
+void aml_spool_clear(aml_spool_t *h);
+
+/* aml_spool_destroy frees up all memory associated with the spool object */
+void aml_spool_destroy(aml_spool_t *h);
+
+/* aml_spool_set_minimum_growth_size alters the minimum size of growth blocks
+   (this defaults to the initial size).  Requests larger than this are given
+   their own block. */
+void aml_spool_set_minimum_growth_size(aml_spool_t *h, size_t size);
+
+/* aml_spool_alloc allocates len uninitialized bytes which are aligned. */
+static inline void *aml_spool_alloc(aml_spool_t *h, size_t len);
+
+/* aml_spool_zalloc allocates len zero'd bytes which are aligned. */
+static inline void *aml_spool_zalloc(aml_spool_t *h, size_t len);
+
+/* aml_spool_calloc allocates num_items*size zero'd bytes which are aligned. */
+static inline void *aml_spool_calloc(aml_spool_t *h, size_t num_items,
+                                     size_t size);
+
+/* aml_spool_dup allocates an aligned copy of the data. */
+static inline void *aml_spool_dup(aml_spool_t *h, const void *data,
+                                  size_t len);
+
+/* aml_spool_strdup allocates a copy of the string p. */
+static inline char *aml_spool_strdup(aml_spool_t *h, const char *p);
+
+/* aml_spool_used returns the number of bytes that have been allocated by the
+   spool itself. */
+size_t aml_spool_used(aml_spool_t *h);
+
+struct aml_spool_chunk_s;
+typedef struct aml_spool_chunk_s aml_spool_chunk_t;
+
+/* aml_spool_chunk_init prepares a chunk which belongs to the calling thread.
+   The chunk reserves chunk_size bytes from the spool at a time and hands them
+   out without atomics.  Requests larger than half of chunk_size go directly
+   to the spool.  A chunk doesn't need to be destroyed. */
+void aml_spool_chunk_init(aml_spool_t *h, aml_spool_chunk_t *c,
+                          size_t chunk_size);
+
+/* aml_spool_chunk_alloc allocates len uninitialized bytes which are aligned
+   from the chunk (refilling it from the spool as needed). */
+static inline void *aml_spool_chunk_alloc(aml_spool_chunk_t *c, size_t len);
+
+/* aml_spool_chunk_zalloc allocates len zero'd bytes which are aligned. */
+static inline void *aml_spool_chunk_zalloc(aml_spool_chunk_t *c, size_t len);
+
+/* aml_spool_chunk_dup allocates an aligned copy of the data. */
+static inline void *aml_spool_chunk_dup(aml_spool_chunk_t *c,
+                                        const void *data, size_t len);
+
+/* aml_spool_chunk_strdup allocates a copy of the string p. */
+static inline char *aml_spool_chunk_strdup(aml_spool_chunk_t *c,
+                                           const char *p);
+
+#include "a-memory-library/impl/aml_spool.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
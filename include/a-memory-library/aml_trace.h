@@ -0,0 +1,150 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  Tracepoints on the slow paths of pools and buffers, for finding out how
+  much latency comes from growing them.  They are compiled in when
+  _AML_TRACE_ is defined (A_BUILD_ENABLE_TRACE in CMake) and are nothing at
+  all otherwise.
+
+  Each event goes to the callback set with aml_trace_set_callback and, where
+  <sys/sdt.h> is available, to a USDT probe of the "aml" provider named
+  after the event, with the object, before, after and ns as its arguments:
+
+    bpftrace -e 'usdt:./server:aml:pool_grow { @ns = hist(arg3); }'
+
+  The clock is only read while a callback is set or a probe is attached, so
+  an untraced build pays a load and a branch per event.
+*/
+
+#ifndef _aml_trace_H
+#define _aml_trace_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  /* a pool got a new block; before / after are aml_pool_used */
+  AML_TRACE_POOL_GROW,
+  /* aml_pool_clear; before / after are aml_pool_used */
+  AML_TRACE_POOL_CLEAR,
+  /* aml_pool_restore; before / after are aml_pool_used */
+  AML_TRACE_POOL_RESTORE,
+  /* a buffer grew; before / after are its capacity */
+  AML_TRACE_BUFFER_GROW,
+  /* aml_buffer_detach; before is the length, after is 0 */
+  AML_TRACE_BUFFER_DETACH,
+  AML_TRACE_EVENTS
+} aml_trace_type_t;
+
+typedef struct {
+  aml_trace_type_t type;
+  /* the pool or buffer */
+  const void *object;
+  size_t before;
+  size_t after;
+  /* the time the operation took */
+  uint64_t ns;
+} aml_trace_event_t;
+
+typedef void (*aml_trace_cb)(const aml_trace_event_t *ev, void *arg);
+
+/* Send every event to cb(ev, arg), or stop with NULL.  The callback runs on
+   the thread which caused the event, in the middle of the operation, so it
+   must not use the pool or buffer it is told about.  Set it while nothing is
+   being traced (cb and arg aren't changed together atomically).  Returns
+   false if tracing isn't compiled in. */
+bool aml_trace_set_callback(aml_trace_cb cb, void *arg);
+
+/* the name of an event ("pool_grow", ...), which is also its probe's name */
+const char *aml_trace_name(aml_trace_type_t type);
+
+/* used internally */
+
+#ifdef _AML_TRACE_
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _AML_TRACE_USDT_
+#endif
+#endif
+
+/* nonzero while a callback is set */
+extern int _aml_trace_hooked;
+
+#ifdef _AML_TRACE_USDT_
+/* set by a tracer while it has the probe attached */
+extern unsigned short aml_pool_grow_semaphore;
+extern unsigned short aml_pool_clear_semaphore;
+extern unsigned short aml_pool_restore_semaphore;
+extern unsigned short aml_buffer_grow_semaphore;
+extern unsigned short aml_buffer_detach_semaphore;
+#endif
+
+static inline bool _aml_trace_on(aml_trace_type_t type) {
+#ifdef _AML_TRACE_USDT_
+  unsigned short attached = 0;
+  switch (type) {
+  case AML_TRACE_POOL_GROW:
+    attached = aml_pool_grow_semaphore;
+    break;
+  case AML_TRACE_POOL_CLEAR:
+    attached = aml_pool_clear_semaphore;
+    break;
+  case AML_TRACE_POOL_RESTORE:
+    attached = aml_pool_restore_semaphore;
+    break;
+  case AML_TRACE_BUFFER_GROW:
+    attached = aml_buffer_grow_semaphore;
+    break;
+  case AML_TRACE_BUFFER_DETACH:
+    attached = aml_buffer_detach_semaphore;
+    break;
+  default:
+    break;
+  }
+  if (attached)
+    return true;
+#else
+  (void)type;
+#endif
+  return __atomic_load_n(&_aml_trace_hooked, __ATOMIC_RELAXED) != 0;
+}
+
+/* the start of an event, 0 if nothing is listening */
+static inline uint64_t _aml_trace_begin(aml_trace_type_t type) {
+  if (!_aml_trace_on(type))
+    return 0;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void _aml_trace(aml_trace_type_t type, const void *object, size_t before,
+                size_t after, uint64_t start);
+
+#define _AML_TRACE_BEGIN(type, before)                                         \
+  uint64_t _aml_trace_start = _aml_trace_begin(type);                          \
+  size_t _aml_trace_before = (before)
+#define _AML_TRACE_END(type, object, after)                                    \
+  do {                                                                         \
+    if (_aml_trace_start)                                                      \
+      _aml_trace(type, object, _aml_trace_before, after, _aml_trace_start);    \
+  } while (0)
+#else
+#define _AML_TRACE_BEGIN(type, before)
+#define _AML_TRACE_END(type, object, after)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
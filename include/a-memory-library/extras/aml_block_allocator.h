@@ -2,25 +2,109 @@
 // SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
 // SPDX-License-Identifier: Apache-2.0
 
+/*
+  The aml_block_allocator recycles variable sized blocks on top of a pool.
+  Sizes are rounded up to one of AML_BLOCK_ALLOCATOR_CLASSES size classes
+  (8, 16, 24, 32, and then four classes per power of two, so no more than 25%
+  is wasted beyond 32 bytes).  Each class has a free list.  Released blocks
+  are pushed onto their class' list and handed out again before the pool is
+  asked for more memory.  The memory belongs to the pool, so clearing or
+  destroying the pool releases everything (including the allocator).
+
+  aml_block_allocator_alloc/release require the caller to pass the size back
+  when releasing.  aml_block_allocator_halloc stores the class in a small
+  header in front of the block so that aml_block_allocator_free doesn't need
+  the size.  The two must not be mixed on the same block.
+
+  Like the pool, the allocator is not thread-safe: it belongs to the thread
+  which allocates from it.  The one exception is giving blocks back.  Any
+  thread may call aml_block_allocator_release_remote/free_remote, which push
+  the block onto a lock-free list for its class with a single compare and
+  swap.  The owner takes a class' remote list the next time that class' free
+  list is empty, so its own allocs and frees never contend with other
+  threads.  Remote releases must happen before the pool is cleared or
+  destroyed.
+*/
+
 #ifndef _aml_block_allocator_H
 #define _aml_block_allocator_H
 
 #include "a-memory-library/aml_pool.h"
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct aml_block_allocator_s;
 typedef struct aml_block_allocator_s aml_block_allocator_t;
 
+/* the number of size classes, ids are 0 to AML_BLOCK_ALLOCATOR_CLASSES-1 */
+#define AML_BLOCK_ALLOCATOR_CLASSES 112
+
 aml_block_allocator_t *aml_block_allocator_init(aml_pool_t *pool);
 
+/* the size class for size (which must be > 0) */
 static inline uint32_t aml_block_allocator_id(uint32_t size);
-static inline uint32_t aml_block_allocator_size(uint32_t id);
+/* the number of bytes in blocks of class id */
+static inline size_t aml_block_allocator_size(uint32_t id);
+
+static inline void *aml_block_allocator_alloc_by_id(aml_block_allocator_t *h,
+                                                    uint32_t id);
+static inline void *aml_block_allocator_alloc(aml_block_allocator_t *h,
+                                              uint32_t size);
 
-void *aml_block_allocator_alloc_by_id(aml_block_allocator_t *h, uint32_t id);
-void *aml_block_allocator_alloc(aml_block_allocator_t *h, uint32_t size);
+/* size must be the size which was passed to aml_block_allocator_alloc (or
+   any size within the same class) */
+static inline void aml_block_allocator_release(aml_block_allocator_t *h,
+                                               void *data, uint32_t size);
 
-void aml_block_allocator_release(aml_block_allocator_t *h, void *data, uint32_t size);
+/* allocate a block which remembers its class, release it with
+   aml_block_allocator_free */
+static inline void *aml_block_allocator_halloc(aml_block_allocator_t *h,
+                                               uint32_t size);
+static inline void aml_block_allocator_free(aml_block_allocator_t *h,
+                                            void *data);
+
+/* Release data (from aml_block_allocator_alloc) or free data (from
+   aml_block_allocator_halloc) from a thread other than the owner.  These
+   work from the owner as well, but the plain calls are cheaper there. */
+static inline void aml_block_allocator_release_remote(aml_block_allocator_t *h,
+                                                      void *data,
+                                                      uint32_t size);
+static inline void aml_block_allocator_free_remote(aml_block_allocator_t *h,
+                                                   void *data);
+
+/* Move every block released remotely onto the owner's free lists.  This
+   happens on its own as classes run out, so it is only needed to bring the
+   counters up to date.  Only the owner may call this. */
+void aml_block_allocator_drain(aml_block_allocator_t *h);
+
+typedef struct {
+  /* the number of bytes in a block of this class */
+  size_t block_size;
+  /* blocks handed out and given back (remote releases count once the owner
+     has taken them) */
+  size_t allocs;
+  size_t frees;
+  /* the part of frees which came from other threads */
+  size_t remote_frees;
+  /* the allocations which were satisfied from the free list */
+  size_t reused;
+  /* blocks which are currently allocated (allocs - frees) */
+  size_t live;
+  /* blocks sitting on the free list (frees - reused) */
+  size_t cached;
+} aml_block_allocator_stats_t;
+
+/* the counters for size class id */
+void aml_block_allocator_stats(aml_block_allocator_t *h, uint32_t id,
+                               aml_block_allocator_stats_t *out);
 
 #include "a-memory-library/extras/impl/aml_block_allocator.h"
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
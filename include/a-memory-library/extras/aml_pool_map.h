@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  aml_pool_map is a hash map from byte string keys to void * values which
+  lives in a pool.  Keys are copied into the pool (zero terminated) when
+  they are inserted.
+
+  The table uses open addressing with a control byte per slot, in the style
+  of Abseil's Swiss tables: 7 bits of each key's hash are kept in the control
+  byte, and 16 control bytes are compared at once (SSE2 on x86, NEON on ARM)
+  so that most lookups touch a single entry.  Tables are at most 7/8 full.
+
+  When the table grows, the old one can be recycled: if a block allocator is
+  given to aml_pool_map_init, tables come from it and go back to it (so maps
+  which grow and shrink, or many maps in one pool, reuse each other's
+  tables).  Without one, old tables stay behind in the pool.  Either way,
+  clearing or destroying the pool releases the map.
+
+  Like the pool, the map is not thread-safe.
+*/
+
+#ifndef _aml_pool_map_H
+#define _aml_pool_map_H
+
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/extras/aml_block_allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct aml_pool_map_s;
+typedef struct aml_pool_map_s aml_pool_map_t;
+
+typedef struct {
+  /* the key as it was copied into the pool (zero terminated) */
+  const char *key;
+  uint32_t len;
+  uint32_t hash;
+  void *value;
+} aml_pool_map_entry_t;
+
+/* ba may be NULL.  If it isn't, it must allocate from the same pool (or one
+   which lives at least as long). */
+aml_pool_map_t *aml_pool_map_init(aml_pool_t *pool, aml_block_allocator_t *ba);
+
+/* make room for n keys without growing the table */
+void aml_pool_map_reserve(aml_pool_map_t *h, size_t n);
+
+/* the number of keys in the map */
+static inline size_t aml_pool_map_size(aml_pool_map_t *h);
+
+/* find key (len bytes), NULL if it isn't in the map */
+aml_pool_map_entry_t *aml_pool_map_find(aml_pool_map_t *h, const void *key,
+                                        size_t len);
+
+/* the value for key, NULL if it isn't in the map */
+static inline void *aml_pool_map_get(aml_pool_map_t *h, const void *key,
+                                     size_t len);
+
+/* find key, inserting it with a NULL value if it isn't in the map.  inserted
+   (which may be NULL) is set to true if the key was added.  The entry is
+   valid until the next insert. */
+aml_pool_map_entry_t *aml_pool_map_insert(aml_pool_map_t *h, const void *key,
+                                          size_t len, bool *inserted);
+
+/* set the value for key */
+static inline void aml_pool_map_put(aml_pool_map_t *h, const void *key,
+                                    size_t len, void *value);
+
+/* remove key, returns false if it wasn't in the map */
+bool aml_pool_map_remove(aml_pool_map_t *h, const void *key, size_t len);
+
+/* iterate over the entries, starting with *pos = 0.  NULL is returned after
+   the last entry.  The map must not be changed while iterating. */
+aml_pool_map_entry_t *aml_pool_map_next(aml_pool_map_t *h, size_t *pos);
+
+/* remove every key, keeping the table */
+void aml_pool_map_clear(aml_pool_map_t *h);
+
+#include "a-memory-library/extras/impl/aml_pool_map.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+  aml_pool_vec is a growable array which lives in a pool.  The element type
+  is given to the aml_pool_vec macro, which declares a small struct:
+
+    typedef aml_pool_vec(point_t) point_vec_t;
+
+    point_vec_t v;
+    aml_pool_vec_init(&v, pool);
+    aml_pool_vec_push(&v, p);
+    for (size_t i = 0; i < v.len; i++)
+      use(v.data[i]);
+
+  The array doubles as it grows.  While it is the pool's most recent
+  allocation it is extended in place (see aml_pool_try_extend), otherwise it
+  is copied and the old array stays behind in the pool.  Nothing needs to be
+  freed, clearing or destroying the pool releases the array.  Elements are
+  aligned like aml_pool_alloc (to sizeof(size_t)).
+
+  The arguments to the macros may be evaluated more than once.
+*/
+
+#ifndef _aml_pool_vec_H
+#define _aml_pool_vec_H
+
+#include "a-memory-library/aml_pool.h"
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define aml_pool_vec(type)                                                     \
+  struct {                                                                     \
+    type *data;                                                                \
+    size_t len;                                                                \
+    size_t cap;                                                                \
+    aml_pool_t *pool;                                                          \
+  }
+
+/* an empty vec which allocates from pool */
+#define aml_pool_vec_init(v, p)                                                \
+  ((v)->data = NULL, (v)->len = 0, (v)->cap = 0, (v)->pool = (p))
+
+/* make room for at least n elements */
+#define aml_pool_vec_reserve(v, n)                                             \
+  ((size_t)(n) > (v)->cap                                                      \
+       ? _aml_pool_vec_grow((v)->pool, (void **)&(v)->data, &(v)->cap,         \
+                            (v)->len, (n), sizeof(*(v)->data))                 \
+       : (void)0)
+
+/* append the value x */
+#define aml_pool_vec_push(v, x)                                                \
+  (aml_pool_vec_reserve(v, (v)->len + 1), (v)->data[(v)->len++] = (x))
+
+/* append n uninitialized elements and return a pointer to the first one */
+#define aml_pool_vec_alloc(v, n)                                               \
+  (aml_pool_vec_reserve(v, (v)->len + (n)), (v)->len += (n),                   \
+   (v)->data + (v)->len - (n))
+
+/* append n elements copied from src */
+#define aml_pool_vec_append(v, src, n)                                         \
+  ((n) ? (void)memcpy(aml_pool_vec_alloc(v, n), (src),                          \
+                      (n) * sizeof(*(v)->data))                                \
+       : (void)0)
+
+/* remove and return the last element (the vec must not be empty) */
+#define aml_pool_vec_pop(v) ((v)->data[--(v)->len])
+
+/* the last element (the vec must not be empty) */
+#define aml_pool_vec_last(v) ((v)->data[(v)->len - 1])
+
+/* remove the elements, keeping the capacity */
+#define aml_pool_vec_clear(v) ((v)->len = 0)
+
+/* used internally: grow *data (holding len of *cap elements of elem_size
+   bytes) to hold at least need elements */
+void _aml_pool_vec_grow(aml_pool_t *pool, void **data, size_t *cap, size_t len,
+                        size_t need, size_t elem_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
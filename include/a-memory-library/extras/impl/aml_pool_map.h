@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_pool_map_impl_H
+#define _aml_pool_map_impl_H
+
+/* IMPLEMENTATION FOLLOWS - API is above this line */
+
+struct aml_pool_map_s {
+  aml_pool_t *pool;
+  aml_block_allocator_t *ba;
+  /* capacity + AML_POOL_MAP_GROUP control bytes (the first group is repeated
+     at the end so that a group can be loaded from any slot), followed by
+     capacity entries */
+  uint8_t *ctrl;
+  aml_pool_map_entry_t *entries;
+  /* a power of two (or 0 before the first insert) */
+  size_t capacity;
+  size_t size;
+  /* the number of empty slots which may still be filled before the table
+     grows (removed keys leave a tombstone which doesn't count as empty) */
+  size_t growth_left;
+};
+
+static inline size_t aml_pool_map_size(aml_pool_map_t *h) { return h->size; }
+
+static inline void *aml_pool_map_get(aml_pool_map_t *h, const void *key,
+                                     size_t len) {
+  aml_pool_map_entry_t *e = aml_pool_map_find(h, key, len);
+  return e ? e->value : NULL;
+}
+
+static inline void aml_pool_map_put(aml_pool_map_t *h, const void *key,
+                                    size_t len, void *value) {
+  aml_pool_map_insert(h, key, len, NULL)->value = value;
+}
+
+#endif
@@ -9,13 +9,41 @@ struct aml_buffer_s {
   aml_allocator_dump_t dump;
   size_t initial_size;
   size_t max_length;
+#endif
+#ifdef _AML_SAMPLING_
+  /* the site which created the buffer, data is charged to it */
+  const char *caller;
 #endif
   char *data;
   size_t length;
   size_t size;
   aml_pool_t *pool;
+  /* growth beyond the length needed, as a percentage of it */
+  size_t growth;
+  /* heap buffers which grow to mmap_threshold bytes move to an anonymous
+     mapping (0 turns this off), mapped is the size of that mapping */
+  size_t mmap_threshold;
+  size_t mapped;
+  /* the NUMA node for the mapping (AML_NUMA_NONE if there is none) */
+  int numa_node;
 };
 
+/* move the heap data to a mapping of at least len + 1 bytes (or resize the
+   mapping).  The contents are kept if keep is true. */
+void _aml_buffer_remap(aml_buffer_t *h, size_t len, bool keep);
+void _aml_buffer_unmap(aml_buffer_t *h);
+
+static inline void aml_buffer_set_growth(aml_buffer_t *h, size_t percent) {
+  h->growth = percent;
+}
+
+static inline void aml_buffer_set_mmap_threshold(aml_buffer_t *h,
+                                                 size_t threshold) {
+  h->mmap_threshold = threshold;
+}
+
+static inline size_t aml_buffer_capacity(aml_buffer_t *h) { return h->size; }
+
 static inline aml_buffer_t *aml_buffer_pool_init(aml_pool_t *pool,
                                                size_t initial_size) {
   aml_buffer_t *h = (aml_buffer_t *)aml_pool_zalloc(pool, sizeof(aml_buffer_t));
@@ -23,6 +51,8 @@ static inline aml_buffer_t *aml_buffer_pool_init(aml_pool_t *pool,
   h->data[0] = 0;
   h->size = initial_size;
   h->pool = pool;
+  h->growth = AML_BUFFER_DEFAULT_GROWTH;
+  h->numa_node = AML_NUMA_NONE;
   return h;
 }
 
@@ -34,7 +64,9 @@ void aml_buffer_destroy(aml_buffer_t *h) {
     uintptr_t pb = (uintptr_t)h;
     uintptr_t pe = pb + sizeof(*h);
     uintptr_t pd = (uintptr_t)h->data;
-    if (!(pd >= pb && pd < pe)) {
+    if (h->mapped)
+      _aml_buffer_unmap(h);
+    else if (!(pd >= pb && pd < pe)) {
       aml_free(h->data);
     }
     aml_free(h);
@@ -51,6 +83,7 @@ char *aml_buffer_detach(aml_buffer_t *h, size_t *length_out) {
 
     char *ret = NULL;
     size_t len = h->length;
+    _AML_TRACE_BEGIN(AML_TRACE_BUFFER_DETACH, len);
 
     if (h->pool) {
         /* Pool-backed: return pool memory (caller must NOT free). */
@@ -69,11 +102,16 @@ char *aml_buffer_detach(aml_buffer_t *h, size_t *length_out) {
         uintptr_t pd = (uintptr_t)h->data;
         bool is_sentinel = (pd >= pb && pd < pe);
 
-        if (is_sentinel) {
+        if (h->mapped) {
+            /* a mapping can't be handed to free, so it is copied once */
+            ret = (char *)_aml_malloc_for(h->caller, len + 1);
+            memcpy(ret, h->data, len + 1);
+            _aml_buffer_unmap(h);
+        } else if (is_sentinel) {
             /* No real heap buffer yet: allocate a minimal heap buffer the
                caller can safely free. Length is 0, so 1 byte is fine. */
             size_t alloc = (len > 0) ? len : 1;
-            ret = (char *)aml_malloc(alloc);
+            ret = (char *)_aml_malloc_for(h->caller, alloc);
             /* Nothing to copy (no user data was stored); just NUL-terminate. */
             if (alloc > 0) ret[0] = '\0';
         } else {
@@ -89,6 +127,7 @@ char *aml_buffer_detach(aml_buffer_t *h, size_t *length_out) {
         h->data[0] = '\0';
     }
 
+    _AML_TRACE_END(AML_TRACE_BUFFER_DETACH, h, 0);
     if (length_out) *length_out = len;
     return ret;
 }
@@ -103,8 +142,11 @@ static inline void aml_buffer_clear(aml_buffer_t *h) {
 static inline void aml_buffer_reset(aml_buffer_t *h, size_t max_size) {
     if (h->size > max_size) {
         if (!h->pool) {
-            aml_free(h->data);
-            h->data = (char *)aml_malloc(max_size + 1);
+            if (h->mapped)
+                _aml_buffer_unmap(h);
+            else
+                aml_free(h->data);
+            h->data = (char *)_aml_malloc_for(h->caller, max_size + 1);
             h->size = max_size;
         } // do nothing if pool
     }
@@ -122,23 +164,47 @@ static inline char *aml_buffer_end(aml_buffer_t *h) {
   return h->data + h->length;
 }
 
-static inline void _aml_buffer_grow(aml_buffer_t *h, size_t length) {
-  size_t len = (length + 50) + (h->size >> 3);
-  if(len > 100*1024*1024)
-    printf("aml_buffer_t: %p(%p): growing to %zu\n", (void*)h, (void*)h->pool, (size_t)len);
+static inline size_t _aml_buffer_grow_size(aml_buffer_t *h, size_t length) {
+  return (length + 50) + (length / 100) * h->growth;
+}
+
+/* grow the buffer to hold len bytes, keeping its contents */
+static inline void _aml_buffer_grow_to(aml_buffer_t *h, size_t len) {
+  _AML_TRACE_BEGIN(AML_TRACE_BUFFER_GROW, h->size);
   if (!h->pool) {
-    char *data = (char *)aml_malloc(len + 1);
-    memcpy(data, h->data, h->length + 1);
+    if (h->mapped || (h->mmap_threshold && len >= h->mmap_threshold)) {
+      _aml_buffer_remap(h, len, true);
+      _AML_TRACE_END(AML_TRACE_BUFFER_GROW, h, h->size);
+      return;
+    }
     if (h->size)
-      aml_free(h->data);
-    h->data = data;
-  } else {
+      h->data = (char *)_aml_realloc_for(h->caller, h->data, len + 1);
+    else {
+      char *data = (char *)_aml_malloc_for(h->caller, len + 1);
+      memcpy(data, h->data, h->length + 1);
+      h->data = data;
+    }
+    /* take whatever slack the allocator rounded the block up to */
+    len = _aml_usable_size(h->data, len + 1) - 1;
+  } else if (!h->size || !aml_pool_try_extend(h->pool, h->data, h->size + 1,
+                                               len + 1)) {
+    /* the data can't be extended unless it is the pool's last allocation */
     char *data = (char *)aml_pool_alloc(h->pool, len + 1);
     if(h->length)
         memcpy(data, h->data, h->length + 1);
     h->data = data;
   }
   h->size = len;
+  _AML_TRACE_END(AML_TRACE_BUFFER_GROW, h, h->size);
+}
+
+static inline void _aml_buffer_grow(aml_buffer_t *h, size_t length) {
+  _aml_buffer_grow_to(h, _aml_buffer_grow_size(h, length));
+}
+
+static inline void aml_buffer_reserve(aml_buffer_t *h, size_t size) {
+  if (size > h->size)
+    _aml_buffer_grow_to(h, size);
 }
 
 static inline void *aml_buffer_shrink_by(aml_buffer_t *h, size_t length) {
@@ -246,12 +312,18 @@ static inline void aml_buffer_appendn(aml_buffer_t *h, char ch, ssize_t n) {
 }
 
 static inline void _aml_buffer_alloc(aml_buffer_t *h, size_t length) {
-  size_t len = (length + 50) + (h->size >> 3);
+  size_t len = _aml_buffer_grow_size(h, length);
   if (!h->pool) {
+    if (h->mapped || (h->mmap_threshold && len >= h->mmap_threshold)) {
+      _aml_buffer_remap(h, len, false);
+      return;
+    }
     if (h->size)
       aml_free(h->data);
-    h->data = (char *)aml_malloc(len + 1);
-  } else
+    h->data = (char *)_aml_malloc_for(h->caller, len + 1);
+    len = _aml_usable_size(h->data, len + 1) - 1;
+  } else if (!h->size || !aml_pool_try_extend(h->pool, h->data, h->size + 1,
+                                               len + 1))
     h->data = (char *)aml_pool_alloc(h->pool, len + 1);
   h->size = len;
 }
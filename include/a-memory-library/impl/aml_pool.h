@@ -12,6 +12,11 @@
 /* used internally */
 void *_aml_pool_alloc_grow(aml_pool_t *h, size_t len);
 
+struct aml_pool_node_s;
+/* releases a block which is no longer part of the pool (a no-op for pools
+   which are allocated from another pool) */
+void _aml_pool_free_node(aml_pool_t *h, struct aml_pool_node_s *node);
+
 // #ifndef _AML_USE_MALLOC_
 // #define _AML_USE_MALLOC_
 // #endif
@@ -26,6 +31,23 @@ typedef struct aml_pool_node_s {
   struct aml_pool_node_s *prev;
 } aml_pool_node_t;
 
+/* used internally: blocks kept for reuse instead of being freed.  The list
+   may be shared by several pools as long as they are used by one thread at a
+   time (see aml_pool_ring). */
+typedef struct aml_pool_spares_s {
+  aml_pool_node_t *head;
+  size_t blocks;
+  size_t bytes;
+  /* blocks beyond this many bytes are freed rather than kept */
+  size_t max_bytes;
+  /* new blocks which came from the list and which didn't */
+  size_t reused;
+  size_t misses;
+} aml_pool_spares_t;
+
+/* used internally: release the spare blocks until at most max_bytes remain */
+void _aml_pool_spares_trim(aml_pool_spares_t *s, size_t max_bytes);
+
 struct aml_pool_s {
 #ifdef _AML_DEBUG_
   aml_allocator_dump_t dump;
@@ -47,6 +69,11 @@ struct aml_pool_s {
   /* A pointer into the current node where memory is available. */
   char *curp;
 
+  /* Bytes in the current node at or beyond the larger of curp and zero_mark
+    are known to be zero.  This is only below endp for mmap backed pools (see
+    aml_pool_init_ex), where fresh pages are zero-filled by the kernel. */
+  char *zero_mark;
+
   /* This is used as an alternate size for new blocks beyond the initial
     block.  It will be initially set to the length of the first block and can
     later be modified. */
@@ -60,12 +87,84 @@ struct aml_pool_s {
 
   /* if set, memory is allocated from this pool */
   aml_pool_t *pool;
+
+  /* if set, the first node is an mmap reservation (see aml_pool_init_ex) */
+  struct aml_pool_mmap_s *mmap;
+
+  /* Requests which are larger than the next growth block get their own node.
+    These are linked together via prev (most recent first) and are never
+    bumped. */
+  aml_pool_node_t *large;
+
+  /* the growth policy (see aml_pool_set_*_growth) */
+  uint32_t growth_policy;
+  /* the size of the last growth block (0 after clear) */
+  size_t growth_size;
+  /* the cap for geometric growth (0 for none) */
+  size_t max_growth_size;
+  aml_pool_growth_cb growth_cb;
+  void *growth_arg;
+
+  /* if set, clear resizes the primary block (see aml_pool_set_adaptive) */
+  struct aml_pool_adapt_s *adapt;
+
+  /* callbacks to run on clear and destroy, most recent first (see
+     aml_pool_add_cleanup) */
+  struct aml_pool_cleanup_s *cleanup;
+
+  /* if set, blocks the pool lets go of are kept here for reuse by this or
+     another pool sharing the list (see aml_pool_ring) */
+  struct aml_pool_spares_s *spares;
+
+  /* if set, the initial block has been lent to another pool and the handle's
+     allocation is shared with it (see aml_pool_adopt) */
+  struct aml_pool_loan_s *loan;
+
+  /* the set of interned strings (see aml_pool_intern), allocated from the
+     pool and dropped by clear.  intern_count goes up whenever the set
+     changes, so a restore can tell whether the set refers to memory which
+     it releases. */
+  struct aml_pool_intern_s *intern;
+  size_t intern_count;
+
+  /* if set, growth blocks are mapped on numa_node (see AML_POOL_NUMA) */
+  bool numa;
+  int numa_node;
+
+#ifdef _AML_SAMPLING_
+  /* the site which created the pool, its blocks are charged to it */
+  const char *caller;
+#endif
+
+#ifdef _AML_POOL_STATS_
+  aml_pool_stats_t stats;
+  /* links in the registry of live pools (see aml_pool_stats_foreach) */
+  struct aml_pool_s *stats_next;
+  struct aml_pool_s *stats_prev;
+#endif
 };
 
+/* account for len bytes handed out after skipping padding bytes to align
+   them (compiles away unless _AML_POOL_STATS_ is defined) */
+static inline void _aml_pool_stats_alloc(aml_pool_t *h, size_t len,
+                                         size_t padding) {
+#ifdef _AML_POOL_STATS_
+  h->stats.bytes += len;
+  h->stats.alignment_waste += padding;
+  if (h->stats.bytes > h->stats.high_water)
+    h->stats.high_water = h->stats.bytes;
+#else
+  (void)h;
+  (void)len;
+  (void)padding;
+#endif
+}
+
 static inline void *aml_pool_ualloc(aml_pool_t *h, size_t len) {
   char *r = h->curp;
   if (r + len < h->current->endp) {
     h->curp = r + len;
+    _aml_pool_stats_alloc(h, len, 0);
 #ifdef _AML_DEBUG_
     h->cur_size += len;
     if (h->cur_size > h->max_size)
@@ -82,6 +181,7 @@ static inline void *aml_pool_min_max_alloc(aml_pool_t *h, size_t *rlen,
       h->curp + ((sizeof(size_t) - ((size_t)(h->curp) & (sizeof(size_t) - 1))) &
                  (sizeof(size_t) - 1));
   if (r + len < h->current->endp) {
+    _aml_pool_stats_alloc(h, len, r - h->curp);
     h->curp = r + len;
 #ifdef _AML_DEBUG_
     h->cur_size += len;
@@ -93,6 +193,7 @@ static inline void *aml_pool_min_max_alloc(aml_pool_t *h, size_t *rlen,
   }
   if (r + min_len < h->current->endp) {
     len = (h->current->endp - r) - 1;
+    _aml_pool_stats_alloc(h, len, r - h->curp);
     h->curp = r + len;
 #ifdef _AML_DEBUG_
     h->cur_size += len;
@@ -113,6 +214,7 @@ static inline void *aml_pool_alloc(aml_pool_t *h, size_t len) {
       h->curp + to_add;
   if (r + len < h->current->endp) {
     h->curp = r + len;
+    _aml_pool_stats_alloc(h, len, to_add);
 #ifdef _AML_DEBUG_
     h->cur_size += len;
     if (h->cur_size > h->max_size)
@@ -125,8 +227,15 @@ static inline void *aml_pool_alloc(aml_pool_t *h, size_t len) {
 
 static inline void *aml_pool_zalloc(aml_pool_t *h, size_t len) {
   /* calloc will simply call the pool_alloc function and then zero the memory.
+     If the memory came from the current node, only the part below zero_mark
+     needs to be cleared.
    */
-  void *dest = aml_pool_alloc(h, len);
+  char *dest = (char *)aml_pool_alloc(h, len);
+  if (dest + len == h->curp && h->zero_mark < h->curp) {
+    if (dest < h->zero_mark)
+      memset(dest, 0, h->zero_mark - dest);
+    return dest;
+  }
   if (len)
     memset(dest, 0, len);
   return dest;
@@ -138,6 +247,43 @@ static inline void *aml_pool_calloc(aml_pool_t *h, size_t num_items, size_t size
   return aml_pool_zalloc(h, num_items*size);
 }
 
+static inline bool aml_pool_try_extend(aml_pool_t *h, void *p, size_t old_len,
+                                       size_t len) {
+  char *r = (char *)p;
+  if (r + old_len != h->curp || r + len >= h->current->endp)
+    return false;
+  if (len < old_len) {
+    /* the bytes given back aren't known to be zero */
+    if (h->zero_mark < h->curp)
+      h->zero_mark = h->curp;
+#ifdef _AML_POOL_STATS_
+    h->stats.bytes -= old_len - len;
+#endif
+#ifdef _AML_DEBUG_
+    h->cur_size -= old_len - len;
+#endif
+  } else {
+    _aml_pool_stats_alloc(h, len - old_len, 0);
+#ifdef _AML_DEBUG_
+    h->cur_size += len - old_len;
+    if (h->cur_size > h->max_size)
+      h->max_size = h->cur_size;
+#endif
+  }
+  h->curp = r + len;
+  return true;
+}
+
+static inline void *aml_pool_realloc(aml_pool_t *h, void *p, size_t old_len,
+                                     size_t len) {
+  if (p && aml_pool_try_extend(h, p, old_len, len))
+    return p;
+  void *r = aml_pool_alloc(h, len);
+  if (p && old_len)
+    memcpy(r, p, old_len < len ? old_len : len);
+  return r;
+}
+
 static inline void *aml_pool_udup(aml_pool_t *h, const void *data, size_t len) {
   /* dup will simply allocate enough bytes to hold the duplicated data,
     copy the data, and return the newly allocated memory which contains a copy
@@ -186,41 +332,84 @@ static inline char *aml_pool_strdupf(aml_pool_t *pool, const char *fmt, ...) {
   return r;
 }
 
+/* interned strings are preceded by their hash and length */
+typedef struct {
+  uint64_t hash;
+  size_t length;
+} aml_pool_intern_entry_t;
+
+static inline const char *aml_pool_interns(aml_pool_t *h, const char *s) {
+  return aml_pool_intern(h, s, strlen(s));
+}
+
+static inline size_t aml_pool_intern_length(const char *s) {
+  return ((const aml_pool_intern_entry_t *)s - 1)->length;
+}
+
+static inline uint64_t aml_pool_intern_hash(const char *s) {
+  return ((const aml_pool_intern_entry_t *)s - 1)->hash;
+}
+
+/* the split functions without the copy, s is modified in place */
 char **_aml_pool_split(aml_pool_t *h, size_t *num_splits, char delim, char *s);
+char **_aml_pool_split2(aml_pool_t *h, size_t *num_splits, char delim, char *s);
+char **_aml_pool_split_with_escape(aml_pool_t *h, size_t *num_splits,
+                                   char delim, char escape, char *s);
+char **_aml_pool_split_with_escape2(aml_pool_t *h, size_t *num_splits,
+                                    char delim, char escape, char *s);
 
 struct aml_pool_marker_s {
   aml_pool_node_t *prev;
+  aml_pool_node_t *large;
   char *curp;
   size_t size;
   size_t used;
+  size_t intern_count;
 #ifdef _AML_DEBUG_
   size_t cur_size;
 #endif
+#ifdef _AML_POOL_STATS_
+  size_t stats_bytes;
+#endif
 };
 
 static inline void aml_pool_save(aml_pool_t *h, aml_pool_marker_t *m) {
   m->prev = h->current->prev;
+  m->large = h->large;
   m->curp = h->curp;
   m->size = h->size;
   m->used = h->used;
+  m->intern_count = h->intern_count;
 #ifdef _AML_DEBUG_
   m->cur_size = h->cur_size;
 #endif
+#ifdef _AML_POOL_STATS_
+  m->stats_bytes = h->stats.bytes;
+#endif
 }
 
 static inline void aml_pool_restore(aml_pool_t *h, aml_pool_marker_t *m) {
+  _AML_TRACE_BEGIN(AML_TRACE_POOL_RESTORE, h->used);
+  /* remove the large nodes added after the marker */
+  while (h->large != m->large) {
+    aml_pool_node_t *node = h->large;
+    h->large = node->prev;
+    _aml_pool_free_node(h, node);
+  }
+
   /* remove the extra blocks (the ones where prev != NULL) */
   aml_pool_node_t *prev = h->current->prev;
-  while (prev != m->prev) {
-    if(!h->pool) {
-#ifdef _AML_USE_MALLOC_
-      free(h->current);
-#else
-      aml_free(h->current);
-#endif
+  if (prev == m->prev) {
+    /* everything between the marker and curp may have been written */
+    if (h->zero_mark < h->curp)
+      h->zero_mark = h->curp;
+  } else {
+    while (prev != m->prev) {
+      _aml_pool_free_node(h, h->current);
+      h->current = prev;
+      prev = prev->prev;
     }
-    h->current = prev;
-    prev = prev->prev;
+    h->zero_mark = h->current->endp;
   }
 
   /* reset to marker */
@@ -229,6 +418,13 @@ static inline void aml_pool_restore(aml_pool_t *h, aml_pool_marker_t *m) {
 
 #ifdef _AML_DEBUG_
   h->cur_size = m->cur_size;
+#endif
+#ifdef _AML_POOL_STATS_
+  h->stats.bytes = m->stats_bytes;
 #endif
   h->used = m->used;
+  /* strings interned since the marker may be gone */
+  if (h->intern_count != m->intern_count)
+    h->intern = NULL;
+  _AML_TRACE_END(AML_TRACE_POOL_RESTORE, h, h->used);
 }
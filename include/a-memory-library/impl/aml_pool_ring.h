@@ -0,0 +1,47 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_pool_ring_impl_H
+#define _aml_pool_ring_impl_H
+
+/* IMPLEMENTATION FOLLOWS - API is above this line */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct {
+  aml_pool_t *pool;
+  /* readers added with aml_pool_ring_retain */
+  atomic_uint readers;
+} aml_pool_ring_generation_t;
+
+struct aml_pool_ring_s {
+#ifdef _AML_DEBUG_
+  aml_allocator_dump_t dump;
+#endif
+  aml_pool_t *current;
+  /* written by the producer, read by aml_pool_ring_release */
+  _Atomic uint64_t epoch;
+  size_t generations;
+  /* shared by every generation's pool */
+  aml_pool_spares_t spares;
+  /* advance waits on cond for a generation's readers to reach zero */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  aml_pool_ring_generation_t gens[];
+};
+
+static inline aml_pool_t *aml_pool_ring_current(aml_pool_ring_t *r) {
+  return r->current;
+}
+
+static inline uint64_t aml_pool_ring_epoch(aml_pool_ring_t *r) {
+  return atomic_load_explicit(&r->epoch, memory_order_relaxed);
+}
+
+static inline size_t aml_pool_ring_generations(aml_pool_ring_t *r) {
+  return r->generations;
+}
+
+#endif
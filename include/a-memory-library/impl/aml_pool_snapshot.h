@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_pool_snapshot_impl_H
+#define _aml_pool_snapshot_impl_H
+
+/* IMPLEMENTATION FOLLOWS - API is above this line */
+
+/* The file starts with this header, padded to AML_POOL_SNAPSHOT_ALIGN bytes
+   plus the data's offset within a page in the pool, so that the data keeps
+   the alignment it had when it was allocated. */
+#define AML_POOL_SNAPSHOT_MAGIC "AMLSNAP"
+#define AML_POOL_SNAPSHOT_ALIGN 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  /* the offset of the data in the file */
+  uint32_t data_offset;
+  uint64_t length;
+  /* the root's offset in the data, or UINT64_MAX for NULL */
+  uint64_t root;
+  uint64_t checksum;
+} aml_pool_snapshot_header_t;
+
+struct aml_pool_snapshot_s {
+  char *map;
+  size_t map_length;
+  char *data;
+  size_t length;
+  void *root;
+  aml_pool_t *pool;
+};
+
+static inline void aml_rel_ptr_set(aml_rel_ptr_t *p, const void *target) {
+  *p = target ? (aml_rel_ptr_t)((intptr_t)target - (intptr_t)p) : 0;
+}
+
+static inline void *aml_rel_ptr_get(const aml_rel_ptr_t *p) {
+  return *p ? (void *)((intptr_t)p + (intptr_t)*p) : NULL;
+}
+
+#endif
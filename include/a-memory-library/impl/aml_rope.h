@@ -0,0 +1,91 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_rope_impl_H
+#define _aml_rope_impl_H
+
+/* IMPLEMENTATION FOLLOWS - API is above this line */
+
+/* A segment is followed by size + 1 bytes (one for a zero terminator). */
+typedef struct aml_rope_segment_s {
+  struct aml_rope_segment_s *next;
+  size_t length;
+  size_t size;
+} aml_rope_segment_t;
+
+struct aml_rope_s {
+#ifdef _AML_DEBUG_
+  aml_allocator_dump_t dump;
+#endif
+#ifdef _AML_SAMPLING_
+  /* the site which created the rope, segments are charged to it */
+  const char *caller;
+#endif
+  /* the segments from head to tail hold the data.  Any segments after tail
+     are empty and are reused before new ones are allocated. */
+  aml_rope_segment_t *head;
+  aml_rope_segment_t *tail;
+  size_t length;
+  /* the size of the next new segment and the size it stops doubling at */
+  size_t segment_size;
+  size_t max_segment_size;
+  aml_pool_t *pool;
+};
+
+static inline char *_aml_rope_segment_data(aml_rope_segment_t *s) {
+  return (char *)(s + 1);
+}
+
+/* makes tail a segment with at least length bytes available */
+void _aml_rope_next(aml_rope_t *h, size_t length);
+void _aml_rope_append(aml_rope_t *h, const void *data, size_t length);
+
+static inline size_t aml_rope_length(aml_rope_t *h) { return h->length; }
+
+static inline void aml_rope_append(aml_rope_t *h, const void *data,
+                                   size_t length) {
+  aml_rope_segment_t *t = h->tail;
+  if (length <= t->size - t->length) {
+    if (length)
+      memcpy(_aml_rope_segment_data(t) + t->length, data, length);
+    t->length += length;
+    h->length += length;
+  } else
+    _aml_rope_append(h, data, length);
+}
+
+static inline void aml_rope_appends(aml_rope_t *h, const char *s) {
+  aml_rope_append(h, s, strlen(s));
+}
+
+static inline void aml_rope_appendc(aml_rope_t *h, char ch) {
+  aml_rope_segment_t *t = h->tail;
+  if (t->length == t->size) {
+    _aml_rope_next(h, 1);
+    t = h->tail;
+  }
+  _aml_rope_segment_data(t)[t->length++] = ch;
+  h->length++;
+}
+
+static inline void *aml_rope_append_alloc(aml_rope_t *h, size_t length) {
+  aml_rope_segment_t *t = h->tail;
+  if (length > t->size - t->length) {
+    _aml_rope_next(h, length);
+    t = h->tail;
+  }
+  char *r = _aml_rope_segment_data(t) + t->length;
+  t->length += length;
+  h->length += length;
+  return r;
+}
+
+static inline void aml_rope_appendf(aml_rope_t *h, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  aml_rope_appendvf(h, fmt, args);
+  va_end(args);
+}
+
+#endif
@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _aml_slice_impl_H
+#define _aml_slice_impl_H
+
+/* IMPLEMENTATION FOLLOWS - API is above this line */
+
+static inline aml_slice_t aml_slice(const char *p, size_t len) {
+  aml_slice_t s;
+  s.p = p;
+  s.len = len;
+  return s;
+}
+
+static inline aml_slice_t aml_slice_str(const char *s) {
+  return aml_slice(s, s ? strlen(s) : 0);
+}
+
+static inline bool aml_slice_eq(aml_slice_t a, aml_slice_t b) {
+  return a.len == b.len && (!a.len || !memcmp(a.p, b.p, a.len));
+}
+
+static inline bool aml_slice_eq_str(aml_slice_t a, const char *s) {
+  return aml_slice_eq(a, aml_slice_str(s));
+}
+
+static inline char *aml_pool_slice_strdup(aml_pool_t *h, aml_slice_t s) {
+  char *r = (char *)aml_pool_ualloc(h, s.len + 1);
+  if (s.len)
+    memcpy(r, s.p, s.len);
+  r[s.len] = 0;
+  return r;
+}
+
+#endif
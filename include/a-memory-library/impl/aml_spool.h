@@ -0,0 +1,130 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+/* IMPLEMENTATION FOLLOWS - API is above this line */
+
+/* The atomic builtins are used (rather than stdatomic.h) so that this header
+   can also be included from C++. */
+
+typedef struct aml_spool_node_s {
+  /* the number of bytes reserved from this node.  This is advanced with an
+    atomic add and may go past size once the node is exhausted. */
+  size_t offset;
+
+  /* the number of bytes which follow the node */
+  size_t size;
+
+  /* this will be NULL if it is the first block. */
+  struct aml_spool_node_s *prev;
+
+  /* keeps the memory after the node 16 byte aligned */
+  size_t reserved;
+} aml_spool_node_t;
+
+struct aml_spool_s {
+#ifdef _AML_DEBUG_
+  aml_allocator_dump_t dump;
+  size_t initial_size;
+#endif
+  /* The block which allocations are made from (accessed atomically).  Older
+    blocks are linked through prev. */
+  aml_spool_node_t *current;
+
+  /* blocks for requests which are larger than minimum_growth_size (accessed
+    atomically) */
+  aml_spool_node_t *large;
+
+  size_t minimum_growth_size;
+
+  /* the total number of bytes allocated by the spool object (accessed
+    atomically) */
+  size_t used;
+
+  /* incremented by clear so that chunks know to refill */
+  size_t generation;
+
+#ifdef _AML_SAMPLING_
+  /* the site which created the spool, its blocks are charged to it */
+  const char *caller;
+#endif
+};
+
+struct aml_spool_chunk_s {
+  aml_spool_t *spool;
+  char *curp;
+  char *endp;
+  size_t chunk_size;
+  size_t generation;
+};
+
+/* used internally */
+void *_aml_spool_alloc_grow(aml_spool_t *h, aml_spool_node_t *node,
+                            size_t len);
+void *_aml_spool_chunk_refill(aml_spool_chunk_t *c, size_t len);
+
+static inline void *aml_spool_alloc(aml_spool_t *h, size_t len) {
+  /* keep every offset aligned */
+  len = (len + (sizeof(size_t) - 1)) & ~(sizeof(size_t) - 1);
+  aml_spool_node_t *node = __atomic_load_n(&h->current, __ATOMIC_ACQUIRE);
+  size_t offset = __atomic_fetch_add(&node->offset, len, __ATOMIC_RELAXED);
+  if (offset + len <= node->size)
+    return (char *)(node + 1) + offset;
+  return _aml_spool_alloc_grow(h, node, len);
+}
+
+static inline void *aml_spool_zalloc(aml_spool_t *h, size_t len) {
+  void *dest = aml_spool_alloc(h, len);
+  if (len)
+    memset(dest, 0, len);
+  return dest;
+}
+
+static inline void *aml_spool_calloc(aml_spool_t *h, size_t num_items,
+                                     size_t size) {
+  return aml_spool_zalloc(h, num_items * size);
+}
+
+static inline void *aml_spool_dup(aml_spool_t *h, const void *data,
+                                  size_t len) {
+  void *dest = aml_spool_alloc(h, len);
+  if (len)
+    memcpy(dest, data, len);
+  return dest;
+}
+
+static inline char *aml_spool_strdup(aml_spool_t *h, const char *p) {
+  size_t len = strlen(p) + 1;
+  return (char *)aml_spool_dup(h, p, len);
+}
+
+static inline void *aml_spool_chunk_alloc(aml_spool_chunk_t *c, size_t len) {
+  len = (len + (sizeof(size_t) - 1)) & ~(sizeof(size_t) - 1);
+  char *r = c->curp;
+  if ((size_t)(c->endp - r) >= len && c->generation == c->spool->generation) {
+    c->curp = r + len;
+    return r;
+  }
+  return _aml_spool_chunk_refill(c, len);
+}
+
+static inline void *aml_spool_chunk_zalloc(aml_spool_chunk_t *c, size_t len) {
+  void *dest = aml_spool_chunk_alloc(c, len);
+  if (len)
+    memset(dest, 0, len);
+  return dest;
+}
+
+static inline void *aml_spool_chunk_dup(aml_spool_chunk_t *c,
+                                        const void *data, size_t len) {
+  void *dest = aml_spool_chunk_alloc(c, len);
+  if (len)
+    memcpy(dest, data, len);
+  return dest;
+}
+
+static inline char *aml_spool_chunk_strdup(aml_spool_chunk_t *c,
+                                           const char *p) {
+  size_t len = strlen(p) + 1;
+  return (char *)aml_spool_chunk_dup(c, p, len);
+}
@@ -7,6 +7,93 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#ifdef __GLIBC__
+#include <execinfo.h>
+#include <malloc.h>
+#endif
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#endif
+
+/* ---- the backend ---- */
+
+static void *default_aligned_alloc(size_t alignment, size_t len) {
+  void *p;
+  return posix_memalign(&p, alignment, len) ? NULL : p;
+}
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+static size_t default_usable_size(void *p) {
+#ifdef __GLIBC__
+  return malloc_usable_size(p);
+#else
+  return malloc_size(p);
+#endif
+}
+#define AML_DEFAULT_USABLE_SIZE default_usable_size
+#else
+#define AML_DEFAULT_USABLE_SIZE NULL
+#endif
+
+#define AML_DEFAULT_BACKEND                                                   \
+  { malloc, free, realloc, default_aligned_alloc, AML_DEFAULT_USABLE_SIZE }
+
+static const aml_alloc_backend_t default_backend = AML_DEFAULT_BACKEND;
+aml_alloc_backend_t _aml_alloc_backend = AML_DEFAULT_BACKEND;
+
+void aml_alloc_set_backend(const aml_alloc_backend_t *backend) {
+  if (!backend)
+    backend = &default_backend;
+  if (!backend->malloc_fn || !backend->free_fn || !backend->realloc_fn ||
+      !backend->aligned_alloc_fn)
+    abort(); /* this doesn't make sense */
+  _aml_alloc_backend = *backend;
+}
+
+const aml_alloc_backend_t *aml_alloc_get_backend(void) {
+  return &_aml_alloc_backend;
+}
+
+/* alignment as the backend expects it, aborting if it isn't a power of two */
+static size_t check_alignment(size_t alignment) {
+  if (alignment & (alignment - 1))
+    abort(); /* this doesn't make sense */
+  return alignment < sizeof(void *) ? sizeof(void *) : alignment;
+}
+
+/* room for a header of hdr bytes and the offset back to the start of the
+   block, rounded up to keep the memory after it aligned */
+static size_t aligned_pad(size_t hdr, size_t alignment) {
+  return (hdr + sizeof(size_t) + alignment - 1) & ~(alignment - 1);
+}
+
+void *_aml_calloc(size_t num_items, size_t size) {
+  /* calloc can skip zeroing memory which is fresh from the kernel */
+  if (_aml_alloc_backend.malloc_fn == malloc)
+    return calloc(num_items, size);
+  if (size && num_items > SIZE_MAX / size)
+    return NULL;
+  size_t len = num_items * size;
+  void *m = _aml_alloc_backend.malloc_fn(len);
+  if (m)
+    memset(m, 0, len);
+  return m;
+}
+
+char *_aml_strdup(const char *p) {
+  size_t len = strlen(p) + 1;
+  char *r = (char *)_aml_alloc_backend.malloc_fn(len);
+  if (r)
+    memcpy(r, p, len);
+  return r;
+}
+
+void *_aml_aligned_alloc(size_t alignment, size_t len) {
+  alignment = check_alignment(alignment);
+  if (!len)
+    return NULL;
+  return _aml_alloc_backend.aligned_alloc_fn(alignment, len);
+}
 
 struct aml_allocator_s;
 typedef struct aml_allocator_s aml_allocator_t;
@@ -15,26 +102,94 @@ void aml_allocator_init();
 void aml_allocator_destroy();
 void aml_dump_global_allocations(aml_allocator_t *a, FILE *out);
 
+/* Allocations are tracked in one of AML_ALLOCATOR_STRIPES lists, each with
+   its own lock, so that threads don't serialize on a single mutex.  A thread
+   adds its allocations to the stripe it was assigned the first time it
+   allocated.  A free locks the stripe the node belongs to (which may be
+   another thread's).  The stripes are only combined when dumping. */
+#define AML_ALLOCATOR_STRIPES 64
+
+struct aml_allocator_stripe_s;
+typedef struct aml_allocator_stripe_s aml_allocator_stripe_t;
+
 typedef struct aml_allocator_node_s {
   const char *caller;
   ssize_t length;
   struct aml_allocator_node_s *next;
   struct aml_allocator_node_s *previous;
-  aml_allocator_t *a;
+  aml_allocator_stripe_t *stripe;
 } aml_allocator_node_t;
 
-struct aml_allocator_s {
+struct aml_allocator_stripe_s {
+  pthread_mutex_t mutex;
   aml_allocator_node_t *head;
   aml_allocator_node_t *tail;
   size_t total_bytes_allocated;
   size_t total_allocations;
+} __attribute__((aligned(64)));
+
+struct aml_allocator_s {
+  aml_allocator_stripe_t stripes[AML_ALLOCATOR_STRIPES];
+  /* the next stripe to hand out to a thread */
+  unsigned int next_stripe;
   char *logfile;
   pthread_t thread;
   pthread_cond_t cond;
+  /* serializes error messages and the logging thread */
   pthread_mutex_t mutex;
   int done;
 };
 
+/* the stripe (+1) which the calling thread allocates into */
+static _Thread_local unsigned int thread_stripe = 0;
+
+static inline aml_allocator_stripe_t *get_stripe(aml_allocator_t *a) {
+  if (!thread_stripe) {
+    unsigned int id = __atomic_fetch_add(&a->next_stripe, 1, __ATOMIC_RELAXED);
+    thread_stripe = (id % AML_ALLOCATOR_STRIPES) + 1;
+  }
+  return a->stripes + (thread_stripe - 1);
+}
+
+static inline void link_node(aml_allocator_stripe_t *s, aml_allocator_node_t *n,
+                             size_t len) {
+  n->stripe = s;
+  n->next = NULL;
+  pthread_mutex_lock(&s->mutex);
+  s->total_bytes_allocated += len;
+  s->total_allocations++;
+  n->previous = s->tail;
+  if (n->previous)
+    n->previous->next = n;
+  else
+    s->head = n;
+  s->tail = n;
+  pthread_mutex_unlock(&s->mutex);
+}
+
+static inline size_t node_length(aml_allocator_node_t *n) {
+  if (n->length > 0)
+    return n->length;
+  ssize_t num = -n->length;
+  return num;
+}
+
+static inline void unlink_node(aml_allocator_node_t *n) {
+  aml_allocator_stripe_t *s = n->stripe;
+  pthread_mutex_lock(&s->mutex);
+  if (n->previous)
+    n->previous->next = n->next;
+  else
+    s->head = n->next;
+  if (n->next)
+    n->next->previous = n->previous;
+  else
+    s->tail = n->previous;
+  s->total_allocations--;
+  s->total_bytes_allocated -= node_length(n);
+  pthread_mutex_unlock(&s->mutex);
+}
+
 static void print_node(FILE *out, const char *caller, ssize_t len,
                        aml_allocator_node_t *n) {
   if (len >= 0)
@@ -49,19 +204,32 @@ static void print_node(FILE *out, const char *caller, ssize_t len,
 
 aml_allocator_t *global_allocator = NULL;
 
+/* Every stripe is locked (in order) for the snapshot so that the totals and
+   the list agree. */
 static void _aml_dump_global_allocations(aml_allocator_t *a, FILE *out) {
-  if (a->head) {
+  size_t total_bytes_allocated = 0;
+  size_t total_allocations = 0;
+  for (int i = 0; i < AML_ALLOCATOR_STRIPES; i++) {
+    pthread_mutex_lock(&a->stripes[i].mutex);
+    total_bytes_allocated += a->stripes[i].total_bytes_allocated;
+    total_allocations += a->stripes[i].total_allocations;
+  }
+  if (total_allocations) {
     fprintf(out,
             "%lu byte(s) allocated in %lu allocations (%lu byte(s) overhead)\n",
-            a->total_bytes_allocated, a->total_allocations,
-            a->total_allocations * sizeof(aml_allocator_node_t));
-    aml_allocator_node_t *n = a->head;
-    while (n) {
-      print_node(out, n->caller, n->length, n);
-      fprintf(out, "\n");
-      n = n->next;
+            total_bytes_allocated, total_allocations,
+            total_allocations * sizeof(aml_allocator_node_t));
+    for (int i = 0; i < AML_ALLOCATOR_STRIPES; i++) {
+      aml_allocator_node_t *n = a->stripes[i].head;
+      while (n) {
+        print_node(out, n->caller, n->length, n);
+        fprintf(out, "\n");
+        n = n->next;
+      }
     }
   }
+  for (int i = AML_ALLOCATOR_STRIPES - 1; i >= 0; i--)
+    pthread_mutex_unlock(&a->stripes[i].mutex);
 }
 
 void aml_dump_global_allocations(aml_allocator_t *a, FILE *out) {
@@ -119,7 +287,11 @@ void *dump_global_allocations_thread(void *arg) {
     time_t t = time(NULL);
     FILE *out = fopen(a->logfile, "wb");
     fprintf(out, "%s", ctime(&t));
+#ifdef _AML_SAMPLING_
+    aml_sample_dump(out);
+#else
     _aml_dump_global_allocations(a, out);
+#endif
     fclose(out);
     save++;
     if (a->done)
@@ -139,11 +311,17 @@ void aml_allocator_init() {
   if(global_allocator)
     return;
 
-  aml_allocator_t *a = (aml_allocator_t *)malloc(sizeof(aml_allocator_t));
-  a->head = NULL;
-  a->tail = NULL;
-  a->total_bytes_allocated = 0;
-  a->total_allocations = 0;
+  aml_allocator_t *a = (aml_allocator_t *)aligned_alloc(
+      64, sizeof(aml_allocator_t));
+  for (int i = 0; i < AML_ALLOCATOR_STRIPES; i++) {
+    aml_allocator_stripe_t *s = a->stripes + i;
+    pthread_mutex_init(&s->mutex, NULL);
+    s->head = NULL;
+    s->tail = NULL;
+    s->total_bytes_allocated = 0;
+    s->total_allocations = 0;
+  }
+  a->next_stripe = 0;
   a->logfile = NULL;
   a->done = 0;
   pthread_mutex_init(&a->mutex, NULL);
@@ -184,7 +362,7 @@ void aml_allocator_destroy() {
   global_allocator = NULL;
 }
 
-#ifdef _AML_DEBUG_
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
 void amlStartupFun(void) __attribute__((constructor));
 void amlCleanupFun(void) __attribute__((destructor));
 
@@ -199,13 +377,10 @@ void *_aml_malloc_d(const char *caller, size_t len, bool custom) {
   if (!len)
     return NULL;
 
-    if(len > 24*1024*1024)
-        printf("allocating %lu bytes\n", len);
-
   aml_allocator_t *a = global_allocator;
 
-  aml_allocator_node_t *n =
-      (aml_allocator_node_t *)malloc(sizeof(aml_allocator_node_t) + len);
+  aml_allocator_node_t *n = (aml_allocator_node_t *)_aml_alloc_backend.malloc_fn(
+      sizeof(aml_allocator_node_t) + len);
   if (!n) {
     pthread_mutex_lock(&a->mutex);
     print_node(stderr, caller, len, NULL);
@@ -219,19 +394,7 @@ void *_aml_malloc_d(const char *caller, size_t len, bool custom) {
 
   n->caller = caller;
   n->length = l;
-  n->next = NULL;
-  n->a = a;
-
-  pthread_mutex_lock(&a->mutex);
-  a->total_bytes_allocated += len;
-  a->total_allocations++;
-  n->previous = a->tail;
-  if (n->previous)
-    n->previous->next = n;
-  else
-    a->head = n;
-  a->tail = n;
-  pthread_mutex_unlock(&a->mutex);
+  link_node(get_stripe(a), n, len);
   return (void *)(n + 1);
 }
 
@@ -259,9 +422,9 @@ char *_aml_strdupvf(const char *fmt, va_list args) {
     abort();
   va_end(args_copy);
   if (n < 32)
-    return strdup(tp);
+    return _aml_strdup(tp);
 
-  char *r = (char *)malloc(n + 1);
+  char *r = (char *)_aml_alloc_backend.malloc_fn(n + 1);
   va_copy(args_copy, args);
   int n2 = vsnprintf(r, n + 1, fmt, args_copy);
   if (n != n2)
@@ -406,7 +569,7 @@ char **_aml_strdupa(char **a) {
 
   size_t n = 0;
   size_t len = count_bytes_in_array(a, &n);
-  char **r = (char **)malloc(len);
+  char **r = (char **)_aml_alloc_backend.malloc_fn(len);
   char *m = (char *)(r + n);
   char **rp = r;
   while (*a) {
@@ -426,7 +589,7 @@ char **_aml_strdupan(char **a, size_t n) {
         return NULL;
 
     size_t len = count_bytes_in_arrayn(a, n);
-    char **r = (char **)malloc(len);
+    char **r = (char **)_aml_alloc_backend.malloc_fn(len);
     char *m = (char *)(r + n + 1);
     char **rp = r;
 
@@ -450,7 +613,10 @@ static aml_allocator_node_t *get_aml_node(const char *caller, void *p, const cha
 
   aml_allocator_node_t *n = (aml_allocator_node_t *)p;
   n--;
-  if (n->a == a)
+  /* the node must point at one of the stripes */
+  uintptr_t offset = (uintptr_t)n->stripe - (uintptr_t)a->stripes;
+  if (offset < sizeof(a->stripes) &&
+      offset % sizeof(aml_allocator_stripe_t) == 0)
     return n;
 
   pthread_mutex_lock(&a->mutex);
@@ -458,7 +624,7 @@ static aml_allocator_node_t *get_aml_node(const char *caller, void *p, const cha
   pthread_mutex_unlock(&a->mutex);
   abort();
 
-  aml_allocator_node_t *n2 = a->head;
+  aml_allocator_node_t *n2 = a->stripes[0].head;
   char *c = (char *)p;
   aml_allocator_node_t *closest = NULL;
   size_t closest_abs_dist;
@@ -493,46 +659,522 @@ void *_aml_realloc_d(const char *caller, void *p, size_t len, bool custom) {
 
   aml_allocator_node_t *n =
       get_aml_node(caller, p, "aml_realloc is invalid (p is not allocated?)");
-
-  void *m = _aml_malloc_d(caller, len, custom);
-  size_t len2;
-  if (n->length > 0)
-    len2 = n->length;
-  else {
-    ssize_t num = -n->length;
-    len2 = num;
+  if (!len) {
+    _aml_free_d(caller, p);
+    return NULL;
   }
-  if (len2 < len)
-    memcpy(m, p, len2);
-  else
-    memcpy(m, p, len);
 
-  _aml_free_d(caller, p);
-  return m;
+  /* The node is unlinked while realloc (possibly) moves it, then linked into
+     the calling thread's stripe like a new allocation. */
+  unlink_node(n);
+  aml_allocator_node_t *n2 = (aml_allocator_node_t *)_aml_alloc_backend.realloc_fn(
+      n, sizeof(aml_allocator_node_t) + len);
+  if (!n2) {
+    aml_allocator_t *a = global_allocator;
+    pthread_mutex_lock(&a->mutex);
+    print_node(stderr, caller, len, NULL);
+    fprintf(stderr, "realloc failed\n");
+    pthread_mutex_unlock(&a->mutex);
+    abort();
+  }
+  ssize_t l = len;
+  if (custom)
+    l = -l;
+  n2->caller = caller;
+  n2->length = l;
+  link_node(get_stripe(global_allocator), n2, len);
+  return (void *)(n2 + 1);
 }
 
 void _aml_free_d(const char *caller, void *p) {
   if (!p)
     return;
 
-  aml_allocator_t *a = global_allocator;
   aml_allocator_node_t *n =
       get_aml_node(caller, p, "aml_free is invalid (double free?)");
-  pthread_mutex_lock(&a->mutex);
-  if (n->previous)
-    n->previous->next = n->next;
-  else
-    a->head = n->next;
-  if (n->next)
-    n->next->previous = n->previous;
-  else
-    a->tail = n->previous;
-  a->total_allocations--;
-  if (n->length > 0)
-    a->total_bytes_allocated -= n->length;
+  unlink_node(n);
+  n->stripe = NULL; // to try and protect against double free
+  _aml_alloc_backend.free_fn(n);
+}
+
+/* The node sits right in front of the aligned memory, with the distance back
+   to the start of the block before it. */
+void *_aml_aligned_alloc_d(const char *caller, size_t alignment, size_t len) {
+  alignment = check_alignment(alignment);
+  if (!len)
+    return NULL;
+  aml_allocator_t *a = global_allocator;
+  size_t pad = aligned_pad(sizeof(aml_allocator_node_t), alignment);
+  char *base = (char *)_aml_alloc_backend.aligned_alloc_fn(alignment, pad + len);
+  if (!base) {
+    pthread_mutex_lock(&a->mutex);
+    print_node(stderr, caller, len, NULL);
+    fprintf(stderr, "aligned allocation failed\n");
+    pthread_mutex_unlock(&a->mutex);
+    abort();
+  }
+  aml_allocator_node_t *n = (aml_allocator_node_t *)(base + pad) - 1;
+  ((size_t *)n)[-1] = pad;
+  n->caller = caller;
+  n->length = len;
+  link_node(get_stripe(a), n, len);
+  return (void *)(n + 1);
+}
+
+void _aml_aligned_free_d(const char *caller, void *p) {
+  if (!p)
+    return;
+  aml_allocator_node_t *n =
+      get_aml_node(caller, p, "aml_aligned_free is invalid (double free?)");
+  unlink_node(n);
+  n->stripe = NULL;
+  _aml_alloc_backend.free_fn((char *)p - ((size_t *)n)[-1]);
+}
+
+/* The sampling heap profiler.  Every allocation gets a small header which
+   records the site it was sampled against (or 0 if it wasn't sampled) so
+   that a free can remove its estimate from the site's live totals.
+
+   Sampling is a Poisson process over bytes allocated - each thread counts
+   down a random (exponentially distributed) number of bytes with a mean of
+   sample_interval, and the allocation which crosses zero is sampled.  An
+   allocation of s bytes is sampled with probability p = 1-e^(-s/interval),
+   so it stands in for s/p bytes and 1/p allocations. */
+#define AML_SAMPLE_SITES 4096
+#define AML_SAMPLE_DEFAULT_INTERVAL (512 * 1024)
+#define AML_SAMPLE_BACKTRACE_DEPTH 16
+
+typedef struct {
+  uint32_t site; /* index + 1 into sample_sites, 0 if not sampled */
+  uint32_t count;
+  size_t bytes;
+} aml_sample_header_t;
+
+typedef struct {
+  const char *caller;
+  size_t samples;
+  size_t live_bytes;
+  size_t live_allocations;
+  size_t total_bytes;
+  size_t total_allocations;
+  int backtrace_len; /* set once backtrace is filled in */
+  void *backtrace[AML_SAMPLE_BACKTRACE_DEPTH];
+} aml_sample_slot_t;
+
+static aml_sample_slot_t sample_sites[AML_SAMPLE_SITES];
+/* sites which don't fit in the table are combined here */
+static aml_sample_slot_t sample_overflow = {"(other)", 0, 0, 0, 0, 0, 0, {0}};
+
+static size_t sample_interval = AML_SAMPLE_DEFAULT_INTERVAL;
+static bool sample_backtrace = false;
+
+typedef struct {
+  ssize_t countdown;
+  size_t interval; /* the interval countdown was drawn from */
+  uint64_t rng;
+} aml_sample_thread_t;
+
+static _Thread_local aml_sample_thread_t sample_thread = {0, 0, 0};
+
+void aml_sample_set_interval(size_t bytes) {
+  if (bytes == 0)
+    abort(); /* this doesn't make sense */
+  __atomic_store_n(&sample_interval, bytes, __ATOMIC_RELAXED);
+}
+
+void aml_sample_set_backtrace(bool enabled) {
+  __atomic_store_n(&sample_backtrace, enabled, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t sample_random(aml_sample_thread_t *t) {
+  /* xorshift64* */
+  uint64_t x = t->rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  t->rng = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* The sampler only needs a few digits of precision, so log and exp are
+   approximated here rather than pulling in libm. */
+static double sample_log(double x) {
+  /* x = m * 2^e with m in [1, 2), ln(m) = 2 atanh((m-1)/(m+1)) */
+  union {
+    double d;
+    uint64_t u;
+  } v = {x};
+  int e = (int)((v.u >> 52) & 0x7FF) - 1023;
+  v.u = (v.u & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+  double z = (v.d - 1.0) / (v.d + 1.0);
+  double z2 = z * z;
+  double r = 2.0 * z * (1.0 + z2 * (1.0 / 3 + z2 * (1.0 / 5 + z2 / 7)));
+  return e * 0.6931471805599453 + r;
+}
+
+static double sample_exp(double x) {
+  /* x = i ln(2) + f with f in [0, ln(2)) */
+  double t = x * 1.4426950408889634;
+  int i = (int)t;
+  if (t < i)
+    i--;
+  if (i < -1022)
+    return 0.0;
+  double f = x - i * 0.6931471805599453;
+  double r = 1.0 + f * (1.0 + f * (1.0 / 2 + f * (1.0 / 6 + f * (1.0 / 24 +
+                        f * (1.0 / 120 + f * (1.0 / 720))))));
+  union {
+    double d;
+    uint64_t u;
+  } v;
+  v.u = (uint64_t)(i + 1023) << 52;
+  return r * v.d;
+}
+
+static ssize_t sample_next(aml_sample_thread_t *t, size_t interval) {
+  if (!t->rng) {
+    uint64_t seed = (uint64_t)(uintptr_t)t ^ (uint64_t)time(NULL);
+    t->rng = seed ? seed : 1;
+  }
+  t->interval = interval;
+  /* a uniform value in (0, 1] */
+  double u = ((sample_random(t) >> 11) + 1) * (1.0 / 9007199254740992.0);
+  double n = -sample_log(u) * (double)interval;
+  return (ssize_t)n + 1;
+}
+
+static aml_sample_slot_t *sample_site(const char *caller, uint32_t *id) {
+  if (!caller)
+    caller = "(unknown)";
+  size_t h = (uintptr_t)caller;
+  h ^= h >> 17;
+  h *= 0x9E3779B97F4A7C15ULL;
+  h >>= 20;
+  for (size_t i = 0; i < AML_SAMPLE_SITES; i++) {
+    size_t idx = (h + i) & (AML_SAMPLE_SITES - 1);
+    aml_sample_slot_t *s = sample_sites + idx;
+    const char *c = __atomic_load_n(&s->caller, __ATOMIC_ACQUIRE);
+    if (!c) {
+      const char *expected = NULL;
+      if (__atomic_compare_exchange_n(&s->caller, &expected, caller, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+#ifdef __GLIBC__
+        if (__atomic_load_n(&sample_backtrace, __ATOMIC_RELAXED)) {
+          int n = backtrace(s->backtrace, AML_SAMPLE_BACKTRACE_DEPTH);
+          __atomic_store_n(&s->backtrace_len, n, __ATOMIC_RELEASE);
+        }
+#endif
+        *id = idx + 1;
+        return s;
+      }
+      c = expected;
+    }
+    if (c == caller) {
+      *id = idx + 1;
+      return s;
+    }
+  }
+  *id = AML_SAMPLE_SITES + 1;
+  return &sample_overflow;
+}
+
+static inline aml_sample_slot_t *sample_slot(uint32_t id) {
+  return id <= AML_SAMPLE_SITES ? sample_sites + id - 1 : &sample_overflow;
+}
+
+static void sample_record(aml_sample_header_t *h, const char *caller,
+                          size_t len, size_t interval) {
+  /* the probability that an allocation of len bytes was sampled */
+  double x = (double)len / (double)interval;
+  double p;
+  if (x < 0.01)
+    p = x * (1.0 - x * (0.5 - x / 6.0));
+  else if (x > 20.0)
+    p = 1.0;
   else
-    a->total_bytes_allocated += n->length;
-  pthread_mutex_unlock(&a->mutex);
-  n->a--; // to try and protect against double free
-  free(n);
+    p = 1.0 - sample_exp(-x);
+  double count = 1.0 / p;
+  if (count > 4294967295.0)
+    count = 4294967295.0;
+  h->count = (uint32_t)(count + 0.5);
+  h->bytes = (size_t)((double)len * count + 0.5);
+
+  aml_sample_slot_t *s = sample_site(caller, &h->site);
+  __atomic_fetch_add(&s->samples, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->live_bytes, h->bytes, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->live_allocations, h->count, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->total_bytes, h->bytes, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->total_allocations, h->count, __ATOMIC_RELAXED);
+}
+
+static inline void sample_release(aml_sample_header_t *h) {
+  if (!h->site)
+    return;
+  aml_sample_slot_t *s = sample_slot(h->site);
+  __atomic_fetch_sub(&s->live_bytes, h->bytes, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&s->live_allocations, h->count, __ATOMIC_RELAXED);
+}
+
+static inline void *sample_alloc(aml_sample_header_t *h, const char *caller,
+                                 size_t len) {
+  aml_sample_thread_t *t = &sample_thread;
+  size_t interval = __atomic_load_n(&sample_interval, __ATOMIC_RELAXED);
+  h->site = 0;
+  t->countdown -= (ssize_t)len;
+  if (t->countdown > 0 && t->interval == interval)
+    return h + 1;
+
+  bool sampled = t->interval == interval;
+  /* the interval changed (or this is the thread's first allocation) */
+  t->countdown = sample_next(t, interval);
+  if (sampled)
+    sample_record(h, caller, len, interval);
+  return h + 1;
+}
+
+void *_aml_malloc_s(const char *caller, size_t len) {
+  if (!len)
+    return NULL;
+  aml_sample_header_t *h = (aml_sample_header_t *)_aml_alloc_backend.malloc_fn(
+      sizeof(aml_sample_header_t) + len);
+  if (!h)
+    abort();
+  return sample_alloc(h, caller, len);
+}
+
+void *_aml_calloc_s(const char *caller, size_t len) {
+  void *m = _aml_malloc_s(caller, len);
+  if (m)
+    memset(m, 0, len);
+  return m;
+}
+
+void *_aml_realloc_s(const char *caller, void *p, size_t len) {
+  if (!p)
+    return _aml_malloc_s(caller, len);
+  if (!len) {
+    _aml_free_s(p);
+    return NULL;
+  }
+  aml_sample_header_t *h = (aml_sample_header_t *)p;
+  h--;
+  sample_release(h);
+  h = (aml_sample_header_t *)_aml_alloc_backend.realloc_fn(
+      h, sizeof(aml_sample_header_t) + len);
+  if (!h)
+    abort();
+  /* the result counts as a new allocation from caller */
+  return sample_alloc(h, caller, len);
+}
+
+void _aml_free_s(void *p) {
+  if (!p)
+    return;
+  aml_sample_header_t *h = (aml_sample_header_t *)p;
+  h--;
+  sample_release(h);
+  _aml_alloc_backend.free_fn(h);
+}
+
+void *_aml_aligned_alloc_s(const char *caller, size_t alignment, size_t len) {
+  alignment = check_alignment(alignment);
+  if (!len)
+    return NULL;
+  size_t pad = aligned_pad(sizeof(aml_sample_header_t), alignment);
+  char *base = (char *)_aml_alloc_backend.aligned_alloc_fn(alignment, pad + len);
+  if (!base)
+    abort();
+  aml_sample_header_t *h = (aml_sample_header_t *)(base + pad) - 1;
+  ((size_t *)h)[-1] = pad;
+  return sample_alloc(h, caller, len);
+}
+
+void _aml_aligned_free_s(void *p) {
+  if (!p)
+    return;
+  aml_sample_header_t *h = (aml_sample_header_t *)p;
+  h--;
+  sample_release(h);
+  _aml_alloc_backend.free_fn((char *)p - ((size_t *)h)[-1]);
+}
+
+char *_aml_strdup_s(const char *caller, const char *p) {
+  size_t len = strlen(p) + 1;
+  char *m = (char *)_aml_malloc_s(caller, len);
+  memcpy(m, p, len);
+  return m;
+}
+
+char *_aml_strdupvf_s(const char *caller, const char *fmt, va_list args) {
+  va_list args_copy;
+  va_copy(args_copy, args);
+  char tmp[32];
+  char *tp = (char *)(&tmp);
+  int n = vsnprintf(tp, 32, fmt, args_copy);
+  if (n < 0)
+    abort();
+  va_end(args_copy);
+  if (n < 32)
+    return _aml_strdup_s(caller, tp);
+
+  char *r = (char *)_aml_malloc_s(caller, n + 1);
+  va_copy(args_copy, args);
+  int n2 = vsnprintf(r, n + 1, fmt, args_copy);
+  if (n != n2)
+    abort(); // should never happen!
+  va_end(args_copy);
+  return r;
+}
+
+char *_aml_strdupf_s(const char *caller, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  char *r = _aml_strdupvf_s(caller, fmt, args);
+  va_end(args);
+  return r;
+}
+
+char **_aml_strdupa2_s(const char *caller, char **a) {
+  if (!a)
+    return NULL;
+
+  char **p = a;
+  while (*p)
+    p++;
+
+  p++;
+  return (char **)_aml_dup_s(caller, a, (p - a) * sizeof(char *));
+}
+
+char **_aml_strdupa_s(const char *caller, char **a) {
+  if (!a)
+    return NULL;
+
+  size_t n = 0;
+  size_t len = count_bytes_in_array(a, &n);
+  char **r = (char **)_aml_malloc_s(caller, len);
+  char *m = (char *)(r + n);
+  char **rp = r;
+  while (*a) {
+    *rp++ = m;
+    char *s = *a;
+    while (*s)
+      *m++ = *s++;
+    *m++ = 0;
+    a++;
+  }
+  *rp = NULL;
+  return r;
+}
+
+char **_aml_strdupan_s(const char *caller, char **a, size_t n) {
+  if (!a)
+    return NULL;
+
+  size_t len = count_bytes_in_arrayn(a, n);
+  char **r = (char **)_aml_malloc_s(caller, len);
+  char *m = (char *)(r + n + 1);
+  char **rp = r;
+
+  for (size_t i = 0; i < n; i++) {
+    if (a[i]) {
+      *rp++ = m;
+      const char *s = a[i];
+      while (*s)
+        *m++ = *s++;
+      *m++ = '\0';
+    } else {
+      *rp++ = NULL;
+    }
+  }
+  *rp = NULL;
+  return r;
+}
+
+static void sample_copy(aml_sample_site_t *r, aml_sample_slot_t *s,
+                        const char *caller) {
+  r->caller = caller;
+  r->samples = __atomic_load_n(&s->samples, __ATOMIC_RELAXED);
+  r->live_bytes = __atomic_load_n(&s->live_bytes, __ATOMIC_RELAXED);
+  r->live_allocations = __atomic_load_n(&s->live_allocations, __ATOMIC_RELAXED);
+  r->total_bytes = __atomic_load_n(&s->total_bytes, __ATOMIC_RELAXED);
+  r->total_allocations =
+      __atomic_load_n(&s->total_allocations, __ATOMIC_RELAXED);
+}
+
+/* the slot for the i'th site (the overflow comes last), NULL if unused */
+static aml_sample_slot_t *sample_slot_at(size_t i, const char **caller) {
+  aml_sample_slot_t *s =
+      i < AML_SAMPLE_SITES ? sample_sites + i : &sample_overflow;
+  *caller = __atomic_load_n(&s->caller, __ATOMIC_ACQUIRE);
+  if (!*caller || !__atomic_load_n(&s->samples, __ATOMIC_RELAXED))
+    return NULL;
+  return s;
+}
+
+void aml_sample_sites(aml_sample_site_cb cb, void *arg) {
+  aml_sample_site_t r;
+  for (size_t i = 0; i <= AML_SAMPLE_SITES; i++) {
+    const char *caller;
+    aml_sample_slot_t *s = sample_slot_at(i, &caller);
+    if (!s)
+      continue;
+    sample_copy(&r, s, caller);
+    cb(arg, &r);
+  }
+}
+
+typedef struct {
+  aml_sample_site_t site;
+  aml_sample_slot_t *slot;
+} aml_sample_entry_t;
+
+static int compare_live_bytes(const void *p1, const void *p2) {
+  const aml_sample_entry_t *a = (const aml_sample_entry_t *)p1;
+  const aml_sample_entry_t *b = (const aml_sample_entry_t *)p2;
+  if (a->site.live_bytes != b->site.live_bytes)
+    return a->site.live_bytes > b->site.live_bytes ? -1 : 1;
+  return 0;
+}
+
+void aml_sample_dump(FILE *out) {
+  /* plain malloc so that the dump doesn't sample itself */
+  aml_sample_entry_t *entries = (aml_sample_entry_t *)malloc(
+      sizeof(aml_sample_entry_t) * (AML_SAMPLE_SITES + 1));
+  if (!entries)
+    return;
+  size_t num = 0;
+  size_t live_bytes = 0, live_allocations = 0;
+  for (size_t i = 0; i <= AML_SAMPLE_SITES; i++) {
+    const char *caller;
+    aml_sample_slot_t *s = sample_slot_at(i, &caller);
+    if (!s)
+      continue;
+    sample_copy(&entries[num].site, s, caller);
+    entries[num].slot = s;
+    live_bytes += entries[num].site.live_bytes;
+    live_allocations += entries[num].site.live_allocations;
+    num++;
+  }
+  qsort(entries, num, sizeof(aml_sample_entry_t), compare_live_bytes);
+
+  fprintf(out,
+          "~%lu byte(s) live in ~%lu allocations (sampled every ~%lu bytes)\n",
+          live_bytes, live_allocations,
+          __atomic_load_n(&sample_interval, __ATOMIC_RELAXED));
+  for (size_t i = 0; i < num; i++) {
+    aml_sample_site_t *r = &entries[i].site;
+    fprintf(out, "%s: %lu live byte(s) in %lu allocation(s), %lu byte(s) in "
+            "%lu allocation(s) total, %lu sample(s)\n",
+            r->caller, r->live_bytes, r->live_allocations, r->total_bytes,
+            r->total_allocations, r->samples);
+#ifdef __GLIBC__
+    int n = __atomic_load_n(&entries[i].slot->backtrace_len, __ATOMIC_ACQUIRE);
+    if (n > 0) {
+      fflush(out);
+      backtrace_symbols_fd(entries[i].slot->backtrace, n, fileno(out));
+    }
+#endif
+  }
+  free(entries);
 }
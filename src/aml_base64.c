@@ -0,0 +1,609 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_buffer.h"
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define AML_BASE64_X86
+#include <immintrin.h>
+#define AML_TARGET(x) __attribute__((target(x)))
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define AML_BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+/* The kernels convert whole blocks as long as they can and return the number
+   of input bytes they consumed (a multiple of 3 for encoding and 4 for
+   decoding).  The scalar code finishes the tail, including any padding.  A
+   decoding kernel stops at the first block with a character it doesn't
+   accept, and the scalar code decides if the input is invalid. */
+typedef size_t (*base64_encode_cb)(const unsigned char *src, size_t len,
+                                   char *dst);
+typedef size_t (*base64_decode_cb)(const char *src, size_t len,
+                                   unsigned char *dst);
+
+typedef struct {
+  const char *name;
+  base64_encode_cb encode;
+  base64_decode_cb decode;
+  bool (*supported)(void);
+} base64_kernel_t;
+
+// -----------------------------------------------------------------------------
+// Base64 Encode Table
+// -----------------------------------------------------------------------------
+static const char b64_table[65] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// -----------------------------------------------------------------------------
+// Base64 Decode Table
+// -----------------------------------------------------------------------------
+static const unsigned char b64_dec_table[256] = {
+    /*   0- 15 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /*  16- 31 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /*  32- 47 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF,   62, 0xFF, 0xFF, 0xFF,   63,
+    /*  48- 63 */   52,   53,   54,   55,   56,   57,   58,   59,
+                    60,   61, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /*  64- 79 */ 0xFF,    0,    1,    2,    3,    4,    5,    6,
+                     7,    8,    9,   10,   11,   12,   13,   14,
+    /*  80- 95 */   15,   16,   17,   18,   19,   20,   21,   22,
+                    23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /*  96-111 */ 0xFF,   26,   27,   28,   29,   30,   31,   32,
+                    33,   34,   35,   36,   37,   38,   39,   40,
+    /* 112-127 */   41,   42,   43,   44,   45,   46,   47,   48,
+                    49,   50,   51, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 128-143 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 144-159 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 160-175 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 176-191 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 192-207 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 208-223 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 224-239 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* 240-255 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+// -----------------------------------------------------------------------------
+// Scalar
+// -----------------------------------------------------------------------------
+static size_t encode_scalar(const unsigned char *data, size_t data_len,
+                            char *encoded) {
+  // Process input in 3-byte chunks
+  size_t i = 0, j = 0;
+  while (i + 3 <= data_len) {
+    uint32_t triple = ((uint32_t)data[i] << 16) |
+                      ((uint32_t)data[i + 1] << 8) | data[i + 2];
+    i += 3;
+
+    // Encode into 4 Base64 chars
+    encoded[j++] = b64_table[(triple >> 18) & 0x3F];
+    encoded[j++] = b64_table[(triple >> 12) & 0x3F];
+    encoded[j++] = b64_table[(triple >> 6)  & 0x3F];
+    encoded[j++] = b64_table[(triple)       & 0x3F];
+  }
+  return i;
+}
+
+static size_t decode_scalar(const char *src, size_t len, unsigned char *dst) {
+  const unsigned char *s = (const unsigned char *)src;
+  size_t i = 0;
+  while (i + 4 <= len) {
+    uint32_t a = b64_dec_table[s[i]], b = b64_dec_table[s[i + 1]],
+             c = b64_dec_table[s[i + 2]], d = b64_dec_table[s[i + 3]];
+    if ((a | b | c | d) & 0x80)
+      break;
+    uint32_t val = (a << 18) | (b << 12) | (c << 6) | d;
+    dst[0] = (unsigned char)(val >> 16);
+    dst[1] = (unsigned char)(val >> 8);
+    dst[2] = (unsigned char)val;
+    dst += 3;
+    i += 4;
+  }
+  return i;
+}
+
+static bool supported_always(void) { return true; }
+
+// -----------------------------------------------------------------------------
+// x86 (SSSE3, AVX2, AVX-512 VBMI)
+// -----------------------------------------------------------------------------
+#ifdef AML_BASE64_X86
+/* Both encoders spread each 3 byte group over a 32 bit lane as b1 b0 b2 b1
+   and then pull the four 6 bit indexes out of it. */
+AML_TARGET("ssse3")
+static inline __m128i encode_lookup_ssse3(__m128i indices) {
+  /* map each index range to the offset which turns it into its character */
+  const __m128i shift_lut = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, reduced), indices);
+}
+
+AML_TARGET("ssse3")
+static inline __m128i encode_indices_ssse3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3,
+                                         4, 1, 2, 0, 1));
+  __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+AML_TARGET("ssse3")
+static size_t encode_ssse3(const unsigned char *src, size_t len, char *dst) {
+  size_t i = 0;
+  /* each step reads 16 bytes and uses 12 */
+  for (; i + 16 <= len; i += 12, dst += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)dst,
+                     encode_lookup_ssse3(encode_indices_ssse3(in)));
+  }
+  return i;
+}
+
+/* Valid characters are found with two nibble lookups (a character is bad if
+   the bits for its low and high nibble overlap), and converted by adding an
+   offset chosen by the high nibble ('/' shares its nibble with '+'). */
+AML_TARGET("ssse3")
+static size_t decode_ssse3(const char *src, size_t len, unsigned char *dst) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                       0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                       0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                       0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll =
+      _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                     -1, -1, -1, -1);
+  size_t i = 0;
+  /* 16 bytes are stored for every 12, so leave enough input behind that
+     the extra 4 bytes land in output which the tail still owns */
+  for (; i + 32 <= len; i += 16, dst += 12) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hi_nibbles =
+        _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    __m128i lo_nibbles = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                         _mm_setzero_si128())))
+      break;
+    __m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f));
+    __m128i roll =
+        _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    __m128i values = _mm_add_epi8(in, roll);
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(merged, pack));
+  }
+  return i;
+}
+
+static bool supported_ssse3(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+}
+
+AML_TARGET("avx2")
+static size_t encode_avx2(const unsigned char *src, size_t len, char *dst) {
+  const __m256i shuffle = _mm256_set_epi8(
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m256i shift_lut = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  size_t i = 0;
+  /* the two lanes take 12 bytes each (the high lane reads src+12..src+27) */
+  for (; i + 28 <= len; i += 24, dst += 32) {
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+        _mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+    in = _mm256_shuffle_epi8(in, shuffle);
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    reduced =
+        _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    __m256i out =
+        _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, reduced), indices);
+    _mm256_storeu_si256((__m256i *)dst, out);
+  }
+  return i;
+}
+
+AML_TARGET("avx2")
+static size_t decode_avx2(const char *src, size_t len, unsigned char *dst) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+      0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t i = 0;
+  /* 32 bytes are stored for every 24 */
+  for (; i + 48 <= len; i += 32, dst += 24) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i hi_nibbles =
+        _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+    __m256i lo_nibbles = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      break;
+    __m256i eq_2f = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f));
+    __m256i roll =
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    __m256i values = _mm256_add_epi8(in, roll);
+    __m256i merged =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(merged, pack);
+    merged = _mm256_permutevar8x32_epi32(
+        merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm256_storeu_si256((__m256i *)dst, merged);
+  }
+  return i;
+}
+
+static bool supported_avx2(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+/* With VBMI, the indexes come from a single multishift and the characters
+   from a single 64 entry byte permute.  Masked loads and stores keep the
+   kernels from touching memory outside of the input and output. */
+AML_TARGET("avx512f,avx512bw,avx512vbmi")
+static size_t encode_avx512vbmi(const unsigned char *src, size_t len,
+                                char *dst) {
+  const __m512i shuffle = _mm512_setr_epi32(
+      0x01020001, 0x04050304, 0x07080607, 0x0a0b090a, 0x0d0e0c0d, 0x10110f10,
+      0x13141213, 0x16171516, 0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122,
+      0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+  const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040aULL);
+  const __m512i lookup = _mm512_loadu_si512((const void *)b64_table);
+  size_t i = 0;
+  for (; i + 48 <= len; i += 48, dst += 64) {
+    __m512i in = _mm512_maskz_loadu_epi8(0x0000FFFFFFFFFFFFULL, src + i);
+    in = _mm512_permutexvar_epi8(shuffle, in);
+    in = _mm512_multishift_epi64_epi8(shifts, in);
+    _mm512_storeu_si512((void *)dst, _mm512_permutexvar_epi8(in, lookup));
+  }
+  return i;
+}
+
+/* the 3 output bytes of each 32 bit lane, in order */
+static const unsigned char b64_avx512_pack[64] = {
+    2,  1,  0,  6,  5,  4,  10, 9,  8,  14, 13, 12, 18, 17, 16, 22,
+    21, 20, 26, 25, 24, 30, 29, 28, 34, 33, 32, 38, 37, 36, 42, 41,
+    40, 46, 45, 44, 50, 49, 48, 54, 53, 52, 58, 57, 56, 62, 61, 60};
+
+AML_TARGET("avx512f,avx512bw,avx512vbmi")
+static size_t decode_avx512vbmi(const char *src, size_t len,
+                                unsigned char *dst) {
+  /* the first 128 entries of b64_dec_table, invalid entries have bit 7 set */
+  const __m512i lookup_0 = _mm512_loadu_si512((const void *)b64_dec_table);
+  const __m512i lookup_1 =
+      _mm512_loadu_si512((const void *)(b64_dec_table + 64));
+  const __m512i pack = _mm512_loadu_si512((const void *)b64_avx512_pack);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64, dst += 48) {
+    __m512i in = _mm512_loadu_si512((const void *)(src + i));
+    __m512i values = _mm512_permutex2var_epi8(lookup_0, in, lookup_1);
+    /* characters >= 128 or with an invalid entry */
+    if (_mm512_movepi8_mask(_mm512_or_si512(values, in)))
+      break;
+    __m512i merged =
+        _mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140));
+    merged = _mm512_madd_epi16(merged, _mm512_set1_epi32(0x00011000));
+    merged = _mm512_permutexvar_epi8(pack, merged);
+    _mm512_mask_storeu_epi8(dst, 0x0000FFFFFFFFFFFFULL, merged);
+  }
+  return i;
+}
+
+static bool supported_avx512vbmi(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512vbmi");
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// ARM (NEON)
+// -----------------------------------------------------------------------------
+#ifdef AML_BASE64_NEON
+static size_t encode_neon(const unsigned char *src, size_t len, char *dst) {
+  uint8x16x4_t tbl;
+  tbl.val[0] = vld1q_u8((const uint8_t *)b64_table);
+  tbl.val[1] = vld1q_u8((const uint8_t *)b64_table + 16);
+  tbl.val[2] = vld1q_u8((const uint8_t *)b64_table + 32);
+  tbl.val[3] = vld1q_u8((const uint8_t *)b64_table + 48);
+  const uint8x16_t mask = vdupq_n_u8(0x3F);
+  size_t i = 0;
+  for (; i + 48 <= len; i += 48, dst += 64) {
+    /* deinterleave 16 groups of 3 bytes */
+    uint8x16x3_t in = vld3q_u8(src + i);
+    uint8x16x4_t out;
+    out.val[0] = vshrq_n_u8(in.val[0], 2);
+    out.val[1] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    out.val[2] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    out.val[3] = vandq_u8(in.val[2], mask);
+    for (int k = 0; k < 4; k++)
+      out.val[k] = vqtbl4q_u8(tbl, out.val[k]);
+    vst4q_u8((uint8_t *)dst, out);
+  }
+  return i;
+}
+
+static size_t decode_neon(const char *src, size_t len, unsigned char *dst) {
+  uint8x16x4_t lo, hi;
+  for (int k = 0; k < 4; k++) {
+    lo.val[k] = vld1q_u8(b64_dec_table + 16 * k);
+    hi.val[k] = vld1q_u8(b64_dec_table + 64 + 16 * k);
+  }
+  const uint8x16_t invalid = vdupq_n_u8(0xFF);
+  const uint8x16_t offset = vdupq_n_u8(64);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64, dst += 48) {
+    uint8x16x4_t in = vld4q_u8((const uint8_t *)src + i);
+    uint8x16_t err = vdupq_n_u8(0);
+    for (int k = 0; k < 4; k++) {
+      /* indexes past the end of a table leave the value alone, so characters
+         >= 128 stay invalid */
+      uint8x16_t v = vqtbx4q_u8(invalid, lo, in.val[k]);
+      v = vqtbx4q_u8(v, hi, vsubq_u8(in.val[k], offset));
+      err = vorrq_u8(err, v);
+      in.val[k] = v;
+    }
+    if (vmaxvq_u8(err) > 63)
+      break;
+    uint8x16x3_t out;
+    out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+    vst3q_u8(dst, out);
+  }
+  return i;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------------------------
+/* ordered from least to most preferred */
+static const base64_kernel_t base64_kernels[] = {
+    {"scalar", encode_scalar, decode_scalar, supported_always},
+#ifdef AML_BASE64_X86
+    {"ssse3", encode_ssse3, decode_ssse3, supported_ssse3},
+    {"avx2", encode_avx2, decode_avx2, supported_avx2},
+    {"avx512vbmi", encode_avx512vbmi, decode_avx512vbmi, supported_avx512vbmi},
+#endif
+#ifdef AML_BASE64_NEON
+    {"neon", encode_neon, decode_neon, supported_always},
+#endif
+};
+
+#define AML_BASE64_KERNELS (sizeof(base64_kernels) / sizeof(base64_kernels[0]))
+
+static const base64_kernel_t *base64_kernel = NULL;
+
+static const base64_kernel_t *best_kernel(void) {
+  size_t i = AML_BASE64_KERNELS;
+  while (i > 1 && !base64_kernels[i - 1].supported())
+    i--;
+  return base64_kernels + i - 1;
+}
+
+/* Every thread which races to pick the kernel picks the same one. */
+static inline const base64_kernel_t *get_kernel(void) {
+  const base64_kernel_t *k = __atomic_load_n(&base64_kernel, __ATOMIC_ACQUIRE);
+  if (!k) {
+    k = best_kernel();
+    __atomic_store_n(&base64_kernel, k, __ATOMIC_RELEASE);
+  }
+  return k;
+}
+
+bool aml_base64_use(const char *name) {
+  if (!name) {
+    __atomic_store_n(&base64_kernel, best_kernel(), __ATOMIC_RELEASE);
+    return true;
+  }
+  for (size_t i = 0; i < AML_BASE64_KERNELS; i++) {
+    if (!strcmp(base64_kernels[i].name, name)) {
+      if (!base64_kernels[i].supported())
+        return false;
+      __atomic_store_n(&base64_kernel, base64_kernels + i, __ATOMIC_RELEASE);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *aml_base64_kernel(void) { return get_kernel()->name; }
+
+// -----------------------------------------------------------------------------
+// Encoding and decoding
+// -----------------------------------------------------------------------------
+static inline size_t encoded_length(size_t data_len) {
+  // Base64 encodes each 3-byte block into 4 chars. If data_len isn't multiple
+  // of 3, padding is added. So final length = 4 * ceil(data_len / 3).
+  return 4 * ((data_len + 2) / 3);
+}
+
+/* writes encoded_length(data_len) characters (not terminated) */
+static void base64_encode(const unsigned char *data, size_t data_len,
+                          char *encoded) {
+  size_t i = get_kernel()->encode(data, data_len, encoded);
+  i += encode_scalar(data + i, data_len - i, encoded + (i / 3) * 4);
+  char *p = encoded + (i / 3) * 4;
+
+  // Add '=' padding if necessary
+  size_t mod = data_len - i;
+  if (mod > 0) {
+    uint32_t octet_a = data[i];
+    uint32_t octet_b = mod == 2 ? data[i + 1] : 0;
+    uint32_t triple = (octet_a << 16) | (octet_b << 8);
+    p[0] = b64_table[(triple >> 18) & 0x3F];
+    p[1] = b64_table[(triple >> 12) & 0x3F];
+    p[2] = mod == 2 ? b64_table[(triple >> 6) & 0x3F] : '=';
+    p[3] = '=';
+  }
+}
+
+/* The most bytes which len characters can decode to.  The output passed to
+   base64_decode must have room for this many bytes. */
+static inline size_t decoded_max_length(size_t len) {
+  return (len / 4) * 3 + ((len & 3) ? (len & 3) - 1 : 0);
+}
+
+/* Padding is optional, but if present must complete the final group.
+   Returns false if the input isn't valid base64. */
+static bool base64_decode(const char *b64, size_t len, unsigned char *out,
+                          size_t *out_len) {
+  const unsigned char *s = (const unsigned char *)b64;
+  size_t tail = len;
+  if (len >= 4 && (len & 3) == 0 && s[len - 1] == '=') {
+    /* the last group (with its padding) is done below */
+    tail = len - 4;
+  }
+  size_t i = get_kernel()->decode(b64, tail, out);
+  i += decode_scalar(b64 + i, tail - i, out + (i / 4) * 3);
+  if (i < tail && tail - i >= 4)
+    return false; /* an invalid character */
+
+  unsigned char *p = out + (i / 4) * 3;
+  size_t rem = len - i;
+  if (rem) {
+    /* 2 or 3 characters (after dropping padding) make 1 or 2 bytes */
+    if (rem == 4 && s[i + 3] == '=')
+      rem = s[i + 2] == '=' ? 2 : 3;
+    if (rem < 2 || rem > 3)
+      return false;
+    uint32_t val = 0;
+    for (size_t k = 0; k < rem; k++) {
+      uint32_t d = b64_dec_table[s[i + k]];
+      if (d & 0x80)
+        return false;
+      val |= d << (18 - 6 * k);
+    }
+    *p++ = (unsigned char)(val >> 16);
+    if (rem == 3)
+      *p++ = (unsigned char)(val >> 8);
+  }
+  *out_len = p - out;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// aml_pool_base64_encode
+// -----------------------------------------------------------------------------
+char *aml_pool_base64_encode(aml_pool_t *pool, const unsigned char *data,
+                             size_t data_len) {
+  if (!data)
+    data_len = 0;
+  size_t encoded_len = encoded_length(data_len);
+
+  // Allocate buffer for the encoded string (+1 for '\0')
+  char *encoded = (char *)aml_pool_ualloc(pool, encoded_len + 1);
+  base64_encode(data, data_len, encoded);
+  encoded[encoded_len] = '\0'; // null-terminate
+  return encoded;
+}
+
+// -----------------------------------------------------------------------------
+// aml_pool_base64_decode
+// -----------------------------------------------------------------------------
+unsigned char *aml_pool_base64_decoden(aml_pool_t *pool, size_t *out_len,
+                                       const char *b64, size_t len) {
+  size_t n = 0;
+  if (!b64)
+    len = 0;
+  unsigned char *decoded =
+      (unsigned char *)aml_pool_ualloc(pool, decoded_max_length(len) + 1);
+  if (!base64_decode(b64, len, decoded, &n)) {
+    if (out_len)
+      *out_len = 0;
+    return NULL;
+  }
+  // Null terminate for safety if you want to treat as string
+  decoded[n] = '\0';
+  if (out_len)
+    *out_len = n;
+  return decoded;
+}
+
+unsigned char *aml_pool_base64_decode(aml_pool_t *pool, size_t *out_len,
+                                      const char *b64) {
+  if (!pool || !b64) {
+    if (out_len)
+      *out_len = 0;
+    return NULL;
+  }
+  return aml_pool_base64_decoden(pool, out_len, b64, strlen(b64));
+}
+
+// -----------------------------------------------------------------------------
+// aml_buffer_append_base64
+// -----------------------------------------------------------------------------
+void aml_buffer_append_base64(aml_buffer_t *h, const void *data,
+                              size_t data_len) {
+  char *encoded =
+      (char *)aml_buffer_append_ualloc(h, encoded_length(data_len));
+  base64_encode((const unsigned char *)data, data_len, encoded);
+}
+
+bool aml_buffer_append_base64_decode(aml_buffer_t *h, const char *b64,
+                                     size_t len) {
+  size_t max_len = decoded_max_length(len);
+  unsigned char *decoded =
+      (unsigned char *)aml_buffer_append_ualloc(h, max_len);
+  size_t n = 0;
+  if (!base64_decode(b64, len, decoded, &n)) {
+    aml_buffer_shrink_by(h, max_len);
+    return false;
+  }
+  aml_buffer_shrink_by(h, max_len - n);
+  return true;
+}
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/extras/aml_block_allocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+aml_block_allocator_t *aml_block_allocator_init(aml_pool_t *pool) {
+  aml_block_allocator_t *h =
+      (aml_block_allocator_t *)aml_pool_zalloc(pool, sizeof(*h));
+  h->pool = pool;
+  return h;
+}
+
+void _aml_block_allocator_bad_free(void *data) {
+  fprintf(stderr,
+          "aml_block_allocator_free: %p was not allocated with "
+          "aml_block_allocator_halloc (double free?)\n",
+          data);
+  abort();
+}
+
+/* Take class id's remote stack and count it as freed, returning its last
+   block in *tail. */
+static aml_block_allocator_free_node_t *
+take_remote(aml_block_allocator_t *h, uint32_t id,
+            aml_block_allocator_free_node_t **tail) {
+  aml_block_allocator_free_node_t *fn =
+      __atomic_exchange_n(h->remote + id, NULL, __ATOMIC_ACQUIRE);
+  if (!fn)
+    return NULL;
+  size_t n = 1;
+  aml_block_allocator_free_node_t *p = fn;
+  while (p->next) {
+    p = p->next;
+    n++;
+  }
+  *tail = p;
+  aml_block_allocator_class_t *c = h->classes + id;
+  c->frees += n;
+  c->remote_frees += n;
+  return fn;
+}
+
+aml_block_allocator_free_node_t *
+_aml_block_allocator_take_remote(aml_block_allocator_t *h, uint32_t id) {
+  /* only called when the free list is empty, so the stack becomes it */
+  aml_block_allocator_free_node_t *tail;
+  aml_block_allocator_free_node_t *fn = take_remote(h, id, &tail);
+  if (fn)
+    h->classes[id].free_list = fn;
+  return fn;
+}
+
+void aml_block_allocator_drain(aml_block_allocator_t *h) {
+  for (uint32_t id = 0; id < AML_BLOCK_ALLOCATOR_CLASSES; id++) {
+    if (!__atomic_load_n(h->remote + id, __ATOMIC_RELAXED))
+      continue;
+    aml_block_allocator_free_node_t *tail;
+    aml_block_allocator_free_node_t *fn = take_remote(h, id, &tail);
+    if (!fn)
+      continue;
+    aml_block_allocator_class_t *c = h->classes + id;
+    tail->next = c->free_list;
+    c->free_list = fn;
+  }
+}
+
+void aml_block_allocator_stats(aml_block_allocator_t *h, uint32_t id,
+                               aml_block_allocator_stats_t *out) {
+  if (id >= AML_BLOCK_ALLOCATOR_CLASSES)
+    abort(); /* this doesn't make sense */
+  aml_block_allocator_class_t *c = h->classes + id;
+  out->block_size = aml_block_allocator_size(id);
+  out->allocs = c->allocs;
+  out->frees = c->frees;
+  out->remote_frees = c->remote_frees;
+  out->reused = c->reused;
+  out->live = c->allocs - c->frees;
+  out->cached = c->frees - c->reused;
+}
@@ -2,11 +2,20 @@
 // SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
 // SPDX-License-Identifier: Apache-2.0
 
+#ifdef __linux__
+/* for mremap */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
 #include "a-memory-library/aml_buffer.h"
+#include "a-memory-library/aml_numa.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
 
 #ifdef _AML_DEBUG_
 static void dump_buffer(FILE *out, const char *caller, void *p, size_t length) {
@@ -21,19 +30,133 @@ aml_buffer_t *_aml_buffer_init(size_t initial_size, const char *caller) {
   h->dump.dump = dump_buffer;
   h->initial_size = initial_size;
   h->max_length = 0;
+#elif defined(_AML_SAMPLING_)
+aml_buffer_t *_aml_buffer_init(size_t initial_size, const char *caller) {
+  aml_buffer_t *h = (aml_buffer_t *)_aml_malloc_s(caller, sizeof(aml_buffer_t));
+  h->caller = caller;
 #else
 aml_buffer_t *_aml_buffer_init(size_t initial_size) {
   aml_buffer_t *h = (aml_buffer_t *)aml_malloc(sizeof(aml_buffer_t));
 #endif
-  h->data = initial_size ? (char *)aml_malloc(initial_size + 1)
+  h->data = initial_size ? (char *)_aml_malloc_for(h->caller, initial_size + 1)
                          : (char *)(&(h->size));
   h->data[0] = 0;
   h->length = 0;
   h->size = initial_size;
   h->pool = NULL;
+  h->growth = AML_BUFFER_DEFAULT_GROWTH;
+  h->mmap_threshold = AML_BUFFER_MMAP_THRESHOLD;
+  h->mapped = 0;
+  h->numa_node = AML_NUMA_NONE;
   return h;
 }
 
+static size_t page_round(size_t len) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (len + page - 1) & ~(page - 1);
+}
+
+/* the mapping keeps its NUMA policy when mremap grows or moves it */
+static char *map_pages(size_t bytes, int numa_node) {
+  char *data = (char *)mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == (char *)MAP_FAILED)
+    abort();
+  if (numa_node != AML_NUMA_NONE)
+    aml_numa_bind(data, bytes, numa_node);
+  return data;
+}
+
+void _aml_buffer_remap(aml_buffer_t *h, size_t len, bool keep) {
+  size_t bytes = page_round(len + 1);
+  char *data;
+  if (h->mapped) {
+#ifdef MREMAP_MAYMOVE
+    data = (char *)mremap(h->data, h->mapped, bytes, MREMAP_MAYMOVE);
+    if (data == (char *)MAP_FAILED)
+      abort();
+#else
+    data = map_pages(bytes, h->numa_node);
+    if (keep)
+      memcpy(data, h->data, h->length + 1);
+    munmap(h->data, h->mapped);
+#endif
+  } else {
+    /* the last copy */
+    data = map_pages(bytes, h->numa_node);
+    if (keep)
+      memcpy(data, h->data, h->length + 1);
+    if (h->size)
+      aml_free(h->data);
+  }
+  h->data = data;
+  h->mapped = bytes;
+  h->size = bytes - 1;
+}
+
+void aml_buffer_set_numa(aml_buffer_t *h, int node) {
+  h->numa_node = node;
+  if (h->mapped)
+    aml_numa_bind(h->data, h->mapped, node);
+}
+
+void _aml_buffer_unmap(aml_buffer_t *h) {
+  munmap(h->data, h->mapped);
+  h->mapped = 0;
+  h->data = (char *)&h->size;
+  h->size = 0;
+  h->length = 0;
+}
+
+size_t aml_buffer_trim(aml_buffer_t *h, size_t keep_bytes) {
+  size_t len = h->length > keep_bytes ? h->length : keep_bytes;
+  size_t size = h->size;
+  if (len >= size)
+    return 0;
+  if (h->pool) {
+    if (size && aml_pool_try_extend(h->pool, h->data, size + 1, len + 1))
+      h->size = len;
+    return 0; /* the memory went back to the pool, not the system */
+  }
+  if (!len) {
+    /* nothing to keep, back to the empty sentinel */
+    if (h->mapped)
+      _aml_buffer_unmap(h);
+    else {
+      aml_free(h->data);
+      h->data = (char *)&h->size;
+      h->size = 0;
+      h->data[0] = 0;
+    }
+    return size + 1;
+  }
+  if (h->mapped) {
+    if (h->mmap_threshold && len >= h->mmap_threshold) {
+      /* unmapping the tail pages is enough */
+      size_t bytes = page_round(len + 1);
+      if (bytes >= h->mapped)
+        return 0;
+      munmap(h->data + bytes, h->mapped - bytes);
+      size_t released = h->mapped - bytes;
+      h->mapped = bytes;
+      h->size = bytes - 1;
+      return released;
+    }
+    char *data = (char *)_aml_malloc_for(h->caller, len + 1);
+    memcpy(data, h->data, h->length + 1);
+    munmap(h->data, h->mapped);
+    h->mapped = 0;
+    h->data = data;
+  } else if (size)
+    h->data = (char *)_aml_realloc_for(h->caller, h->data, len + 1);
+  else
+    return 0; /* still the empty sentinel */
+  h->size = len;
+  return size - len;
+}
+
+void aml_buffer_shrink_to_fit(aml_buffer_t *h) { aml_buffer_trim(h, 0); }
+
 void _aml_buffer_append(aml_buffer_t *h, const void *data, size_t length) {
   if (h->length + length > h->size)
     _aml_buffer_grow(h, h->length + length);
@@ -0,0 +1,570 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_buffer.h"
+#include <stdint.h>
+#include <string.h>
+
+/* The writers below format straight into memory which has room for the
+   widest result and return the number of bytes written.  Nothing here goes
+   through printf. */
+
+/* the widest results (without a terminator) */
+#define AML_FORMAT_U64 20
+#define AML_FORMAT_I64 20
+#define AML_FORMAT_HEX 16
+#define AML_FORMAT_DOUBLE 25
+
+// -----------------------------------------------------------------------------
+// Integers
+// -----------------------------------------------------------------------------
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline size_t u64_digits(uint64_t v) {
+  size_t n = 1;
+  for (;;) {
+    if (v < 10)
+      return n;
+    if (v < 100)
+      return n + 1;
+    if (v < 1000)
+      return n + 2;
+    if (v < 10000)
+      return n + 3;
+    v /= 10000;
+    n += 4;
+  }
+}
+
+/* two digits at a time, from the end */
+static size_t write_u64(char *dst, uint64_t v) {
+  size_t n = u64_digits(v);
+  char *p = dst + n;
+  while (v >= 100) {
+    size_t i = (size_t)(v % 100) * 2;
+    v /= 100;
+    p -= 2;
+    memcpy(p, digit_pairs + i, 2);
+  }
+  if (v >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + v * 2, 2);
+  } else
+    *--p = (char)('0' + v);
+  return n;
+}
+
+static size_t write_i64(char *dst, int64_t v) {
+  if (v >= 0)
+    return write_u64(dst, (uint64_t)v);
+  *dst = '-';
+  return 1 + write_u64(dst + 1, 0 - (uint64_t)v);
+}
+
+static size_t write_hex(char *dst, uint64_t v) {
+  static const char hex[] = "0123456789abcdef";
+  size_t n = (64 - __builtin_clzll(v | 1) + 3) >> 2;
+  for (size_t i = n; i > 0; i--) {
+    dst[i - 1] = hex[v & 15];
+    v >>= 4;
+  }
+  return n;
+}
+
+// -----------------------------------------------------------------------------
+// Doubles
+// -----------------------------------------------------------------------------
+/* Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+   Accurately with Integers", 2010), following the layout of Milo Yip's
+   implementation.  The digits always read back as the same double, and are
+   the shortest such digits for all but a small fraction of inputs. */
+typedef struct {
+  uint64_t f;
+  int e;
+} diy_fp_t;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_EXPONENT_BIAS 1075
+
+/* 10^k for k = -348, -340, ..., 340, normalized to 64 bits */
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+    0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+    0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+    0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+    0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+    0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+    0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+    0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+    0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+    0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+    0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+    0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+    0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+    0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+    0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+    0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+    0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+    0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+    0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+    0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+    0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+    0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+
+static const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10_u64[] = {1ULL,
+                                     10ULL,
+                                     100ULL,
+                                     1000ULL,
+                                     10000ULL,
+                                     100000ULL,
+                                     1000000ULL,
+                                     10000000ULL,
+                                     100000000ULL,
+                                     1000000000ULL,
+                                     10000000000ULL,
+                                     100000000000ULL,
+                                     1000000000000ULL,
+                                     10000000000000ULL,
+                                     100000000000000ULL,
+                                     1000000000000000ULL,
+                                     10000000000000000ULL,
+                                     100000000000000000ULL,
+                                     1000000000000000000ULL,
+                                     10000000000000000000ULL};
+
+static inline diy_fp_t diy_fp(uint64_t f, int e) {
+  diy_fp_t r;
+  r.f = f;
+  r.e = e;
+  return r;
+}
+
+static inline diy_fp_t diy_fp_mul(diy_fp_t a, diy_fp_t b) {
+  const uint64_t m32 = 0xFFFFFFFFULL;
+  uint64_t ah = a.f >> 32, al = a.f & m32;
+  uint64_t bh = b.f >> 32, bl = b.f & m32;
+  uint64_t hh = ah * bh, lh = al * bh, hl = ah * bl, ll = al * bl;
+  uint64_t tmp = (ll >> 32) + (hl & m32) + (lh & m32);
+  tmp += 1ULL << 31; /* round */
+  return diy_fp(hh + (hl >> 32) + (lh >> 32) + (tmp >> 32), a.e + b.e + 64);
+}
+
+static inline diy_fp_t diy_fp_normalize(diy_fp_t a) {
+  int s = __builtin_clzll(a.f);
+  return diy_fp(a.f << s, a.e - s);
+}
+
+/* the boundaries of the interval of reals which round to v (v.f != 0) */
+static void normalized_boundaries(diy_fp_t v, diy_fp_t *minus,
+                                  diy_fp_t *plus) {
+  diy_fp_t pl = diy_fp((v.f << 1) + 1, v.e - 1);
+  while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+    pl.f <<= 1;
+    pl.e--;
+  }
+  pl.f <<= 64 - 52 - 2;
+  pl.e -= 64 - 52 - 2;
+  diy_fp_t mi = (v.f == DP_HIDDEN_BIT) ? diy_fp((v.f << 2) - 1, v.e - 2)
+                                       : diy_fp((v.f << 1) - 1, v.e - 1);
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  *minus = mi;
+  *plus = pl;
+}
+
+/* a power of ten which brings the exponent into [-60, -32] */
+static diy_fp_t cached_power(int e, int *k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0)
+    ik++;
+  unsigned index = (unsigned)((ik >> 3) + 1);
+  *k = -(-348 + (int)index * 8);
+  return diy_fp(cached_powers_f[index], cached_powers_e[index]);
+}
+
+static inline void grisu_round(char *buf, int len, uint64_t delta,
+                               uint64_t rest, uint64_t ten_kappa,
+                               uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static inline int u32_digits(uint32_t n) {
+  int d = 1;
+  while (d < 10 && n >= pow10_u64[d])
+    d++;
+  return d;
+}
+
+static int digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta, char *buf,
+                     int *k) {
+  const diy_fp_t one = diy_fp(1ULL << -mp.e, mp.e);
+  const uint64_t wp_w = mp.f - w.f;
+  uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = u32_digits(p1);
+  int len = 0;
+
+  while (kappa > 0) {
+    uint32_t pow = (uint32_t)pow10_u64[kappa - 1];
+    uint32_t d = p1 / pow;
+    p1 %= pow;
+    if (d || len)
+      buf[len++] = (char)('0' + d);
+    kappa--;
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      grisu_round(buf, len, delta, rest, pow10_u64[kappa] << -one.e, wp_w);
+      return len;
+    }
+  }
+
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = (char)(p2 >> -one.e);
+    if (d || len)
+      buf[len++] = (char)('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      int index = -kappa;
+      grisu_round(buf, len, delta, p2, one.f,
+                  wp_w * (index < 20 ? pow10_u64[index] : 0));
+      return len;
+    }
+  }
+}
+
+/* the digits of v (> 0) in buf, v is digits * 10^k */
+static int grisu2(double value, char *buf, int *k) {
+  uint64_t u;
+  memcpy(&u, &value, sizeof(u));
+  int biased_e = (int)((u >> 52) & 0x7FF);
+  uint64_t significand = u & DP_SIGNIFICAND_MASK;
+  diy_fp_t v = biased_e ? diy_fp(significand + DP_HIDDEN_BIT,
+                                 biased_e - DP_EXPONENT_BIAS)
+                        : diy_fp(significand, 1 - DP_EXPONENT_BIAS);
+  diy_fp_t w_m, w_p;
+  normalized_boundaries(v, &w_m, &w_p);
+  diy_fp_t c_mk = cached_power(w_p.e, k);
+  diy_fp_t w = diy_fp_mul(diy_fp_normalize(v), c_mk);
+  diy_fp_t wp = diy_fp_mul(w_p, c_mk);
+  diy_fp_t wm = diy_fp_mul(w_m, c_mk);
+  wm.f++;
+  wp.f--;
+  return digit_gen(w, wp, wp.f - wm.f, buf, k);
+}
+
+static size_t write_exponent(char *dst, int e) {
+  char *p = dst;
+  *p++ = 'e';
+  if (e < 0) {
+    *p++ = '-';
+    e = -e;
+  } else
+    *p++ = '+';
+  if (e >= 100) {
+    *p++ = (char)('0' + e / 100);
+    e %= 100;
+    memcpy(p, digit_pairs + e * 2, 2);
+    p += 2;
+  } else if (e >= 10) {
+    memcpy(p, digit_pairs + e * 2, 2);
+    p += 2;
+  } else
+    *p++ = (char)('0' + e);
+  return p - dst;
+}
+
+/* The layout follows JavaScript's Number to string: plain digits from 1e-6
+   up to 1e21, exponents outside of that (1e+21, 1.5e-7). */
+static size_t write_double(char *dst, double v) {
+  uint64_t u;
+  memcpy(&u, &v, sizeof(u));
+  char *p = dst;
+  if (u >> 63) {
+    *p++ = '-';
+    u &= ~(1ULL << 63);
+  }
+  if ((u >> 52) == 0x7FF) {
+    if (u & DP_SIGNIFICAND_MASK) {
+      memcpy(dst, "nan", 3);
+      return 3;
+    }
+    memcpy(p, "inf", 3);
+    return p + 3 - dst;
+  }
+  if (!u) {
+    *p = '0';
+    return p + 1 - dst;
+  }
+  memcpy(&v, &u, sizeof(v));
+
+  int k = 0;
+  int len = grisu2(v, p, &k);
+  int kk = len + k; /* 10^(kk-1) <= v < 10^kk */
+  if (k >= 0 && kk <= 21) {
+    /* 1234e7 -> 12340000000 */
+    memset(p + len, '0', k);
+    return p + kk - dst;
+  }
+  if (kk > 0 && kk <= 21) {
+    /* 1234e-2 -> 12.34 */
+    memmove(p + kk + 1, p + kk, len - kk);
+    p[kk] = '.';
+    return p + len + 1 - dst;
+  }
+  if (kk > -6 && kk <= 0) {
+    /* 1234e-6 -> 0.001234 */
+    int offset = 2 - kk;
+    memmove(p + offset, p, len);
+    p[0] = '0';
+    p[1] = '.';
+    memset(p + 2, '0', offset - 2);
+    return p + len + offset - dst;
+  }
+  if (len == 1) {
+    /* 1e30 */
+    return p + 1 + write_exponent(p + 1, kk - 1) - dst;
+  }
+  /* 1234e30 -> 1.234e+33 */
+  memmove(p + 2, p + 1, len - 1);
+  p[1] = '.';
+  return p + len + 1 + write_exponent(p + len + 1, kk - 1) - dst;
+}
+
+// -----------------------------------------------------------------------------
+// Escaping
+// -----------------------------------------------------------------------------
+/* the escaped length of each byte inside a JSON string */
+static inline size_t json_escaped_length(unsigned char ch) {
+  if (ch == '"' || ch == '\\')
+    return 2;
+  if (ch < 0x20)
+    return (ch == '\b' || ch == '\f' || ch == '\n' || ch == '\r' ||
+            ch == '\t')
+               ? 2
+               : 6;
+  return 1;
+}
+
+static size_t json_length(const char *s, size_t len) {
+  size_t n = 2;
+  for (size_t i = 0; i < len; i++)
+    n += json_escaped_length((unsigned char)s[i]);
+  return n;
+}
+
+static size_t write_json(char *dst, const char *s, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  char *p = dst;
+  *p++ = '"';
+  for (size_t i = 0; i < len; i++) {
+    unsigned char ch = (unsigned char)s[i];
+    if (json_escaped_length(ch) == 1) {
+      *p++ = (char)ch;
+      continue;
+    }
+    *p++ = '\\';
+    switch (ch) {
+    case '"':
+    case '\\':
+      *p++ = (char)ch;
+      break;
+    case '\b':
+      *p++ = 'b';
+      break;
+    case '\f':
+      *p++ = 'f';
+      break;
+    case '\n':
+      *p++ = 'n';
+      break;
+    case '\r':
+      *p++ = 'r';
+      break;
+    case '\t':
+      *p++ = 't';
+      break;
+    default:
+      memcpy(p, "u00", 3);
+      p[3] = hex[ch >> 4];
+      p[4] = hex[ch & 15];
+      p += 5;
+    }
+  }
+  *p++ = '"';
+  return p - dst;
+}
+
+/* RFC 4180: a field which has the delimiter, a quote or a line break is
+   quoted, and its quotes are doubled.  Returns 0 if it needs no quotes. */
+static size_t csv_length(const char *s, size_t len, char delim) {
+  size_t quotes = 0;
+  bool quote = false;
+  for (size_t i = 0; i < len; i++) {
+    char ch = s[i];
+    if (ch == '"')
+      quotes++;
+    else if (ch == delim || ch == '\n' || ch == '\r')
+      quote = true;
+  }
+  if (!quote && !quotes)
+    return 0;
+  return len + quotes + 2;
+}
+
+static size_t write_csv_quoted(char *dst, const char *s, size_t len) {
+  char *p = dst;
+  *p++ = '"';
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] == '"')
+      *p++ = '"';
+    *p++ = s[i];
+  }
+  *p++ = '"';
+  return p - dst;
+}
+
+// -----------------------------------------------------------------------------
+// Buffer appenders
+// -----------------------------------------------------------------------------
+/* reserve the widest result, write it, and give back what wasn't used */
+static inline char *buffer_reserve(aml_buffer_t *h, size_t max_len) {
+  return (char *)aml_buffer_append_ualloc(h, max_len);
+}
+
+static inline void buffer_commit(aml_buffer_t *h, size_t max_len, size_t n) {
+  h->length -= max_len - n;
+  h->data[h->length] = 0;
+}
+
+void aml_buffer_append_u64(aml_buffer_t *h, uint64_t v) {
+  buffer_commit(h, AML_FORMAT_U64,
+                write_u64(buffer_reserve(h, AML_FORMAT_U64), v));
+}
+
+void aml_buffer_append_i64(aml_buffer_t *h, int64_t v) {
+  buffer_commit(h, AML_FORMAT_I64,
+                write_i64(buffer_reserve(h, AML_FORMAT_I64), v));
+}
+
+void aml_buffer_append_hex(aml_buffer_t *h, uint64_t v) {
+  buffer_commit(h, AML_FORMAT_HEX,
+                write_hex(buffer_reserve(h, AML_FORMAT_HEX), v));
+}
+
+void aml_buffer_append_double(aml_buffer_t *h, double v) {
+  buffer_commit(h, AML_FORMAT_DOUBLE,
+                write_double(buffer_reserve(h, AML_FORMAT_DOUBLE), v));
+}
+
+void aml_buffer_append_json_string(aml_buffer_t *h, const char *s,
+                                   size_t len) {
+  size_t n = json_length(s, len);
+  write_json((char *)aml_buffer_append_ualloc(h, n), s, len);
+}
+
+void aml_buffer_append_csv_field(aml_buffer_t *h, const char *s, size_t len,
+                                 char delim) {
+  size_t n = csv_length(s, len, delim);
+  if (!n)
+    aml_buffer_append(h, s, len);
+  else
+    write_csv_quoted((char *)aml_buffer_append_ualloc(h, n), s, len);
+}
+
+// -----------------------------------------------------------------------------
+// Pool strings
+// -----------------------------------------------------------------------------
+/* The pool versions write at curp and then shrink the allocation to what
+   was written (see aml_pool_try_extend). */
+static inline char *pool_reserve(aml_pool_t *h, size_t max_len) {
+  return (char *)aml_pool_ualloc(h, max_len + 1);
+}
+
+static inline char *pool_commit(aml_pool_t *h, char *r, size_t max_len,
+                                size_t n) {
+  r[n] = 0;
+  aml_pool_try_extend(h, r, max_len + 1, n + 1);
+  return r;
+}
+
+char *aml_pool_u64(aml_pool_t *h, uint64_t v) {
+  char *r = pool_reserve(h, AML_FORMAT_U64);
+  return pool_commit(h, r, AML_FORMAT_U64, write_u64(r, v));
+}
+
+char *aml_pool_i64(aml_pool_t *h, int64_t v) {
+  char *r = pool_reserve(h, AML_FORMAT_I64);
+  return pool_commit(h, r, AML_FORMAT_I64, write_i64(r, v));
+}
+
+char *aml_pool_hex(aml_pool_t *h, uint64_t v) {
+  char *r = pool_reserve(h, AML_FORMAT_HEX);
+  return pool_commit(h, r, AML_FORMAT_HEX, write_hex(r, v));
+}
+
+char *aml_pool_double(aml_pool_t *h, double v) {
+  char *r = pool_reserve(h, AML_FORMAT_DOUBLE);
+  return pool_commit(h, r, AML_FORMAT_DOUBLE, write_double(r, v));
+}
+
+char *aml_pool_json_string(aml_pool_t *h, const char *s, size_t len) {
+  size_t n = json_length(s, len);
+  char *r = pool_reserve(h, n);
+  write_json(r, s, len);
+  r[n] = 0;
+  return r;
+}
+
+char *aml_pool_csv_field(aml_pool_t *h, const char *s, size_t len,
+                         char delim) {
+  size_t n = csv_length(s, len, delim);
+  if (!n)
+    return aml_pool_strndup(h, s, len);
+  char *r = pool_reserve(h, n);
+  write_csv_quoted(r, s, len);
+  r[n] = 0;
+  return r;
+}
@@ -0,0 +1,217 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_idle.h"
+#include "a-memory-library/aml_alloc.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* The owner moves an entry between ACTIVE and PARKED.  aml_idle_release
+   takes a PARKED entry to TRIMMING and back, which is what keeps it from
+   trimming an object its owner is using. */
+#define AML_IDLE_ACTIVE 0
+#define AML_IDLE_PARKED 1
+#define AML_IDLE_TRIMMING 2
+
+struct aml_idle_s {
+  aml_pool_t *pool;
+  aml_buffer_t *buffer;
+  size_t keep_bytes;
+  int state; /* accessed atomically */
+  /* set by the owner before parking */
+  uint64_t parked_at;
+  /* set while trimming, cleared by the owner when it parks (accessed
+     atomically, aml_idle_trimmed reads it without owning the entry) */
+  bool trimmed;
+  struct aml_idle_s *next;
+  struct aml_idle_s *prev;
+};
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static aml_idle_t *idle_head = NULL;
+static size_t idle_count = 0;
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static aml_idle_t *idle_add(aml_pool_t *pool, aml_buffer_t *buffer,
+                            size_t keep_bytes) {
+  aml_idle_t *e = (aml_idle_t *)aml_zalloc(sizeof(*e));
+  e->pool = pool;
+  e->buffer = buffer;
+  e->keep_bytes = keep_bytes;
+  e->state = AML_IDLE_ACTIVE;
+  pthread_mutex_lock(&idle_lock);
+  e->next = idle_head;
+  if (idle_head)
+    idle_head->prev = e;
+  idle_head = e;
+  idle_count++;
+  pthread_mutex_unlock(&idle_lock);
+  return e;
+}
+
+aml_idle_t *aml_idle_add_pool(aml_pool_t *pool, size_t keep_bytes) {
+  return idle_add(pool, NULL, keep_bytes);
+}
+
+aml_idle_t *aml_idle_add_buffer(aml_buffer_t *buffer, size_t keep_bytes) {
+  return idle_add(NULL, buffer, keep_bytes);
+}
+
+void aml_idle_remove(aml_idle_t *e) {
+  if (!e)
+    return;
+  /* a walk holds the lock, so the entry isn't being trimmed */
+  pthread_mutex_lock(&idle_lock);
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    idle_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  idle_count--;
+  pthread_mutex_unlock(&idle_lock);
+  aml_free(e);
+}
+
+void aml_idle_park(aml_idle_t *e) {
+  e->parked_at = now_ms();
+  __atomic_store_n(&e->trimmed, false, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->state, AML_IDLE_PARKED, __ATOMIC_RELEASE);
+}
+
+void aml_idle_unpark(aml_idle_t *e) {
+  for (;;) {
+    int expected = AML_IDLE_PARKED;
+    if (__atomic_compare_exchange_n(&e->state, &expected, AML_IDLE_ACTIVE,
+                                    false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED) ||
+        expected == AML_IDLE_ACTIVE)
+      return;
+    /* a trim is running, it is short */
+    sched_yield();
+  }
+}
+
+static size_t idle_trim(aml_idle_t *e) {
+  if (e->pool)
+    return aml_pool_trim(e->pool, e->keep_bytes);
+  return aml_buffer_trim(e->buffer, e->keep_bytes);
+}
+
+size_t aml_idle_release(uint64_t idle_ms) {
+  size_t released = 0;
+  uint64_t now = now_ms();
+  pthread_mutex_lock(&idle_lock);
+  for (aml_idle_t *e = idle_head; e; e = e->next) {
+    if (__atomic_load_n(&e->state, __ATOMIC_RELAXED) != AML_IDLE_PARKED)
+      continue;
+    int expected = AML_IDLE_PARKED;
+    if (!__atomic_compare_exchange_n(&e->state, &expected, AML_IDLE_TRIMMING,
+                                     false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED))
+      continue; /* the owner just took it back */
+    /* the owner only writes these while the entry is ACTIVE */
+    if (!e->trimmed && now - e->parked_at >= idle_ms) {
+      released += idle_trim(e);
+      __atomic_store_n(&e->trimmed, true, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&e->state, AML_IDLE_PARKED, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&idle_lock);
+  return released;
+}
+
+size_t aml_idle_count(void) {
+  pthread_mutex_lock(&idle_lock);
+  size_t n = idle_count;
+  pthread_mutex_unlock(&idle_lock);
+  return n;
+}
+
+size_t aml_idle_trimmed(void) {
+  size_t n = 0;
+  pthread_mutex_lock(&idle_lock);
+  for (aml_idle_t *e = idle_head; e; e = e->next)
+    if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == AML_IDLE_PARKED &&
+        __atomic_load_n(&e->trimmed, __ATOMIC_RELAXED))
+      n++;
+  pthread_mutex_unlock(&idle_lock);
+  return n;
+}
+
+/* ---- the background thread ---- */
+
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_cond;
+static pthread_t thread;
+static bool running = false;
+static bool stopping = false;
+static uint64_t thread_idle_ms, thread_period_ms;
+
+static void *idle_thread(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&thread_lock);
+  while (!stopping) {
+    uint64_t idle_ms = thread_idle_ms;
+    pthread_mutex_unlock(&thread_lock);
+    aml_idle_release(idle_ms);
+    pthread_mutex_lock(&thread_lock);
+    if (stopping)
+      break;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = ts.tv_nsec + (thread_period_ms % 1000) * 1000000;
+    ts.tv_sec += thread_period_ms / 1000 + ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    pthread_cond_timedwait(&thread_cond, &thread_lock, &ts);
+  }
+  pthread_mutex_unlock(&thread_lock);
+  return NULL;
+}
+
+bool aml_idle_start(uint64_t idle_ms, uint64_t period_ms) {
+  pthread_mutex_lock(&thread_lock);
+  thread_idle_ms = idle_ms;
+  thread_period_ms = period_ms ? period_ms : 1;
+  bool ok = true;
+  if (!running) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&thread_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    stopping = false;
+    ok = !pthread_create(&thread, NULL, idle_thread, NULL);
+    running = ok;
+    if (!ok)
+      pthread_cond_destroy(&thread_cond);
+  } else
+    pthread_cond_signal(&thread_cond);
+  pthread_mutex_unlock(&thread_lock);
+  return ok;
+}
+
+void aml_idle_stop(void) {
+  pthread_mutex_lock(&thread_lock);
+  if (!running) {
+    pthread_mutex_unlock(&thread_lock);
+    return;
+  }
+  stopping = true;
+  pthread_cond_signal(&thread_cond);
+  pthread_mutex_unlock(&thread_lock);
+  pthread_join(thread, NULL);
+  pthread_mutex_lock(&thread_lock);
+  running = false;
+  pthread_cond_destroy(&thread_cond);
+  pthread_mutex_unlock(&thread_lock);
+}
@@ -0,0 +1,192 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_buffer.h"
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_rope.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* the most iovecs passed to one writev */
+#define AML_IO_MAX_IOV 64
+
+/* the bytes left to read from fd, or 0 if that isn't known */
+static size_t remaining_bytes(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+    return 0;
+  off_t pos = lseek(fd, 0, SEEK_CUR);
+  if (pos < 0 || st.st_size <= pos)
+    return 0;
+  return (size_t)(st.st_size - pos);
+}
+
+bool aml_buffer_append_fd(aml_buffer_t *h, int fd) {
+  size_t remaining = remaining_bytes(fd);
+  if (remaining)
+    /* one more byte so that the read which sees the end doesn't grow it */
+    aml_buffer_reserve(h, h->length + remaining + 1);
+  else if (h->size - h->length < AML_BUFFER_READ_SIZE)
+    _aml_buffer_grow(h, h->length + AML_BUFFER_READ_SIZE);
+
+  bool ok = true;
+  for (;;) {
+    if (h->length == h->size)
+      _aml_buffer_grow(h, h->length + AML_BUFFER_READ_SIZE);
+    ssize_t n = read(fd, h->data + h->length, h->size - h->length);
+    if (n > 0)
+      h->length += n;
+    else if (!n)
+      break;
+    else if (errno != EINTR) {
+      ok = false;
+      break;
+    }
+  }
+  h->data[h->length] = 0;
+#ifdef _AML_DEBUG_
+  if (h->length > h->max_length)
+    h->max_length = h->length;
+#endif
+  return ok;
+}
+
+ssize_t aml_buffer_read_fd(aml_buffer_t *h, int fd, size_t max) {
+  if (h->size - h->length < max)
+    _aml_buffer_grow(h, h->length + max);
+  ssize_t n;
+  do {
+    n = read(fd, h->data + h->length, max);
+  } while (n < 0 && errno == EINTR);
+  if (n > 0)
+    h->length += n;
+  h->data[h->length] = 0;
+#ifdef _AML_DEBUG_
+  if (h->length > h->max_length)
+    h->max_length = h->length;
+#endif
+  return n;
+}
+
+bool aml_buffer_append_file(aml_buffer_t *h, const char *filename) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool ok = aml_buffer_append_fd(h, fd);
+  close(fd);
+  return ok;
+}
+
+static bool write_all(int fd, const char *p, size_t len) {
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool aml_buffer_write_fd(aml_buffer_t *h, int fd) {
+  return write_all(fd, h->data, h->length);
+}
+
+bool aml_rope_write_fd(aml_rope_t *h, int fd) {
+  struct iovec iov[AML_IO_MAX_IOV];
+  aml_rope_segment_t *s = h->head;
+  size_t offset = 0; /* bytes of s which were already written */
+  for (;;) {
+    /* gather up to AML_IO_MAX_IOV segments starting at s + offset */
+    int n = 0;
+    for (aml_rope_segment_t *t = s; n < AML_IO_MAX_IOV; t = t->next) {
+      size_t skip = t == s ? offset : 0;
+      if (t->length > skip) {
+        iov[n].iov_base = _aml_rope_segment_data(t) + skip;
+        iov[n].iov_len = t->length - skip;
+        n++;
+      }
+      if (t == h->tail)
+        break;
+    }
+    if (!n)
+      return true;
+    ssize_t w = writev(fd, iov, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    /* move past what was written, which may end inside a segment */
+    size_t left = (size_t)w;
+    for (;;) {
+      size_t avail = s->length - offset;
+      if (left < avail || s == h->tail) {
+        offset += left;
+        break;
+      }
+      left -= avail;
+      offset = 0;
+      s = s->next;
+    }
+  }
+}
+
+typedef struct {
+  void *addr;
+  size_t length;
+} pool_mapping_t;
+
+static void unmap_file(void *arg) {
+  pool_mapping_t *m = (pool_mapping_t *)arg;
+  munmap(m->addr, m->length);
+  aml_free(m);
+}
+
+const void *aml_pool_load_file(aml_pool_t *h, const char *filename,
+                               size_t *len) {
+  *len = 0;
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+      st.st_size >= AML_POOL_MMAP_FILE_MIN) {
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      close(fd);
+      pool_mapping_t *m =
+          (pool_mapping_t *)_aml_malloc_for(h->caller, sizeof(*m));
+      m->addr = addr;
+      m->length = st.st_size;
+      aml_pool_add_cleanup(h, unmap_file, m);
+      *len = st.st_size;
+      return addr;
+    }
+  }
+
+  /* read it into the pool, growing in place where it can */
+  aml_buffer_t *b = aml_buffer_pool_init(h, AML_BUFFER_READ_SIZE);
+  bool ok = aml_buffer_append_fd(b, fd);
+  close(fd);
+  if (!ok)
+    return NULL;
+  *len = aml_buffer_length(b);
+  return aml_buffer_data(b);
+}
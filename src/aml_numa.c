@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+#define AML_NUMA_SYSCALLS
+
+/* from <linux/mempolicy.h>, which isn't always installed */
+#define AML_MPOL_DEFAULT 0
+#define AML_MPOL_PREFERRED 1
+#define AML_MPOL_MF_MOVE (1 << 1)
+#define AML_MPOL_F_NODE (1 << 0)
+#define AML_MPOL_F_ADDR (1 << 1)
+#endif
+
+static size_t page_size(void) {
+  static size_t size = 0;
+  if (!size)
+    size = (size_t)sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+int aml_numa_current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+    return (int)node;
+#endif
+  return -1;
+}
+
+int aml_numa_node_count(void) {
+  static int count = 0;
+  if (count)
+    return count;
+  int n = 1;
+#ifdef __linux__
+  /* a list of ranges like "0-1,3", the count is one past the highest */
+  FILE *f = fopen("/sys/devices/system/node/online", "r");
+  char buf[256];
+  if (f) {
+    if (fgets(buf, sizeof(buf), f)) {
+      char *s = buf, *e;
+      for (;;) {
+        long v = strtol(s, &e, 10);
+        if (e == s)
+          break;
+        if (v >= n)
+          n = (int)v + 1;
+        if (*e != '-' && *e != ',')
+          break;
+        s = e + 1;
+      }
+    }
+    fclose(f);
+  }
+#endif
+  count = n;
+  return n;
+}
+
+int aml_numa_node_of(const void *p) {
+#ifdef AML_NUMA_SYSCALLS
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, NULL, 0UL, p,
+              AML_MPOL_F_NODE | AML_MPOL_F_ADDR) == 0)
+    return node;
+#else
+  (void)p;
+#endif
+  return -1;
+}
+
+bool aml_numa_bind(void *p, size_t len, int node) {
+#ifdef AML_NUMA_SYSCALLS
+  if (node == AML_NUMA_LOCAL)
+    node = aml_numa_current_node();
+  if (node == AML_NUMA_NONE)
+    return syscall(SYS_mbind, p, len, AML_MPOL_DEFAULT, NULL, 0UL, 0U) == 0;
+  if (node < 0 || node >= AML_NUMA_MAX_NODES)
+    return false;
+  unsigned long mask = 1UL << node;
+  /* the kernel reads one bit fewer than maxnode */
+  return syscall(SYS_mbind, p, len, AML_MPOL_PREFERRED, &mask,
+                 (unsigned long)AML_NUMA_MAX_NODES + 1, AML_MPOL_MF_MOVE) == 0;
+#else
+  (void)p;
+  (void)len;
+  (void)node;
+  return false;
+#endif
+}
+
+void *aml_numa_alloc(size_t *len, int node) {
+  size_t bytes = (*len + page_size() - 1) & ~(page_size() - 1);
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    abort();
+  /* nothing has been touched yet, so this is only a policy */
+  if (node != AML_NUMA_NONE)
+    aml_numa_bind(p, bytes, node);
+  *len = bytes;
+  return p;
+}
+
+void aml_numa_free(void *p, size_t len) { munmap(p, len); }
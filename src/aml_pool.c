@@ -4,13 +4,94 @@
 
 #include "a-memory-library/aml_alloc.h"
 #include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_pool_cache.h"
+#include "a-memory-library/aml_numa.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#ifdef _AML_POOL_STATS_
+#include <pthread.h>
+#endif
 
 // #ifndef _AML_USE_MALLOC_
 // #define _AML_USE_MALLOC_
 // #endif
 
+/* The state of an mmap backed pool.  The first node lives at the start of
+   the reservation and its endp marks how much has been committed. */
+typedef struct aml_pool_mmap_s {
+  char *base;
+  size_t reserved;
+  size_t page_size;
+  size_t commit_size;
+  size_t retain_size;
+  uint32_t flags;
+} aml_pool_mmap_t;
+
+#define AML_POOL_DEFAULT_COMMIT_SIZE (1024 * 1024)
+#define AML_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static inline size_t round_up(size_t v, size_t m) {
+  return ((v + m - 1) / m) * m;
+}
+
+#ifdef _AML_POOL_STATS_
+/* the registry of live (top level) pools */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static aml_pool_t *stats_head = NULL;
+
+static void stats_register(aml_pool_t *h, size_t initial_size) {
+  memset(&h->stats, 0, sizeof(h->stats));
+  h->stats.initial_size = initial_size;
+  h->stats_prev = NULL;
+  pthread_mutex_lock(&stats_lock);
+  h->stats_next = stats_head;
+  if (stats_head)
+    stats_head->stats_prev = h;
+  stats_head = h;
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_unregister(aml_pool_t *h) {
+  pthread_mutex_lock(&stats_lock);
+  if (h->stats_prev)
+    h->stats_prev->stats_next = h->stats_next;
+  else
+    stats_head = h->stats_next;
+  if (h->stats_next)
+    h->stats_next->stats_prev = h->stats_prev;
+  pthread_mutex_unlock(&stats_lock);
+}
+#endif
+
+bool aml_pool_stats(aml_pool_t *h, aml_pool_stats_t *out) {
+#ifdef _AML_POOL_STATS_
+  *out = h->stats;
+  out->used = h->used;
+  return true;
+#else
+  (void)h;
+  memset(out, 0, sizeof(*out));
+  return false;
+#endif
+}
+
+void aml_pool_stats_foreach(aml_pool_stats_cb cb, void *arg) {
+#ifdef _AML_POOL_STATS_
+  pthread_mutex_lock(&stats_lock);
+  for (aml_pool_t *h = stats_head; h; h = h->stats_next) {
+    aml_pool_stats_t st;
+    aml_pool_stats(h, &st);
+    cb(arg, h, &st);
+  }
+  pthread_mutex_unlock(&stats_lock);
+#else
+  (void)cb;
+  (void)arg;
+#endif
+}
+
 size_t aml_pool_size(aml_pool_t *h) {
   return h->size + (h->current->endp - h->curp);
 }
@@ -23,6 +104,44 @@ void aml_pool_set_minimum_growth_size(aml_pool_t *h, size_t size) {
   h->minimum_growth_size = size;
 }
 
+#define AML_POOL_GROWTH_FIXED 0
+#define AML_POOL_GROWTH_GEOMETRIC 1
+#define AML_POOL_GROWTH_CALLBACK 2
+
+void aml_pool_set_fixed_growth(aml_pool_t *h) {
+  h->growth_policy = AML_POOL_GROWTH_FIXED;
+}
+
+void aml_pool_set_geometric_growth(aml_pool_t *h, size_t max_block_size) {
+  h->growth_policy = AML_POOL_GROWTH_GEOMETRIC;
+  h->max_growth_size = max_block_size;
+}
+
+void aml_pool_set_growth_callback(aml_pool_t *h, aml_pool_growth_cb cb,
+                                  void *arg) {
+  if (!cb)
+    abort(); /* use aml_pool_set_fixed_growth */
+  h->growth_policy = AML_POOL_GROWTH_CALLBACK;
+  h->growth_cb = cb;
+  h->growth_arg = arg;
+}
+
+/* the size of the next growth block according to the growth policy */
+static size_t next_block_size(aml_pool_t *h, size_t len) {
+  size_t block_size = h->minimum_growth_size;
+  if (h->growth_policy == AML_POOL_GROWTH_GEOMETRIC) {
+    if (h->growth_size > block_size / 2)
+      block_size = h->growth_size * 2;
+    if (h->max_growth_size && block_size > h->max_growth_size)
+      block_size = h->max_growth_size;
+  } else if (h->growth_policy == AML_POOL_GROWTH_CALLBACK) {
+    size_t r = h->growth_cb(h->growth_arg, len, h->growth_size);
+    if (r)
+      block_size = r;
+  }
+  return block_size;
+}
+
 #ifdef _AML_DEBUG_
 static void dump_pool(FILE *out, const char *caller, void *p, size_t length) {
   aml_pool_t *pool = (aml_pool_t *)p;
@@ -31,6 +150,8 @@ static void dump_pool(FILE *out, const char *caller, void *p, size_t length) {
           pool->used);
 }
 
+aml_pool_t *_aml_pool_init(size_t initial_size, const char *caller) {
+#elif defined(_AML_SAMPLING_)
 aml_pool_t *_aml_pool_init(size_t initial_size, const char *caller) {
 #else
 aml_pool_t *_aml_pool_init(size_t initial_size) {
@@ -50,13 +171,13 @@ aml_pool_t *_aml_pool_init(size_t initial_size) {
   /* If the initial_size is an even multiple of 4096, then reduce the block size
    so that the actual memory allocated via the system malloc is 4096 bytes. */
   size_t block_size = initial_size;
-  if ((block_size & 4096) == 0)
+  if ((block_size & 4095) == 0)
     block_size -= (sizeof(aml_pool_t) + sizeof(aml_pool_node_t));
 
   aml_pool_t *h;
 #ifdef _AML_DEBUG_
 #ifdef _AML_USE_MALLOC_
-  h = (aml_pool_t *)malloc(block_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t));
+  h = (aml_pool_t *)_aml_alloc_backend.malloc_fn(block_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t));
 #else
   h = (aml_pool_t *)_aml_malloc_d(
       caller, block_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t),
@@ -69,27 +190,202 @@ aml_pool_t *_aml_pool_init(size_t initial_size) {
   h->max_size = 0;
 #else
 #ifdef _AML_USE_MALLOC_
-    h = (aml_pool_t *)malloc(block_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t));
+    h = (aml_pool_t *)_aml_alloc_backend.malloc_fn(block_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t));
 #else
-    h = (aml_pool_t *)aml_malloc(block_size + sizeof(aml_pool_t) +
-                                 sizeof(aml_pool_node_t));
+    h = (aml_pool_t *)_aml_malloc_for(caller, block_size + sizeof(aml_pool_t) +
+                                      sizeof(aml_pool_node_t));
 #endif
   memset(h, 0, sizeof(aml_pool_t) + sizeof(aml_pool_node_t));
+#endif
+#ifdef _AML_SAMPLING_
+  h->caller = caller;
 #endif
   if (!h) /* what else might we do? */
     abort();
-  h->used = initial_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t);
+  h->used = block_size + sizeof(aml_pool_t) + sizeof(aml_pool_node_t);
   h->size = 0;
   h->pool = NULL;
   h->current = (aml_pool_node_t *)(h + 1);
   h->curp = (char *)(h->current + 1);
   h->current->endp = h->curp + block_size;
   h->current->prev = NULL;
+  h->zero_mark = h->current->endp;
+  h->mmap = NULL;
+#ifdef _AML_POOL_STATS_
+  stats_register(h, initial_size);
+#endif
 
   aml_pool_set_minimum_growth_size(h, initial_size);
   return h;
 }
 
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+aml_pool_t *_aml_pool_init_ex(size_t initial_size,
+                              const aml_pool_options_t *opts,
+                              const char *caller) {
+  if (!opts || (!opts->reserve_size && !(opts->flags & AML_POOL_NUMA)))
+    return _aml_pool_init(initial_size, caller);
+#else
+aml_pool_t *_aml_pool_init_ex(size_t initial_size,
+                              const aml_pool_options_t *opts) {
+  if (!opts || (!opts->reserve_size && !(opts->flags & AML_POOL_NUMA)))
+    return _aml_pool_init(initial_size);
+#endif
+  if (initial_size == 0)
+    abort(); /* this doesn't make any sense */
+  initial_size += ((sizeof(size_t) - (initial_size & (sizeof(size_t) - 1))) &
+                   (sizeof(size_t) - 1));
+
+  /* Reserve the address space without committing it.  Pages are committed
+     by _aml_pool_alloc_grow as curp advances. */
+  int map_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t reserve_size = opts->reserve_size;
+  if (!reserve_size)
+    reserve_size = sizeof(aml_pool_node_t) + initial_size + 1;
+  size_t reserved = 0;
+  char *base = (char *)MAP_FAILED;
+#ifdef MAP_HUGETLB
+  /* Huge pages are reserved up front (no MAP_NORESERVE) so that the mmap
+     fails, rather than faulting later, if there aren't enough of them. */
+  if (opts->flags & AML_POOL_HUGETLB) {
+    reserved = round_up(reserve_size, AML_POOL_HUGE_PAGE_SIZE);
+    base = (char *)mmap(NULL, reserved, PROT_NONE, map_flags | MAP_HUGETLB,
+                        -1, 0);
+    if (base != (char *)MAP_FAILED)
+      page_size = AML_POOL_HUGE_PAGE_SIZE;
+  }
+#endif
+  if (base == (char *)MAP_FAILED) {
+#ifdef MAP_NORESERVE
+    map_flags |= MAP_NORESERVE;
+#endif
+    reserved = round_up(reserve_size, page_size);
+    base = (char *)mmap(NULL, reserved, PROT_NONE, map_flags, -1, 0);
+  }
+  if (base == (char *)MAP_FAILED) /* what else might we do? */
+    abort();
+  /* a specific node is a policy on the whole reservation.  For
+     AML_NUMA_LOCAL, pages already land on the node of the thread which
+     first touches them. */
+  if ((opts->flags & AML_POOL_NUMA) && opts->numa_node >= 0)
+    aml_numa_bind(base, reserved, opts->numa_node);
+#ifdef MADV_HUGEPAGE
+  if (opts->flags & AML_POOL_HUGEPAGE)
+    madvise(base, reserved, MADV_HUGEPAGE);
+#endif
+
+  size_t commit_size = opts->commit_size ? opts->commit_size
+                                         : AML_POOL_DEFAULT_COMMIT_SIZE;
+  commit_size = round_up(commit_size, page_size);
+  size_t committed = round_up(sizeof(aml_pool_node_t) + initial_size + 1,
+                              commit_size);
+  if (committed > reserved)
+    committed = reserved;
+  if (mprotect(base, committed, PROT_READ | PROT_WRITE))
+    abort();
+
+  /* The handle lives on the heap so that it can be tracked like any other
+     pool in debug builds. */
+  aml_pool_t *h;
+#ifdef _AML_DEBUG_
+  h = (aml_pool_t *)_aml_malloc_d(
+      caller, sizeof(aml_pool_t) + sizeof(aml_pool_mmap_t), true);
+  memset(h, 0, sizeof(aml_pool_t) + sizeof(aml_pool_mmap_t));
+  h->dump.dump = dump_pool;
+  h->initial_size = initial_size;
+#else
+  h = (aml_pool_t *)_aml_malloc_for(caller,
+                                    sizeof(aml_pool_t) + sizeof(aml_pool_mmap_t));
+  if (!h)
+    abort();
+  memset(h, 0, sizeof(aml_pool_t) + sizeof(aml_pool_mmap_t));
+#endif
+#ifdef _AML_SAMPLING_
+  h->caller = caller;
+#endif
+  aml_pool_mmap_t *m = (aml_pool_mmap_t *)(h + 1);
+  m->base = base;
+  m->reserved = reserved;
+  m->page_size = page_size;
+  m->commit_size = commit_size;
+  m->retain_size = opts->retain_size;
+  m->flags = opts->flags;
+
+  if (opts->flags & AML_POOL_NUMA) {
+    h->numa = true;
+    h->numa_node = opts->numa_node;
+  }
+  h->mmap = m;
+  h->pool = NULL;
+  h->size = 0;
+  h->used = committed + sizeof(aml_pool_t) + sizeof(aml_pool_mmap_t);
+  h->current = (aml_pool_node_t *)base;
+  h->current->endp = base + committed;
+  h->current->prev = NULL;
+  h->curp = (char *)(h->current + 1);
+  /* fresh pages from mmap are zero */
+  h->zero_mark = h->curp;
+#ifdef _AML_POOL_STATS_
+  stats_register(h, initial_size);
+#endif
+
+  aml_pool_set_minimum_growth_size(h, initial_size);
+  return h;
+}
+
+/* Commit more of the reservation so that len bytes fit after curp.  Returns
+   NULL if the reservation is exhausted. */
+static void *pool_mmap_extend(aml_pool_t *h, size_t alignment, size_t len) {
+  aml_pool_mmap_t *m = h->mmap;
+  char *endp = h->current->endp;
+  if (alignment < sizeof(size_t))
+    alignment = sizeof(size_t);
+  char *r = (char *)(((uintptr_t)h->curp + alignment - 1) &
+                     ~(uintptr_t)(alignment - 1));
+  if (r >= m->base + m->reserved || len >= (size_t)((m->base + m->reserved) - r))
+    return NULL;
+
+  size_t need = (size_t)((r + len + 1) - endp);
+  char *new_endp = endp + round_up(need, m->commit_size);
+  if (new_endp > m->base + m->reserved)
+    new_endp = m->base + m->reserved;
+  if (mprotect(endp, new_endp - endp, PROT_READ | PROT_WRITE))
+    return NULL;
+
+  h->used += new_endp - endp;
+  h->current->endp = new_endp;
+  _aml_pool_stats_alloc(h, len, r - h->curp);
+#ifdef _AML_DEBUG_
+  h->cur_size += (r - h->curp) + len;
+  if (h->cur_size > h->max_size)
+    h->max_size = h->cur_size;
+#endif
+  h->curp = r + len;
+  return r;
+}
+
+/* Give the pages beyond retain_size back to the kernel.  dirty is the
+   highest address which may have been written. */
+static void pool_mmap_release(aml_pool_t *h, char *dirty) {
+  aml_pool_mmap_t *m = h->mmap;
+  if (!(m->flags & (AML_POOL_CLEAR_DONTNEED | AML_POOL_CLEAR_FREE)))
+    return;
+  char *start = m->base + round_up(sizeof(aml_pool_node_t) + m->retain_size,
+                                   m->page_size);
+  char *end = m->base + round_up(dirty - m->base, m->page_size);
+  if (end <= start)
+    return;
+#ifdef MADV_FREE
+  if (!(m->flags & AML_POOL_CLEAR_DONTNEED)) {
+    madvise(start, end - start, MADV_FREE);
+    return;
+  }
+#endif
+  if (!madvise(start, end - start, MADV_DONTNEED))
+    h->zero_mark = start;
+}
+
 
 
 aml_pool_t *aml_pool_pool_init(aml_pool_t *pool, size_t initial_size) {
@@ -111,29 +407,292 @@ aml_pool_t *aml_pool_pool_init(aml_pool_t *pool, size_t initial_size) {
   h->curp = (char *)(h->current + 1);
   h->current->endp = h->curp + block_size;
   h->current->prev = NULL;
+  h->zero_mark = h->current->endp;
   h->pool = pool;
+  h->mmap = NULL;
+  h->large = NULL;
+  h->adapt = NULL;
+  h->cleanup = NULL;
+  h->spares = NULL;
+  h->numa = false;
+  h->loan = NULL;
+  h->intern = NULL;
+  h->intern_count = 0;
+  h->growth_policy = AML_POOL_GROWTH_FIXED;
+  h->growth_size = 0;
+  h->max_growth_size = 0;
+  h->growth_cb = NULL;
+  h->growth_arg = NULL;
+#ifdef _AML_SAMPLING_
+  h->caller = pool->caller;
+#endif
+#ifdef _AML_POOL_STATS_
+  /* sub-pools live in their parent's memory, so they aren't registered */
+  memset(&h->stats, 0, sizeof(h->stats));
+  h->stats.initial_size = initial_size;
+  h->stats_next = h->stats_prev = NULL;
+#endif
   aml_pool_set_minimum_growth_size(h, initial_size);
   return h;
 }
 
 
-void aml_pool_clear(aml_pool_t *h) {
-  /* remove the extra blocks (the ones where prev != NULL) */
-  aml_pool_node_t *prev = h->current->prev;
-  while (prev) {
-    if(!h->pool) {
+/* the spare block which best fits *alloc_size bytes (including the node),
+   *alloc_size is set to the size of the block */
+static aml_pool_node_t *spares_take(aml_pool_spares_t *s, size_t *alloc_size) {
+  aml_pool_node_t **best = NULL;
+  size_t best_size = SIZE_MAX;
+  for (aml_pool_node_t **p = &s->head; *p; p = &(*p)->prev) {
+    size_t bytes = (*p)->endp - (char *)*p;
+    if (bytes >= *alloc_size && bytes < best_size) {
+      best = p;
+      best_size = bytes;
+      if (bytes == *alloc_size)
+        break;
+    }
+  }
+  if (!best) {
+    s->misses++;
+    return NULL;
+  }
+  aml_pool_node_t *node = *best;
+  *best = node->prev;
+  s->blocks--;
+  s->bytes -= best_size;
+  s->reused++;
+  *alloc_size = best_size;
+  return node;
+}
+
+static bool spares_put(aml_pool_spares_t *s, aml_pool_node_t *node) {
+  size_t bytes = node->endp - (char *)node;
+  if (bytes > s->max_bytes - s->bytes)
+    return false;
+  node->prev = s->head;
+  s->head = node;
+  s->blocks++;
+  s->bytes += bytes;
+  return true;
+}
+
+static void free_block(aml_pool_node_t *node) {
 #ifdef _AML_USE_MALLOC_
-        free(h->current);
+  _aml_alloc_backend.free_fn(node);
 #else
-        aml_free(h->current);
+  /* the block is parked in the recycled block cache if it is enabled */
+  if (!_aml_pool_cache_release(node, node->endp - (char *)node))
+    aml_free(node);
 #endif
-    }
-    h->current = prev;
-    prev = prev->prev;
+}
+
+void _aml_pool_spares_trim(aml_pool_spares_t *s, size_t max_bytes) {
+  while (s->head && s->bytes > max_bytes) {
+    aml_pool_node_t *node = s->head;
+    s->head = node->prev;
+    s->blocks--;
+    s->bytes -= node->endp - (char *)node;
+    free_block(node);
   }
+}
+
+/* the node a NUMA pool's next block goes to */
+static inline int pool_numa_node(aml_pool_t *h) {
+  return h->numa_node == AML_NUMA_LOCAL ? aml_numa_current_node()
+                                        : h->numa_node;
+}
 
+/* the node a freed block of a NUMA pool is cached under.  A block of an
+   AML_NUMA_LOCAL pool was bound to the node of the thread which grew the
+   pool, which the (always touched) header page still reports. */
+static inline int block_numa_node(aml_pool_t *h, aml_pool_node_t *node) {
+  if (h->numa_node != AML_NUMA_LOCAL)
+    return h->numa_node;
+  int n = aml_numa_node_of(node);
+  return n >= 0 ? n : pool_numa_node(h);
+}
+
+void _aml_pool_free_node(aml_pool_t *h, aml_pool_node_t *node) {
+  if (h->pool)
+    return;
+  if (h->numa) {
+    /* the blocks of a NUMA pool are mappings, cached with their node */
+    size_t len = node->endp - (char *)node;
+    if (!_aml_pool_cache_release_node(node, len, block_numa_node(h, node)))
+      aml_numa_free(node, len);
+    return;
+  }
+  if (h->spares && spares_put(h->spares, node))
+    return;
+  free_block(node);
+}
+
+/* Adaptive sizing (see aml_pool_set_adaptive).  The peak of each of the last
+   AML_POOL_ADAPT_WINDOW cycles is kept. */
+#define AML_POOL_ADAPT_WINDOW 100
+/* the number of cycles in the window which must have overflowed the primary
+   block before it is grown */
+#define AML_POOL_ADAPT_OVERFLOWS 4
+
+typedef struct aml_pool_adapt_s {
+  size_t max_size;
+  uint32_t num;
+  uint32_t pos;
+  size_t peaks[AML_POOL_ADAPT_WINDOW];
+} aml_pool_adapt_t;
+
+void aml_pool_set_adaptive(aml_pool_t *h, size_t max_size) {
+  if (h->pool || h->mmap)
+    return;
+  if (!max_size) {
+    if (h->adapt)
+      aml_free(h->adapt);
+    h->adapt = NULL;
+    return;
+  }
+  if (!h->adapt)
+    h->adapt = (aml_pool_adapt_t *)aml_calloc(1, sizeof(aml_pool_adapt_t));
+  h->adapt->max_size = max_size;
+}
+
+/* the memory the pool needed since the last clear.  Blocks other than the
+   current one are counted in full, which overstates the need by whatever was
+   left at the end of them (less than a single request). */
+static size_t pool_cycle_peak(aml_pool_t *h) {
+  size_t peak = h->curp - (char *)(h->current + 1);
+  for (aml_pool_node_t *n = h->current->prev; n; n = n->prev)
+    peak += n->endp - (char *)(n + 1);
+  for (aml_pool_node_t *n = h->large; n; n = n->prev)
+    peak += n->endp - (char *)(n + 1);
+  return peak;
+}
+
+static int compare_size(const void *a, const void *b) {
+  size_t x = *(const size_t *)a, y = *(const size_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* the nearest rank 99th percentile of the recorded peaks */
+static size_t adapt_p99(aml_pool_adapt_t *a) {
+  size_t v[AML_POOL_ADAPT_WINDOW];
+  memcpy(v, a->peaks, a->num * sizeof(size_t));
+  qsort(v, a->num, sizeof(size_t), compare_size);
+  return v[(a->num * 99 + 99) / 100 - 1];
+}
+
+/* Record the cycle and replace the primary block if needed.  This is called
+   by clear once the extra blocks have been released (so current is the
+   primary block). */
+static void pool_adapt(aml_pool_t *h, size_t peak, bool overflowed) {
+  aml_pool_adapt_t *a = h->adapt;
+  a->peaks[a->pos] = peak;
+  a->pos = (a->pos + 1) % AML_POOL_ADAPT_WINDOW;
+  if (a->num < AML_POOL_ADAPT_WINDOW)
+    a->num++;
+
+  size_t capacity = h->current->endp - (char *)(h->current + 1);
+  if (overflowed) {
+    /* grow once the overflow has repeated */
+    uint32_t overflows = 0;
+    for (uint32_t i = 0; i < a->num; i++)
+      if (a->peaks[i] > capacity)
+        overflows++;
+    if (overflows < AML_POOL_ADAPT_OVERFLOWS)
+      return;
+  } else if (a->pos || a->num < AML_POOL_ADAPT_WINDOW)
+    return; /* only consider shrinking once per full window */
+
+  size_t target = adapt_p99(a);
+  target += target / 4;
+  if (target > a->max_size)
+    target = a->max_size;
+  if (overflowed ? target <= capacity : target * 2 > capacity)
+    return;
+
+  /* The initial block is part of the handle's allocation, so it can't be
+     freed.  It is used again if the target fits in it. */
+  aml_pool_node_t *initial = (aml_pool_node_t *)(h + 1);
+  aml_pool_node_t *node = initial;
+  /* an initial block lent to another pool (see aml_pool_adopt) isn't ours to
+     reuse */
+  if (h->loan || target > (size_t)(initial->endp - (char *)(initial + 1))) {
+    size_t alloc_size = round_up(sizeof(aml_pool_node_t) + target, 4096);
+    if (alloc_size - sizeof(aml_pool_node_t) > a->max_size)
+      alloc_size = sizeof(aml_pool_node_t) + a->max_size;
+#ifdef _AML_USE_MALLOC_
+    node = (aml_pool_node_t *)_aml_alloc_backend.malloc_fn(alloc_size);
+#else
+    node = (aml_pool_node_t *)_aml_malloc_for(h->caller, alloc_size);
+#endif
+    if (!node)
+      abort();
+    node->endp = (char *)node + alloc_size;
+  }
+  if (node == h->current)
+    return;
+  if (h->current != initial) {
+#ifdef _AML_USE_MALLOC_
+    _aml_alloc_backend.free_fn(h->current);
+#else
+    aml_free(h->current);
+#endif
+  }
+  node->prev = NULL;
+  h->current = node;
+  h->zero_mark = node->endp;
+}
+
+typedef struct aml_pool_cleanup_s {
+  aml_pool_cleanup_cb cb;
+  void *arg;
+  struct aml_pool_cleanup_s *next;
+} aml_pool_cleanup_t;
+
+void aml_pool_add_cleanup(aml_pool_t *h, aml_pool_cleanup_cb cb, void *arg) {
+  /* The entries live on the heap rather than in the pool so that they
+     survive aml_pool_restore. */
+  aml_pool_cleanup_t *c =
+      (aml_pool_cleanup_t *)_aml_malloc_for(h->caller, sizeof(*c));
+  c->cb = cb;
+  c->arg = arg;
+  c->next = h->cleanup;
+  h->cleanup = c;
+}
+
+/* The initial block of a heap pool is part of the handle's allocation.  When
+   another pool adopts it, the allocation is shared by the two and freed by
+   whichever lets go of it last. */
+typedef struct aml_pool_loan_s {
+  atomic_int refs;
+  void *base;
+} aml_pool_loan_t;
+
+static void loan_release(void *arg) {
+  aml_pool_loan_t *l = (aml_pool_loan_t *)arg;
+  if (atomic_fetch_sub_explicit(&l->refs, 1, memory_order_acq_rel) == 1) {
+#ifdef _AML_USE_MALLOC_
+    _aml_alloc_backend.free_fn(l->base);
+#else
+    aml_free(l->base);
+#endif
+    aml_free(l);
+  }
+}
+
+static void run_cleanups(aml_pool_t *h) {
+  /* a callback may add another, which runs too */
+  while (h->cleanup) {
+    aml_pool_cleanup_t *c = h->cleanup;
+    h->cleanup = c->next;
+    c->cb(c->arg);
+    aml_free(c);
+  }
+}
+
+/* start over at the beginning of the primary block */
+static void pool_reset(aml_pool_t *h) {
   /* reset curp to the beginning */
   h->curp = (char *)(h->current + 1);
+  h->intern = NULL;
 
   /* reset size and used */
   h->size = 0;
@@ -142,22 +701,325 @@ void aml_pool_clear(aml_pool_t *h) {
 #endif
   h->used =
       (h->current->endp - h->curp) + sizeof(aml_pool_t) + sizeof(aml_pool_node_t);
+  if (h->mmap)
+    h->used += sizeof(aml_pool_mmap_t);
+  else if (h->current != (aml_pool_node_t *)(h + 1) && !h->loan) {
+    /* an adaptive pool may have replaced the initial block (a lent one is
+       counted by the pool which adopted it) */
+    aml_pool_node_t *initial = (aml_pool_node_t *)(h + 1);
+    h->used += sizeof(aml_pool_node_t) + (initial->endp - (char *)(initial + 1));
+  }
+}
+
+void aml_pool_clear(aml_pool_t *h) {
+  _AML_TRACE_BEGIN(AML_TRACE_POOL_CLEAR, h->used);
+  run_cleanups(h);
+
+  size_t peak = 0;
+  bool overflowed = false;
+  if (h->adapt) {
+    peak = pool_cycle_peak(h);
+    overflowed = h->current->prev || h->large;
+  }
+
+  while (h->large) {
+    aml_pool_node_t *node = h->large;
+    h->large = node->prev;
+    _aml_pool_free_node(h, node);
+  }
+  h->growth_size = 0;
+#ifdef _AML_POOL_STATS_
+  h->stats.bytes = 0;
+  h->stats.clears++;
+#endif
+
+  /* remove the extra blocks (the ones where prev != NULL) */
+  aml_pool_node_t *prev = h->current->prev;
+  if (!prev) {
+    if (h->zero_mark < h->curp)
+      h->zero_mark = h->curp;
+  } else {
+    while (prev) {
+      _aml_pool_free_node(h, h->current);
+      h->current = prev;
+      prev = prev->prev;
+    }
+    h->zero_mark = h->current->endp;
+  }
+  if (h->mmap)
+    pool_mmap_release(h, h->zero_mark);
+  if (h->adapt)
+    pool_adapt(h, peak, overflowed);
+  pool_reset(h);
+  _AML_TRACE_END(AML_TRACE_POOL_CLEAR, h, h->used);
+}
+
+size_t aml_pool_trim(aml_pool_t *h, size_t keep_bytes) {
+  if (h->pool)
+    return 0;
+  size_t released = 0;
+  aml_pool_node_t *initial = (aml_pool_node_t *)(h + 1);
+  /* an empty pool whose primary block replaced the initial one (see
+     aml_pool_set_adaptive) goes back to the initial block if that's enough */
+  if (!h->mmap && !h->loan && h->current != initial && !h->current->prev &&
+      !h->large && h->curp == (char *)(h->current + 1) &&
+      keep_bytes <= (size_t)(initial->endp - (char *)(initial + 1))) {
+    released = h->current->endp - (char *)h->current;
+#ifdef _AML_USE_MALLOC_
+    _aml_alloc_backend.free_fn(h->current);
+#else
+    aml_free(h->current);
+#endif
+    initial->prev = NULL;
+    h->current = initial;
+    h->zero_mark = initial->endp;
+    pool_reset(h);
+  }
+
+  /* The whole pages of the current block's free space (beyond keep_bytes)
+     are released.  They stay part of the block and are faulted back in as
+     zero pages when the pool gets to them. */
+  size_t page = h->mmap ? h->mmap->page_size : (size_t)sysconf(_SC_PAGESIZE);
+  char *start = h->curp;
+  if (keep_bytes > (size_t)(h->current->endp - start))
+    return released;
+  start += keep_bytes;
+  start = (char *)round_up((uintptr_t)start, page);
+  char *end = (char *)((uintptr_t)h->current->endp & ~(uintptr_t)(page - 1));
+  if (end <= start || madvise(start, end - start, MADV_DONTNEED))
+    return released;
+  released += end - start;
+  /* only an mmap backed pool ends on a page boundary, so only it gains a
+     zero tail it can rely on */
+  if (end == h->current->endp && start < h->zero_mark)
+    h->zero_mark = start;
+  return released;
 }
 
 void aml_pool_destroy(aml_pool_t *h) {
   /* pool_clear frees all of the memory from all of the extra nodes and only
     leaves the main block and main node allocated */
   aml_pool_clear(h);
+#ifdef _AML_POOL_STATS_
+  if (!h->pool)
+    stats_unregister(h);
+#endif
+  if (h->mmap) {
+    munmap(h->mmap->base, h->mmap->reserved);
+    aml_free(h);
+    return;
+  }
   /* free the main block and the main node */
   if(!h->pool) {
+    if (h->adapt)
+      aml_free(h->adapt);
 #ifdef _AML_USE_MALLOC_
-    free(h);
+    if (h->current != (aml_pool_node_t *)(h + 1))
+      _aml_alloc_backend.free_fn(h->current);
+    if (h->loan)
+      loan_release(h->loan);
+    else
+      _aml_alloc_backend.free_fn(h);
 #else
-    aml_free(h);
+    if (h->current != (aml_pool_node_t *)(h + 1))
+      aml_free(h->current);
+    if (h->loan)
+      loan_release(h->loan);
+    else
+      aml_free(h);
+#endif
+  }
+}
+
+
+/* allocate a node with room for *len bytes after it.  *len may be increased
+   if the recycled block cache hands back a larger block. */
+static aml_pool_node_t *alloc_node(aml_pool_t *h, size_t *len) {
+  aml_pool_node_t *block;
+  if(!h->pool) {
+#ifdef _AML_USE_MALLOC_
+    /* spare blocks are parked on free in this build too, so reuse them */
+    size_t alloc_size = sizeof(aml_pool_node_t) + *len;
+    block = h->spares ? spares_take(h->spares, &alloc_size) : NULL;
+    if (!block)
+      block = (aml_pool_node_t *)_aml_alloc_backend.malloc_fn(alloc_size);
+    *len = alloc_size - sizeof(aml_pool_node_t);
+#else
+    /* NUMA pools map their blocks on the node (reusing them through the
+       cache's per-node lists).  Others try the pool's spare blocks and then
+       the recycled block cache.  Any of these may hand back a larger block
+       than was asked for, so the extra space is given to the block. */
+    size_t alloc_size = sizeof(aml_pool_node_t) + *len;
+    block = NULL;
+    if (h->numa) {
+      int node = pool_numa_node(h);
+      block = (aml_pool_node_t *)_aml_pool_cache_alloc_node(&alloc_size, node);
+      if (!block)
+        block = (aml_pool_node_t *)aml_numa_alloc(&alloc_size, node);
+    }
+    if (!block && h->spares)
+      block = spares_take(h->spares, &alloc_size);
+    if (!block)
+      block = (aml_pool_node_t *)_aml_pool_cache_alloc(&alloc_size);
+    if (!block)
+      block = (aml_pool_node_t *)_aml_malloc_for(h->caller, alloc_size);
+    *len = alloc_size - sizeof(aml_pool_node_t);
 #endif
   }
+  else
+    block = (aml_pool_node_t *)aml_pool_alloc(h->pool, sizeof(aml_pool_node_t) + *len);
+  if (!block)
+    abort();
+  block->endp = (char *)(block + 1) + *len;
+  return block;
 }
 
+static inline char *align_ptr(char *p, size_t alignment) {
+  return (char *)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+static void *pool_grow(aml_pool_t *h, size_t alignment, size_t len) {
+  _AML_TRACE_BEGIN(AML_TRACE_POOL_GROW, h->used);
+#ifdef _AML_POOL_STATS_
+  h->stats.grow_count++;
+#endif
+  if (h->mmap && h->current == (aml_pool_node_t *)h->mmap->base) {
+    void *r = pool_mmap_extend(h, alignment, len);
+    if (r) {
+      _AML_TRACE_END(AML_TRACE_POOL_GROW, h, h->used);
+      return r;
+    }
+  }
+  /* node memory is always aligned to at least sizeof(size_t), so that is the
+     most padding which can be needed beyond that */
+  size_t padding = alignment > sizeof(size_t) ? alignment - sizeof(size_t) : 0;
+  size_t block_size = next_block_size(h, len);
+
+  aml_pool_node_t *block;
+  char *r;
+  if (len + padding > block_size) {
+    /* The request gets a node of its own.  The current block is left alone
+       so that it can keep serving smaller requests. */
+    block_size = len + padding;
+    block = alloc_node(h, &block_size);
+    block->prev = h->large;
+    h->large = block;
+#ifdef _AML_POOL_STATS_
+    h->stats.large_count++;
+#endif
+    h->used += sizeof(aml_pool_node_t) + block_size;
+    r = align_ptr((char *)(block + 1), alignment);
+  } else {
+    block = alloc_node(h, &block_size);
+#ifdef _AML_POOL_STATS_
+    h->stats.tail_waste += h->current->endp - h->curp;
+#endif
+    if (h->current->prev)
+      h->size += (h->current->endp - h->curp);
+    h->used += sizeof(aml_pool_node_t) + block_size;
+    h->growth_size = block_size;
+    block->prev = h->current;
+    h->current = block;
+    h->zero_mark = block->endp;
+    r = align_ptr((char *)(block + 1), alignment);
+    h->curp = r + len;
+  }
+  _aml_pool_stats_alloc(h, len, r - (char *)(block + 1));
+#ifdef _AML_DEBUG_
+  h->cur_size += (r - (char *)(block + 1)) + len;
+  if (h->cur_size > h->max_size)
+    h->max_size = h->cur_size;
+#endif
+  _AML_TRACE_END(AML_TRACE_POOL_GROW, h, h->used);
+  return r;
+}
+
+bool aml_pool_adopt(aml_pool_t *dst, aml_pool_t *src) {
+  if (dst == src || dst->pool || dst->numa || src->pool || src->mmap ||
+      src->numa)
+    return false;
+
+  aml_pool_node_t *primary = src->current;
+  while (primary->prev)
+    primary = primary->prev;
+  bool primary_used =
+      src->current != primary || src->curp != (char *)(primary + 1);
+
+#ifdef _AML_DEBUG_
+  dst->cur_size += src->cur_size;
+  if (dst->cur_size > dst->max_size)
+    dst->max_size = dst->cur_size;
+#endif
+#ifdef _AML_POOL_STATS_
+  dst->stats.bytes += src->stats.bytes;
+  if (dst->stats.bytes > dst->stats.high_water)
+    dst->stats.high_water = dst->stats.bytes;
+  src->stats.bytes = 0;
+#endif
+
+  /* The large nodes and the growth blocks become large nodes of dst, which
+     are never bumped and are freed by its clear, destroy or a restore to a
+     marker saved before this. */
+  aml_pool_node_t *head = dst->large;
+  size_t moved = 0;
+  aml_pool_node_t *node = src->large;
+  while (node) {
+    aml_pool_node_t *next = node->prev;
+    moved += node->endp - (char *)node;
+    node->prev = head;
+    head = node;
+    node = next;
+  }
+  node = src->current;
+  while (node != primary) {
+    aml_pool_node_t *next = node->prev;
+    moved += node->endp - (char *)node;
+    node->prev = head;
+    head = node;
+    node = next;
+  }
+
+  if (primary_used) {
+    size_t len = primary->endp - (char *)(primary + 1);
+    if (primary == (aml_pool_node_t *)(src + 1)) {
+      /* the initial block can't be freed on its own, so dst holds a
+         reference to src's allocation instead */
+      aml_pool_loan_t *l =
+          (aml_pool_loan_t *)_aml_malloc_for(src->caller, sizeof(*l));
+      atomic_init(&l->refs, 2);
+      l->base = src;
+      src->loan = l;
+      aml_pool_add_cleanup(dst, loan_release, l);
+    } else {
+      primary->prev = head;
+      head = primary;
+    }
+    moved += sizeof(aml_pool_node_t) + len;
+    /* src carries on with a new primary block of the same size */
+    primary = alloc_node(src, &len);
+    primary->prev = NULL;
+    src->zero_mark = primary->endp;
+  } else if (src->zero_mark < src->curp)
+    src->zero_mark = src->curp;
+  dst->large = head;
+  dst->used += moved;
+
+  /* the cleanups go with the memory and run before dst's own */
+  if (src->cleanup) {
+    aml_pool_cleanup_t *c = src->cleanup;
+    while (c->next)
+      c = c->next;
+    c->next = dst->cleanup;
+    dst->cleanup = src->cleanup;
+    src->cleanup = NULL;
+  }
+
+  src->large = NULL;
+  src->growth_size = 0;
+  src->current = primary;
+  pool_reset(src);
+  return true;
+}
 
 void *aml_pool_aalloc(aml_pool_t *pool, size_t alignment, size_t size) {
 #ifdef _AML_DEBUG_
@@ -176,7 +1038,7 @@ void *aml_pool_aalloc(aml_pool_t *pool, size_t alignment, size_t size) {
         pool->curp += padding;  // Adjust pointer to aligned address
         void *result = pool->curp;
         pool->curp += size;  // Reserve the requested size
-        pool->used += padding + size;  // Update used size
+        _aml_pool_stats_alloc(pool, size, padding);
 #ifdef _AML_DEBUG_
         pool->cur_size += padding + size;
         if (pool->cur_size > pool->max_size) {
@@ -187,47 +1049,12 @@ void *aml_pool_aalloc(aml_pool_t *pool, size_t alignment, size_t size) {
     }
 
     // Not enough space in the current block, grow the pool and allocate aligned
-    size_t total_size = size + alignment - 1;  // Account for alignment padding
-    char *block = (char *)_aml_pool_alloc_grow(pool, total_size);
-    aligned = ((uintptr_t)block + alignment - 1) & ~(alignment - 1);
-    return (void *)aligned;
+    return pool_grow(pool, alignment, size);
 }
 
-
 void *_aml_pool_alloc_grow(aml_pool_t *h, size_t len) {
-  size_t block_size = len;
-  if (block_size < h->minimum_growth_size)
-    block_size = h->minimum_growth_size;
-  aml_pool_node_t *block;
-  if(len > 100*1024*1024)
-    printf("aml_pool_t: %p(%p): growing to %lu, %lu\n", h, h->pool, block_size, h->size);
-  if(!h->pool) {
-#ifdef _AML_USE_MALLOC_
-    block = (aml_pool_node_t *)malloc(sizeof(aml_pool_node_t) + block_size);
-#else
-    block = (aml_pool_node_t *)aml_malloc(sizeof(aml_pool_node_t) + block_size);
-#endif
-  }
-  else
-    block = (aml_pool_node_t *)aml_pool_alloc(h->pool, sizeof(aml_pool_node_t) + block_size);
-  if (!block)
-    abort();
-  if (h->current->prev)
-    h->size += (h->current->endp - h->curp);
-  h->used += sizeof(aml_pool_node_t) + block_size;
-  block->prev = h->current;
-  h->current = block;
-  char *r = (char *)(block + 1);
-  block->endp = r + block_size;
-  h->curp = r + len;
-#ifdef _AML_DEBUG_
-  h->cur_size += len;
-  if (h->cur_size > h->max_size)
-    h->max_size = h->cur_size;
-#endif
-  return r;
+  return pool_grow(h, 1, len);
 }
-
 char *aml_pool_strdupvf(aml_pool_t *pool, const char *fmt, va_list args) {
   va_list args_copy;
   va_copy(args_copy, args);
@@ -237,8 +1064,13 @@ char *aml_pool_strdupvf(aml_pool_t *pool, const char *fmt, va_list args) {
   if (n < 0)
     abort();
   va_end(args_copy);
-  if (n < leftover) {
+  /* vsnprintf may have written beyond curp */
+  char *written = r + ((size_t)n < leftover ? (size_t)n + 1 : leftover);
+  if (pool->zero_mark < written)
+    pool->zero_mark = written;
+  if ((size_t)n < leftover) {
     pool->curp += n + 1;
+    _aml_pool_stats_alloc(pool, n + 1, 0);
 #ifdef _AML_DEBUG_
     pool->cur_size += (n + 1);
     if (pool->cur_size > pool->max_size)
@@ -329,374 +1161,3 @@ char **aml_pool_strdupa2(aml_pool_t *pool, char **a) {
   p++;
   return (char **)aml_pool_dup(pool, a, (p - a) * sizeof(char *));
 }
-
-
-char **_aml_pool_split(aml_pool_t *h, size_t *num_splits, char delim, char *s) {
-  static char *nil = NULL;
-  if (!s) {
-    if (num_splits)
-      *num_splits = 0;
-    return &nil;
-  }
-  char *p = s;
-  size_t num = 1;
-  while (*p != 0) {
-    if (*p == delim)
-      num++;
-    p++;
-  }
-  if (num_splits)
-    *num_splits = num;
-  char **r = (char **)aml_pool_alloc(h, sizeof(char *) * (num + 1));
-  char **wr = r;
-  *wr = s;
-  wr++;
-    // ,,, => "","","",""
-
-  while (*s != 0) {
-    if (*s == delim) {
-      *s = 0;
-      s++;
-      *wr = s;
-      wr++;
-    } else
-      s++;
-  }
-  *wr = NULL;
-  return r;
-}
-
-char **aml_pool_split(aml_pool_t *h, size_t *num_splits, char delim,
-                     const char *p) {
-  return _aml_pool_split(h, num_splits, delim, p ? aml_pool_strdup(h, p) : NULL);
-}
-
-char **aml_pool_splitf(aml_pool_t *h, size_t *num_splits, char delim,
-                      const char *p, ...) {
-  va_list args;
-  va_start(args, p);
-  char *r = aml_pool_strdupvf(h, p, args);
-  va_end(args);
-  return _aml_pool_split(h, num_splits, delim, r);
-}
-
-char **_aml_pool_split2(aml_pool_t *h, size_t *num_splits, char delim, char *s) {
-  size_t num_res = 0;
-  char **res = _aml_pool_split(h, &num_res, delim, s);
-  char **wp = res;
-  char **p = res;
-  char **ep = p+num_res;
-  while(p < ep) {
-    if(*p[0] != 0)
-        *wp++ = *p;
-    p++;
-  }
-  *num_splits = wp-res;
-  *wp++ = NULL;
-  return res;
-}
-
-char **aml_pool_split2(aml_pool_t *h, size_t *num_splits, char delim,
-                      const char *p) {
-  return _aml_pool_split2(h, num_splits, delim, p ? aml_pool_strdup(h, p) : NULL);
-}
-
-char **aml_pool_split2f(aml_pool_t *h, size_t *num_splits, char delim,
-                       const char *p, ...) {
-  va_list args;
-  va_start(args, p);
-  char *r = aml_pool_strdupvf(h, p, args);
-  va_end(args);
-  return _aml_pool_split2(h, num_splits, delim, r);
-}
-
-char **_aml_pool_split_with_escape(aml_pool_t *h, size_t *num_splits, char delim, char escape, const char *p) {
-    if (!p) {
-        if (num_splits)
-            *num_splits = 0;
-        static char *nil = NULL;
-        return &nil;
-    }
-
-    // Duplicate the string into the pool for modification
-    char *s = aml_pool_strdup(h, p);
-    char *current = s;
-    size_t count = 1; // At least one split by default
-    int escape_next = 0; // Flag to handle escape sequences
-
-    // First pass: Count splits while handling escape characters
-    for (char *c = s; *c; ++c) {
-        if (escape_next) {
-            escape_next = 0; // Skip this character; it was escaped
-            continue;
-        }
-        if (*c == escape) {
-            escape_next = 1; // Escape the next character
-            continue;
-        }
-        if (*c == delim) {
-            ++count;
-        }
-    }
-
-    // Allocate memory for the result array
-    char **result = (char **)aml_pool_alloc(h, sizeof(char *) * (count + 1));
-
-    size_t idx = 0;
-    result[idx++] = current; // First segment starts at the beginning
-    escape_next = 0;
-
-    // Second pass: Split the string while removing escape characters
-    for (char *c = s; *c; ++c) {
-        if (escape_next) {
-            escape_next = 0; // Keep the escaped character
-            *current++ = *c;
-            continue;
-        }
-        if (*c == escape) {
-            escape_next = 1; // Mark next character for escaping
-            continue;
-        }
-        if (*c == delim) {
-            *current++ = '\0'; // Terminate the current segment
-            result[idx++] = current; // Start a new segment
-            continue;
-        }
-        *current++ = *c; // Copy character
-    }
-
-    *current = '\0'; // Null-terminate the final segment
-    result[idx] = NULL; // Null-terminate the result array
-
-    if (num_splits) {
-        *num_splits = idx;
-    }
-
-    return result;
-}
-
-char **aml_pool_split_with_escape(aml_pool_t *h, size_t *num_splits, char delim, char escape,
-                                  const char *p) {
-  return _aml_pool_split_with_escape(h, num_splits, delim, escape, p ? aml_pool_strdup(h, p) : NULL);
-}
-
-char **aml_pool_split_with_escapef(aml_pool_t *h, size_t *num_splits, char delim, char escape,
-                                   const char *p, ...) {
-  va_list args;
-  va_start(args, p);
-  char *r = aml_pool_strdupvf(h, p, args);
-  va_end(args);
-  return _aml_pool_split_with_escape(h, num_splits, delim, escape, r);
-}
-
-char **_aml_pool_split_with_escape2(aml_pool_t *h, size_t *num_splits, char delim, char escape, char *s) {
-  size_t num_res = 0;
-  char **res = _aml_pool_split_with_escape(h, &num_res, delim, escape, s);
-  char **wp = res;
-  char **p = res;
-  char **ep = p+num_res;
-  while(p < ep) {
-    if(*p[0] != 0)
-        *wp++ = *p;
-    p++;
-  }
-  *num_splits = wp-res;
-  *wp++ = NULL;
-  return res;
-}
-
-char **aml_pool_split_with_escape2(aml_pool_t *h, size_t *num_splits, char delim, char escape,
-                                   const char *p) {
-  return _aml_pool_split_with_escape2(h, num_splits, delim, escape, p ? aml_pool_strdup(h, p) : NULL);
-}
-
-
-char **aml_pool_split_with_escape2f(aml_pool_t *h, size_t *num_splits, char delim, char escape,
-                                    const char *p, ...) {
-  va_list args;
-  va_start(args, p);
-  char *r = aml_pool_strdupvf(h, p, args);
-  va_end(args);
-  return aml_pool_split_with_escape2(h, num_splits, delim, escape, r);
-}
-
-// -----------------------------------------------------------------------------
-// Base64 Encode Table
-// -----------------------------------------------------------------------------
-static const char b64_table[65] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-// -----------------------------------------------------------------------------
-// aml_pool_base64_encode
-// -----------------------------------------------------------------------------
-char *aml_pool_base64_encode(aml_pool_t *pool, const unsigned char *data, size_t data_len) {
-    if (!pool || !data || data_len == 0) {
-        // Return an empty string (allocated in the pool) for consistency
-        char *empty = (char *)aml_pool_alloc(pool, 1);
-        empty[0] = '\0';
-        return empty;
-    }
-
-    // Calculate the length of the output
-    // Base64 encodes each 3-byte block into 4 chars. If data_len isn't multiple
-    // of 3, padding is added. So final length = 4 * ceil(data_len / 3).
-    size_t encoded_len = 4 * ((data_len + 2) / 3);
-
-    // Allocate buffer for the encoded string (+1 for '\0')
-    char *encoded = (char *)aml_pool_alloc(pool, encoded_len + 1);
-    encoded[encoded_len] = '\0'; // null-terminate
-
-    // Process input in 3-byte chunks
-    size_t i = 0, j = 0;
-    while (i < data_len) {
-        // Collect 3 bytes (24 bits)
-        uint32_t octet_a = i < data_len ? data[i++] : 0;
-        uint32_t octet_b = i < data_len ? data[i++] : 0;
-        uint32_t octet_c = i < data_len ? data[i++] : 0;
-
-        uint32_t triple = (octet_a << 16) | (octet_b << 8) | octet_c;
-
-        // Encode into 4 Base64 chars
-        encoded[j++] = b64_table[(triple >> 18) & 0x3F];
-        encoded[j++] = b64_table[(triple >> 12) & 0x3F];
-        encoded[j++] = b64_table[(triple >> 6)  & 0x3F];
-        encoded[j++] = b64_table[(triple)       & 0x3F];
-    }
-
-    // Add '=' padding if necessary
-    // If data_len % 3 == 1, we added 2 extra Base64 chars => last two should be '='
-    // If data_len % 3 == 2, we added 1 extra Base64 char => last one should be '='
-    int mod = data_len % 3;
-    if (mod > 0) {
-        encoded[encoded_len - 1] = '=';
-        if (mod == 1) {
-            encoded[encoded_len - 2] = '=';
-        }
-    }
-
-    return encoded;
-}
-
-// -----------------------------------------------------------------------------
-// Base64 Decode Table
-// -----------------------------------------------------------------------------
-static const unsigned char b64_dec_table[256] = {
-    /*   0- 15 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /*  16- 31 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /*  32- 47 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF,   62, 0xFF, 0xFF, 0xFF,   63,
-    /*  48- 63 */   52,   53,   54,   55,   56,   57,   58,   59,
-                    60,   61, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /*  64- 79 */ 0xFF,    0,    1,    2,    3,    4,    5,    6,
-                     7,    8,    9,   10,   11,   12,   13,   14,
-    /*  80- 95 */   15,   16,   17,   18,   19,   20,   21,   22,
-                    23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /*  96-111 */ 0xFF,   26,   27,   28,   29,   30,   31,   32,
-                    33,   34,   35,   36,   37,   38,   39,   40,
-    /* 112-127 */   41,   42,   43,   44,   45,   46,   47,   48,
-                    49,   50,   51, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 128-143 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 144-159 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 160-175 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 176-191 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 192-207 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 208-223 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 224-239 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    /* 240-255 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
-};
-
-// -----------------------------------------------------------------------------
-// aml_pool_base64_decode
-// -----------------------------------------------------------------------------
-unsigned char *aml_pool_base64_decode(aml_pool_t *pool, size_t *out_len, const char *b64) {
-    if (!pool || !b64) {
-        if (out_len) *out_len = 0;
-        return NULL;
-    }
-
-    // We can skip leading/trailing whitespace if desired, but for simplicity:
-    // We assume `b64` is a valid Base64 string (possibly with '=' padding).
-    // We'll do a quick length check ignoring '=' padding.
-    size_t in_len = strlen(b64);
-    if (in_len == 0) {
-        if (out_len) *out_len = 0;
-        unsigned char *empty = (unsigned char*)aml_pool_alloc(pool, 1);
-        empty[0] = '\0';
-        return empty;
-    }
-
-    // Count how many actual base64 chars we have (ignore '=' at end)
-    // We won't do robust validation here, but we do handle trailing '='
-    size_t pad = 0;
-    if (in_len >= 1 && b64[in_len - 1] == '=') pad++;
-    if (in_len >= 2 && b64[in_len - 2] == '=') pad++;
-
-    // The maximum possible output size is 3 * (in_len / 4).
-    // We'll handle the final result length carefully once we parse.
-    size_t decoded_max_len = 3 * (in_len / 4);
-
-    // Allocate a buffer for the decoded result (plus 1 for safety \0).
-    unsigned char *decoded = (unsigned char*)aml_pool_alloc(pool, decoded_max_len + 1);
-
-    // Decode in 4-byte chunks
-    size_t i = 0, j = 0;
-    while (i < in_len) {
-        // Each 4 input chars -> 3 output bytes
-        // We'll handle '=' by treating them as zero in the decode table for now.
-
-        uint32_t val = 0;
-        int shift = 18;
-
-        for (int k = 0; k < 4 && i < in_len; k++) {
-            unsigned char c = (unsigned char)b64[i++];
-            if (c == '=') {
-                // If padding, shift doesn't matter, just skip
-                c = 0;
-            } else {
-                unsigned char d = b64_dec_table[c];
-                if (d == 0xFF) {
-                    // Invalid character
-                    // In production, you might skip or handle error
-                    if (out_len) *out_len = 0;
-                    return NULL;
-                }
-                c = d;
-            }
-
-            val |= ((uint32_t)c << shift);
-            shift -= 6;
-        }
-
-        decoded[j++] = (unsigned char)((val >> 16) & 0xFF);
-        decoded[j++] = (unsigned char)((val >> 8)  & 0xFF);
-        decoded[j++] = (unsigned char)(val & 0xFF);
-    }
-
-    // Adjust final length for padding
-    // Each '=' can remove one output byte
-    size_t decoded_len = j;
-    if (pad) {
-        decoded_len -= pad;
-    }
-
-    // Null terminate for safety if you want to treat as string
-    if (decoded_len < decoded_max_len + 1) {
-        decoded[decoded_len] = '\0';
-    }
-
-    // Provide actual length if caller wants it
-    if (out_len) {
-        *out_len = decoded_len;
-    }
-    return decoded;
-}
@@ -0,0 +1,344 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_alloc.h"
+#include "a-memory-library/aml_pool_cache.h"
+#include "a-memory-library/aml_numa.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Blocks are bucketed by powers of two from 64 bytes to 4GB.  Larger blocks
+   are never cached. */
+#define AML_POOL_CACHE_MIN_SHIFT 6
+#define AML_POOL_CACHE_MAX_SHIFT 32
+#define AML_POOL_CACHE_CLASSES                                                 \
+  (AML_POOL_CACHE_MAX_SHIFT - AML_POOL_CACHE_MIN_SHIFT + 1)
+
+/* the number of blocks per bucket a thread keeps before spilling to the
+   global depot */
+#define AML_POOL_CACHE_LOCAL_DEPTH 4
+
+/* A parked block is reused to hold the free list link and its own size. */
+typedef struct aml_pool_cache_block_s {
+  struct aml_pool_cache_block_s *next;
+  size_t size;
+} aml_pool_cache_block_t;
+
+typedef struct {
+  aml_pool_cache_block_t *head[AML_POOL_CACHE_CLASSES];
+  uint32_t count[AML_POOL_CACHE_CLASSES];
+  bool registered;
+} aml_pool_cache_local_t;
+
+static _Thread_local aml_pool_cache_local_t local_cache;
+static _Atomic(aml_pool_cache_block_t *) depot[AML_POOL_CACHE_CLASSES];
+
+/* NUMA blocks are mappings bound to a node.  They only go through a depot
+   per node (no thread lists) because they are only used by growing pools,
+   and blocks on nodes at or above this aren't cached. */
+#define AML_POOL_CACHE_NUMA_NODES 8
+static _Atomic(aml_pool_cache_block_t *)
+    node_depot[AML_POOL_CACHE_NUMA_NODES][AML_POOL_CACHE_CLASSES];
+
+static atomic_size_t max_bytes;
+static atomic_size_t cached_bytes;
+static atomic_size_t cached_blocks;
+static atomic_size_t hits;
+static atomic_size_t misses;
+static atomic_size_t parked;
+static atomic_size_t dropped;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+/* the smallest class whose blocks are all at least len bytes */
+static inline int class_ceil(size_t len) {
+  if (len <= ((size_t)1 << AML_POOL_CACHE_MIN_SHIFT))
+    return 0;
+  int shift = 64 - __builtin_clzll((unsigned long long)(len - 1));
+  return shift - AML_POOL_CACHE_MIN_SHIFT;
+}
+
+/* the largest class whose nominal size is at most len bytes */
+static inline int class_floor(size_t len) {
+  int shift = 63 - __builtin_clzll((unsigned long long)len);
+  return shift - AML_POOL_CACHE_MIN_SHIFT;
+}
+
+static void push_stack(_Atomic(aml_pool_cache_block_t *) *stack,
+                       aml_pool_cache_block_t *b) {
+  aml_pool_cache_block_t *head =
+      atomic_load_explicit(stack, memory_order_relaxed);
+  do {
+    b->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      stack, &head, b, memory_order_release, memory_order_relaxed));
+}
+
+static void push_depot(aml_pool_cache_block_t *b, int c) {
+  push_stack(&depot[c], b);
+}
+
+static void free_block(aml_pool_cache_block_t *b) {
+  atomic_fetch_sub_explicit(&cached_bytes, b->size, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&cached_blocks, 1, memory_order_relaxed);
+  aml_free(b);
+}
+
+static void free_node_block(aml_pool_cache_block_t *b) {
+  atomic_fetch_sub_explicit(&cached_bytes, b->size, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&cached_blocks, 1, memory_order_relaxed);
+  aml_numa_free(b, b->size);
+}
+
+/* thread exit: hand anything still held privately to the depot */
+static void flush_local(void *arg) {
+  aml_pool_cache_local_t *l = (aml_pool_cache_local_t *)arg;
+  for (int c = 0; c < AML_POOL_CACHE_CLASSES; c++) {
+    aml_pool_cache_block_t *b = l->head[c];
+    while (b) {
+      aml_pool_cache_block_t *next = b->next;
+      push_depot(b, c);
+      b = next;
+    }
+    l->head[c] = NULL;
+    l->count[c] = 0;
+  }
+  l->registered = false;
+}
+
+static void make_key(void) { pthread_key_create(&key, flush_local); }
+
+static inline void register_local(aml_pool_cache_local_t *l) {
+  if (l->registered)
+    return;
+  pthread_once(&key_once, make_key);
+  pthread_setspecific(key, l);
+  l->registered = true;
+}
+
+/* Take the first block of at least len bytes from a depot.  Taking the whole
+   chain avoids the ABA problem of popping a single node from a lock-free
+   stack.  The rest are kept on l (if given) up to its depth and the others
+   are returned. */
+static aml_pool_cache_block_t *
+take_chain(_Atomic(aml_pool_cache_block_t *) *stack, size_t len,
+           aml_pool_cache_local_t *l, int c) {
+  aml_pool_cache_block_t *b =
+      atomic_exchange_explicit(stack, NULL, memory_order_acquire);
+  aml_pool_cache_block_t *found = NULL;
+  while (b) {
+    aml_pool_cache_block_t *next = b->next;
+    if (!found && b->size >= len)
+      found = b;
+    else if (l && l->count[c] < AML_POOL_CACHE_LOCAL_DEPTH) {
+      register_local(l);
+      b->next = l->head[c];
+      l->head[c] = b;
+      l->count[c]++;
+    } else
+      push_stack(stack, b);
+    b = next;
+  }
+  return found;
+}
+
+/* a block of class c with at least len bytes, from the thread's list and
+   then the depot */
+static aml_pool_cache_block_t *take(aml_pool_cache_local_t *l, int c,
+                                    size_t len) {
+  for (aml_pool_cache_block_t **p = &l->head[c]; *p; p = &(*p)->next) {
+    if ((*p)->size >= len) {
+      aml_pool_cache_block_t *b = *p;
+      *p = b->next;
+      l->count[c]--;
+      return b;
+    }
+  }
+  return take_chain(&depot[c], len, l, c);
+}
+
+/* Blocks are filed under the class below their size, so a block in the
+   class above len always fits, while one in len's own class only might.
+   The latter is tried first as it is the closer fit (and the only one for
+   blocks of the same size as the request). */
+static inline void request_classes(size_t len, int *lo, int *hi) {
+  *hi = class_ceil(len);
+  *lo = len >= ((size_t)1 << AML_POOL_CACHE_MIN_SHIFT) ? class_floor(len)
+                                                       : *hi;
+}
+
+static void *hit(aml_pool_cache_block_t *b, size_t *len) {
+  if (!b) {
+    atomic_fetch_add_explicit(&misses, 1, memory_order_relaxed);
+    return NULL;
+  }
+  atomic_fetch_add_explicit(&hits, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&cached_bytes, b->size, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&cached_blocks, 1, memory_order_relaxed);
+  *len = b->size;
+  return b;
+}
+
+void *_aml_pool_cache_alloc(size_t *len) {
+  if (!atomic_load_explicit(&max_bytes, memory_order_relaxed))
+    return NULL;
+
+  int lo, hi;
+  request_classes(*len, &lo, &hi);
+  if (lo >= AML_POOL_CACHE_CLASSES)
+    return NULL;
+
+  aml_pool_cache_local_t *l = &local_cache;
+  aml_pool_cache_block_t *b = take(l, lo, *len);
+  if (!b && hi != lo && hi < AML_POOL_CACHE_CLASSES)
+    b = take(l, hi, *len);
+  return hit(b, len);
+}
+
+bool _aml_pool_cache_release(void *block, size_t len) {
+  size_t cap = atomic_load_explicit(&max_bytes, memory_order_relaxed);
+  if (!cap)
+    return false;
+
+  int c = -1;
+  if (len >= ((size_t)1 << AML_POOL_CACHE_MIN_SHIFT))
+    c = class_floor(len);
+  if (c < 0 || c >= AML_POOL_CACHE_CLASSES) {
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    return false;
+  }
+
+  size_t total =
+      atomic_fetch_add_explicit(&cached_bytes, len, memory_order_relaxed) +
+      len;
+  if (total > cap) {
+    atomic_fetch_sub_explicit(&cached_bytes, len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    return false;
+  }
+  atomic_fetch_add_explicit(&cached_blocks, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&parked, 1, memory_order_relaxed);
+
+  aml_pool_cache_block_t *b = (aml_pool_cache_block_t *)block;
+  b->size = len;
+  aml_pool_cache_local_t *l = &local_cache;
+  if (l->count[c] < AML_POOL_CACHE_LOCAL_DEPTH) {
+    register_local(l);
+    b->next = l->head[c];
+    l->head[c] = b;
+    l->count[c]++;
+  } else
+    push_depot(b, c);
+  return true;
+}
+
+void *_aml_pool_cache_alloc_node(size_t *len, int node) {
+  if (!atomic_load_explicit(&max_bytes, memory_order_relaxed) || node < 0 ||
+      node >= AML_POOL_CACHE_NUMA_NODES)
+    return NULL;
+
+  int lo, hi;
+  request_classes(*len, &lo, &hi);
+  if (lo >= AML_POOL_CACHE_CLASSES)
+    return NULL;
+
+  aml_pool_cache_block_t *b =
+      take_chain(&node_depot[node][lo], *len, NULL, lo);
+  if (!b && hi != lo && hi < AML_POOL_CACHE_CLASSES)
+    b = take_chain(&node_depot[node][hi], *len, NULL, hi);
+  return hit(b, len);
+}
+
+bool _aml_pool_cache_release_node(void *block, size_t len, int node) {
+  size_t cap = atomic_load_explicit(&max_bytes, memory_order_relaxed);
+  if (!cap)
+    return false;
+  int c = -1;
+  if (len >= ((size_t)1 << AML_POOL_CACHE_MIN_SHIFT))
+    c = class_floor(len);
+  if (c < 0 || c >= AML_POOL_CACHE_CLASSES || node < 0 ||
+      node >= AML_POOL_CACHE_NUMA_NODES) {
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    return false;
+  }
+  size_t total =
+      atomic_fetch_add_explicit(&cached_bytes, len, memory_order_relaxed) +
+      len;
+  if (total > cap) {
+    atomic_fetch_sub_explicit(&cached_bytes, len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    return false;
+  }
+  atomic_fetch_add_explicit(&cached_blocks, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&parked, 1, memory_order_relaxed);
+
+  aml_pool_cache_block_t *b = (aml_pool_cache_block_t *)block;
+  b->size = len;
+  push_stack(&node_depot[node][c], b);
+  return true;
+}
+
+/* release the NUMA blocks of class c until at most keep bytes are cached */
+static void trim_nodes(int c, size_t keep) {
+  for (int n = 0; n < AML_POOL_CACHE_NUMA_NODES; n++) {
+    if (atomic_load_explicit(&cached_bytes, memory_order_relaxed) <= keep)
+      return;
+    aml_pool_cache_block_t *b = atomic_exchange_explicit(
+        &node_depot[n][c], NULL, memory_order_acquire);
+    while (b) {
+      aml_pool_cache_block_t *next = b->next;
+      if (atomic_load_explicit(&cached_bytes, memory_order_relaxed) > keep)
+        free_node_block(b);
+      else
+        push_stack(&node_depot[n][c], b);
+      b = next;
+    }
+  }
+}
+
+void aml_pool_cache_trim(size_t keep) {
+  aml_pool_cache_local_t *l = &local_cache;
+  /* release the largest blocks first */
+  for (int c = AML_POOL_CACHE_CLASSES - 1; c >= 0; c--) {
+    trim_nodes(c, keep);
+    while (l->head[c] &&
+           atomic_load_explicit(&cached_bytes, memory_order_relaxed) > keep) {
+      aml_pool_cache_block_t *b = l->head[c];
+      l->head[c] = b->next;
+      l->count[c]--;
+      free_block(b);
+    }
+    if (atomic_load_explicit(&cached_bytes, memory_order_relaxed) <= keep)
+      return;
+
+    aml_pool_cache_block_t *b =
+        atomic_exchange_explicit(&depot[c], NULL, memory_order_acquire);
+    while (b) {
+      aml_pool_cache_block_t *next = b->next;
+      if (atomic_load_explicit(&cached_bytes, memory_order_relaxed) > keep)
+        free_block(b);
+      else
+        push_depot(b, c);
+      b = next;
+    }
+  }
+}
+
+void aml_pool_cache_enable(size_t cap) {
+  atomic_store_explicit(&max_bytes, cap, memory_order_relaxed);
+  aml_pool_cache_trim(cap);
+}
+
+void aml_pool_cache_stats(aml_pool_cache_stats_t *out) {
+  out->hits = atomic_load_explicit(&hits, memory_order_relaxed);
+  out->misses = atomic_load_explicit(&misses, memory_order_relaxed);
+  out->parked = atomic_load_explicit(&parked, memory_order_relaxed);
+  out->dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+  out->cached_bytes = atomic_load_explicit(&cached_bytes, memory_order_relaxed);
+  out->cached_blocks =
+      atomic_load_explicit(&cached_blocks, memory_order_relaxed);
+  out->max_bytes = atomic_load_explicit(&max_bytes, memory_order_relaxed);
+}
@@ -0,0 +1,215 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_pool.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* the first table has this many slots, it doubles when half full */
+#define AML_POOL_INTERN_MIN_SLOTS 64
+/* aml_pool_intern_all hashes this many strings ahead of inserting them */
+#define AML_POOL_INTERN_BATCH 16
+
+/* Slots keep the hash next to the string so that most probes which don't
+   match never touch the string. */
+typedef struct {
+  uint64_t hash;
+  const char *s;
+} aml_pool_intern_slot_t;
+
+struct aml_pool_intern_s {
+  size_t mask;
+  size_t count;
+  aml_pool_intern_slot_t *slots;
+};
+
+/* ---- hashing (the structure of wyhash) ---- */
+
+#define WY0 0xa0761d6478bd642fULL
+#define WY1 0xe7037ed1a0b428dbULL
+#define WY2 0x8ebc6af09c88c6e3ULL
+#define WY3 0x589965cc75374cc3ULL
+
+static inline void mum128(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+  mum128(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t r8(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t r4(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static uint64_t intern_hash(const void *key, size_t len) {
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t seed = mix(WY0, WY1);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t q = (len >> 3) << 2;
+      a = (r4(p) << 32) | r4(p + q);
+      b = (r4(p + len - 4) << 32) | r4(p + len - 4 - q);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else
+      a = b = 0;
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = mix(r8(p) ^ WY1, r8(p + 8) ^ seed);
+        see1 = mix(r8(p + 16) ^ WY2, r8(p + 24) ^ see1);
+        see2 = mix(r8(p + 32) ^ WY3, r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = mix(r8(p) ^ WY1, r8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = r8(p + i - 16);
+    b = r8(p + i - 8);
+  }
+  a ^= WY1;
+  b ^= seed;
+  mum128(&a, &b);
+  return mix(a ^ WY0 ^ len, b ^ WY1);
+}
+
+/* ---- the set ---- */
+
+static aml_pool_intern_slot_t *new_slots(aml_pool_t *h, size_t n) {
+  return (aml_pool_intern_slot_t *)aml_pool_zalloc(
+      h, n * sizeof(aml_pool_intern_slot_t));
+}
+
+static struct aml_pool_intern_s *intern_table(aml_pool_t *h) {
+  struct aml_pool_intern_s *t = h->intern;
+  if (!t) {
+    t = (struct aml_pool_intern_s *)aml_pool_alloc(h, sizeof(*t));
+    t->mask = AML_POOL_INTERN_MIN_SLOTS - 1;
+    t->count = 0;
+    t->slots = new_slots(h, AML_POOL_INTERN_MIN_SLOTS);
+    h->intern = t;
+    /* a restore to before this has to drop the table too */
+    h->intern_count++;
+  }
+  return t;
+}
+
+/* Double the table.  The old slots stay in the pool until it is cleared,
+   which costs less than the table's final size. */
+static void intern_grow(aml_pool_t *h, struct aml_pool_intern_s *t) {
+  size_t n = (t->mask + 1) * 2;
+  aml_pool_intern_slot_t *slots = new_slots(h, n);
+  for (size_t i = 0; i <= t->mask; i++) {
+    if (!t->slots[i].s)
+      continue;
+    size_t j = t->slots[i].hash & (n - 1);
+    while (slots[j].s)
+      j = (j + 1) & (n - 1);
+    slots[j] = t->slots[i];
+  }
+  t->slots = slots;
+  t->mask = n - 1;
+}
+
+static const char *intern_hashed(aml_pool_t *h, struct aml_pool_intern_s *t,
+                                 const char *s, size_t len, uint64_t hash) {
+  size_t i = hash & t->mask;
+  for (;;) {
+    aml_pool_intern_slot_t *slot = t->slots + i;
+    if (!slot->s)
+      break;
+    if (slot->hash == hash && aml_pool_intern_length(slot->s) == len &&
+        !memcmp(slot->s, s, len))
+      return slot->s;
+    i = (i + 1) & t->mask;
+  }
+
+  /* keep the table at most half full */
+  if ((t->count + 1) * 2 > t->mask + 1) {
+    intern_grow(h, t);
+    i = hash & t->mask;
+    while (t->slots[i].s)
+      i = (i + 1) & t->mask;
+  }
+  aml_pool_intern_entry_t *e = (aml_pool_intern_entry_t *)aml_pool_alloc(
+      h, sizeof(aml_pool_intern_entry_t) + len + 1);
+  e->hash = hash;
+  e->length = len;
+  char *r = (char *)(e + 1);
+  memcpy(r, s, len);
+  r[len] = 0;
+  t->slots[i].hash = hash;
+  t->slots[i].s = r;
+  t->count++;
+  h->intern_count++;
+  return r;
+}
+
+const char *aml_pool_intern(aml_pool_t *h, const char *s, size_t len) {
+  return intern_hashed(h, intern_table(h), s, len, intern_hash(s, len));
+}
+
+void aml_pool_intern_all(aml_pool_t *h, char **arr, size_t n) {
+  struct aml_pool_intern_s *t = intern_table(h);
+  uint64_t hashes[AML_POOL_INTERN_BATCH];
+  size_t lens[AML_POOL_INTERN_BATCH];
+  for (size_t base = 0; base < n; base += AML_POOL_INTERN_BATCH) {
+    size_t m = n - base;
+    if (m > AML_POOL_INTERN_BATCH)
+      m = AML_POOL_INTERN_BATCH;
+    /* hash the batch and start loading its slots so that the probes below
+       overlap their cache misses */
+    for (size_t i = 0; i < m; i++) {
+      const char *s = arr[base + i];
+      if (!s)
+        continue;
+      lens[i] = strlen(s);
+      hashes[i] = intern_hash(s, lens[i]);
+#if defined(__GNUC__) || defined(__clang__)
+      __builtin_prefetch(t->slots + (hashes[i] & t->mask));
+#endif
+    }
+    for (size_t i = 0; i < m; i++) {
+      char **s = arr + base + i;
+      if (*s)
+        *s = (char *)intern_hashed(h, t, *s, lens[i], hashes[i]);
+    }
+  }
+}
+
+size_t aml_pool_intern_count(aml_pool_t *h) {
+  return h->intern ? h->intern->count : 0;
+}
@@ -0,0 +1,336 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/extras/aml_pool_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AML_POOL_MAP_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AML_POOL_MAP_NEON
+#endif
+
+/* the number of control bytes compared at once, also the smallest table */
+#define AML_POOL_MAP_GROUP 16
+
+/* A control byte is either one of these (high bit set) or the low 7 bits of
+   the hash of the key in the slot. */
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
+
+/* Group masks have one bit per slot for SSE2 and the scalar code.  NEON has
+   no movemask, so it produces four bits per slot and keeps the top one. */
+#ifdef AML_POOL_MAP_NEON
+#define MASK_SHIFT 2
+#define MASK_UNUSED 0
+#else
+#define MASK_SHIFT 0
+#define MASK_UNUSED 48
+#endif
+
+#if defined(AML_POOL_MAP_SSE2)
+static inline uint64_t match_byte(const uint8_t *g, uint8_t b) {
+  __m128i v = _mm_loadu_si128((const __m128i *)g);
+  return (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)b)));
+}
+
+static inline uint64_t match_empty_or_deleted(const uint8_t *g) {
+  return (uint64_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+}
+#elif defined(AML_POOL_MAP_NEON)
+static inline uint64_t neon_mask(uint8x16_t eq) {
+  uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(n), 0) & 0x8888888888888888ULL;
+}
+
+static inline uint64_t match_byte(const uint8_t *g, uint8_t b) {
+  return neon_mask(vceqq_u8(vld1q_u8(g), vdupq_n_u8(b)));
+}
+
+static inline uint64_t match_empty_or_deleted(const uint8_t *g) {
+  return neon_mask(vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(g)), vdupq_n_s8(0)));
+}
+#else
+static inline uint64_t match_byte(const uint8_t *g, uint8_t b) {
+  uint64_t m = 0;
+  for (int i = 0; i < AML_POOL_MAP_GROUP; i++)
+    m |= (uint64_t)(g[i] == b) << i;
+  return m;
+}
+
+static inline uint64_t match_empty_or_deleted(const uint8_t *g) {
+  uint64_t m = 0;
+  for (int i = 0; i < AML_POOL_MAP_GROUP; i++)
+    m |= (uint64_t)(g[i] >> 7) << i;
+  return m;
+}
+#endif
+
+static inline uint64_t match_empty(const uint8_t *g) {
+  return match_byte(g, CTRL_EMPTY);
+}
+
+/* the slot of the lowest (highest) bit in a non-zero mask */
+static inline size_t trailing_slots(uint64_t m) {
+  return (size_t)__builtin_ctzll(m) >> MASK_SHIFT;
+}
+
+static inline size_t leading_slots(uint64_t m) {
+  return (size_t)(__builtin_clzll(m) - MASK_UNUSED) >> MASK_SHIFT;
+}
+
+/* MurmurHash64A */
+static uint64_t hash_bytes(const void *key, size_t len) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ (len * m);
+  while (len >= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+    p += 8;
+    len -= 8;
+  }
+  switch (len) {
+  case 7:
+    h ^= (uint64_t)p[6] << 48;
+    /* fall through */
+  case 6:
+    h ^= (uint64_t)p[5] << 40;
+    /* fall through */
+  case 5:
+    h ^= (uint64_t)p[4] << 32;
+    /* fall through */
+  case 4:
+    h ^= (uint64_t)p[3] << 24;
+    /* fall through */
+  case 3:
+    h ^= (uint64_t)p[2] << 16;
+    /* fall through */
+  case 2:
+    h ^= (uint64_t)p[1] << 8;
+    /* fall through */
+  case 1:
+    h ^= (uint64_t)p[0];
+    h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+/* the slot is picked with the high bits, the control byte gets the low 7 and
+   the entry keeps 32 more for a quick comparison */
+static inline size_t h1(uint64_t hash) { return (size_t)(hash >> 7); }
+static inline uint8_t h2(uint64_t hash) { return (uint8_t)(hash & 0x7F); }
+static inline uint32_t entry_hash(uint64_t hash) {
+  return (uint32_t)(hash >> 32);
+}
+
+static inline size_t max_load(size_t capacity) {
+  return capacity - capacity / 8;
+}
+
+static inline size_t ctrl_bytes(size_t capacity) {
+  return (capacity + AML_POOL_MAP_GROUP + 7) & ~(size_t)7;
+}
+
+static inline size_t table_bytes(size_t capacity) {
+  return ctrl_bytes(capacity) + capacity * sizeof(aml_pool_map_entry_t);
+}
+
+static void *table_alloc(aml_pool_map_t *h, size_t bytes) {
+  if (h->ba && bytes <= UINT32_MAX)
+    return aml_block_allocator_alloc(h->ba, (uint32_t)bytes);
+  return aml_pool_alloc(h->pool, bytes);
+}
+
+static void table_release(aml_pool_map_t *h, void *p, size_t bytes) {
+  if (h->ba && bytes <= UINT32_MAX)
+    aml_block_allocator_release(h->ba, p, (uint32_t)bytes);
+  else
+    /* only gives the memory back if nothing was allocated after it */
+    aml_pool_try_extend(h->pool, p, bytes, 0);
+}
+
+static inline void set_ctrl(aml_pool_map_t *h, size_t i, uint8_t v) {
+  size_t mask = h->capacity - 1;
+  h->ctrl[i] = v;
+  /* the copy of the first group at the end */
+  h->ctrl[((i - AML_POOL_MAP_GROUP) & mask) + AML_POOL_MAP_GROUP] = v;
+}
+
+/* Groups are probed quadratically (1, 2, 3, ... groups further along each
+   time), which visits every group of a power of two table. */
+static size_t find_free(aml_pool_map_t *h, uint64_t hash) {
+  size_t mask = h->capacity - 1;
+  size_t pos = h1(hash) & mask;
+  for (size_t step = AML_POOL_MAP_GROUP;; step += AML_POOL_MAP_GROUP) {
+    uint64_t m = match_empty_or_deleted(h->ctrl + pos);
+    if (m)
+      return (pos + trailing_slots(m)) & mask;
+    pos = (pos + step) & mask;
+  }
+}
+
+static size_t find_slot(aml_pool_map_t *h, const void *key, size_t len,
+                        uint64_t hash) {
+  size_t mask = h->capacity - 1;
+  size_t pos = h1(hash) & mask;
+  uint8_t tag = h2(hash);
+  uint32_t eh = entry_hash(hash);
+  for (size_t step = AML_POOL_MAP_GROUP;; step += AML_POOL_MAP_GROUP) {
+    const uint8_t *g = h->ctrl + pos;
+    for (uint64_t m = match_byte(g, tag); m; m &= m - 1) {
+      size_t i = (pos + trailing_slots(m)) & mask;
+      aml_pool_map_entry_t *e = h->entries + i;
+      if (e->hash == eh && e->len == len && !memcmp(e->key, key, len))
+        return i;
+    }
+    /* an empty slot ends every probe sequence which passed through here */
+    if (match_empty(g))
+      return SIZE_MAX;
+    pos = (pos + step) & mask;
+  }
+}
+
+static void rehash(aml_pool_map_t *h, size_t capacity) {
+  uint8_t *old_ctrl = h->ctrl;
+  aml_pool_map_entry_t *old_entries = h->entries;
+  size_t old_capacity = h->capacity;
+
+  uint8_t *ctrl = (uint8_t *)table_alloc(h, table_bytes(capacity));
+  memset(ctrl, CTRL_EMPTY, capacity + AML_POOL_MAP_GROUP);
+  h->ctrl = ctrl;
+  h->entries = (aml_pool_map_entry_t *)(ctrl + ctrl_bytes(capacity));
+  h->capacity = capacity;
+  h->growth_left = max_load(capacity) - h->size;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] & 0x80)
+      continue;
+    aml_pool_map_entry_t *e = old_entries + i;
+    uint64_t hash = hash_bytes(e->key, e->len);
+    size_t j = find_free(h, hash);
+    set_ctrl(h, j, h2(hash));
+    h->entries[j] = *e;
+  }
+  if (old_capacity)
+    table_release(h, old_ctrl, table_bytes(old_capacity));
+}
+
+aml_pool_map_t *aml_pool_map_init(aml_pool_t *pool, aml_block_allocator_t *ba) {
+  aml_pool_map_t *h = (aml_pool_map_t *)aml_pool_zalloc(pool, sizeof(*h));
+  h->pool = pool;
+  h->ba = ba;
+  return h;
+}
+
+void aml_pool_map_reserve(aml_pool_map_t *h, size_t n) {
+  size_t capacity = AML_POOL_MAP_GROUP;
+  while (max_load(capacity) < n)
+    capacity <<= 1;
+  if (capacity > h->capacity)
+    rehash(h, capacity);
+}
+
+aml_pool_map_entry_t *aml_pool_map_find(aml_pool_map_t *h, const void *key,
+                                        size_t len) {
+  if (!h->size)
+    return NULL;
+  size_t i = find_slot(h, key, len, hash_bytes(key, len));
+  return i == SIZE_MAX ? NULL : h->entries + i;
+}
+
+aml_pool_map_entry_t *aml_pool_map_insert(aml_pool_map_t *h, const void *key,
+                                          size_t len, bool *inserted) {
+  if (len > UINT32_MAX)
+    abort(); /* keys are limited to 4GB */
+  uint64_t hash = hash_bytes(key, len);
+  if (h->size) {
+    size_t i = find_slot(h, key, len, hash);
+    if (i != SIZE_MAX) {
+      if (inserted)
+        *inserted = false;
+      return h->entries + i;
+    }
+  }
+  if (!h->growth_left) {
+    /* a table which is mostly tombstones is rebuilt at the same size */
+    size_t capacity = h->capacity ? h->capacity : AML_POOL_MAP_GROUP;
+    if (h->size * 2 >= max_load(capacity))
+      capacity <<= 1;
+    rehash(h, capacity);
+  }
+
+  size_t i = find_free(h, hash);
+  if (h->ctrl[i] == CTRL_EMPTY)
+    h->growth_left--;
+  set_ctrl(h, i, h2(hash));
+  h->size++;
+
+  char *k = (char *)aml_pool_ualloc(h->pool, len + 1);
+  if (len)
+    memcpy(k, key, len);
+  k[len] = 0;
+  aml_pool_map_entry_t *e = h->entries + i;
+  e->key = k;
+  e->len = (uint32_t)len;
+  e->hash = entry_hash(hash);
+  e->value = NULL;
+  if (inserted)
+    *inserted = true;
+  return e;
+}
+
+bool aml_pool_map_remove(aml_pool_map_t *h, const void *key, size_t len) {
+  if (!h->size)
+    return false;
+  size_t i = find_slot(h, key, len, hash_bytes(key, len));
+  if (i == SIZE_MAX)
+    return false;
+  /* If no group which covers slot i was ever full, no probe sequence went
+     past it and the slot can simply become empty again. */
+  size_t mask = h->capacity - 1;
+  uint64_t empty_before = match_empty(h->ctrl + ((i - AML_POOL_MAP_GROUP) & mask));
+  uint64_t empty_after = match_empty(h->ctrl + i);
+  if (empty_before && empty_after &&
+      trailing_slots(empty_after) + leading_slots(empty_before) <
+          AML_POOL_MAP_GROUP) {
+    set_ctrl(h, i, CTRL_EMPTY);
+    h->growth_left++;
+  } else
+    set_ctrl(h, i, CTRL_DELETED);
+  h->size--;
+  return true;
+}
+
+aml_pool_map_entry_t *aml_pool_map_next(aml_pool_map_t *h, size_t *pos) {
+  for (size_t i = *pos; i < h->capacity; i++) {
+    if (!(h->ctrl[i] & 0x80)) {
+      *pos = i + 1;
+      return h->entries + i;
+    }
+  }
+  *pos = h->capacity;
+  return NULL;
+}
+
+void aml_pool_map_clear(aml_pool_map_t *h) {
+  if (!h->capacity)
+    return;
+  memset(h->ctrl, CTRL_EMPTY, h->capacity + AML_POOL_MAP_GROUP);
+  h->size = 0;
+  h->growth_left = max_load(h->capacity);
+}
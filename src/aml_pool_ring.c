@@ -0,0 +1,134 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_pool_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _AML_DEBUG_
+static void dump_ring(FILE *out, const char *caller, void *p, size_t length) {
+  (void)length;
+  aml_pool_ring_t *r = (aml_pool_ring_t *)p;
+  fprintf(out, "%s generations: %lu, epoch: %llu, spare: %lu ", caller,
+          r->generations, (unsigned long long)aml_pool_ring_epoch(r),
+          r->spares.bytes);
+}
+#endif
+
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+aml_pool_ring_t *_aml_pool_ring_init(size_t generations, size_t size,
+                                     const char *caller) {
+#else
+aml_pool_ring_t *_aml_pool_ring_init(size_t generations, size_t size) {
+#endif
+  if (!generations || generations > AML_POOL_RING_MAX_GENERATIONS)
+    abort();
+  size_t bytes =
+      sizeof(aml_pool_ring_t) + generations * sizeof(aml_pool_ring_generation_t);
+#ifdef _AML_DEBUG_
+  aml_pool_ring_t *r = (aml_pool_ring_t *)_aml_malloc_d(caller, bytes, true);
+  memset(r, 0, bytes);
+  r->dump.dump = dump_ring;
+#else
+  aml_pool_ring_t *r = (aml_pool_ring_t *)_aml_malloc_for(caller, bytes);
+  memset(r, 0, bytes);
+#endif
+  r->generations = generations;
+  r->spares.max_bytes = SIZE_MAX;
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->cond, NULL);
+  for (size_t i = 0; i < generations; i++) {
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+    aml_pool_t *pool = _aml_pool_init(size, caller);
+#else
+    aml_pool_t *pool = _aml_pool_init(size);
+#endif
+    pool->spares = &r->spares;
+    r->gens[i].pool = pool;
+    atomic_init(&r->gens[i].readers, 0);
+  }
+  r->current = r->gens[0].pool;
+  return r;
+}
+
+void aml_pool_ring_destroy(aml_pool_ring_t *r) {
+  for (size_t i = 0; i < r->generations; i++) {
+    if (atomic_load(&r->gens[i].readers))
+      abort(); /* a reader still holds this generation */
+    aml_pool_t *pool = r->gens[i].pool;
+    /* the extra blocks are freed rather than kept */
+    pool->spares = NULL;
+    aml_pool_destroy(pool);
+  }
+  _aml_pool_spares_trim(&r->spares, 0);
+  pthread_cond_destroy(&r->cond);
+  pthread_mutex_destroy(&r->lock);
+  aml_free(r);
+}
+
+static aml_pool_t *advance(aml_pool_ring_t *r, bool wait) {
+  uint64_t next = aml_pool_ring_epoch(r) + 1;
+  aml_pool_ring_generation_t *g = r->gens + next % r->generations;
+  if (atomic_load_explicit(&g->readers, memory_order_acquire)) {
+    if (!wait)
+      return NULL;
+    pthread_mutex_lock(&r->lock);
+    while (atomic_load_explicit(&g->readers, memory_order_acquire))
+      pthread_cond_wait(&r->cond, &r->lock);
+    pthread_mutex_unlock(&r->lock);
+  }
+  /* the generation's extra blocks go to the spares */
+  aml_pool_clear(g->pool);
+  atomic_store_explicit(&r->epoch, next, memory_order_release);
+  r->current = g->pool;
+  return g->pool;
+}
+
+aml_pool_t *aml_pool_ring_advance(aml_pool_ring_t *r) {
+  return advance(r, true);
+}
+
+aml_pool_t *aml_pool_ring_try_advance(aml_pool_ring_t *r) {
+  return advance(r, false);
+}
+
+/* the generation of epoch, aborting if it has been recycled */
+static aml_pool_ring_generation_t *generation(aml_pool_ring_t *r,
+                                              uint64_t epoch) {
+  uint64_t current = aml_pool_ring_epoch(r);
+  if (epoch > current || current - epoch >= r->generations)
+    abort();
+  return r->gens + epoch % r->generations;
+}
+
+void aml_pool_ring_retain(aml_pool_ring_t *r, uint64_t epoch) {
+  atomic_fetch_add_explicit(&generation(r, epoch)->readers, 1,
+                            memory_order_relaxed);
+}
+
+void aml_pool_ring_release(aml_pool_ring_t *r, uint64_t epoch) {
+  /* the generation can't be recycled while this reader holds it */
+  aml_pool_ring_generation_t *g = generation(r, epoch);
+  if (atomic_fetch_sub_explicit(&g->readers, 1, memory_order_acq_rel) == 1) {
+    /* taking the lock orders this with an advance about to wait */
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+  }
+}
+
+void aml_pool_ring_set_max_spare(aml_pool_ring_t *r, size_t max_bytes) {
+  r->spares.max_bytes = max_bytes;
+  _aml_pool_spares_trim(&r->spares, max_bytes);
+}
+
+void aml_pool_ring_stats(aml_pool_ring_t *r, aml_pool_ring_stats_t *out) {
+  out->epoch = aml_pool_ring_epoch(r);
+  out->spare_blocks = r->spares.blocks;
+  out->spare_bytes = r->spares.bytes;
+  out->reused = r->spares.reused;
+  out->misses = r->spares.misses;
+}
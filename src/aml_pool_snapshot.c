@@ -0,0 +1,218 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_pool_snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+
+static inline uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix(uint64_t acc, uint64_t w) {
+  acc += w * P2;
+  return rotl(acc, 31) * P1;
+}
+
+/* Four independent lanes over 32 byte stripes keep the multiplies from
+   waiting on each other, which matters when verifying a large image. */
+static uint64_t checksum(const char *p, size_t len) {
+  uint64_t a = P1 + P2, b = P2, c = 0, d = -P1;
+  uint64_t w[4];
+  size_t n = len;
+  while (n >= 32) {
+    memcpy(w, p, 32);
+    a = mix(a, w[0]);
+    b = mix(b, w[1]);
+    c = mix(c, w[2]);
+    d = mix(d, w[3]);
+    p += 32;
+    n -= 32;
+  }
+  uint64_t h = rotl(a, 1) + rotl(b, 7) + rotl(c, 12) + rotl(d, 18) + len;
+  while (n >= 8) {
+    memcpy(w, p, 8);
+    h = mix(h, w[0]);
+    p += 8;
+    n -= 8;
+  }
+  while (n) {
+    h = mix(h, (unsigned char)*p++);
+    n--;
+  }
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  return h;
+}
+
+static bool write_all(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+/* flush the rename of path to disk, so a crash can't leave the old image
+   (or none) in place after the write was reported */
+static bool sync_parent_dir(const char *path) {
+  const char *slash = strrchr(path, '/');
+  char *dir;
+  if (!slash)
+    dir = aml_strdup(".");
+  else if (slash == path)
+    dir = aml_strdup("/");
+  else {
+    dir = (char *)aml_malloc(slash - path + 1);
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = 0;
+  }
+  int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  aml_free(dir);
+  if (fd < 0)
+    return false;
+  bool ok = !fsync(fd);
+  close(fd);
+  return ok;
+}
+
+bool aml_pool_write_snapshot(aml_pool_t *h, const void *root,
+                             const char *path) {
+  /* pointers between blocks wouldn't survive the blocks being written next
+     to each other */
+  if (h->current->prev || h->large)
+    return false;
+  const char *start = (const char *)(h->current + 1);
+  size_t length = h->curp - start;
+  if (root && ((const char *)root < start || (const char *)root >= h->curp))
+    return false;
+
+  aml_pool_snapshot_header_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, AML_POOL_SNAPSHOT_MAGIC, sizeof(AML_POOL_SNAPSHOT_MAGIC));
+  hdr.version = AML_POOL_SNAPSHOT_VERSION;
+  hdr.data_offset = AML_POOL_SNAPSHOT_ALIGN +
+                    ((uintptr_t)start & (AML_POOL_SNAPSHOT_ALIGN - 1));
+  hdr.length = length;
+  hdr.root = root ? (uint64_t)((const char *)root - start) : UINT64_MAX;
+  hdr.checksum = checksum(start, length);
+
+  size_t path_len = strlen(path);
+  char *tmp = (char *)aml_malloc(path_len + sizeof(".XXXXXX"));
+  memcpy(tmp, path, path_len);
+  memcpy(tmp + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    aml_free(tmp);
+    return false;
+  }
+
+  /* the header, zeros up to the data and then the data */
+  char *head = (char *)aml_calloc(1, hdr.data_offset);
+  memcpy(head, &hdr, sizeof(hdr));
+  /* mkstemp creates the file 0600, which other accounts couldn't map */
+  bool ok = write_all(fd, head, hdr.data_offset) &&
+            write_all(fd, start, length) && !fchmod(fd, 0644) && !fsync(fd);
+  aml_free(head);
+  if (close(fd))
+    ok = false;
+  if (ok && rename(tmp, path))
+    ok = false;
+  if (!ok)
+    unlink(tmp);
+  else
+    ok = sync_parent_dir(path);
+  aml_free(tmp);
+  return ok;
+}
+
+aml_pool_snapshot_t *aml_pool_map_snapshot(const char *path, uint32_t flags) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+      (size_t)st.st_size < sizeof(aml_pool_snapshot_header_t)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  int prot = PROT_READ;
+  if (flags & AML_POOL_SNAPSHOT_WRITABLE)
+    prot |= PROT_WRITE;
+  char *map = (char *)mmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == (char *)MAP_FAILED)
+    return NULL;
+
+  aml_pool_snapshot_header_t hdr;
+  memcpy(&hdr, map, sizeof(hdr));
+  bool ok = !memcmp(hdr.magic, AML_POOL_SNAPSHOT_MAGIC,
+                    sizeof(AML_POOL_SNAPSHOT_MAGIC)) &&
+            hdr.version == AML_POOL_SNAPSHOT_VERSION &&
+            hdr.data_offset >= sizeof(hdr) && hdr.data_offset <= size &&
+            hdr.length == size - hdr.data_offset &&
+            (hdr.root == UINT64_MAX || hdr.root < hdr.length);
+  if (ok && (flags & AML_POOL_SNAPSHOT_VERIFY))
+    ok = checksum(map + hdr.data_offset, hdr.length) == hdr.checksum;
+  if (!ok) {
+    munmap(map, size);
+    return NULL;
+  }
+
+  aml_pool_snapshot_t *s =
+      (aml_pool_snapshot_t *)aml_malloc(sizeof(aml_pool_snapshot_t));
+  s->map = map;
+  s->map_length = size;
+  s->data = map + hdr.data_offset;
+  s->length = hdr.length;
+  s->root = hdr.root == UINT64_MAX ? NULL : s->data + hdr.root;
+  s->pool = NULL;
+  return s;
+}
+
+void aml_pool_snapshot_unmap(aml_pool_snapshot_t *s) {
+  if (s->pool)
+    aml_pool_destroy(s->pool);
+  munmap(s->map, s->map_length);
+  aml_free(s);
+}
+
+void *aml_pool_snapshot_root(aml_pool_snapshot_t *s) { return s->root; }
+
+void *aml_pool_snapshot_data(aml_pool_snapshot_t *s) { return s->data; }
+
+size_t aml_pool_snapshot_length(aml_pool_snapshot_t *s) { return s->length; }
+
+bool aml_pool_snapshot_contains(aml_pool_snapshot_t *s, const void *p) {
+  return (const char *)p >= s->data && (const char *)p < s->data + s->length;
+}
+
+aml_pool_t *aml_pool_snapshot_pool(aml_pool_snapshot_t *s) {
+  if (!s->pool)
+    s->pool = aml_pool_init(AML_POOL_SNAPSHOT_POOL_SIZE);
+  return s->pool;
+}
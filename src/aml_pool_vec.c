@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/extras/aml_pool_vec.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* the first array holds at least this many bytes */
+#define AML_POOL_VEC_MIN_BYTES 64
+
+void _aml_pool_vec_grow(aml_pool_t *pool, void **data, size_t *cap, size_t len,
+                        size_t need, size_t elem_size) {
+  size_t new_cap = *cap ? *cap * 2 : AML_POOL_VEC_MIN_BYTES / elem_size;
+  if (new_cap < need)
+    new_cap = need;
+  if (new_cap > SIZE_MAX / elem_size)
+    abort();
+  if (*data &&
+      aml_pool_try_extend(pool, *data, *cap * elem_size, new_cap * elem_size)) {
+    *cap = new_cap;
+    return;
+  }
+  void *d = aml_pool_alloc(pool, new_cap * elem_size);
+  if (len)
+    memcpy(d, *data, len * elem_size);
+  *data = d;
+  *cap = new_cap;
+}
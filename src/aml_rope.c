@@ -0,0 +1,233 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_rope.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static aml_rope_segment_t *new_segment(aml_rope_t *h, size_t size) {
+  size_t bytes = sizeof(aml_rope_segment_t) + size + 1;
+  aml_rope_segment_t *s =
+      h->pool ? (aml_rope_segment_t *)aml_pool_alloc(h->pool, bytes)
+              : (aml_rope_segment_t *)_aml_malloc_for(h->caller, bytes);
+  s->next = NULL;
+  s->length = 0;
+  s->size = size;
+  return s;
+}
+
+static void free_segments(aml_rope_segment_t *s) {
+  while (s) {
+    aml_rope_segment_t *next = s->next;
+    aml_free(s);
+    s = next;
+  }
+}
+
+static void rope_setup(aml_rope_t *h, size_t segment_size) {
+  if (!segment_size)
+    segment_size = AML_ROPE_DEFAULT_SEGMENT_SIZE;
+  h->length = 0;
+  h->segment_size = segment_size;
+  h->max_segment_size = segment_size > AML_ROPE_MAX_SEGMENT_SIZE
+                            ? segment_size
+                            : AML_ROPE_MAX_SEGMENT_SIZE;
+  h->head = h->tail = new_segment(h, segment_size);
+}
+
+#ifdef _AML_DEBUG_
+static void dump_rope(FILE *out, const char *caller, void *p, size_t length) {
+  (void)length;
+  aml_rope_t *h = (aml_rope_t *)p;
+  fprintf(out, "%s length: %lu, segments: %lu ", caller, h->length,
+          aml_rope_segments(h));
+}
+
+aml_rope_t *_aml_rope_init(size_t segment_size, const char *caller) {
+  aml_rope_t *h =
+      (aml_rope_t *)_aml_malloc_d(caller, sizeof(aml_rope_t), true);
+  h->dump.dump = dump_rope;
+#elif defined(_AML_SAMPLING_)
+aml_rope_t *_aml_rope_init(size_t segment_size, const char *caller) {
+  aml_rope_t *h = (aml_rope_t *)_aml_malloc_s(caller, sizeof(aml_rope_t));
+  h->caller = caller;
+#else
+aml_rope_t *_aml_rope_init(size_t segment_size) {
+  aml_rope_t *h = (aml_rope_t *)aml_malloc(sizeof(aml_rope_t));
+#endif
+  h->pool = NULL;
+  rope_setup(h, segment_size);
+  return h;
+}
+
+aml_rope_t *aml_rope_pool_init(aml_pool_t *pool, size_t segment_size) {
+  aml_rope_t *h = (aml_rope_t *)aml_pool_zalloc(pool, sizeof(aml_rope_t));
+#ifdef _AML_SAMPLING_
+  h->caller = pool->caller;
+#endif
+  h->pool = pool;
+  rope_setup(h, segment_size);
+  return h;
+}
+
+void aml_rope_destroy(aml_rope_t *h) {
+  if (h->pool)
+    return;
+  free_segments(h->head);
+  aml_free(h);
+}
+
+void aml_rope_set_max_segment_size(aml_rope_t *h, size_t max_size) {
+  h->max_segment_size = max_size;
+  if (h->segment_size > max_size)
+    h->segment_size = max_size;
+}
+
+void aml_rope_clear(aml_rope_t *h) {
+  for (aml_rope_segment_t *s = h->head; s; s = s->next)
+    s->length = 0;
+  h->tail = h->head;
+  h->length = 0;
+}
+
+void _aml_rope_next(aml_rope_t *h, size_t length) {
+  aml_rope_segment_t *t = h->tail;
+  aml_rope_segment_t *s = t->next;
+  if (!s && h->pool) {
+    /* if the tail is the pool's last allocation, it can simply grow */
+    size_t avail = t->size - t->length;
+    size_t size = t->size + (length - avail);
+    if (size < t->size + h->segment_size)
+      size = t->size + h->segment_size;
+    if (aml_pool_try_extend(h->pool, t, sizeof(*t) + t->size + 1,
+                            sizeof(*t) + size + 1)) {
+      t->size = size;
+      return;
+    }
+  }
+  if (!s || s->size < length) {
+    /* a spare which is too small stays after the new segment */
+    size_t size = h->segment_size;
+    if (size < h->max_segment_size) {
+      h->segment_size <<= 1;
+      if (h->segment_size > h->max_segment_size)
+        h->segment_size = h->max_segment_size;
+    }
+    if (size < length)
+      size = length;
+    s = new_segment(h, size);
+    s->next = t->next;
+    t->next = s;
+  }
+  h->tail = s;
+}
+
+void _aml_rope_append(aml_rope_t *h, const void *data, size_t length) {
+  const char *p = (const char *)data;
+  aml_rope_segment_t *t = h->tail;
+  size_t avail = t->size - t->length;
+  if (avail) {
+    memcpy(_aml_rope_segment_data(t) + t->length, p, avail);
+    t->length += avail;
+    h->length += avail;
+    p += avail;
+    length -= avail;
+  }
+  _aml_rope_next(h, length);
+  t = h->tail;
+  memcpy(_aml_rope_segment_data(t) + t->length, p, length);
+  t->length += length;
+  h->length += length;
+}
+
+void aml_rope_appendvf(aml_rope_t *h, const char *fmt, va_list args) {
+  va_list args_copy;
+  va_copy(args_copy, args);
+  aml_rope_segment_t *t = h->tail;
+  size_t leftover = t->size - t->length;
+  /* the byte after size is there for the terminator */
+  int n = vsnprintf(_aml_rope_segment_data(t) + t->length, leftover + 1, fmt,
+                    args_copy);
+  va_end(args_copy);
+  if (n < 0)
+    abort();
+  if ((size_t)n > leftover) {
+    /* the formatted string has to be contiguous, so the rest of the current
+       segment may be left unused */
+    _aml_rope_next(h, n);
+    t = h->tail;
+    va_copy(args_copy, args);
+    int n2 = vsnprintf(_aml_rope_segment_data(t) + t->length, n + 1, fmt,
+                       args_copy);
+    va_end(args_copy);
+    if (n != n2)
+      abort(); // should never happen!
+  }
+  t->length += n;
+  h->length += n;
+}
+
+size_t aml_rope_segments(aml_rope_t *h) {
+  size_t n = 0;
+  for (aml_rope_segment_t *s = h->head;; s = s->next) {
+    if (s->length)
+      n++;
+    if (s == h->tail)
+      return n;
+  }
+}
+
+size_t aml_rope_iovec(aml_rope_t *h, struct iovec *iov, size_t max) {
+  size_t n = 0;
+  for (aml_rope_segment_t *s = h->head; n < max; s = s->next) {
+    if (s->length) {
+      iov[n].iov_base = _aml_rope_segment_data(s);
+      iov[n].iov_len = s->length;
+      n++;
+    }
+    if (s == h->tail)
+      break;
+  }
+  return n;
+}
+
+void aml_rope_copy(aml_rope_t *h, void *dest) {
+  char *d = (char *)dest;
+  for (aml_rope_segment_t *s = h->head;; s = s->next) {
+    if (s->length) {
+      memcpy(d, _aml_rope_segment_data(s), s->length);
+      d += s->length;
+    }
+    if (s == h->tail)
+      return;
+  }
+}
+
+char *aml_rope_data(aml_rope_t *h) {
+  /* the data is already contiguous if it is all in one segment */
+  aml_rope_segment_t *s = h->head;
+  while (s != h->tail && !s->length)
+    s = s->next;
+  if (s->length == h->length) {
+    _aml_rope_segment_data(s)[s->length] = 0;
+    return _aml_rope_segment_data(s);
+  }
+
+  /* leave room to keep appending */
+  aml_rope_segment_t *flat = new_segment(h, h->length + h->segment_size);
+  aml_rope_copy(h, _aml_rope_segment_data(flat));
+  flat->length = h->length;
+  _aml_rope_segment_data(flat)[flat->length] = 0;
+  if (h->pool) {
+    /* pool memory can't be given back, so the old segments become spares */
+    aml_rope_clear(h);
+    flat->next = h->head;
+  } else
+    free_segments(h->head);
+  h->head = h->tail = flat;
+  h->length = flat->length;
+  return _aml_rope_segment_data(flat);
+}
@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_scratch.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/* one conflict can always be avoided with two arenas */
+#define AML_SCRATCH_ARENAS 2
+
+typedef struct {
+  aml_pool_t *arena[AML_SCRATCH_ARENAS];
+  bool registered;
+} aml_scratch_local_t;
+
+static _Thread_local aml_scratch_local_t local_scratch;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static void release_local(void *arg) {
+  aml_scratch_local_t *l = (aml_scratch_local_t *)arg;
+  for (int i = 0; i < AML_SCRATCH_ARENAS; i++) {
+    if (l->arena[i])
+      aml_pool_destroy(l->arena[i]);
+    l->arena[i] = NULL;
+  }
+}
+
+static void make_key(void) { pthread_key_create(&key, release_local); }
+
+static aml_pool_t *new_arena(aml_scratch_local_t *l, int i) {
+  if (!l->registered) {
+    /* so that the arenas are destroyed when the thread exits */
+    pthread_once(&key_once, make_key);
+    pthread_setspecific(key, l);
+    l->registered = true;
+  }
+  l->arena[i] = aml_pool_init(AML_SCRATCH_SIZE);
+  return l->arena[i];
+}
+
+aml_scratch_t aml_scratch_begin(aml_pool_t *conflict) {
+  aml_scratch_local_t *l = &local_scratch;
+  aml_scratch_t s;
+  s.pool = l->arena[0];
+  if (!s.pool)
+    s.pool = new_arena(l, 0);
+  if (s.pool == conflict) {
+    s.pool = l->arena[1];
+    if (!s.pool)
+      s.pool = new_arena(l, 1);
+  }
+  aml_pool_save(s.pool, &s.marker);
+  return s;
+}
+
+void aml_scratch_end(aml_scratch_t *s) { aml_pool_restore(s->pool, &s->marker); }
+
+void aml_scratch_release(void) { release_local(&local_scratch); }
@@ -0,0 +1,572 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_slice.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define AML_SPLIT_X86
+#include <immintrin.h>
+#define AML_TARGET(x) __attribute__((target(x)))
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define AML_SPLIT_NEON
+#include <arm_neon.h>
+#endif
+
+/* The string is scanned one aligned 64 byte block at a time.  A block never
+   crosses a page, so the kernels may read bytes before the start of the
+   string and after its terminator without faulting; those bits are masked
+   off or never reached.  The sanitizer can't know that, so the kernels are
+   not instrumented. */
+#if defined(__clang__) || defined(__GNUC__)
+#define AML_SPLIT_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define AML_SPLIT_NO_ASAN
+#endif
+
+#define AML_SPLIT_BLOCK 64
+
+/* A kernel returns a bit for every byte in the aligned block which is a, b,
+   c or d (bit i for block[i]).  The callers repeat a character when they
+   need fewer than four. */
+typedef uint64_t (*split_mask_cb)(const char *block, char a, char b, char c,
+                                  char d);
+
+typedef struct {
+  const char *name;
+  split_mask_cb mask;
+  bool (*supported)(void);
+} split_kernel_t;
+
+// -----------------------------------------------------------------------------
+// Kernels
+// -----------------------------------------------------------------------------
+AML_SPLIT_NO_ASAN
+static uint64_t mask_scalar(const char *block, char a, char b, char c,
+                            char d) {
+  uint64_t r = 0;
+  for (int i = 0; i < AML_SPLIT_BLOCK; i++) {
+    char ch = block[i];
+    if (ch == a || ch == b || ch == c || ch == d)
+      r |= (uint64_t)1 << i;
+  }
+  return r;
+}
+
+static bool supported_always(void) { return true; }
+
+#ifdef AML_SPLIT_X86
+/* SSE2 is part of x86-64, but not of every 32 bit target */
+AML_SPLIT_NO_ASAN AML_TARGET("sse2")
+static uint64_t mask_sse2(const char *block, char a, char b, char c,
+                          char d) {
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  const __m128i vc = _mm_set1_epi8(c);
+  const __m128i vd = _mm_set1_epi8(d);
+  uint64_t r = 0;
+  for (int i = 0; i < AML_SPLIT_BLOCK; i += 16) {
+    __m128i v = _mm_load_si128((const __m128i *)(block + i));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd)));
+    r |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << i;
+  }
+  return r;
+}
+
+static bool supported_sse2(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+AML_SPLIT_NO_ASAN AML_TARGET("avx2")
+static uint64_t mask_avx2(const char *block, char a, char b, char c,
+                          char d) {
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  const __m256i vc = _mm256_set1_epi8(c);
+  const __m256i vd = _mm256_set1_epi8(d);
+  __m256i lo = _mm256_load_si256((const __m256i *)block);
+  __m256i hi = _mm256_load_si256((const __m256i *)(block + 32));
+  __m256i mlo = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(lo, va), _mm256_cmpeq_epi8(lo, vb)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(lo, vc), _mm256_cmpeq_epi8(lo, vd)));
+  __m256i mhi = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(hi, va), _mm256_cmpeq_epi8(hi, vb)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(hi, vc), _mm256_cmpeq_epi8(hi, vd)));
+  return (uint64_t)(uint32_t)_mm256_movemask_epi8(mlo) |
+         ((uint64_t)(uint32_t)_mm256_movemask_epi8(mhi) << 32);
+}
+
+static bool supported_avx2(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#ifdef AML_SPLIT_NEON
+/* NEON has no movemask, so each lane keeps one bit of its byte's position
+   and three rounds of pairwise adds fold the four vectors into 64 bits. */
+AML_SPLIT_NO_ASAN
+static uint64_t mask_neon(const char *block, char a, char b, char c,
+                          char d) {
+  static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                   1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t vbits = vld1q_u8(bits);
+  const uint8x16_t va = vdupq_n_u8((uint8_t)a);
+  const uint8x16_t vb = vdupq_n_u8((uint8_t)b);
+  const uint8x16_t vc = vdupq_n_u8((uint8_t)c);
+  const uint8x16_t vd = vdupq_n_u8((uint8_t)d);
+  uint8x16_t m[4];
+  for (int i = 0; i < 4; i++) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)block + i * 16);
+    uint8x16_t t = vorrq_u8(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb)),
+                            vorrq_u8(vceqq_u8(v, vc), vceqq_u8(v, vd)));
+    m[i] = vandq_u8(t, vbits);
+  }
+  uint8x16_t s = vpaddq_u8(vpaddq_u8(m[0], m[1]), vpaddq_u8(m[2], m[3]));
+  s = vpaddq_u8(s, s);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(s), 0);
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------------------------
+/* ordered from least to most preferred */
+static const split_kernel_t split_kernels[] = {
+    {"scalar", mask_scalar, supported_always},
+#ifdef AML_SPLIT_X86
+    {"sse2", mask_sse2, supported_sse2},
+    {"avx2", mask_avx2, supported_avx2},
+#endif
+#ifdef AML_SPLIT_NEON
+    {"neon", mask_neon, supported_always},
+#endif
+};
+
+#define AML_SPLIT_KERNELS (sizeof(split_kernels) / sizeof(split_kernels[0]))
+
+static const split_kernel_t *split_kernel = NULL;
+
+static const split_kernel_t *best_kernel(void) {
+  size_t i = AML_SPLIT_KERNELS;
+  while (i > 1 && !split_kernels[i - 1].supported())
+    i--;
+  return split_kernels + i - 1;
+}
+
+/* Every thread which races to pick the kernel picks the same one. */
+static inline const split_kernel_t *get_kernel(void) {
+  const split_kernel_t *k = __atomic_load_n(&split_kernel, __ATOMIC_ACQUIRE);
+  if (!k) {
+    k = best_kernel();
+    __atomic_store_n(&split_kernel, k, __ATOMIC_RELEASE);
+  }
+  return k;
+}
+
+bool aml_split_use(const char *name) {
+  if (!name) {
+    __atomic_store_n(&split_kernel, best_kernel(), __ATOMIC_RELEASE);
+    return true;
+  }
+  for (size_t i = 0; i < AML_SPLIT_KERNELS; i++) {
+    if (!strcmp(split_kernels[i].name, name)) {
+      if (!split_kernels[i].supported())
+        return false;
+      __atomic_store_n(&split_kernel, split_kernels + i, __ATOMIC_RELEASE);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *aml_split_kernel(void) { return get_kernel()->name; }
+
+// -----------------------------------------------------------------------------
+// The result arrays
+// -----------------------------------------------------------------------------
+/* The number of pieces isn't known until the end of the input, so the
+   array starts small and doubles.  It is normally the last thing allocated
+   from the pool (just after the copy of the string), so it can usually grow
+   in place by extending the allocation into the rest of the current block.
+   The same code builds the char * arrays and the aml_slice_t arrays. */
+#define AML_SPLIT_INITIAL 16
+
+typedef struct {
+  aml_pool_t *pool;
+  char *arr;
+  size_t num;
+  size_t size;
+  size_t elem;
+} split_out_t;
+
+static void split_out_init(split_out_t *o, aml_pool_t *pool, size_t elem) {
+  o->pool = pool;
+  o->arr = (char *)aml_pool_alloc(pool, elem * AML_SPLIT_INITIAL);
+  o->num = 0;
+  o->size = AML_SPLIT_INITIAL;
+  o->elem = elem;
+}
+
+static void split_out_grow(split_out_t *o) {
+  size_t bytes = o->elem * o->size;
+  o->arr = (char *)aml_pool_realloc(o->pool, o->arr, bytes, bytes * 2);
+  o->size *= 2;
+}
+
+static inline void split_out_push(split_out_t *o, char *s) {
+  if (o->num == o->size)
+    split_out_grow(o);
+  ((char **)o->arr)[o->num++] = s;
+}
+
+static char **split_out_finish(split_out_t *o, size_t *num_splits) {
+  if (num_splits)
+    *num_splits = o->num;
+  split_out_push(o, NULL);
+  return (char **)o->arr;
+}
+
+static inline void slice_out_push(split_out_t *o, aml_slice_t s) {
+  if (o->num == o->size)
+    split_out_grow(o);
+  ((aml_slice_t *)o->arr)[o->num++] = s;
+}
+
+static aml_slice_t *slice_out_finish(split_out_t *o, size_t *num) {
+  if (num)
+    *num = o->num;
+  slice_out_push(o, aml_slice(NULL, 0));
+  return (aml_slice_t *)o->arr;
+}
+
+// -----------------------------------------------------------------------------
+// Splitting
+// -----------------------------------------------------------------------------
+static char *split_nil = NULL;
+
+static char **split_nil_result(size_t *num_splits) {
+  if (num_splits)
+    *num_splits = 0;
+  return &split_nil;
+}
+
+/* Each delimiter is replaced with a zero as it is found, so the string is
+   only walked once.  The block's mask is taken before any of it is written,
+   and the bytes which are written are all behind the current position. */
+static char **split_scan(aml_pool_t *h, size_t *num_splits, char delim,
+                         char *s, bool skip_empty) {
+  split_mask_cb mask = get_kernel()->mask;
+  split_out_t out;
+  split_out_init(&out, h, sizeof(char *));
+
+  char *field = s;
+  char *block = (char *)((uintptr_t)s & ~(uintptr_t)(AML_SPLIT_BLOCK - 1));
+  uint64_t m = mask(block, delim, 0, 0, 0) & (~(uint64_t)0 << (s - block));
+  while (true) {
+    while (m) {
+      char *c = block + __builtin_ctzll(m);
+      m &= m - 1;
+      bool end = (*c == 0);
+      if (!skip_empty || c > field)
+        split_out_push(&out, field);
+      if (end)
+        return split_out_finish(&out, num_splits);
+      *c = 0;
+      field = c + 1;
+    }
+    block += AML_SPLIT_BLOCK;
+    m = mask(block, delim, 0, 0, 0);
+  }
+}
+
+/* The escape characters are removed, which shifts the rest of the piece to
+   the left.  Until the first escape is seen, nothing needs to move.  After
+   that, the run between two special characters is moved with memmove (wp
+   always trails rp). */
+static char **split_scan_escape(aml_pool_t *h, size_t *num_splits, char delim,
+                                char escape, char *s, bool skip_empty) {
+  split_mask_cb mask = get_kernel()->mask;
+  split_out_t out;
+  split_out_init(&out, h, sizeof(char *));
+
+  char *field = s; /* the start of the current piece */
+  char *wp = s;    /* where the next byte of the piece goes */
+  char *rp = s;    /* the first byte which hasn't been consumed */
+  char *block = (char *)((uintptr_t)s & ~(uintptr_t)(AML_SPLIT_BLOCK - 1));
+  uint64_t m = mask(block, delim, escape, 0, 0) & (~(uint64_t)0 << (s - block));
+  while (true) {
+    while (m) {
+      char *c = block + __builtin_ctzll(m);
+      m &= m - 1;
+      /* the character after an escape was already consumed */
+      if (c < rp)
+        continue;
+      if (wp != rp)
+        memmove(wp, rp, c - rp);
+      wp += c - rp;
+      char ch = *c;
+      if (ch == escape && c[1] != 0) {
+        /* keep the next character, whatever it is */
+        *wp++ = c[1];
+        rp = c + 2;
+        continue;
+      }
+      /* a trailing escape is dropped */
+      bool end = (ch == 0 || ch == escape);
+      *wp = 0;
+      if (!skip_empty || wp > field)
+        split_out_push(&out, field);
+      if (end)
+        return split_out_finish(&out, num_splits);
+      wp++;
+      field = wp;
+      rp = c + 1;
+    }
+    block += AML_SPLIT_BLOCK;
+    m = mask(block, delim, escape, 0, 0);
+  }
+}
+
+char **_aml_pool_split(aml_pool_t *h, size_t *num_splits, char delim, char *s) {
+  if (!s)
+    return split_nil_result(num_splits);
+  return split_scan(h, num_splits, delim, s, false);
+}
+
+char **aml_pool_split(aml_pool_t *h, size_t *num_splits, char delim,
+                     const char *p) {
+  return _aml_pool_split(h, num_splits, delim, p ? aml_pool_strdup(h, p) : NULL);
+}
+
+char **aml_pool_splitf(aml_pool_t *h, size_t *num_splits, char delim,
+                      const char *p, ...) {
+  va_list args;
+  va_start(args, p);
+  char *r = aml_pool_strdupvf(h, p, args);
+  va_end(args);
+  return _aml_pool_split(h, num_splits, delim, r);
+}
+
+char **_aml_pool_split2(aml_pool_t *h, size_t *num_splits, char delim, char *s) {
+  if (!s)
+    return split_nil_result(num_splits);
+  return split_scan(h, num_splits, delim, s, true);
+}
+
+char **aml_pool_split2(aml_pool_t *h, size_t *num_splits, char delim,
+                      const char *p) {
+  return _aml_pool_split2(h, num_splits, delim, p ? aml_pool_strdup(h, p) : NULL);
+}
+
+char **aml_pool_split2f(aml_pool_t *h, size_t *num_splits, char delim,
+                       const char *p, ...) {
+  va_list args;
+  va_start(args, p);
+  char *r = aml_pool_strdupvf(h, p, args);
+  va_end(args);
+  return _aml_pool_split2(h, num_splits, delim, r);
+}
+
+char **_aml_pool_split_with_escape(aml_pool_t *h, size_t *num_splits,
+                                   char delim, char escape, char *s) {
+  if (!s)
+    return split_nil_result(num_splits);
+  return split_scan_escape(h, num_splits, delim, escape, s, false);
+}
+
+char **aml_pool_split_with_escape(aml_pool_t *h, size_t *num_splits, char delim, char escape,
+                                  const char *p) {
+  return _aml_pool_split_with_escape(h, num_splits, delim, escape, p ? aml_pool_strdup(h, p) : NULL);
+}
+
+char **aml_pool_split_with_escapef(aml_pool_t *h, size_t *num_splits, char delim, char escape,
+                                   const char *p, ...) {
+  va_list args;
+  va_start(args, p);
+  char *r = aml_pool_strdupvf(h, p, args);
+  va_end(args);
+  return _aml_pool_split_with_escape(h, num_splits, delim, escape, r);
+}
+
+char **_aml_pool_split_with_escape2(aml_pool_t *h, size_t *num_splits,
+                                    char delim, char escape, char *s) {
+  if (!s)
+    return split_nil_result(num_splits);
+  return split_scan_escape(h, num_splits, delim, escape, s, true);
+}
+
+char **aml_pool_split_with_escape2(aml_pool_t *h, size_t *num_splits, char delim, char escape,
+                                   const char *p) {
+  return _aml_pool_split_with_escape2(h, num_splits, delim, escape, p ? aml_pool_strdup(h, p) : NULL);
+}
+
+char **aml_pool_split_with_escape2f(aml_pool_t *h, size_t *num_splits, char delim, char escape,
+                                    const char *p, ...) {
+  va_list args;
+  va_start(args, p);
+  char *r = aml_pool_strdupvf(h, p, args);
+  va_end(args);
+  return _aml_pool_split_with_escape2(h, num_splits, delim, escape, r);
+}
+
+// -----------------------------------------------------------------------------
+// Slices
+// -----------------------------------------------------------------------------
+#define AML_SLICE_DONE 1
+#define AML_SLICE_SKIP_EMPTY 2
+/* the delimiters are in set rather than delim */
+#define AML_SLICE_SET 4
+
+/* The input isn't null terminated, so the last block is cut off at ep. */
+static inline uint64_t slice_block_mask(aml_slice_iter_t *it) {
+  uint64_t m = get_kernel()->mask(it->block, it->delim[0], it->delim[1],
+                                  it->delim[2], it->delim[3]);
+  size_t left = it->ep - it->block;
+  if (left < AML_SPLIT_BLOCK)
+    m &= ((uint64_t)1 << left) - 1;
+  return m;
+}
+
+static void slice_iter_start(aml_slice_iter_t *it, const char *p, size_t len,
+                             uint8_t flags) {
+  it->p = p;
+  it->ep = p;
+  it->block = p;
+  it->mask = 0;
+  it->flags = flags;
+  if (!p) {
+    it->flags |= AML_SLICE_DONE;
+    return;
+  }
+  it->ep = p + len;
+  it->block = (const char *)((uintptr_t)p & ~(uintptr_t)(AML_SPLIT_BLOCK - 1));
+  /* an empty buffer may not have a readable byte at p */
+  if (len && !(flags & AML_SLICE_SET))
+    it->mask = slice_block_mask(it) & (~(uint64_t)0 << (p - it->block));
+}
+
+/* the next delimiter, or NULL if there isn't one before ep */
+static const char *slice_find(aml_slice_iter_t *it) {
+  if (it->flags & AML_SLICE_SET) {
+    for (const char *c = it->p; c < it->ep; c++) {
+      unsigned char ch = (unsigned char)*c;
+      if (it->set[ch >> 6] & ((uint64_t)1 << (ch & 63)))
+        return c;
+    }
+    return NULL;
+  }
+  while (!it->mask) {
+    if (it->ep - it->block <= AML_SPLIT_BLOCK)
+      return NULL;
+    it->block += AML_SPLIT_BLOCK;
+    it->mask = slice_block_mask(it);
+  }
+  const char *c = it->block + __builtin_ctzll(it->mask);
+  it->mask &= it->mask - 1;
+  return c;
+}
+
+void aml_slice_split_init(aml_slice_iter_t *it, const char *p, size_t len,
+                          char delim) {
+  memset(it->delim, delim, sizeof(it->delim));
+  slice_iter_start(it, p, len, 0);
+}
+
+void aml_slice_tokenize_init(aml_slice_iter_t *it, const char *p, size_t len,
+                             const char *delims) {
+  size_t n = strlen(delims);
+  uint8_t flags = AML_SLICE_SKIP_EMPTY;
+  if (n && n <= sizeof(it->delim)) {
+    for (size_t i = 0; i < sizeof(it->delim); i++)
+      it->delim[i] = delims[i < n ? i : 0];
+  } else {
+    /* no delimiters at all is an empty set, never matched */
+    memset(it->set, 0, sizeof(it->set));
+    for (size_t i = 0; i < n; i++) {
+      unsigned char ch = (unsigned char)delims[i];
+      it->set[ch >> 6] |= (uint64_t)1 << (ch & 63);
+    }
+    flags |= AML_SLICE_SET;
+  }
+  slice_iter_start(it, p, len, flags);
+}
+
+bool aml_slice_next(aml_slice_iter_t *it, aml_slice_t *out) {
+  while (!(it->flags & AML_SLICE_DONE)) {
+    const char *start = it->p;
+    const char *c = slice_find(it);
+    if (c)
+      it->p = c + 1;
+    else {
+      c = it->ep;
+      it->flags |= AML_SLICE_DONE;
+    }
+    if (c > start || !(it->flags & AML_SLICE_SKIP_EMPTY)) {
+      *out = aml_slice(start, c - start);
+      return true;
+    }
+  }
+  return false;
+}
+
+static aml_slice_t *slice_collect(aml_pool_t *h, size_t *num,
+                                  aml_slice_iter_t *it) {
+  split_out_t out;
+  split_out_init(&out, h, sizeof(aml_slice_t));
+  aml_slice_t s;
+  while (aml_slice_next(it, &s))
+    slice_out_push(&out, s);
+  return slice_out_finish(&out, num);
+}
+
+aml_slice_t *aml_pool_split_slices(aml_pool_t *h, size_t *num, char delim,
+                                   const char *p, size_t len) {
+  aml_slice_iter_t it;
+  aml_slice_split_init(&it, p, len, delim);
+  return slice_collect(h, num, &it);
+}
+
+aml_slice_t *aml_pool_split_slices2(aml_pool_t *h, size_t *num, char delim,
+                                    const char *p, size_t len) {
+  aml_slice_iter_t it;
+  aml_slice_split_init(&it, p, len, delim);
+  it.flags |= AML_SLICE_SKIP_EMPTY;
+  return slice_collect(h, num, &it);
+}
+
+aml_slice_t *aml_pool_tokenize_slices(aml_pool_t *h, size_t *num,
+                                      const char *delims, const char *p,
+                                      size_t len) {
+  aml_slice_iter_t it;
+  aml_slice_tokenize_init(&it, p, len, delims);
+  return slice_collect(h, num, &it);
+}
+
+char **aml_pool_slice_strdupa(aml_pool_t *h, const aml_slice_t *slices,
+                              size_t num) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < num; i++)
+    bytes += slices[i].len + 1;
+  char **r = (char **)aml_pool_alloc(h, sizeof(char *) * (num + 1));
+  char *m = (char *)aml_pool_ualloc(h, bytes);
+  for (size_t i = 0; i < num; i++) {
+    r[i] = m;
+    if (slices[i].len)
+      memcpy(m, slices[i].p, slices[i].len);
+    m[slices[i].len] = 0;
+    m += slices[i].len + 1;
+  }
+  r[num] = NULL;
+  return r;
+}
@@ -0,0 +1,177 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_alloc.h"
+#include "a-memory-library/aml_spool.h"
+#include <stdlib.h>
+
+size_t aml_spool_used(aml_spool_t *h) {
+  return __atomic_load_n(&h->used, __ATOMIC_RELAXED);
+}
+
+void aml_spool_set_minimum_growth_size(aml_spool_t *h, size_t size) {
+  if (size == 0)
+    abort(); /* this doesn't make sense */
+  h->minimum_growth_size = size;
+}
+
+#ifdef _AML_DEBUG_
+static void dump_spool(FILE *out, const char *caller, void *p, size_t length) {
+  (void)length;
+  aml_spool_t *spool = (aml_spool_t *)p;
+  fprintf(out, "%s initial_size: %lu used: %lu ", caller, spool->initial_size,
+          aml_spool_used(spool));
+}
+
+aml_spool_t *_aml_spool_init(size_t initial_size, const char *caller) {
+#elif defined(_AML_SAMPLING_)
+aml_spool_t *_aml_spool_init(size_t initial_size, const char *caller) {
+#else
+aml_spool_t *_aml_spool_init(size_t initial_size) {
+#endif
+  if (initial_size == 0)
+    abort(); /* this doesn't make any sense */
+  /* round initial_size up to be properly aligned */
+  initial_size += ((sizeof(size_t) - (initial_size & (sizeof(size_t) - 1))) &
+                   (sizeof(size_t) - 1));
+
+  /* Like the pool, the handle, the first node, and the first block are
+     allocated together. */
+  size_t alloc_size = sizeof(aml_spool_t) + sizeof(aml_spool_node_t) +
+                      initial_size;
+  aml_spool_t *h;
+#ifdef _AML_DEBUG_
+  h = (aml_spool_t *)_aml_malloc_d(caller, alloc_size, true);
+  if (!h)
+    abort();
+  memset(h, 0, sizeof(aml_spool_t) + sizeof(aml_spool_node_t));
+  h->dump.dump = dump_spool;
+  h->initial_size = initial_size;
+#else
+  h = (aml_spool_t *)_aml_malloc_for(caller, alloc_size);
+  if (!h) /* what else might we do? */
+    abort();
+  memset(h, 0, sizeof(aml_spool_t) + sizeof(aml_spool_node_t));
+#endif
+#ifdef _AML_SAMPLING_
+  h->caller = caller;
+#endif
+  aml_spool_node_t *node = (aml_spool_node_t *)(h + 1);
+  node->size = initial_size;
+  node->offset = 0;
+  node->prev = NULL;
+  h->current = node;
+  h->large = NULL;
+  h->used = alloc_size;
+  h->generation = 0;
+  aml_spool_set_minimum_growth_size(h, initial_size);
+  return h;
+}
+
+static aml_spool_node_t *new_node(aml_spool_t *h, size_t size) {
+  aml_spool_node_t *node =
+      (aml_spool_node_t *)_aml_malloc_for(h->caller,
+                                          sizeof(aml_spool_node_t) + size);
+  if (!node)
+    abort();
+  node->size = size;
+  node->offset = 0;
+  node->prev = NULL;
+  __atomic_fetch_add(&h->used, sizeof(aml_spool_node_t) + size,
+                     __ATOMIC_RELAXED);
+  return node;
+}
+
+void *_aml_spool_alloc_grow(aml_spool_t *h, aml_spool_node_t *node,
+                            size_t len) {
+  if (len > h->minimum_growth_size) {
+    /* The request gets a block of its own so that current isn't abandoned. */
+    aml_spool_node_t *large = new_node(h, len);
+    large->offset = len;
+    large->prev = __atomic_load_n(&h->large, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&h->large, &large->prev, large, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    return large + 1;
+  }
+
+  for (;;) {
+    aml_spool_node_t *cur = __atomic_load_n(&h->current, __ATOMIC_ACQUIRE);
+    if (cur != node) {
+      /* another thread installed a new block, try it */
+      size_t offset = __atomic_fetch_add(&cur->offset, len, __ATOMIC_RELAXED);
+      if (offset + len <= cur->size)
+        return (char *)(cur + 1) + offset;
+      node = cur;
+      continue;
+    }
+    /* The new block is installed with this request already reserved.  If
+       another thread wins the race, its block is used instead. */
+    aml_spool_node_t *block = new_node(h, h->minimum_growth_size);
+    block->offset = len;
+    block->prev = cur;
+    if (__atomic_compare_exchange_n(&h->current, &cur, block, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      return block + 1;
+    __atomic_fetch_sub(&h->used, sizeof(aml_spool_node_t) + block->size,
+                       __ATOMIC_RELAXED);
+    aml_free(block);
+  }
+}
+
+void aml_spool_chunk_init(aml_spool_t *h, aml_spool_chunk_t *c,
+                          size_t chunk_size) {
+  if (chunk_size == 0)
+    abort(); /* this doesn't make sense */
+  chunk_size += ((sizeof(size_t) - (chunk_size & (sizeof(size_t) - 1))) &
+                 (sizeof(size_t) - 1));
+  c->spool = h;
+  c->curp = NULL;
+  c->endp = NULL;
+  c->chunk_size = chunk_size;
+  /* forces the first allocation to reserve a chunk */
+  c->generation = h->generation - 1;
+}
+
+void *_aml_spool_chunk_refill(aml_spool_chunk_t *c, size_t len) {
+  aml_spool_t *h = c->spool;
+  if (c->generation != h->generation) {
+    c->curp = c->endp = NULL;
+    c->generation = h->generation;
+  }
+  /* large requests don't replace the chunk */
+  if (len > c->chunk_size / 2)
+    return aml_spool_alloc(h, len);
+  char *r = (char *)aml_spool_alloc(h, c->chunk_size);
+  c->curp = r + len;
+  c->endp = r + c->chunk_size;
+  return r;
+}
+
+void aml_spool_clear(aml_spool_t *h) {
+  aml_spool_node_t *node = h->large;
+  while (node) {
+    aml_spool_node_t *prev = node->prev;
+    aml_free(node);
+    node = prev;
+  }
+  h->large = NULL;
+
+  /* remove the extra blocks (the ones where prev != NULL) */
+  node = h->current;
+  while (node->prev) {
+    aml_spool_node_t *prev = node->prev;
+    aml_free(node);
+    node = prev;
+  }
+  node->offset = 0;
+  h->current = node;
+  h->used = sizeof(aml_spool_t) + sizeof(aml_spool_node_t) + node->size;
+  h->generation++;
+}
+
+void aml_spool_destroy(aml_spool_t *h) {
+  aml_spool_clear(h);
+  aml_free(h);
+}
@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+#include "a-memory-library/aml_trace.h"
+
+static const char *trace_names[AML_TRACE_EVENTS] = {
+    "pool_grow", "pool_clear", "pool_restore", "buffer_grow", "buffer_detach"};
+
+const char *aml_trace_name(aml_trace_type_t type) {
+  return (unsigned)type < AML_TRACE_EVENTS ? trace_names[type] : "unknown";
+}
+
+#ifdef _AML_TRACE_
+
+#ifdef _AML_TRACE_USDT_
+/* the probes below check these, a tracer increments them while attached */
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define AML_TRACE_SEMAPHORE(name)                                              \
+  __extension__ unsigned short aml_##name##_semaphore                          \
+      __attribute__((unused)) __attribute__((section(".probes"))) = 0
+
+AML_TRACE_SEMAPHORE(pool_grow);
+AML_TRACE_SEMAPHORE(pool_clear);
+AML_TRACE_SEMAPHORE(pool_restore);
+AML_TRACE_SEMAPHORE(buffer_grow);
+AML_TRACE_SEMAPHORE(buffer_detach);
+#endif
+
+int _aml_trace_hooked = 0;
+static aml_trace_cb trace_cb = NULL;
+static void *trace_arg = NULL;
+
+bool aml_trace_set_callback(aml_trace_cb cb, void *arg) {
+  trace_arg = arg;
+  __atomic_store_n(&trace_cb, cb, __ATOMIC_RELEASE);
+  __atomic_store_n(&_aml_trace_hooked, cb != NULL, __ATOMIC_RELAXED);
+  return true;
+}
+
+void _aml_trace(aml_trace_type_t type, const void *object, size_t before,
+                size_t after, uint64_t start) {
+  uint64_t ns = _aml_trace_begin(type);
+  if (!ns)
+    return; /* the listener went away */
+  ns -= start;
+#ifdef _AML_TRACE_USDT_
+  switch (type) {
+  case AML_TRACE_POOL_GROW:
+    STAP_PROBE4(aml, pool_grow, object, before, after, ns);
+    break;
+  case AML_TRACE_POOL_CLEAR:
+    STAP_PROBE4(aml, pool_clear, object, before, after, ns);
+    break;
+  case AML_TRACE_POOL_RESTORE:
+    STAP_PROBE4(aml, pool_restore, object, before, after, ns);
+    break;
+  case AML_TRACE_BUFFER_GROW:
+    STAP_PROBE4(aml, buffer_grow, object, before, after, ns);
+    break;
+  case AML_TRACE_BUFFER_DETACH:
+    STAP_PROBE4(aml, buffer_detach, object, before, after, ns);
+    break;
+  default:
+    break;
+  }
+#endif
+  aml_trace_cb cb = __atomic_load_n(&trace_cb, __ATOMIC_ACQUIRE);
+  if (cb) {
+    aml_trace_event_t ev = {type, object, before, after, ns};
+    cb(&ev, trace_arg);
+  }
+}
+
+#else
+
+bool aml_trace_set_callback(aml_trace_cb cb, void *arg) {
+  (void)cb;
+  (void)arg;
+  return false;
+}
+
+#endif
@@ -8,6 +8,10 @@
 
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
+
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_buffer.h"
 
 #ifdef _AML_DEBUG_
 #define ASSERT_ZERO_ALLOC_RETURNS_NULL(expr) MACRO_ASSERT_TRUE((expr) == NULL)
@@ -279,6 +283,259 @@ MACRO_TEST(alloc_strdupf_large_string) {
     aml_free(s);
 }
 
+#define ALLOC_THREADS 4
+#define ALLOC_PER_THREAD 10000
+
+static void *alloc_worker(void *arg) {
+    char **out = (char **)arg;
+    for (int i = 0; i < ALLOC_PER_THREAD; i++) {
+        char *p = (char *)aml_malloc(16);
+        snprintf(p, 16, "%d", i);
+        /* grow (and possibly move) the allocation */
+        p = (char *)aml_realloc(p, 64 + (i % 100));
+        out[i] = p;
+    }
+    return NULL;
+}
+
+static void *free_worker(void *arg) {
+    char **in = (char **)arg;
+    for (int i = 0; i < ALLOC_PER_THREAD; i++)
+        aml_free(in[i]);
+    return NULL;
+}
+
+MACRO_TEST(alloc_concurrent_cross_thread_free) {
+    pthread_t t[ALLOC_THREADS];
+    char **ptrs[ALLOC_THREADS];
+    for (int i = 0; i < ALLOC_THREADS; i++) {
+        ptrs[i] = (char **)aml_malloc(sizeof(char *) * ALLOC_PER_THREAD);
+        pthread_create(t + i, NULL, alloc_worker, ptrs[i]);
+    }
+    for (int i = 0; i < ALLOC_THREADS; i++)
+        pthread_join(t[i], NULL);
+
+    char tmp[16];
+    for (int i = 0; i < ALLOC_THREADS; i++) {
+        for (int k = 0; k < ALLOC_PER_THREAD; k++) {
+            snprintf(tmp, sizeof(tmp), "%d", k);
+            MACRO_ASSERT_STREQ(ptrs[i][k], tmp);
+        }
+    }
+
+    /* free everything from threads other than the ones that allocated it */
+    for (int i = 0; i < ALLOC_THREADS; i++)
+        pthread_create(t + i, NULL, free_worker,
+                       ptrs[(i + 1) % ALLOC_THREADS]);
+    for (int i = 0; i < ALLOC_THREADS; i++)
+        pthread_join(t[i], NULL);
+    for (int i = 0; i < ALLOC_THREADS; i++)
+        aml_free(ptrs[i]);
+}
+
+MACRO_TEST(alloc_aligned) {
+    for (size_t alignment = 1; alignment <= 4096; alignment <<= 1) {
+        char *p = (char *)aml_aligned_alloc(alignment, 100);
+        MACRO_ASSERT_TRUE(p != NULL);
+        MACRO_ASSERT_EQ_SZ((size_t)p & (alignment - 1), 0);
+        memset(p, 'x', 100);
+        aml_aligned_free(p);
+    }
+    MACRO_ASSERT_TRUE(aml_aligned_alloc(64, 0) == NULL);
+    aml_aligned_free(NULL);
+}
+
+/* A backend which rounds blocks up to 256 bytes and counts what it does.
+   The block header remembers where the block starts and how much can be
+   used. */
+typedef struct {
+    void *base;
+    size_t usable;
+} test_block_t;
+
+static size_t test_mallocs, test_frees, test_aligned;
+
+static void *test_place(char *base, size_t offset, size_t usable) {
+    test_block_t *b = (test_block_t *)(base + offset) - 1;
+    b->base = base;
+    b->usable = usable;
+    return b + 1;
+}
+
+static void *test_malloc(size_t len) {
+    size_t usable = (len + 255) & ~(size_t)255;
+    char *base = (char *)malloc(sizeof(test_block_t) + usable);
+    test_mallocs++;
+    return test_place(base, sizeof(test_block_t), usable);
+}
+
+static void *test_aligned_alloc(size_t alignment, size_t len) {
+    char *base = (char *)malloc(sizeof(test_block_t) + alignment + len);
+    size_t offset = sizeof(test_block_t) + alignment - 1;
+    offset -= ((size_t)base + offset) & (alignment - 1);
+    test_aligned++;
+    return test_place(base, offset, len);
+}
+
+static void test_free(void *p) {
+    if (!p)
+        return;
+    test_frees++;
+    free(((test_block_t *)p - 1)->base);
+}
+
+static size_t test_usable_size(void *p) { return ((test_block_t *)p - 1)->usable; }
+
+static void *test_realloc(void *p, size_t len) {
+    if (!p)
+        return test_malloc(len);
+    size_t old = test_usable_size(p);
+    void *r = test_malloc(len);
+    memcpy(r, p, old < len ? old : len);
+    test_free(p);
+    return r;
+}
+
+MACRO_TEST(alloc_backend) {
+    aml_alloc_backend_t backend = {test_malloc, test_free, test_realloc,
+                                   test_aligned_alloc, test_usable_size};
+    aml_alloc_set_backend(&backend);
+    MACRO_ASSERT_TRUE(aml_alloc_get_backend()->malloc_fn == test_malloc);
+
+    char *s = aml_strdup("backend");
+    s = (char *)aml_realloc(s, 1000);
+    MACRO_ASSERT_STREQ(s, "backend");
+    aml_free(s);
+    char *z = (char *)aml_zalloc(300);
+    MACRO_ASSERT_EQ_INT(z[299], 0);
+    aml_free(z);
+    MACRO_ASSERT_TRUE(test_mallocs >= 3);
+
+    char *a = (char *)aml_aligned_alloc(64, 1000);
+    MACRO_ASSERT_EQ_SZ((size_t)a & 63, 0);
+    MACRO_ASSERT_EQ_SZ(test_aligned, 1);
+    aml_aligned_free(a);
+
+    /* pools and buffers get their blocks from the backend */
+    size_t mallocs = test_mallocs;
+    aml_pool_t *pool = aml_pool_init(1024);
+    for (int i = 0; i < 10; i++)
+        aml_pool_alloc(pool, 2000);
+    aml_pool_destroy(pool);
+    MACRO_ASSERT_TRUE(test_mallocs > mallocs + 1);
+
+    aml_buffer_t *b = aml_buffer_init(16);
+    aml_buffer_append(b, "0123456789", 10);
+    for (int i = 0; i < 100; i++)
+        aml_buffer_appends(b, "more bytes");
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 1010);
+#if defined(_AML_DEBUG_) || defined(_AML_SAMPLING_)
+    /* these builds keep the length which was asked for */
+    MACRO_ASSERT_TRUE(b->size + 1 < test_usable_size(b->data));
+#else
+    /* the buffer grew into the rounding */
+    MACRO_ASSERT_EQ_SZ(b->size + 1, test_usable_size(b->data));
+#endif
+    aml_buffer_destroy(b);
+
+    aml_alloc_set_backend(NULL);
+    MACRO_ASSERT_TRUE(aml_alloc_get_backend()->malloc_fn != test_malloc);
+    MACRO_ASSERT_EQ_SZ(test_frees, test_mallocs + test_aligned);
+}
+
+#ifdef _AML_SAMPLING_
+typedef struct {
+    const char *caller;
+    aml_sample_site_t site;
+    bool found;
+} find_site_t;
+
+static void find_site_cb(void *arg, const aml_sample_site_t *site) {
+    find_site_t *f = (find_site_t *)arg;
+    if (!strcmp(site->caller, f->caller)) {
+        f->site = *site;
+        f->found = true;
+    }
+}
+
+static aml_sample_site_t find_site(const char *caller) {
+    find_site_t f;
+    memset(&f, 0, sizeof(f));
+    f.caller = caller;
+    aml_sample_sites(find_site_cb, &f);
+    MACRO_ASSERT_TRUE(f.found);
+    return f.site;
+}
+
+MACRO_TEST(alloc_sample_every_allocation) {
+    /* with an interval of 1 byte, everything is sampled at its exact size */
+    aml_sample_set_interval(1);
+    aml_free(aml_malloc(1)); /* picks up the new interval */
+
+    const char *site = NULL;
+    char *p[10];
+    for (int i = 0; i < 10; i++) {
+        p[i] = (char *)aml_malloc(1000); site = aml_file_line();
+    }
+    aml_sample_site_t s = find_site(site);
+    MACRO_ASSERT_EQ_SZ(s.samples, 10);
+    MACRO_ASSERT_EQ_SZ(s.live_bytes, 10000);
+    MACRO_ASSERT_EQ_SZ(s.live_allocations, 10);
+
+    for (int i = 0; i < 5; i++)
+        aml_free(p[i]);
+    s = find_site(site);
+    MACRO_ASSERT_EQ_SZ(s.live_bytes, 5000);
+    MACRO_ASSERT_EQ_SZ(s.live_allocations, 5);
+    MACRO_ASSERT_EQ_SZ(s.total_bytes, 10000);
+
+    /* a pool's blocks are charged to the line which created it */
+    aml_pool_t *pool; const char *pool_site;
+    pool = aml_pool_init(4096); pool_site = aml_file_line_func("aml_pool");
+    for (int i = 0; i < 10; i++)
+        aml_pool_alloc(pool, 4000);
+    s = find_site(pool_site);
+    MACRO_ASSERT_TRUE(s.live_bytes > 40000);
+    aml_pool_destroy(pool);
+    s = find_site(pool_site);
+    MACRO_ASSERT_EQ_SZ(s.live_bytes, 0);
+
+    FILE *out = tmpfile();
+    aml_sample_dump(out);
+    MACRO_ASSERT_TRUE(ftell(out) > 0);
+    fclose(out);
+
+    for (int i = 5; i < 10; i++)
+        aml_free(p[i]);
+    aml_sample_set_interval(512 * 1024);
+}
+
+MACRO_TEST(alloc_sample_estimates) {
+    aml_sample_set_interval(4096);
+    aml_free(aml_malloc(1));
+
+    const char *site = NULL;
+    size_t n = 100000;
+    char **p = (char **)malloc(sizeof(char *) * n);
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (char *)aml_malloc(64); site = aml_file_line();
+    }
+    /* about 1600 samples, so the estimate should be within a few percent */
+    aml_sample_site_t s = find_site(site);
+    MACRO_ASSERT_TRUE(s.live_bytes > n * 64 * 8 / 10);
+    MACRO_ASSERT_TRUE(s.live_bytes < n * 64 * 12 / 10);
+    MACRO_ASSERT_TRUE(s.live_allocations > n * 8 / 10);
+    MACRO_ASSERT_TRUE(s.live_allocations < n * 12 / 10);
+    for (size_t i = 0; i < n; i++)
+        aml_free(p[i]);
+    s = find_site(site);
+    MACRO_ASSERT_EQ_SZ(s.live_bytes, 0);
+    MACRO_ASSERT_EQ_SZ(s.live_allocations, 0);
+    free(p);
+    aml_sample_set_interval(512 * 1024);
+}
+#endif
+
 /* --- runner --- */
 int main(void) {
     macro_test_case tests[64];
@@ -311,6 +568,13 @@ int main(void) {
     MACRO_ADD(tests, alloc_strdupan_partial_nulls);
     MACRO_ADD(tests, alloc_realloc_ping_pong_many);
     MACRO_ADD(tests, alloc_strdupf_large_string);
+    MACRO_ADD(tests, alloc_concurrent_cross_thread_free);
+    MACRO_ADD(tests, alloc_aligned);
+    MACRO_ADD(tests, alloc_backend);
+#ifdef _AML_SAMPLING_
+    MACRO_ADD(tests, alloc_sample_every_allocation);
+    MACRO_ADD(tests, alloc_sample_estimates);
+#endif
 
     macro_run_all("a-memory-library/aml_alloc", tests, test_count);
     return 0;
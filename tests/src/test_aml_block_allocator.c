@@ -0,0 +1,238 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_block_allocator.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/extras/aml_block_allocator.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+
+static void check_class(uint32_t size) {
+    uint32_t id = aml_block_allocator_id(size);
+    MACRO_ASSERT_TRUE(id < AML_BLOCK_ALLOCATOR_CLASSES);
+    size_t block_size = aml_block_allocator_size(id);
+    /* the smallest class which fits */
+    MACRO_ASSERT_TRUE(block_size >= size);
+    if (id)
+        MACRO_ASSERT_TRUE(aml_block_allocator_size(id - 1) < size);
+    /* no more than 25% waste past the first classes */
+    if (size > 32)
+        MACRO_ASSERT_TRUE(block_size - size < size / 4 + 1);
+    MACRO_ASSERT_EQ_SZ(block_size & 7, 0);
+}
+
+MACRO_TEST(block_allocator_size_classes) {
+    for (uint32_t size = 1; size < 70000; size++)
+        check_class(size);
+    for (uint32_t shift = 16; shift < 32; shift++) {
+        uint32_t p = (uint32_t)1 << shift;
+        check_class(p - 1);
+        check_class(p);
+        check_class(p + 1);
+    }
+    check_class(UINT32_MAX);
+    MACRO_ASSERT_EQ_INT(aml_block_allocator_id(UINT32_MAX),
+                        AML_BLOCK_ALLOCATOR_CLASSES - 1);
+    for (uint32_t id = 1; id < AML_BLOCK_ALLOCATOR_CLASSES; id++)
+        MACRO_ASSERT_TRUE(aml_block_allocator_size(id) >
+                          aml_block_allocator_size(id - 1));
+}
+
+MACRO_TEST(block_allocator_reuses_released_blocks) {
+    aml_pool_t *pool = aml_pool_init(4096);
+    aml_block_allocator_t *ba = aml_block_allocator_init(pool);
+
+    char *a = (char *)aml_block_allocator_alloc(ba, 100);
+    char *b = (char *)aml_block_allocator_alloc(ba, 100);
+    MACRO_ASSERT_TRUE(a != b);
+    memset(a, 'a', 100);
+    memset(b, 'b', 100);
+    size_t used = aml_pool_used(pool);
+
+    aml_block_allocator_release(ba, a, 100);
+    aml_block_allocator_release(ba, b, 100);
+    /* last in, first out, and any size in the same class can use it */
+    MACRO_ASSERT_TRUE(aml_block_allocator_alloc(ba, 97) == b);
+    MACRO_ASSERT_TRUE(aml_block_allocator_alloc(ba, 100) == a);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(pool), used);
+    /* a different class comes from the pool */
+    MACRO_ASSERT_TRUE(aml_block_allocator_alloc(ba, 200) != a);
+
+    MACRO_ASSERT_TRUE(aml_block_allocator_alloc(ba, 0) == NULL);
+    aml_block_allocator_release(ba, NULL, 10);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(block_allocator_header_free) {
+    aml_pool_t *pool = aml_pool_init(4096);
+    aml_block_allocator_t *ba = aml_block_allocator_init(pool);
+
+    void *p[64];
+    for (int i = 0; i < 64; i++) {
+        p[i] = aml_block_allocator_halloc(ba, 1 + i * 37);
+        MACRO_ASSERT_EQ_SZ((uintptr_t)p[i] & 7, 0);
+        memset(p[i], i, 1 + i * 37);
+    }
+    for (int i = 0; i < 64; i++)
+        aml_block_allocator_free(ba, p[i]);
+    /* the same sizes get the same blocks back */
+    for (int i = 63; i >= 0; i--)
+        MACRO_ASSERT_TRUE(aml_block_allocator_halloc(ba, 1 + i * 37) == p[i]);
+    aml_block_allocator_free(ba, NULL);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(block_allocator_stats) {
+    aml_pool_t *pool = aml_pool_init(4096);
+    aml_block_allocator_t *ba = aml_block_allocator_init(pool);
+    uint32_t id = aml_block_allocator_id(48);
+
+    void *p[10];
+    for (int i = 0; i < 10; i++)
+        p[i] = aml_block_allocator_alloc(ba, 48);
+    for (int i = 0; i < 4; i++)
+        aml_block_allocator_release(ba, p[i], 48);
+    aml_block_allocator_alloc(ba, 48);
+
+    aml_block_allocator_stats_t st;
+    aml_block_allocator_stats(ba, id, &st);
+    MACRO_ASSERT_EQ_SZ(st.block_size, 48);
+    MACRO_ASSERT_EQ_SZ(st.allocs, 11);
+    MACRO_ASSERT_EQ_SZ(st.frees, 4);
+    MACRO_ASSERT_EQ_SZ(st.reused, 1);
+    MACRO_ASSERT_EQ_SZ(st.live, 7);
+    MACRO_ASSERT_EQ_SZ(st.cached, 3);
+
+    aml_block_allocator_stats(ba, id + 1, &st);
+    MACRO_ASSERT_EQ_SZ(st.allocs, 0);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(block_allocator_remote_release) {
+    aml_pool_t *pool = aml_pool_init(4096);
+    aml_block_allocator_t *ba = aml_block_allocator_init(pool);
+    uint32_t id = aml_block_allocator_id(8);
+
+    void *a = aml_block_allocator_alloc(ba, 8);
+    void *b = aml_block_allocator_alloc(ba, 8);
+    void *h = aml_block_allocator_halloc(ba, 8);
+    aml_block_allocator_release_remote(ba, a, 8);
+    aml_block_allocator_release_remote(ba, NULL, 8);
+    aml_block_allocator_free_remote(ba, NULL);
+
+    /* not counted until the owner takes them */
+    aml_block_allocator_stats_t st;
+    aml_block_allocator_stats(ba, id, &st);
+    MACRO_ASSERT_EQ_SZ(st.frees, 0);
+
+    /* the local free list is used first */
+    aml_block_allocator_release(ba, b, 8);
+    MACRO_ASSERT_TRUE(aml_block_allocator_alloc(ba, 8) == b);
+    /* and the miss takes the remote block */
+    MACRO_ASSERT_TRUE(aml_block_allocator_alloc(ba, 8) == a);
+    aml_block_allocator_stats(ba, id, &st);
+    MACRO_ASSERT_EQ_SZ(st.frees, 2);
+    MACRO_ASSERT_EQ_SZ(st.remote_frees, 1);
+    MACRO_ASSERT_EQ_SZ(st.reused, 2);
+
+    /* drain merges the remote blocks with what is on the free list */
+    aml_block_allocator_free_remote(ba, h);
+    aml_block_allocator_release(ba, b, 8);
+    aml_block_allocator_release_remote(ba, a, 8);
+    aml_block_allocator_drain(ba);
+    aml_block_allocator_stats(ba, id, &st);
+    MACRO_ASSERT_EQ_SZ(st.remote_frees, 2);
+    MACRO_ASSERT_EQ_SZ(st.cached, 2);
+    aml_block_allocator_stats(ba, aml_block_allocator_id(16), &st);
+    MACRO_ASSERT_EQ_SZ(st.remote_frees, 1);
+    MACRO_ASSERT_EQ_SZ(st.live, 0);
+    MACRO_ASSERT_TRUE(aml_block_allocator_halloc(ba, 8) == h);
+    aml_pool_destroy(pool);
+}
+
+#define REMOTE_THREADS 4
+#define REMOTE_BLOCKS 20000
+
+typedef struct {
+    aml_block_allocator_t *ba;
+    void **blocks;
+    int *ready; /* set by the owner once blocks[i] is written */
+    int first;
+} remote_arg_t;
+
+/* releases every REMOTE_THREADS'th block once the owner has handed it out */
+static void *remote_releaser(void *arg) {
+    remote_arg_t *ra = (remote_arg_t *)arg;
+    for (int i = ra->first; i < REMOTE_BLOCKS; i += REMOTE_THREADS) {
+        while (!__atomic_load_n(ra->ready + i, __ATOMIC_ACQUIRE))
+            ;
+        uint32_t size = 8 + (i % 7) * 24;
+        char *p = (char *)ra->blocks[i];
+        MACRO_ASSERT_EQ_INT(p[size - 1], (char)i);
+        if (i & 1)
+            aml_block_allocator_free_remote(ra->ba, p);
+        else
+            aml_block_allocator_release_remote(ra->ba, p, size);
+    }
+    return NULL;
+}
+
+MACRO_TEST(block_allocator_remote_threads) {
+    aml_pool_t *pool = aml_pool_init(4096);
+    aml_block_allocator_t *ba = aml_block_allocator_init(pool);
+    void **blocks = (void **)aml_pool_zalloc(pool, REMOTE_BLOCKS * sizeof(void *));
+    int *ready = (int *)aml_pool_zalloc(pool, REMOTE_BLOCKS * sizeof(int));
+
+    pthread_t th[REMOTE_THREADS];
+    remote_arg_t args[REMOTE_THREADS];
+    for (int t = 0; t < REMOTE_THREADS; t++) {
+        args[t].ba = ba;
+        args[t].blocks = blocks;
+        args[t].ready = ready;
+        args[t].first = t;
+        pthread_create(th + t, NULL, remote_releaser, args + t);
+    }
+    /* the owner keeps allocating (and so taking remote blocks) while the
+       other threads release */
+    for (int i = 0; i < REMOTE_BLOCKS; i++) {
+        uint32_t size = 8 + (i % 7) * 24;
+        char *p = (char *)(i & 1 ? aml_block_allocator_halloc(ba, size)
+                                 : aml_block_allocator_alloc(ba, size));
+        memset(p, (char)i, size);
+        blocks[i] = p;
+        __atomic_store_n(ready + i, 1, __ATOMIC_RELEASE);
+    }
+    for (int t = 0; t < REMOTE_THREADS; t++)
+        pthread_join(th[t], NULL);
+    aml_block_allocator_drain(ba);
+
+    size_t live = 0, remote = 0;
+    for (uint32_t id = 0; id < AML_BLOCK_ALLOCATOR_CLASSES; id++) {
+        aml_block_allocator_stats_t st;
+        aml_block_allocator_stats(ba, id, &st);
+        live += st.live;
+        remote += st.remote_frees;
+    }
+    MACRO_ASSERT_EQ_SZ(live, 0);
+    MACRO_ASSERT_EQ_SZ(remote, REMOTE_BLOCKS);
+    aml_pool_destroy(pool);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, block_allocator_size_classes);
+    MACRO_ADD(tests, block_allocator_reuses_released_blocks);
+    MACRO_ADD(tests, block_allocator_header_free);
+    MACRO_ADD(tests, block_allocator_stats);
+    MACRO_ADD(tests, block_allocator_remote_release);
+    MACRO_ADD(tests, block_allocator_remote_threads);
+
+    macro_run_all("a-memory-library/aml_block_allocator", tests, test_count);
+    return 0;
+}
@@ -11,6 +11,8 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #define SAFE_FREE_HEAP_PTR(p) do { if (p) aml_free(p); } while (0)
 
@@ -227,6 +229,385 @@ MACRO_TEST(buffer_append_binary_with_nulls) {
     aml_buffer_destroy(b);
 }
 
+MACRO_TEST(buffer_append_base64_roundtrip) {
+    aml_buffer_t *b = aml_buffer_init(4);
+    unsigned char data[300];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)(i * 31 + 7);
+
+    aml_buffer_appends(b, "x=");
+    aml_buffer_append_base64(b, data, sizeof(data));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 2 + 400);
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[402], 0);
+
+    aml_buffer_t *d = aml_buffer_init(4);
+    aml_buffer_appends(d, "y");
+    MACRO_ASSERT_TRUE(aml_buffer_append_base64_decode(d, aml_buffer_data(b) + 2, 400));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(d), 1 + sizeof(data));
+    MACRO_ASSERT_TRUE(memcmp(aml_buffer_data(d) + 1, data, sizeof(data)) == 0);
+
+    /* invalid input leaves the buffer alone, and the input needn't be
+       terminated */
+    MACRO_ASSERT_TRUE(!aml_buffer_append_base64_decode(d, "Zm9v*mFy", 8));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(d), 1 + sizeof(data));
+    MACRO_ASSERT_TRUE(aml_buffer_append_base64_decode(d, "Zm9vYmFyXXXX", 8));
+    MACRO_ASSERT_TRUE(!memcmp(aml_buffer_data(d) + 1 + sizeof(data), "foobar", 7));
+
+    aml_buffer_destroy(d);
+    aml_buffer_destroy(b);
+}
+
+MACRO_TEST(buffer_pool_grows_in_place) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_buffer_t *b = aml_buffer_pool_init(pool, 16);
+    char *data = aml_buffer_data(b);
+    for (int i = 0; i < 2000; i++)
+        aml_buffer_appendf(b, "%d,", i);
+    /* the data was the pool's last allocation, so it never moved */
+    MACRO_ASSERT_TRUE(aml_buffer_data(b) == data);
+    MACRO_ASSERT_TRUE(aml_pool_used(pool) <= (1 << 16) + 1024);
+    MACRO_ASSERT_TRUE(!strncmp(aml_buffer_data(b), "0,1,2,", 6));
+
+    /* once something else is allocated, growing copies */
+    aml_pool_alloc(pool, 8);
+    size_t len = aml_buffer_length(b);
+    aml_buffer_appendn(b, 'x', 20000);
+    MACRO_ASSERT_TRUE(aml_buffer_data(b) != data);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), len + 20000);
+    MACRO_ASSERT_TRUE(!strncmp(aml_buffer_data(b), "0,1,2,", 6));
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[len + 19999], 'x');
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(buffer_append_integers_match_printf) {
+    aml_buffer_t *b = aml_buffer_init(4);
+    char expected[64];
+    uint64_t values[] = {0, 1, 9, 10, 99, 100, 999, 1000, 9999, 10000,
+                         123456789, 4294967295ULL, 4294967296ULL,
+                         999999999999ULL, 10000000000000000000ULL, UINT64_MAX};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        aml_buffer_clear(b);
+        aml_buffer_append_u64(b, values[i]);
+        snprintf(expected, sizeof(expected), "%llu", (unsigned long long)values[i]);
+        MACRO_ASSERT_STREQ(aml_buffer_data(b), expected);
+
+        aml_buffer_clear(b);
+        aml_buffer_append_hex(b, values[i]);
+        snprintf(expected, sizeof(expected), "%llx", (unsigned long long)values[i]);
+        MACRO_ASSERT_STREQ(aml_buffer_data(b), expected);
+    }
+
+    int64_t svalues[] = {0, -1, 1, -10, -99, -100, INT64_MAX, INT64_MIN,
+                         INT64_MIN + 1, -123456789012LL};
+    for (size_t i = 0; i < sizeof(svalues) / sizeof(svalues[0]); i++) {
+        aml_buffer_clear(b);
+        aml_buffer_append_i64(b, svalues[i]);
+        snprintf(expected, sizeof(expected), "%lld", (long long)svalues[i]);
+        MACRO_ASSERT_STREQ(aml_buffer_data(b), expected);
+    }
+
+    /* every digit count, and appends keep what came before */
+    aml_buffer_t *e = aml_buffer_init(4);
+    aml_buffer_clear(b);
+    uint64_t v = 1;
+    for (int i = 0; i < 64; i++) {
+        aml_buffer_appendc(b, ',');
+        aml_buffer_append_u64(b, v - 1);
+        aml_buffer_appendc(b, ',');
+        aml_buffer_append_i64(b, -(int64_t)(v >> 1));
+        aml_buffer_appendf(e, ",%llu,%lld", (unsigned long long)(v - 1),
+                           -(long long)(v >> 1));
+        v = v * 3 + 1;
+    }
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), aml_buffer_length(e));
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), aml_buffer_data(e));
+    aml_buffer_destroy(e);
+    aml_buffer_destroy(b);
+}
+
+MACRO_TEST(buffer_append_double_roundtrips) {
+    aml_buffer_t *b = aml_buffer_init(4);
+    struct {
+        double v;
+        const char *s;
+    } known[] = {
+        {0.0, "0"}, {-0.0, "-0"}, {1.0, "1"}, {-2.5, "-2.5"}, {0.1, "0.1"},
+        {1.0 / 3.0, "0.3333333333333333"}, {100.0, "100"}, {123.456, "123.456"},
+        {1e21, "1e+21"}, {1e20, "100000000000000000000"}, {1e-6, "0.000001"},
+        {1.5e-7, "1.5e-7"}, {5e-324, "5e-324"}, {1.7976931348623157e308, "1.7976931348623157e+308"},
+        {2.2250738585072014e-308, "2.2250738585072014e-308"}, {9007199254740993.0, "9007199254740992"},
+    };
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        aml_buffer_clear(b);
+        aml_buffer_append_double(b, known[i].v);
+        MACRO_ASSERT_STREQ(aml_buffer_data(b), known[i].s);
+    }
+    aml_buffer_clear(b);
+    aml_buffer_append_double(b, 1.0 / 0.0);
+    aml_buffer_appendc(b, ' ');
+    aml_buffer_append_double(b, -1.0 / 0.0);
+    aml_buffer_appendc(b, ' ');
+    aml_buffer_append_double(b, 0.0 / 0.0);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "inf -inf nan");
+
+    /* random bit patterns read back as the same double */
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 200000; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        uint64_t bits = seed;
+        /* half of them with small exponents, which are printed without e */
+        if (i & 1)
+            bits = (bits & 0x800FFFFFFFFFFFFFULL) | ((uint64_t)(1003 + i % 90) << 52);
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (v != v || v - v != 0.0)
+            continue;
+        aml_buffer_clear(b);
+        aml_buffer_append_double(b, v);
+        MACRO_ASSERT_TRUE(aml_buffer_length(b) <= 25);
+        char *end = NULL;
+        double r = strtod(aml_buffer_data(b), &end);
+        MACRO_ASSERT_TRUE(*end == 0);
+        MACRO_ASSERT_TRUE(memcmp(&r, &v, sizeof(v)) == 0);
+    }
+    aml_buffer_destroy(b);
+}
+
+MACRO_TEST(buffer_append_escaped_strings) {
+    aml_buffer_t *b = aml_buffer_init(4);
+    const char raw[] = "a\"b\\c\n\t\x01\x1f\xc3\xa9";
+    aml_buffer_append_json_string(b, raw, sizeof(raw) - 1);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "\"a\\\"b\\\\c\\n\\t\\u0001\\u001f\xc3\xa9\"");
+    aml_buffer_clear(b);
+    aml_buffer_append_json_string(b, "", 0);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "\"\"");
+
+    /* embedded zeros are escaped too */
+    aml_buffer_clear(b);
+    aml_buffer_append_json_string(b, "x\0y", 3);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "\"x\\u0000y\"");
+
+    aml_buffer_clear(b);
+    aml_buffer_append_csv_field(b, "plain", 5, ',');
+    aml_buffer_appendc(b, ',');
+    aml_buffer_append_csv_field(b, "a,b", 3, ',');
+    aml_buffer_appendc(b, ',');
+    aml_buffer_append_csv_field(b, "say \"hi\"", 8, ',');
+    aml_buffer_appendc(b, ',');
+    aml_buffer_append_csv_field(b, "two\nlines", 9, ',');
+    aml_buffer_appendc(b, ',');
+    aml_buffer_append_csv_field(b, "a,b", 3, '\t');
+    aml_buffer_appendc(b, ',');
+    aml_buffer_append_csv_field(b, "", 0, ',');
+    MACRO_ASSERT_STREQ(aml_buffer_data(b),
+                       "plain,\"a,b\",\"say \"\"hi\"\"\",\"two\nlines\",a,b,");
+    aml_buffer_destroy(b);
+}
+
+MACRO_TEST(buffer_reserve_and_growth) {
+    aml_buffer_t *b = aml_buffer_init(0);
+    aml_buffer_reserve(b, 1000);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 0);
+    /* the allocator may have rounded the reservation up */
+    size_t cap = aml_buffer_capacity(b);
+    MACRO_ASSERT_TRUE(cap >= 1000);
+    char *data = aml_buffer_data(b);
+    for (size_t i = 0; i < cap; i++)
+        aml_buffer_appendc(b, 'a');
+    MACRO_ASSERT_TRUE(aml_buffer_data(b) == data);
+    /* reserving less than the capacity does nothing */
+    aml_buffer_reserve(b, 10);
+    MACRO_ASSERT_TRUE(aml_buffer_data(b) == data);
+
+    /* growth is a percentage of the length needed */
+    aml_buffer_set_growth(b, 100);
+    aml_buffer_appendc(b, 'b');
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) >= 2 * cap);
+    aml_buffer_set_growth(b, 0);
+    aml_buffer_appendn(b, 'c', 5000 + 2 * cap);
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) < 5100 + 3 * cap);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 5001 + 3 * cap);
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[cap], 'b');
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[5000 + 3 * cap], 'c');
+
+    aml_buffer_shrink_to_fit(b);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 5001 + 3 * cap);
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[5000 + 3 * cap], 'c');
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[5001 + 3 * cap], 0);
+    aml_buffer_appendc(b, 'd');
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[5001 + 3 * cap], 'd');
+
+    /* an empty buffer which never allocated stays that way */
+    aml_buffer_t *e = aml_buffer_init(0);
+    aml_buffer_shrink_to_fit(e);
+    MACRO_ASSERT_STREQ(aml_buffer_data(e), "");
+    aml_buffer_destroy(e);
+    aml_buffer_destroy(b);
+}
+
+MACRO_TEST(buffer_mmap_growth) {
+    aml_buffer_t *b = aml_buffer_init(16);
+    aml_buffer_set_mmap_threshold(b, 64 * 1024);
+    /* small growth steps, so the mapping is resized many times */
+    aml_buffer_set_growth(b, 5);
+    for (uint32_t i = 0; i < 1000000; i++)
+        aml_buffer_append(b, &i, sizeof(i));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 4000000);
+    uint32_t *v = (uint32_t *)aml_buffer_data(b);
+    for (uint32_t i = 0; i < 1000000; i += 999)
+        MACRO_ASSERT_TRUE(v[i] == i);
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[4000000], 0);
+
+    /* mapped buffers shrink by dropping pages */
+    aml_buffer_reserve(b, 8000000);
+    aml_buffer_shrink_to_fit(b);
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) >= 4000000);
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) < 4000000 + 65536);
+    v = (uint32_t *)aml_buffer_data(b);
+    MACRO_ASSERT_TRUE(v[999999] == 999999);
+
+    /* set replaces the contents of a mapping */
+    aml_buffer_set(b, "hello", 5);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "hello");
+
+    /* below the threshold it goes back to the heap */
+    aml_buffer_shrink_to_fit(b);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 5);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "hello");
+
+    /* a detached mapping is copied into memory which can be freed */
+    aml_buffer_appendn(b, 'x', 100000);
+    size_t len = 0;
+    char *d = aml_buffer_detach(b, &len);
+    MACRO_ASSERT_EQ_SZ(len, 100005);
+    MACRO_ASSERT_TRUE(!strncmp(d, "hellox", 6));
+    MACRO_ASSERT_EQ_INT(d[100004], 'x');
+    MACRO_ASSERT_EQ_INT(d[100005], 0);
+    aml_free(d);
+
+    /* reset unmaps */
+    aml_buffer_appendn(b, 'y', 100000);
+    aml_buffer_reset(b, 100);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 100);
+    aml_buffer_appends(b, "after");
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "after");
+
+    /* and destroy unmaps */
+    aml_buffer_appendn(b, 'z', 100000);
+    aml_buffer_destroy(b);
+}
+
+MACRO_TEST(buffer_pool_shrink_to_fit) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_buffer_t *b = aml_buffer_pool_init(pool, 16);
+    aml_buffer_appendn(b, 'a', 1000);
+    aml_buffer_reserve(b, 4000);
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) >= 4000);
+    aml_buffer_shrink_to_fit(b);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 1000);
+    /* the pool continues right after the data */
+    char *next = (char *)aml_pool_ualloc(pool, 1);
+    MACRO_ASSERT_TRUE(next == aml_buffer_data(b) + 1001);
+    aml_buffer_appendn(b, 'b', 10);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 1010);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(buffer_trim_keeps_room) {
+    aml_buffer_t *b = aml_buffer_init(0);
+    aml_buffer_reserve(b, 100000);
+    aml_buffer_appends(b, "spike");
+    size_t cap = aml_buffer_capacity(b);
+    /* room for keep_bytes stays */
+    MACRO_ASSERT_EQ_SZ(aml_buffer_trim(b, 4096), cap - 4096);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 4096);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "spike");
+    MACRO_ASSERT_EQ_SZ(aml_buffer_trim(b, 8192), 0);
+    /* or the length, if that is more */
+    aml_buffer_appendn(b, 'x', 5000);
+    aml_buffer_trim(b, 16);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 5005);
+    /* an empty buffer gives everything back and still works */
+    aml_buffer_clear(b);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_trim(b, 0), 5006);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 0);
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "");
+    MACRO_ASSERT_EQ_SZ(aml_buffer_trim(b, 0), 0);
+    aml_buffer_appends(b, "again");
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "again");
+    aml_buffer_destroy(b);
+
+    /* a mapping returns whole pages */
+    b = aml_buffer_init(16);
+    aml_buffer_set_mmap_threshold(b, 64 * 1024);
+    aml_buffer_appendn(b, 'm', 1 << 20);
+    aml_buffer_clear(b);
+    MACRO_ASSERT_TRUE(aml_buffer_trim(b, 256 * 1024) >= (1 << 19));
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) >= 256 * 1024);
+    aml_buffer_trim(b, 0);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 0);
+    aml_buffer_appendn(b, 'n', 200000);
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[199999], 'n');
+    aml_buffer_destroy(b);
+
+    /* a pool buffer's memory goes back to its pool */
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    b = aml_buffer_pool_init(pool, 4000);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_trim(b, 100), 0);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 100);
+    aml_pool_destroy(pool);
+}
+
+static int temp_file(char *path) {
+    strcpy(path, "/tmp/aml_buffer_XXXXXX");
+    int fd = mkstemp(path);
+    MACRO_ASSERT_TRUE(fd >= 0);
+    return fd;
+}
+
+MACRO_TEST(buffer_fd_io) {
+    char path[64];
+    int fd = temp_file(path);
+    aml_buffer_t *b = aml_buffer_init(16);
+    for (int i = 0; i < 50000; i++)
+        aml_buffer_appendf(b, "%d\n", i);
+    MACRO_ASSERT_TRUE(aml_buffer_write_fd(b, fd));
+    close(fd);
+
+    /* a regular file is read with the size known up front */
+    aml_buffer_t *r = aml_buffer_init(0);
+    aml_buffer_appends(r, "head:");
+    MACRO_ASSERT_TRUE(aml_buffer_append_file(r, path));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(r), 5 + aml_buffer_length(b));
+    /* (at most a page more if the allocator rounded it up) */
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(r) >= aml_buffer_length(r) + 1);
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(r) < aml_buffer_length(r) + 4097);
+    MACRO_ASSERT_TRUE(!memcmp(aml_buffer_data(r) + 5, aml_buffer_data(b),
+                              aml_buffer_length(b)));
+    MACRO_ASSERT_FALSE(aml_buffer_append_file(r, "/nonexistent/file"));
+
+    /* a pipe can't be sized */
+    int fds[2];
+    MACRO_ASSERT_EQ_INT(pipe(fds), 0);
+    MACRO_ASSERT_EQ_INT((int)write(fds[1], "abc", 3), 3);
+    aml_buffer_clear(r);
+    MACRO_ASSERT_EQ_SZ((size_t)aml_buffer_read_fd(r, fds[0], 2), 2);
+    MACRO_ASSERT_STREQ(aml_buffer_data(r), "ab");
+    close(fds[1]);
+    MACRO_ASSERT_TRUE(aml_buffer_append_fd(r, fds[0]));
+    MACRO_ASSERT_STREQ(aml_buffer_data(r), "abc");
+    MACRO_ASSERT_EQ_SZ((size_t)aml_buffer_read_fd(r, fds[0], 100), 0);
+    close(fds[0]);
+    MACRO_ASSERT_TRUE(aml_buffer_read_fd(r, fds[0], 100) < 0);
+    MACRO_ASSERT_STREQ(aml_buffer_data(r), "abc");
+
+    unlink(path);
+    aml_buffer_destroy(r);
+    aml_buffer_destroy(b);
+}
+
 /* --- runner --- */
 int main(void) {
     macro_test_case tests[128];
@@ -248,6 +629,16 @@ int main(void) {
     MACRO_ADD(tests, buffer_grow_and_shrink_cycles);
     MACRO_ADD(tests, buffer_large_appends);
     MACRO_ADD(tests, buffer_append_binary_with_nulls);
+    MACRO_ADD(tests, buffer_append_base64_roundtrip);
+    MACRO_ADD(tests, buffer_pool_grows_in_place);
+    MACRO_ADD(tests, buffer_append_integers_match_printf);
+    MACRO_ADD(tests, buffer_append_double_roundtrips);
+    MACRO_ADD(tests, buffer_append_escaped_strings);
+    MACRO_ADD(tests, buffer_reserve_and_growth);
+    MACRO_ADD(tests, buffer_mmap_growth);
+    MACRO_ADD(tests, buffer_pool_shrink_to_fit);
+    MACRO_ADD(tests, buffer_trim_keeps_room);
+    MACRO_ADD(tests, buffer_fd_io);
 
     macro_run_all("a-memory-library/aml_buffer", tests, test_count);
     return 0;
@@ -0,0 +1,132 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_idle.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_idle.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/* a pool whose block is far bigger than what it holds */
+static aml_pool_t *spiked_pool(void) {
+    aml_pool_t *p = aml_pool_init(1 << 20);
+    memset(aml_pool_alloc(p, 1000000), 'x', 1000000);
+    aml_pool_clear(p);
+    return p;
+}
+
+MACRO_TEST(idle_trims_parked_objects) {
+    aml_pool_t *p = spiked_pool();
+    aml_buffer_t *b = aml_buffer_init(0);
+    aml_buffer_appendn(b, 'b', 100000);
+    aml_buffer_clear(b);
+    aml_idle_t *ip = aml_idle_add_pool(p, 0);
+    aml_idle_t *ib = aml_idle_add_buffer(b, 1024);
+    MACRO_ASSERT_EQ_SZ(aml_idle_count(), 2);
+
+    /* nothing is parked yet */
+    MACRO_ASSERT_EQ_SZ(aml_idle_release(0), 0);
+    aml_idle_park(ip);
+    aml_idle_park(ib);
+    /* not idle for long enough */
+    MACRO_ASSERT_EQ_SZ(aml_idle_release(60000), 0);
+    MACRO_ASSERT_EQ_SZ(aml_idle_trimmed(), 0);
+
+    MACRO_ASSERT_TRUE(aml_idle_release(0) > 1000000);
+    MACRO_ASSERT_EQ_SZ(aml_idle_trimmed(), 2);
+    MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(b), 1024);
+    /* once per park */
+    MACRO_ASSERT_EQ_SZ(aml_idle_release(0), 0);
+
+    /* the objects can be used again */
+    aml_idle_unpark(ip);
+    aml_idle_unpark(ib);
+    MACRO_ASSERT_EQ_SZ(aml_idle_trimmed(), 0);
+    MACRO_ASSERT_STREQ(aml_pool_strdup(p, "after"), "after");
+    aml_buffer_appends(b, "after");
+    MACRO_ASSERT_STREQ(aml_buffer_data(b), "after");
+    /* an unparked object is left alone */
+    aml_buffer_reserve(b, 100000);
+    MACRO_ASSERT_EQ_SZ(aml_idle_release(0), 0);
+    MACRO_ASSERT_TRUE(aml_buffer_capacity(b) >= 100000);
+    /* unparking twice is harmless */
+    aml_idle_unpark(ib);
+
+    aml_idle_remove(ip);
+    aml_idle_remove(ib);
+    MACRO_ASSERT_EQ_SZ(aml_idle_count(), 0);
+    aml_pool_destroy(p);
+    aml_buffer_destroy(b);
+}
+
+typedef struct {
+    aml_buffer_t *b;
+    aml_idle_t *idle;
+    int rounds;
+} owner_t;
+
+/* an owner which keeps using its buffer between short parks */
+static void *owner(void *arg) {
+    owner_t *o = (owner_t *)arg;
+    for (int i = 0; i < o->rounds; i++) {
+        aml_idle_unpark(o->idle);
+        aml_buffer_clear(o->b);
+        aml_buffer_appendn(o->b, 'a' + i % 26, 10000 + (i % 7) * 5000);
+        MACRO_ASSERT_EQ_INT(aml_buffer_data(o->b)[9999], 'a' + i % 26);
+        aml_buffer_clear(o->b);
+        aml_idle_park(o->idle);
+        if (i % 16 == 0)
+            usleep(200);
+    }
+    return NULL;
+}
+
+MACRO_TEST(idle_background_thread) {
+    enum { OWNERS = 4 };
+    owner_t o[OWNERS];
+    pthread_t t[OWNERS];
+    for (int i = 0; i < OWNERS; i++) {
+        o[i].b = aml_buffer_init(0);
+        o[i].idle = aml_idle_add_buffer(o[i].b, 0);
+        o[i].rounds = 2000;
+    }
+    MACRO_ASSERT_TRUE(aml_idle_start(0, 1));
+    /* starting again only changes the intervals */
+    MACRO_ASSERT_TRUE(aml_idle_start(0, 1));
+    for (int i = 0; i < OWNERS; i++)
+        pthread_create(&t[i], NULL, owner, o + i);
+    for (int i = 0; i < OWNERS; i++)
+        pthread_join(t[i], NULL);
+
+    /* everything is parked, so the thread gets to all of it */
+    for (int tries = 0; aml_idle_trimmed() < OWNERS && tries < 1000; tries++)
+        usleep(1000);
+    MACRO_ASSERT_EQ_SZ(aml_idle_trimmed(), OWNERS);
+    aml_idle_stop();
+    aml_idle_stop();
+    for (int i = 0; i < OWNERS; i++) {
+        MACRO_ASSERT_EQ_SZ(aml_buffer_capacity(o[i].b), 0);
+        aml_idle_remove(o[i].idle);
+        aml_buffer_destroy(o[i].b);
+    }
+    MACRO_ASSERT_EQ_SZ(aml_idle_count(), 0);
+
+    /* and it can be started again */
+    MACRO_ASSERT_TRUE(aml_idle_start(1000, 1000));
+    aml_idle_stop();
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, idle_trims_parked_objects);
+    MACRO_ADD(tests, idle_background_thread);
+
+    macro_run_all("a-memory-library/aml_idle", tests, test_count);
+    return 0;
+}
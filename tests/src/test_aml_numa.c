@@ -0,0 +1,167 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_numa.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_numa.h"
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_pool_cache.h"
+#include "a-memory-library/aml_buffer.h"
+
+#include <string.h>
+
+/* most machines running the tests have a single node or no NUMA support, so
+   placement is only checked when the kernel reports a node */
+static int test_node(void) {
+    int node = aml_numa_current_node();
+    return node >= 0 && node < aml_numa_node_count() ? node : -1;
+}
+
+static aml_pool_t *numa_pool(int node) {
+    aml_pool_options_t opts = {0};
+    opts.flags = AML_POOL_NUMA;
+    opts.numa_node = node;
+    return aml_pool_init_ex(4096, &opts);
+}
+
+MACRO_TEST(numa_topology) {
+    MACRO_ASSERT_TRUE(aml_numa_node_count() >= 1);
+    int node = aml_numa_current_node();
+    MACRO_ASSERT_TRUE(node >= -1 && node < AML_NUMA_MAX_NODES);
+
+    size_t len = 100;
+    char *p = (char *)aml_numa_alloc(&len, node < 0 ? 0 : node);
+    MACRO_ASSERT_TRUE(len >= 100 && len % 4096 == 0);
+    MACRO_ASSERT_EQ_INT(p[0], 0);
+    memset(p, 1, len);
+    if (test_node() >= 0)
+        MACRO_ASSERT_EQ_INT(aml_numa_node_of(p), node);
+    MACRO_ASSERT_TRUE(aml_numa_bind(p, len, AML_NUMA_NONE) || node < 0);
+    aml_numa_free(p, len);
+
+    /* out of range nodes aren't bound */
+    len = 4096;
+    p = (char *)aml_numa_alloc(&len, AML_NUMA_MAX_NODES);
+    MACRO_ASSERT_TRUE(!aml_numa_bind(p, len, AML_NUMA_MAX_NODES));
+    aml_numa_free(p, len);
+}
+
+MACRO_TEST(numa_pool_blocks_on_node) {
+    int node = test_node();
+    aml_pool_t *p = numa_pool(node < 0 ? 0 : node);
+    char *first = (char *)aml_pool_alloc(p, 100);
+    memset(first, 'a', 100);
+    /* well past the reservation, so the pool adds blocks */
+    char *blocks[32];
+    for (int i = 0; i < 32; i++) {
+        blocks[i] = (char *)aml_pool_alloc(p, 10000 + i * 1000);
+        memset(blocks[i], 'b', 10000 + i * 1000);
+    }
+    MACRO_ASSERT_TRUE(aml_pool_used(p) > 32 * 10000);
+    for (int i = 0; i < 100; i++)
+        MACRO_ASSERT_EQ_INT(first[i], 'a');
+    if (node >= 0) {
+        MACRO_ASSERT_EQ_INT(aml_numa_node_of(first), node);
+        for (int i = 0; i < 32; i++)
+            MACRO_ASSERT_EQ_INT(aml_numa_node_of(blocks[i]), node);
+    }
+
+    /* the blocks are released on clear and the pool is still usable */
+    aml_pool_clear(p);
+    char *s = aml_pool_strdup(p, "after clear");
+    MACRO_ASSERT_STREQ(s, "after clear");
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(numa_pool_local) {
+    int node = test_node();
+    aml_pool_t *p = numa_pool(AML_NUMA_LOCAL);
+    for (int i = 0; i < 20; i++) {
+        char *b = (char *)aml_pool_alloc(p, 50000);
+        memset(b, 'c', 50000);
+        if (node >= 0)
+            MACRO_ASSERT_EQ_INT(aml_numa_node_of(b), node);
+    }
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(numa_pool_cache_reuses_node_blocks) {
+    int node = test_node();
+    aml_pool_cache_enable(8 << 20);
+    aml_pool_t *p = numa_pool(node < 0 ? 0 : node);
+
+    for (int i = 0; i < 10; i++)
+        memset(aml_pool_alloc(p, 20000), 'd', 20000);
+    aml_pool_clear(p);
+
+    aml_pool_cache_stats_t st;
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.cached_blocks > 0);
+    size_t hits = st.hits;
+
+    /* the same sizes come back from the node's list */
+    for (int i = 0; i < 10; i++) {
+        char *b = (char *)aml_pool_alloc(p, 20000);
+        memset(b, 'e', 20000);
+        if (node >= 0)
+            MACRO_ASSERT_EQ_INT(aml_numa_node_of(b), node);
+    }
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.hits > hits);
+
+    /* blocks on an unsupported node aren't cached */
+    MACRO_ASSERT_TRUE(!_aml_pool_cache_release_node(NULL, 8192, 1000));
+
+    aml_pool_destroy(p);
+    /* disabling unmaps the cached node blocks */
+    aml_pool_cache_enable(0);
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_EQ_SZ(st.cached_bytes, 0);
+    MACRO_ASSERT_EQ_SZ(st.cached_blocks, 0);
+}
+
+MACRO_TEST(numa_buffer_mapping) {
+    int node = test_node();
+    aml_buffer_t *b = aml_buffer_init(16);
+    aml_buffer_set_mmap_threshold(b, 64 << 10);
+    aml_buffer_set_numa(b, node < 0 ? 0 : node);
+
+    char chunk[1000];
+    memset(chunk, 'f', sizeof(chunk));
+    for (int i = 0; i < 500; i++)
+        aml_buffer_append(b, chunk, sizeof(chunk));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(b), 500000);
+    if (node >= 0) {
+        MACRO_ASSERT_EQ_INT(aml_numa_node_of(aml_buffer_data(b)), node);
+        MACRO_ASSERT_EQ_INT(aml_numa_node_of(aml_buffer_data(b) + 400000),
+                            node);
+    }
+
+    /* binding a buffer which is already mapped moves it */
+    aml_buffer_set_numa(b, AML_NUMA_LOCAL);
+    MACRO_ASSERT_EQ_INT(aml_buffer_data(b)[499999], 'f');
+    aml_buffer_destroy(b);
+
+    /* pool buffers start without a node */
+    aml_pool_t *pool = aml_pool_init(1024);
+    aml_buffer_t *pb = aml_buffer_pool_init(pool, 16);
+    aml_buffer_appends(pb, "pool");
+    MACRO_ASSERT_STREQ(aml_buffer_data(pb), "pool");
+    aml_pool_destroy(pool);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, numa_topology);
+    MACRO_ADD(tests, numa_pool_blocks_on_node);
+    MACRO_ADD(tests, numa_pool_local);
+    MACRO_ADD(tests, numa_pool_cache_reuses_node_blocks);
+    MACRO_ADD(tests, numa_buffer_mapping);
+
+    macro_run_all("a-memory-library/aml_numa", tests, test_count);
+    return 0;
+}
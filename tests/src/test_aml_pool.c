@@ -10,6 +10,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 static char *pool_vdup(aml_pool_t *pool, const char *fmt, ...) {
     va_list args;
@@ -196,6 +199,163 @@ MACRO_TEST(pool_split_with_escape_variants) {
     aml_pool_destroy(p);
 }
 
+static const char *split_kernels[] = {"scalar", "sse2", "avx2", "neon"};
+
+/* the obvious byte at a time splitter to check the kernels against */
+static size_t split_reference(char **out, char *buf, const char *s,
+                              char delim, int escape, bool skip_empty) {
+    size_t n = 0;
+    char *field = buf, *wp = buf;
+    for (;; s++) {
+        if (escape >= 0 && *s == escape) {
+            if (s[1] == 0) {
+                s++;
+            } else {
+                *wp++ = *++s;
+                continue;
+            }
+        }
+        if (*s == delim || *s == 0) {
+            bool end = (*s == 0);
+            *wp++ = 0;
+            if (!skip_empty || wp - 1 > field)
+                out[n++] = field;
+            if (end)
+                return n;
+            field = wp;
+            continue;
+        }
+        *wp++ = *s;
+    }
+}
+
+MACRO_TEST(pool_split_kernels_match_reference) {
+    aml_pool_t *p = aml_pool_init(128);
+    static const char alphabet[] = "ab,,\\,c";
+    char input[700];
+    char buf[sizeof(input) + 1];
+    char *expected[sizeof(input) + 1];
+    uint32_t seed = 777;
+
+    for (size_t k = 0; k < sizeof(split_kernels) / sizeof(split_kernels[0]); k++) {
+        if (!aml_split_use(split_kernels[k]))
+            continue;
+        MACRO_ASSERT_STREQ(aml_split_kernel(), split_kernels[k]);
+        for (size_t len = 0; len < sizeof(input); len += 1 + len / 8) {
+            for (size_t i = 0; i < len; i++) {
+                seed = seed * 1103515245 + 12345;
+                input[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+            }
+            input[len] = 0;
+            for (int mode = 0; mode < 4; mode++) {
+                bool skip_empty = (mode & 1) != 0;
+                int escape = (mode & 2) ? '\\' : -1;
+                size_t n_expected = split_reference(expected, buf, input, ',',
+                                                    escape, skip_empty);
+                /* start at every alignment */
+                aml_pool_clear(p);
+                char *s = aml_pool_ualloc(p, len + 1 + (len & 15));
+                s += len & 15;
+                memcpy(s, input, len + 1);
+
+                size_t n = 12345;
+                char **r;
+                if (escape < 0)
+                    r = skip_empty ? _aml_pool_split2(p, &n, ',', s)
+                                   : _aml_pool_split(p, &n, ',', s);
+                else
+                    r = skip_empty ? _aml_pool_split_with_escape2(p, &n, ',', '\\', s)
+                                   : _aml_pool_split_with_escape(p, &n, ',', '\\', s);
+                MACRO_ASSERT_EQ_SZ(n, n_expected);
+                for (size_t i = 0; i < n; i++)
+                    MACRO_ASSERT_STREQ(r[i], expected[i]);
+                MACRO_ASSERT_TRUE(r[n] == NULL);
+            }
+        }
+    }
+    MACRO_ASSERT_TRUE(!aml_split_use("no-such-kernel"));
+    MACRO_ASSERT_TRUE(aml_split_use(NULL));
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_split_edge_cases) {
+    aml_pool_t *p = aml_pool_init(256);
+    size_t n = 99;
+
+    char **r = aml_pool_split(p, &n, ',', NULL);
+    MACRO_ASSERT_EQ_SZ(n, 0);
+    MACRO_ASSERT_TRUE(r[0] == NULL);
+    r = aml_pool_split2(p, NULL, ',', NULL);
+    MACRO_ASSERT_TRUE(r[0] == NULL);
+
+    r = aml_pool_split(p, &n, ',', "");
+    MACRO_ASSERT_EQ_SZ(n, 1);
+    MACRO_ASSERT_STREQ(r[0], "");
+    MACRO_ASSERT_TRUE(r[1] == NULL);
+    r = aml_pool_split2(p, &n, ',', ",,,");
+    MACRO_ASSERT_EQ_SZ(n, 0);
+    MACRO_ASSERT_TRUE(r[0] == NULL);
+
+    /* a trailing escape is dropped, an escaped escape is kept */
+    r = aml_pool_split_with_escape(p, &n, ',', '\\', "a\\\\,b\\");
+    MACRO_ASSERT_EQ_SZ(n, 2);
+    MACRO_ASSERT_STREQ(r[0], "a\\");
+    MACRO_ASSERT_STREQ(r[1], "b");
+    MACRO_ASSERT_TRUE(r[2] == NULL);
+
+    /* many pieces grow the pointer array, within and across blocks */
+    char big[4001];
+    for (int i = 0; i < 4000; i++)
+        big[i] = (i & 1) ? ';' : (char)('a' + i % 26);
+    big[4000] = 0;
+    r = aml_pool_split(p, &n, ';', big);
+    MACRO_ASSERT_EQ_SZ(n, 2001);
+    for (size_t i = 0; i < 2000; i++) {
+        MACRO_ASSERT_EQ_INT(r[i][0], 'a' + (int)((i * 2) % 26));
+        MACRO_ASSERT_EQ_INT(r[i][1], 0);
+    }
+    MACRO_ASSERT_STREQ(r[2000], "");
+    MACRO_ASSERT_TRUE(r[2001] == NULL);
+
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_try_extend_and_realloc) {
+    aml_pool_t *p = aml_pool_init(1024);
+    char *a = (char *)aml_pool_alloc(p, 10);
+    memcpy(a, "0123456789", 10);
+
+    /* the last allocation grows and shrinks in place */
+    MACRO_ASSERT_TRUE(aml_pool_try_extend(p, a, 10, 100));
+    MACRO_ASSERT_TRUE(aml_pool_try_extend(p, a, 100, 50));
+    char *b = (char *)aml_pool_ualloc(p, 1);
+    MACRO_ASSERT_TRUE(b == a + 50);
+    /* ... but not once something follows it, or past the block */
+    MACRO_ASSERT_FALSE(aml_pool_try_extend(p, a, 50, 60));
+    MACRO_ASSERT_FALSE(aml_pool_try_extend(p, b, 1, 4096));
+
+    char *c = (char *)aml_pool_realloc(p, a, 50, 200);
+    MACRO_ASSERT_TRUE(c != a);
+    MACRO_ASSERT_TRUE(memcmp(c, "0123456789", 10) == 0);
+    MACRO_ASSERT_EQ_SZ((uintptr_t)c & (sizeof(size_t) - 1), 0);
+    MACRO_ASSERT_TRUE(aml_pool_realloc(p, c, 200, 300) == c);
+
+    /* a realloc which can't fit in the block moves to a new one */
+    char *d = (char *)aml_pool_realloc(p, c, 300, 5000);
+    MACRO_ASSERT_TRUE(memcmp(d, "0123456789", 10) == 0);
+    MACRO_ASSERT_TRUE(aml_pool_realloc(p, NULL, 0, 16) != NULL);
+
+    /* bytes which were given back are zeroed by zalloc */
+    aml_pool_clear(p);
+    char *e = (char *)aml_pool_alloc(p, 64);
+    memset(e, 0xff, 64);
+    MACRO_ASSERT_TRUE(aml_pool_try_extend(p, e, 64, 8));
+    char *z = (char *)aml_pool_zalloc(p, 56);
+    for (int i = 0; i < 56; i++)
+        MACRO_ASSERT_EQ_INT(z[i], 0);
+    aml_pool_destroy(p);
+}
+
 MACRO_TEST(pool_strdupa_families) {
     aml_pool_t *p = aml_pool_init(256);
 
@@ -244,6 +404,82 @@ MACRO_TEST(pool_base64_roundtrip) {
     aml_pool_destroy(p);
 }
 
+static const char *base64_kernels[] = {"scalar", "ssse3", "avx2",
+                                       "avx512vbmi", "neon"};
+
+MACRO_TEST(pool_base64_rfc4648_vectors) {
+    const char *plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    const char *coded[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=",
+                           "Zm9vYmFy"};
+    aml_pool_t *p = aml_pool_init(512);
+    for (size_t i = 0; i < 7; i++) {
+        size_t len = strlen(plain[i]);
+        MACRO_ASSERT_STREQ(aml_pool_base64_encode(p, (const unsigned char *)plain[i], len),
+                           coded[i]);
+        size_t out_len = 99;
+        unsigned char *d = aml_pool_base64_decode(p, &out_len, coded[i]);
+        MACRO_ASSERT_EQ_SZ(out_len, len);
+        MACRO_ASSERT_STREQ((char *)d, plain[i]);
+        /* without the padding */
+        size_t n = strlen(coded[i]);
+        while (n && coded[i][n - 1] == '=')
+            n--;
+        d = aml_pool_base64_decoden(p, &out_len, coded[i], n);
+        MACRO_ASSERT_EQ_SZ(out_len, len);
+        MACRO_ASSERT_TRUE(memcmp(d, plain[i], len) == 0);
+    }
+    MACRO_ASSERT_TRUE(aml_pool_base64_decode(p, NULL, "Z") == NULL);
+    MACRO_ASSERT_TRUE(aml_pool_base64_decode(p, NULL, "Zg=a") == NULL);
+    MACRO_ASSERT_TRUE(aml_pool_base64_decode(p, NULL, "Zg==Zg==") == NULL);
+    MACRO_ASSERT_TRUE(aml_pool_base64_decode(p, NULL, "Zm9v!mFy") == NULL);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_base64_kernels_match_scalar) {
+    aml_pool_t *p = aml_pool_init(1 << 16);
+    unsigned char data[1500];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+    aml_pool_t *ref = aml_pool_init(1 << 20);
+    MACRO_ASSERT_TRUE(aml_base64_use("scalar"));
+    char *expected[sizeof(data) + 1];
+    for (size_t len = 0; len <= sizeof(data); len++)
+        expected[len] = aml_pool_base64_encode(ref, data, len);
+
+    for (size_t k = 0; k < sizeof(base64_kernels) / sizeof(base64_kernels[0]); k++) {
+        if (!aml_base64_use(base64_kernels[k]))
+            continue;
+        MACRO_ASSERT_STREQ(aml_base64_kernel(), base64_kernels[k]);
+        for (size_t len = 0; len <= sizeof(data); len++) {
+            aml_pool_clear(p);
+            char *e = aml_pool_base64_encode(p, data, len);
+            MACRO_ASSERT_STREQ(e, expected[len]);
+            size_t out_len = 0;
+            unsigned char *d = aml_pool_base64_decode(p, &out_len, e);
+            MACRO_ASSERT_EQ_SZ(out_len, len);
+            MACRO_ASSERT_TRUE(memcmp(d, data, len) == 0);
+            MACRO_ASSERT_EQ_INT(d[len], 0);
+
+            /* a bad character anywhere is caught */
+            size_t n = strlen(e);
+            if (n > 4) {
+                size_t pos = (len * 7) % (n - 3);
+                char saved = e[pos];
+                e[pos] = (len & 1) ? '*' : (char)0x80;
+                MACRO_ASSERT_TRUE(aml_pool_base64_decode(p, &out_len, e) == NULL);
+                e[pos] = saved;
+            }
+        }
+    }
+    MACRO_ASSERT_TRUE(!aml_base64_use("no-such-kernel"));
+    MACRO_ASSERT_TRUE(aml_base64_use(NULL));
+    aml_pool_destroy(ref);
+    aml_pool_destroy(p);
+}
+
 MACRO_TEST(pool_subpool_lifecycle) {
     aml_pool_t *root = aml_pool_init(1024);
     aml_pool_t *sub = aml_pool_pool_init(root, 128);
@@ -273,7 +509,691 @@ MACRO_TEST(pool_strdupa_empty_array) {
     aml_pool_destroy(p);
 }
 
+static int all_zero(const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        if (p[i]) return 0;
+    return 1;
+}
+
+MACRO_TEST(pool_mmap_commits_lazily) {
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 64 << 20;
+    opts.commit_size = 64 << 10;
+    aml_pool_t *p = aml_pool_init_ex(4096, &opts);
+
+    size_t used0 = aml_pool_used(p);
+    MACRO_ASSERT_TRUE(used0 < (1 << 20));
+
+    /* grows inside the reservation instead of adding blocks */
+    char *first = (char *)aml_pool_alloc(p, 16);
+    char *last = first;
+    for (int i = 0; i < 64; i++) {
+        last = (char *)aml_pool_alloc(p, 64 << 10);
+        memset(last, 0xAA, 64 << 10);
+    }
+    MACRO_ASSERT_TRUE(last > first && last - first < (8 << 20));
+    MACRO_ASSERT_TRUE(aml_pool_used(p) >= used0 + (4 << 20));
+
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_mmap_zalloc_after_reuse) {
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 16 << 20;
+    aml_pool_t *p = aml_pool_init_ex(1 << 20, &opts);
+
+    unsigned char *a = (unsigned char *)aml_pool_zalloc(p, 100000);
+    MACRO_ASSERT_TRUE(all_zero(a, 100000));
+    memset(a, 0x55, 100000);
+
+    /* memory that was handed out before must be cleared again */
+    aml_pool_clear(p);
+    unsigned char *b = (unsigned char *)aml_pool_calloc(p, 1000, 200);
+    MACRO_ASSERT_TRUE(all_zero(b, 200000));
+    memset(b, 0x66, 200000);
+
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    unsigned char *c = (unsigned char *)aml_pool_alloc(p, 5000);
+    memset(c, 0x77, 5000);
+    aml_pool_restore(p, &m);
+    unsigned char *d = (unsigned char *)aml_pool_zalloc(p, 8000);
+    MACRO_ASSERT_TRUE(all_zero(d, 8000));
+
+    /* formatted strings may scribble past curp */
+    aml_pool_clear(p);
+    char *s = aml_pool_strdupf(p, "%s-%d", "abcdefgh", 12345678);
+    MACRO_ASSERT_STREQ(s, "abcdefgh-12345678");
+    aml_pool_restore(p, &m);
+    aml_pool_clear(p);
+    unsigned char *e = (unsigned char *)aml_pool_zalloc(p, 64);
+    MACRO_ASSERT_TRUE(all_zero(e, 64));
+
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_mmap_clear_releases_tail) {
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 8 << 20;
+    opts.retain_size = 64 << 10;
+    opts.flags = AML_POOL_CLEAR_DONTNEED | AML_POOL_HUGEPAGE;
+    aml_pool_t *p = aml_pool_init_ex(4096, &opts);
+
+    unsigned char *a = (unsigned char *)aml_pool_alloc(p, 4 << 20);
+    memset(a, 0xEE, 4 << 20);
+    aml_pool_clear(p);
+
+    unsigned char *b = (unsigned char *)aml_pool_zalloc(p, 4 << 20);
+    MACRO_ASSERT_TRUE(b == a);
+    MACRO_ASSERT_TRUE(all_zero(b, 4 << 20));
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_mmap_reservation_exhausted) {
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 1 << 20;
+    opts.flags = AML_POOL_HUGETLB | AML_POOL_CLEAR_FREE;
+    aml_pool_t *p = aml_pool_init_ex(4096, &opts);
+
+    /* once the reservation is full, the pool falls back to heap blocks */
+    for (int i = 0; i < 48; i++) {
+        unsigned char *z = (unsigned char *)aml_pool_zalloc(p, 64 << 10);
+        MACRO_ASSERT_TRUE(all_zero(z, 64 << 10));
+        memset(z, 0x11, 64 << 10);
+    }
+    aml_pool_clear(p);
+    for (int i = 0; i < 48; i++) {
+        unsigned char *z = (unsigned char *)aml_pool_zalloc(p, 64 << 10);
+        MACRO_ASSERT_TRUE(all_zero(z, 64 << 10));
+    }
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_init_ex_without_options) {
+    aml_pool_t *p = aml_pool_init_ex(256, NULL);
+    char *s = aml_pool_strdup(p, "heap");
+    MACRO_ASSERT_STREQ(s, "heap");
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_large_allocation_keeps_current_block) {
+    aml_pool_t *p = aml_pool_init(1024);
+    char *a = (char *)aml_pool_alloc(p, 64);
+    size_t before = aml_pool_size(p);
+
+    /* larger than the growth block, so it gets its own node */
+    char *big = (char *)aml_pool_alloc(p, 64 * 1024);
+    memset(big, 'b', 64 * 1024);
+    MACRO_ASSERT_EQ_SZ(aml_pool_size(p), before);
+
+    /* small allocations continue in the first block */
+    char *b = (char *)aml_pool_alloc(p, 64);
+    MACRO_ASSERT_TRUE(b == a + 64);
+
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    size_t used = aml_pool_used(p);
+    char *big2 = (char *)aml_pool_zalloc(p, 32 * 1024);
+    for (size_t i = 0; i < 32 * 1024; i++)
+        MACRO_ASSERT_EQ_INT(big2[i], 0);
+    MACRO_ASSERT_TRUE(aml_pool_used(p) > used);
+    aml_pool_restore(p, &m);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), used);
+
+    aml_pool_clear(p);
+    aml_pool_t *q = aml_pool_init(1024);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), aml_pool_used(q));
+    aml_pool_destroy(q);
+    aml_pool_destroy(p);
+}
+
+/* allocate 256 bytes at a time and return the size of the next block added */
+static size_t next_growth(aml_pool_t *p) {
+    size_t used = aml_pool_used(p);
+    while (aml_pool_used(p) == used)
+        aml_pool_alloc(p, 256);
+    return aml_pool_used(p) - used;
+}
+
+MACRO_TEST(pool_geometric_growth) {
+    aml_pool_t *p = aml_pool_init(1024);
+    aml_pool_set_geometric_growth(p, 8192);
+
+    size_t expect[] = {1024, 2048, 4096, 8192, 8192};
+    for (size_t i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+        size_t added = next_growth(p);
+        MACRO_ASSERT_TRUE(added >= expect[i]);
+        MACRO_ASSERT_TRUE(added < expect[i] + 64);
+    }
+
+    /* clear starts over at the minimum growth size */
+    aml_pool_clear(p);
+    size_t added = next_growth(p);
+    MACRO_ASSERT_TRUE(added < 1024 + 64);
+    aml_pool_destroy(p);
+}
+
+static size_t grow_by_len(void *arg, size_t len, size_t last_block_size) {
+    size_t *calls = (size_t *)arg;
+    (*calls)++;
+    (void)last_block_size;
+    return len * 4;
+}
+
+MACRO_TEST(pool_growth_callback) {
+    size_t calls = 0;
+    aml_pool_t *p = aml_pool_init(256);
+    aml_pool_set_growth_callback(p, grow_by_len, &calls);
+
+    char *a = (char *)aml_pool_alloc(p, 200);
+    memset(a, 'a', 200);
+    /* doesn't fit, the callback asks for a block of 4x the request */
+    size_t used = aml_pool_used(p);
+    char *b = (char *)aml_pool_alloc(p, 1000);
+    memset(b, 'b', 1000);
+    MACRO_ASSERT_EQ_SZ(calls, 1);
+    MACRO_ASSERT_TRUE(aml_pool_used(p) - used >= 4000);
+    /* the rest of that block is used for the next request */
+    char *c = (char *)aml_pool_alloc(p, 1000);
+    MACRO_ASSERT_TRUE(c == b + 1000);
+    MACRO_ASSERT_EQ_SZ(calls, 1);
+
+    aml_pool_set_fixed_growth(p);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_aalloc_grow_alignment) {
+    aml_pool_t *p = aml_pool_init(128);
+    size_t alignments[] = {8, 16, 64, 256, 4096};
+    for (size_t i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++) {
+        size_t a = alignments[i];
+        /* both a growth block and a large node */
+        char *x = (char *)aml_pool_aalloc(p, a, 100);
+        char *y = (char *)aml_pool_aalloc(p, a, 10000);
+        MACRO_ASSERT_EQ_SZ((uintptr_t)x & (a - 1), 0);
+        MACRO_ASSERT_EQ_SZ((uintptr_t)y & (a - 1), 0);
+        memset(x, 1, 100);
+        memset(y, 2, 10000);
+    }
+    /* after growing for an aligned request, the next ordinary allocation
+       follows it */
+    aml_pool_clear(p);
+    aml_pool_alloc(p, 120);
+    char *x = (char *)aml_pool_aalloc(p, 64, 16);
+    char *z = (char *)aml_pool_ualloc(p, 1);
+    MACRO_ASSERT_TRUE(z == x + 16);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_subpool_large_allocation) {
+    aml_pool_t *root = aml_pool_init(1 << 16);
+    aml_pool_t *sub = aml_pool_pool_init(root, 256);
+    char *a = (char *)aml_pool_alloc(sub, 16);
+    char *big = (char *)aml_pool_alloc(sub, 4096);
+    memset(big, 'x', 4096);
+    char *b = (char *)aml_pool_alloc(sub, 16);
+    MACRO_ASSERT_TRUE(b == a + 16);
+    aml_pool_clear(sub);
+    aml_pool_destroy(sub);
+    aml_pool_destroy(root);
+}
+
+MACRO_TEST(pool_stats_counters) {
+    aml_pool_t *p = aml_pool_init(1024);
+    aml_pool_stats_t st;
+    if (!aml_pool_stats(p, &st)) {
+        /* built without _AML_POOL_STATS_ */
+        MACRO_ASSERT_EQ_SZ(st.grow_count, 0);
+        MACRO_ASSERT_EQ_SZ(st.used, 0);
+        aml_pool_destroy(p);
+        return;
+    }
+    MACRO_ASSERT_EQ_SZ(st.initial_size, 1024);
+    MACRO_ASSERT_EQ_SZ(st.used, aml_pool_used(p));
+
+    aml_pool_ualloc(p, 3);
+    aml_pool_alloc(p, 8);      /* 5 bytes of padding */
+    aml_pool_stats(p, &st);
+    MACRO_ASSERT_EQ_SZ(st.bytes, 11);
+    MACRO_ASSERT_EQ_SZ(st.alignment_waste, 5);
+    MACRO_ASSERT_EQ_SZ(st.grow_count, 0);
+
+    /* abandon the first block */
+    aml_pool_alloc(p, 1000);
+    aml_pool_alloc(p, 1000);
+    aml_pool_alloc(p, 4096);   /* large */
+    aml_pool_stats(p, &st);
+    MACRO_ASSERT_EQ_SZ(st.grow_count, 2);
+    MACRO_ASSERT_EQ_SZ(st.large_count, 1);
+    MACRO_ASSERT_TRUE(st.tail_waste > 0);
+    MACRO_ASSERT_EQ_SZ(st.bytes, 11 + 2000 + 4096);
+    MACRO_ASSERT_EQ_SZ(st.high_water, st.bytes);
+
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    aml_pool_alloc(p, 64);
+    aml_pool_restore(p, &m);
+    aml_pool_stats(p, &st);
+    MACRO_ASSERT_EQ_SZ(st.bytes, 11 + 2000 + 4096);
+    MACRO_ASSERT_EQ_SZ(st.high_water, 11 + 2000 + 4096 + 64);
+
+    aml_pool_clear(p);
+    aml_pool_stats(p, &st);
+    MACRO_ASSERT_EQ_SZ(st.bytes, 0);
+    MACRO_ASSERT_EQ_SZ(st.clears, 1);
+    MACRO_ASSERT_EQ_SZ(st.high_water, 11 + 2000 + 4096 + 64);
+    aml_pool_destroy(p);
+}
+
+typedef struct {
+    aml_pool_t *a;
+    aml_pool_t *b;
+    size_t found;
+    size_t total;
+} stats_walk_t;
+
+static void count_pool(void *arg, aml_pool_t *pool, const aml_pool_stats_t *st) {
+    stats_walk_t *w = (stats_walk_t *)arg;
+    w->total++;
+    if (pool == w->a || pool == w->b) {
+        w->found++;
+        MACRO_ASSERT_EQ_SZ(st->used, aml_pool_used(pool));
+    }
+}
+
+MACRO_TEST(pool_stats_registry) {
+    aml_pool_stats_t st;
+    stats_walk_t w = {0};
+    w.a = aml_pool_init(256);
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 1 << 20;
+    w.b = aml_pool_init_ex(256, &opts);
+    aml_pool_t *sub = aml_pool_pool_init(w.a, 64);
+
+    aml_pool_stats_foreach(count_pool, &w);
+    if (aml_pool_stats(w.a, &st)) {
+        MACRO_ASSERT_EQ_SZ(w.found, 2);
+        MACRO_ASSERT_EQ_SZ(w.total, 2);
+    } else {
+        MACRO_ASSERT_EQ_SZ(w.total, 0);
+    }
+
+    aml_pool_destroy(sub);
+    aml_pool_destroy(w.b);
+    w.found = w.total = 0;
+    aml_pool_stats_foreach(count_pool, &w);
+    MACRO_ASSERT_TRUE(w.total <= 1);
+    MACRO_ASSERT_TRUE(w.found == w.total);
+    aml_pool_destroy(w.a);
+}
+
+MACRO_TEST(pool_format_strings) {
+    aml_pool_t *p = aml_pool_init(256);
+    MACRO_ASSERT_STREQ(aml_pool_u64(p, 18446744073709551615ULL), "18446744073709551615");
+    MACRO_ASSERT_STREQ(aml_pool_i64(p, INT64_MIN), "-9223372036854775808");
+    MACRO_ASSERT_STREQ(aml_pool_hex(p, 0xdeadbeef), "deadbeef");
+    MACRO_ASSERT_STREQ(aml_pool_hex(p, 0), "0");
+    MACRO_ASSERT_STREQ(aml_pool_double(p, 0.1), "0.1");
+    MACRO_ASSERT_STREQ(aml_pool_double(p, -1e100), "-1e+100");
+    MACRO_ASSERT_STREQ(aml_pool_json_string(p, "a\"b", 3), "\"a\\\"b\"");
+    MACRO_ASSERT_STREQ(aml_pool_csv_field(p, "a;b", 3, ';'), "\"a;b\"");
+    MACRO_ASSERT_STREQ(aml_pool_csv_field(p, "ab", 2, ';'), "ab");
+
+    /* only the bytes which were written are kept */
+    aml_pool_clear(p);
+    char *a = aml_pool_u64(p, 7);
+    char *b = aml_pool_u64(p, 42);
+    MACRO_ASSERT_TRUE(b == a + 2);
+    MACRO_ASSERT_STREQ(a, "7");
+    MACRO_ASSERT_STREQ(b, "42");
+
+    /* values which don't fit in the current block */
+    for (int i = 0; i < 1000; i++) {
+        char *s = aml_pool_i64(p, -i);
+        MACRO_ASSERT_TRUE(s[0] == (i ? '-' : '0'));
+    }
+    aml_pool_destroy(p);
+}
+
+static int cleanup_calls;
+static void note_cleanup(void *arg) {
+    (void)arg;
+    cleanup_calls++;
+}
+
+MACRO_TEST(pool_cleanup_callbacks) {
+    aml_pool_t *p = aml_pool_init(256);
+    cleanup_calls = 0;
+    aml_pool_add_cleanup(p, note_cleanup, NULL);
+    aml_pool_add_cleanup(p, note_cleanup, NULL);
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    aml_pool_add_cleanup(p, note_cleanup, NULL);
+    aml_pool_alloc(p, 100);
+    /* restore doesn't run (or lose) them */
+    aml_pool_restore(p, &m);
+    aml_pool_alloc(p, 200);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 0);
+    aml_pool_clear(p);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 3);
+    aml_pool_clear(p);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 3);
+
+    aml_pool_add_cleanup(p, note_cleanup, NULL);
+    aml_pool_t *sub = aml_pool_pool_init(p, 64);
+    aml_pool_add_cleanup(sub, note_cleanup, NULL);
+    aml_pool_destroy(sub);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 4);
+    aml_pool_destroy(p);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 5);
+}
+
+MACRO_TEST(pool_load_file) {
+    aml_pool_t *p = aml_pool_init(1024);
+    char path[] = "/tmp/aml_pool_XXXXXX";
+    int fd = mkstemp(path);
+    MACRO_ASSERT_TRUE(fd >= 0);
+    MACRO_ASSERT_EQ_INT((int)write(fd, "small", 5), 5);
+
+    /* small files are read into the pool */
+    size_t len = 0;
+    const char *s = (const char *)aml_pool_load_file(p, path, &len);
+    MACRO_ASSERT_EQ_SZ(len, 5);
+    MACRO_ASSERT_STREQ(s, "small");
+
+    /* large ones are mapped */
+    char block[4096];
+    for (size_t i = 0; i < sizeof(block); i++)
+        block[i] = (char)('a' + i % 26);
+    for (int i = 0; i < 32; i++)
+        MACRO_ASSERT_EQ_INT((int)write(fd, block, sizeof(block)), (int)sizeof(block));
+    close(fd);
+    size_t used = aml_pool_used(p);
+    const char *big = (const char *)aml_pool_load_file(p, path, &len);
+    MACRO_ASSERT_EQ_SZ(len, 5 + 32 * sizeof(block));
+    MACRO_ASSERT_TRUE(!memcmp(big, "small", 5));
+    MACRO_ASSERT_TRUE(!memcmp(big + 5 + 31 * sizeof(block), block, sizeof(block)));
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), used);
+
+    /* the mapping goes away with the pool's contents */
+    aml_pool_clear(p);
+    MACRO_ASSERT_TRUE(aml_pool_load_file(p, "/nonexistent/file", &len) == NULL);
+    MACRO_ASSERT_EQ_SZ(len, 0);
+
+    /* files which can't be sized are read */
+    s = (const char *)aml_pool_load_file(p, "/proc/self/stat", &len);
+    MACRO_ASSERT_TRUE(s == NULL || strlen(s) == len);
+    unlink(path);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_adopt_moves_blocks) {
+    aml_pool_t *dst = aml_pool_init(256);
+    aml_pool_t *src = aml_pool_init(256);
+    char *mine = aml_pool_strdup(dst, "dst");
+
+    /* data in the initial block, growth blocks and a large node */
+    char *strs[100];
+    for (int i = 0; i < 100; i++)
+        strs[i] = aml_pool_strdupf(src, "string %d", i);
+    char *big = (char *)aml_pool_alloc(src, 10000);
+    memset(big, 'z', 10000);
+    size_t dst_used = aml_pool_used(dst);
+    size_t src_used = aml_pool_used(src);
+
+    MACRO_ASSERT_TRUE(aml_pool_adopt(dst, src));
+    /* src's blocks (less its handle) are now counted by dst */
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(dst), dst_used + src_used - sizeof(aml_pool_t));
+    MACRO_ASSERT_TRUE(aml_pool_used(src) < 1024);
+
+    /* src is empty and reusable, which doesn't touch what dst adopted */
+    for (int i = 0; i < 100; i++)
+        aml_pool_strdupf(src, "overwrite %d", i);
+    aml_pool_clear(src);
+    aml_pool_destroy(src);
+    char expect[32];
+    for (int i = 0; i < 100; i++) {
+        snprintf(expect, sizeof(expect), "string %d", i);
+        MACRO_ASSERT_STREQ(strs[i], expect);
+    }
+    MACRO_ASSERT_EQ_INT(big[9999], 'z');
+    MACRO_ASSERT_STREQ(mine, "dst");
+
+    /* dst keeps allocating in its own block */
+    MACRO_ASSERT_STREQ(aml_pool_strdup(dst, "more"), "more");
+    aml_pool_clear(dst);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(dst), dst_used);
+    aml_pool_destroy(dst);
+}
+
+MACRO_TEST(pool_adopt_lifetimes) {
+    /* dst lets go of src's initial block before src is destroyed */
+    aml_pool_t *dst = aml_pool_init(256);
+    aml_pool_t *src = aml_pool_init(256);
+    char *s = aml_pool_strdup(src, "first");
+    MACRO_ASSERT_TRUE(aml_pool_adopt(dst, src));
+    MACRO_ASSERT_STREQ(s, "first");
+    aml_pool_destroy(dst);
+    /* adopting again moves src's replacement block rather than lending */
+    dst = aml_pool_init(256);
+    s = aml_pool_strdup(src, "second");
+    MACRO_ASSERT_TRUE(aml_pool_adopt(dst, src));
+    aml_pool_destroy(src);
+    MACRO_ASSERT_STREQ(s, "second");
+    aml_pool_destroy(dst);
+
+    /* an empty pool has nothing to hand over */
+    dst = aml_pool_init(256);
+    src = aml_pool_init(256);
+    size_t used = aml_pool_used(dst);
+    MACRO_ASSERT_TRUE(aml_pool_adopt(dst, src));
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(dst), used);
+
+    /* the same pool, sub-pools and mmap backed sources can't be adopted */
+    MACRO_ASSERT_FALSE(aml_pool_adopt(dst, dst));
+    aml_pool_t *sub = aml_pool_pool_init(dst, 64);
+    MACRO_ASSERT_FALSE(aml_pool_adopt(dst, sub));
+    MACRO_ASSERT_FALSE(aml_pool_adopt(sub, src));
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 1 << 20;
+    aml_pool_t *m = aml_pool_init_ex(4096, &opts);
+    MACRO_ASSERT_FALSE(aml_pool_adopt(dst, m));
+    /* but an mmap backed pool can adopt */
+    s = aml_pool_strdup(src, "into mmap");
+    MACRO_ASSERT_TRUE(aml_pool_adopt(m, src));
+    aml_pool_destroy(src);
+    MACRO_ASSERT_STREQ(s, "into mmap");
+    aml_pool_destroy(m);
+    aml_pool_destroy(dst);
+}
+
+MACRO_TEST(pool_adopt_cleanups_and_restore) {
+    aml_pool_t *dst = aml_pool_init(256);
+    aml_pool_t *src = aml_pool_init(256);
+    cleanup_calls = 0;
+    aml_pool_add_cleanup(src, note_cleanup, NULL);
+    aml_pool_strdup(src, "x");
+    aml_pool_marker_t m;
+    aml_pool_save(dst, &m);
+    MACRO_ASSERT_TRUE(aml_pool_adopt(dst, src));
+    /* the cleanup moved with the memory */
+    aml_pool_clear(src);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 0);
+
+    /* restoring to before the adoption frees the adopted blocks */
+    for (int i = 0; i < 50; i++)
+        aml_pool_alloc(src, 100);
+    MACRO_ASSERT_TRUE(aml_pool_adopt(dst, src));
+    aml_pool_restore(dst, &m);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(dst), m.used);
+    aml_pool_destroy(src);
+    aml_pool_clear(dst);
+    MACRO_ASSERT_EQ_INT(cleanup_calls, 1);
+    aml_pool_destroy(dst);
+}
+
 /* --- runner --- */
+/* one cycle of n 100 byte allocations, returning whether the pool grew */
+static bool adaptive_cycle(aml_pool_t *p, int n) {
+    size_t used = aml_pool_used(p);
+    for (int i = 0; i < n; i++)
+        memset(aml_pool_alloc(p, 100), 'x', 100);
+    bool grew = aml_pool_used(p) != used;
+    aml_pool_clear(p);
+    return grew;
+}
+
+MACRO_TEST(pool_adaptive_grows_after_repeated_overflow) {
+    aml_pool_t *p = aml_pool_init(256);
+    aml_pool_set_adaptive(p, 1 << 20);
+    for (int i = 0; i < 3; i++)
+        MACRO_ASSERT_TRUE(adaptive_cycle(p, 50));
+    /* the fourth overflow replaces the primary block */
+    MACRO_ASSERT_TRUE(adaptive_cycle(p, 50));
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 5000);
+    for (int i = 0; i < 10; i++)
+        MACRO_ASSERT_FALSE(adaptive_cycle(p, 50));
+
+    /* save/restore and large requests still work with the new block */
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    char *big = (char *)aml_pool_alloc(p, 1 << 16);
+    memset(big, 'y', 1 << 16);
+    aml_pool_restore(p, &m);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_adaptive_ignores_outlier) {
+    aml_pool_t *p = aml_pool_init(4096);
+    aml_pool_set_adaptive(p, 1 << 24);
+    size_t initial = aml_pool_used(p);
+    MACRO_ASSERT_TRUE(adaptive_cycle(p, 10000));
+    for (int i = 0; i < 200; i++)
+        MACRO_ASSERT_FALSE(adaptive_cycle(p, 10));
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), initial);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_adaptive_respects_cap) {
+    aml_pool_t *p = aml_pool_init(256);
+    aml_pool_set_adaptive(p, 2048);
+    for (int i = 0; i < 10; i++)
+        adaptive_cycle(p, 100);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) <= 2048);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) > 1024);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(pool_adaptive_shrinks) {
+    aml_pool_t *p = aml_pool_init(256);
+    aml_pool_set_adaptive(p, 1 << 20);
+    size_t initial = aml_pool_used(p);
+    for (int i = 0; i < 4; i++)
+        adaptive_cycle(p, 200);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 20000);
+
+    /* once the window only holds cycles which need far less */
+    for (int i = 0; i < 200; i++)
+        adaptive_cycle(p, 20);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) < 20000);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 2000);
+    MACRO_ASSERT_FALSE(adaptive_cycle(p, 20));
+
+    /* tiny cycles go back to the initial block */
+    for (int i = 0; i < 200; i++)
+        adaptive_cycle(p, 1);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), initial);
+
+    aml_pool_set_adaptive(p, 0);
+    aml_pool_destroy(p);
+}
+
+/* the number of pages of [p, p + len) which are resident */
+static size_t resident_pages(void *p, size_t len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)p & ~(page - 1);
+    size_t n = ((uintptr_t)p + len - start + page - 1) / page;
+    unsigned char *vec = (unsigned char *)malloc(n);
+    MACRO_ASSERT_EQ_INT(mincore((void *)start, n * page, vec), 0);
+    size_t r = 0;
+    for (size_t i = 0; i < n; i++)
+        r += vec[i] & 1;
+    free(vec);
+    return r;
+}
+
+MACRO_TEST(pool_trim_releases_free_pages) {
+    /* a heap block: the free space goes, what was allocated stays */
+    aml_pool_t *p = aml_pool_init(1 << 20);
+    char *a = aml_pool_strdup(p, "kept");
+    char *tail = (char *)aml_pool_alloc(p, 1);
+    size_t free_bytes = aml_pool_size(p);
+    memset(tail + 64, 'x', free_bytes - 128);
+    size_t used = aml_pool_used(p);
+    size_t released = aml_pool_trim(p, 0);
+    MACRO_ASSERT_TRUE(released > (1 << 20) - 3 * 4096);
+    MACRO_ASSERT_TRUE(resident_pages(tail + 8192, released - 8192) == 0);
+    MACRO_ASSERT_STREQ(a, "kept");
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), used);
+    MACRO_ASSERT_EQ_SZ(aml_pool_size(p), free_bytes);
+    /* the pages come back as they are used */
+    char *b = (char *)aml_pool_alloc(p, 500000);
+    memset(b, 'y', 500000);
+    MACRO_ASSERT_EQ_INT(b[499999], 'y');
+    /* keep_bytes leaves room resident */
+    MACRO_ASSERT_TRUE(aml_pool_trim(p, 1 << 20) == 0);
+    MACRO_ASSERT_TRUE(aml_pool_trim(p, 100000) < aml_pool_size(p) - 90000);
+    aml_pool_destroy(p);
+
+    /* an mmap pool's zero tail is known again after a trim */
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 64 << 20;
+    p = aml_pool_init_ex(4096, &opts);
+    char *m = (char *)aml_pool_alloc(p, 4 << 20);
+    memset(m, 'z', 4 << 20);
+    aml_pool_clear(p);
+    MACRO_ASSERT_TRUE(resident_pages(m, 4 << 20) > 512);
+    MACRO_ASSERT_TRUE(aml_pool_trim(p, 0) >= (4 << 20) - 4096);
+    MACRO_ASSERT_TRUE(resident_pages(m + 4096, (4 << 20) - 4096) == 0);
+    char *z = (char *)aml_pool_zalloc(p, 1 << 20);
+    for (size_t i = 0; i < (1 << 20); i += 4096)
+        MACRO_ASSERT_EQ_INT(z[i], 0);
+    aml_pool_destroy(p);
+
+    /* a sub-pool has nothing of its own */
+    aml_pool_t *parent = aml_pool_init(1 << 16);
+    aml_pool_t *sub = aml_pool_pool_init(parent, 8192);
+    MACRO_ASSERT_EQ_SZ(aml_pool_trim(sub, 0), 0);
+    aml_pool_destroy(parent);
+}
+
+MACRO_TEST(pool_trim_drops_adapted_block) {
+    aml_pool_t *p = aml_pool_init(256);
+    aml_pool_set_adaptive(p, 1 << 20);
+    size_t initial = aml_pool_used(p);
+    for (int i = 0; i < 4; i++)
+        adaptive_cycle(p, 200);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 20000);
+
+    /* not while something is allocated */
+    aml_pool_strdup(p, "busy");
+    aml_pool_trim(p, 0);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 20000);
+    /* nor if keep_bytes doesn't fit in the initial block */
+    aml_pool_clear(p);
+    aml_pool_trim(p, 4096);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 20000);
+
+    MACRO_ASSERT_TRUE(aml_pool_trim(p, 0) >= 20000);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p), initial);
+    MACRO_ASSERT_EQ_SZ(aml_pool_size(p), 256);
+    /* and it can adapt again */
+    for (int i = 0; i < 4; i++)
+        adaptive_cycle(p, 200);
+    MACRO_ASSERT_TRUE(aml_pool_size(p) >= 20000);
+    aml_pool_destroy(p);
+}
+
 int main(void) {
     macro_test_case tests[128];
     size_t test_count = 0;
@@ -286,10 +1206,39 @@ int main(void) {
     MACRO_ADD(tests, pool_strdup_family);
     MACRO_ADD(tests, pool_split_variants_basic);
     MACRO_ADD(tests, pool_split_with_escape_variants);
+    MACRO_ADD(tests, pool_split_kernels_match_reference);
+    MACRO_ADD(tests, pool_split_edge_cases);
+    MACRO_ADD(tests, pool_try_extend_and_realloc);
+    MACRO_ADD(tests, pool_format_strings);
+    MACRO_ADD(tests, pool_cleanup_callbacks);
+    MACRO_ADD(tests, pool_load_file);
     MACRO_ADD(tests, pool_strdupa_families);
     MACRO_ADD(tests, pool_base64_roundtrip);
+    MACRO_ADD(tests, pool_base64_rfc4648_vectors);
+    MACRO_ADD(tests, pool_base64_kernels_match_scalar);
     MACRO_ADD(tests, pool_subpool_lifecycle);
     MACRO_ADD(tests, pool_strdupa_empty_array);
+    MACRO_ADD(tests, pool_mmap_commits_lazily);
+    MACRO_ADD(tests, pool_mmap_zalloc_after_reuse);
+    MACRO_ADD(tests, pool_mmap_clear_releases_tail);
+    MACRO_ADD(tests, pool_mmap_reservation_exhausted);
+    MACRO_ADD(tests, pool_init_ex_without_options);
+    MACRO_ADD(tests, pool_large_allocation_keeps_current_block);
+    MACRO_ADD(tests, pool_geometric_growth);
+    MACRO_ADD(tests, pool_growth_callback);
+    MACRO_ADD(tests, pool_aalloc_grow_alignment);
+    MACRO_ADD(tests, pool_subpool_large_allocation);
+    MACRO_ADD(tests, pool_stats_counters);
+    MACRO_ADD(tests, pool_stats_registry);
+    MACRO_ADD(tests, pool_adaptive_grows_after_repeated_overflow);
+    MACRO_ADD(tests, pool_adaptive_ignores_outlier);
+    MACRO_ADD(tests, pool_adaptive_respects_cap);
+    MACRO_ADD(tests, pool_adaptive_shrinks);
+    MACRO_ADD(tests, pool_adopt_moves_blocks);
+    MACRO_ADD(tests, pool_adopt_lifetimes);
+    MACRO_ADD(tests, pool_adopt_cleanups_and_restore);
+    MACRO_ADD(tests, pool_trim_releases_free_pages);
+    MACRO_ADD(tests, pool_trim_drops_adapted_block);
 
 
     macro_run_all("a-memory-library/aml_pool", tests, test_count);
@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_allocator.cpp
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_pool_allocator.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* true if p is somewhere in the pool's current block */
+static bool in_pool(aml_pool_t *pool, const void *p) {
+    const char *c = (const char *)p;
+    return c >= (const char *)(pool->current + 1) && c < pool->current->endp;
+}
+
+using pool_string = std::basic_string<char, std::char_traits<char>,
+                                      aml::pool_allocator<char>>;
+
+/* std::hash only knows strings with the default allocator */
+struct pool_string_hash {
+    size_t operator()(const pool_string &s) const {
+        return std::hash<std::string_view>()(std::string_view(s.data(), s.size()));
+    }
+};
+
+MACRO_TEST(allocator_std_containers) {
+    aml_pool_t *pool = aml_pool_init(1 << 20);
+    {
+        aml::pool_allocator<int> a(pool);
+        std::vector<int, aml::pool_allocator<int>> v(a);
+        for (int i = 0; i < 1000; i++)
+            v.push_back(i);
+        MACRO_ASSERT_TRUE(in_pool(pool, v.data()));
+        MACRO_ASSERT_EQ_INT(v[999], 999);
+
+        using pair_alloc = aml::pool_allocator<std::pair<const pool_string, int>>;
+        std::unordered_map<pool_string, int, pool_string_hash,
+                           std::equal_to<pool_string>, pair_alloc>
+            m(16, pool_string_hash(), std::equal_to<pool_string>(), pair_alloc(pool));
+        for (int i = 0; i < 200; i++) {
+            pool_string key("a long enough key to avoid the small string buffer ",
+                    aml::pool_allocator<char>(pool));
+            key += std::to_string(i).c_str();
+            m.emplace(key, i);
+        }
+        MACRO_ASSERT_EQ_SZ(m.size(), 200);
+        for (auto &kv : m)
+            MACRO_ASSERT_TRUE(in_pool(pool, kv.first.data()));
+
+        /* allocators compare equal when they share a pool */
+        aml::pool_allocator<long> b(a);
+        MACRO_ASSERT_TRUE(b == aml::pool_allocator<long>(pool));
+        aml_pool_t *other = aml_pool_init(256);
+        MACRO_ASSERT_TRUE(b != aml::pool_allocator<long>(other));
+        aml_pool_destroy(other);
+    }
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(allocator_deallocate_gives_back_last) {
+    aml_pool_t *pool = aml_pool_init(1024);
+    aml::pool_allocator<std::uint64_t> a(pool);
+    std::uint64_t *p = a.allocate(10);
+    a.deallocate(p, 10);
+    MACRO_ASSERT_TRUE(pool->curp == (char *)p);
+    std::uint64_t *q = a.allocate(4);
+    MACRO_ASSERT_TRUE(q == p);
+    /* anything older just stays */
+    std::uint64_t *r = a.allocate(4);
+    a.deallocate(q, 4);
+    MACRO_ASSERT_TRUE(pool->curp == (char *)(r + 4));
+    aml_pool_destroy(pool);
+}
+
+struct alignas(64) wide {
+    char bytes[64];
+};
+
+struct counted {
+    int a;
+    std::string s;
+    counted(int a_, const char *s_) : a(a_), s(s_) {}
+};
+
+MACRO_TEST(allocator_make_and_alignment) {
+    aml_pool_t *pool = aml_pool_init(4096);
+    aml_pool_ualloc(pool, 3);
+    wide *w = aml::make<wide>(pool);
+    MACRO_ASSERT_EQ_SZ((std::uintptr_t)w & 63, 0);
+    aml_pool_ualloc(pool, 1);
+    double *d = aml::make<double>(pool, 2.5);
+    MACRO_ASSERT_EQ_SZ((std::uintptr_t)d & 7, 0);
+    MACRO_ASSERT_TRUE(*d == 2.5);
+
+    counted *c = aml::make<counted>(pool, 7, "seven");
+    MACRO_ASSERT_EQ_INT(c->a, 7);
+    MACRO_ASSERT_TRUE(c->s == "seven");
+    c->~counted();
+
+    int *zeros = aml::make_array<int>(pool, 100);
+    for (int i = 0; i < 100; i++)
+        MACRO_ASSERT_EQ_INT(zeros[i], 0);
+    wide *ws = aml::make_array<wide>(pool, 3);
+    MACRO_ASSERT_EQ_SZ((std::uintptr_t)ws & 63, 0);
+    MACRO_ASSERT_EQ_INT(ws[2].bytes[63], 0);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(allocator_pmr_resource) {
+#ifdef AML_POOL_HAS_PMR
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml::pool_resource res(pool);
+    {
+        std::pmr::vector<std::pmr::string> names(&res);
+        for (int i = 0; i < 100; i++)
+            names.emplace_back("a name which is long enough to be allocated");
+        MACRO_ASSERT_TRUE(in_pool(pool, names.data()));
+        MACRO_ASSERT_TRUE(in_pool(pool, names[99].data()));
+
+        std::pmr::map<int, int> m(&res);
+        m[1] = 2;
+        MACRO_ASSERT_EQ_INT(m[1], 2);
+    }
+    aml::pool_resource same(pool);
+    MACRO_ASSERT_TRUE(res.is_equal(same));
+    MACRO_ASSERT_FALSE(res.is_equal(*std::pmr::new_delete_resource()));
+    void *p = res.allocate(100, 128);
+    MACRO_ASSERT_EQ_SZ((std::uintptr_t)p & 127, 0);
+    aml_pool_destroy(pool);
+#endif
+}
+
+MACRO_TEST(allocator_pool_scope) {
+    aml_pool_t *pool = aml_pool_init(1024);
+    aml_pool_alloc(pool, 16);
+    char *before = pool->curp;
+    {
+        aml::pool_scope scope(pool);
+        std::vector<int, aml::pool_allocator<int>> v{
+            aml::pool_allocator<int>(scope.pool())};
+        /* enough to need more blocks */
+        for (int i = 0; i < 10000; i++)
+            v.push_back(i);
+        MACRO_ASSERT_TRUE(pool->current->prev != NULL);
+    }
+    MACRO_ASSERT_TRUE(pool->curp == before);
+    MACRO_ASSERT_TRUE(pool->current->prev == NULL);
+    aml_pool_destroy(pool);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, allocator_std_containers);
+    MACRO_ADD(tests, allocator_deallocate_gives_back_last);
+    MACRO_ADD(tests, allocator_make_and_alignment);
+    MACRO_ADD(tests, allocator_pmr_resource);
+    MACRO_ADD(tests, allocator_pool_scope);
+
+    macro_run_all("a-memory-library/aml_pool_allocator", tests, test_count);
+    return 0;
+}
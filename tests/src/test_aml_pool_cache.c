@@ -0,0 +1,177 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_cache.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_pool_cache.h"
+#include "a-memory-library/aml_alloc.h"
+
+#include <pthread.h>
+#include <string.h>
+
+static void overflow(aml_pool_t *p, int n) {
+    for (int i = 0; i < n; i++) {
+        char *s = (char *)aml_pool_alloc(p, 100);
+        memset(s, 'x', 100);
+    }
+}
+
+MACRO_TEST(cache_disabled_by_default) {
+    aml_pool_cache_stats_t st;
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_EQ_SZ(st.max_bytes, 0);
+    MACRO_ASSERT_EQ_SZ(st.cached_bytes, 0);
+
+    aml_pool_t *p = aml_pool_init(128);
+    overflow(p, 20);
+    aml_pool_clear(p);
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_EQ_SZ(st.parked, 0);
+    MACRO_ASSERT_EQ_SZ(st.hits, 0);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(cache_recycles_overflow_blocks) {
+    aml_pool_cache_enable(1 << 20);
+    aml_pool_cache_stats_t before, after;
+    aml_pool_cache_stats(&before);
+
+    aml_pool_t *p = aml_pool_init(128);
+    overflow(p, 20);
+    aml_pool_clear(p);
+
+    aml_pool_cache_stats(&after);
+    MACRO_ASSERT_TRUE(after.parked > before.parked);
+    MACRO_ASSERT_TRUE(after.cached_blocks > 0);
+
+    /* the next cycle should be served from the cache */
+    size_t hits = after.hits;
+    overflow(p, 20);
+    aml_pool_cache_stats(&after);
+    MACRO_ASSERT_TRUE(after.hits > hits);
+
+    /* restore also parks blocks */
+    aml_pool_marker_t m;
+    aml_pool_clear(p);
+    aml_pool_save(p, &m);
+    size_t parked = 0;
+    aml_pool_cache_stats(&after);
+    parked = after.parked;
+    overflow(p, 20);
+    aml_pool_restore(p, &m);
+    aml_pool_cache_stats(&after);
+    MACRO_ASSERT_TRUE(after.parked > parked);
+
+    aml_pool_destroy(p);
+    aml_pool_cache_enable(0);
+    aml_pool_cache_stats(&after);
+    MACRO_ASSERT_EQ_SZ(after.cached_bytes, 0);
+    MACRO_ASSERT_EQ_SZ(after.cached_blocks, 0);
+}
+
+MACRO_TEST(cache_respects_byte_cap) {
+    aml_pool_cache_enable(512);
+    aml_pool_cache_stats_t st;
+    aml_pool_cache_stats(&st);
+    size_t dropped = st.dropped;
+
+    aml_pool_t *p = aml_pool_init(4096);
+    overflow(p, 200);
+    aml_pool_clear(p);
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.cached_bytes <= 512);
+    MACRO_ASSERT_TRUE(st.dropped > dropped);
+    aml_pool_destroy(p);
+    aml_pool_cache_enable(0);
+}
+
+MACRO_TEST(cache_trim) {
+    aml_pool_cache_enable(1 << 20);
+    aml_pool_t *p = aml_pool_init(256);
+    overflow(p, 100);
+    aml_pool_clear(p);
+
+    aml_pool_cache_stats_t st;
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.cached_bytes > 0);
+
+    aml_pool_cache_trim(0);
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_EQ_SZ(st.cached_bytes, 0);
+    MACRO_ASSERT_EQ_SZ(st.cached_blocks, 0);
+
+    aml_pool_destroy(p);
+    aml_pool_cache_enable(0);
+}
+
+MACRO_TEST(cache_miss_keeps_requested_size) {
+    aml_pool_cache_enable(1 << 20);
+    aml_pool_cache_trim(0);
+    aml_pool_cache_stats_t st;
+    aml_pool_cache_stats(&st);
+    size_t misses = st.misses;
+
+    /* a miss allocates what was asked for, not the cache's class size */
+    size_t len = 65536 + 16;
+    MACRO_ASSERT_TRUE(_aml_pool_cache_alloc(&len) == NULL);
+    MACRO_ASSERT_EQ_SZ(len, 65536 + 16);
+
+    aml_pool_t *p = aml_pool_init(128);
+    size_t used = aml_pool_used(p);
+    aml_pool_alloc(p, 100000);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(p) - used,
+                       sizeof(aml_pool_node_t) + 100000);
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.misses > misses);
+    aml_pool_destroy(p);
+    aml_pool_cache_enable(0);
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    aml_pool_t *p = aml_pool_init(128);
+    overflow(p, 20);
+    aml_pool_destroy(p);
+    return NULL;
+}
+
+MACRO_TEST(cache_cross_thread_depot) {
+    aml_pool_cache_enable(1 << 20);
+    aml_pool_cache_trim(0);
+
+    /* blocks freed on the worker are flushed to the depot on thread exit */
+    pthread_t t;
+    pthread_create(&t, NULL, worker, NULL);
+    pthread_join(t, NULL);
+
+    aml_pool_cache_stats_t st;
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.cached_blocks > 0);
+    size_t hits = st.hits;
+
+    aml_pool_t *p = aml_pool_init(128);
+    overflow(p, 20);
+    aml_pool_cache_stats(&st);
+    MACRO_ASSERT_TRUE(st.hits > hits);
+    aml_pool_destroy(p);
+
+    aml_pool_cache_enable(0);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, cache_disabled_by_default);
+    MACRO_ADD(tests, cache_recycles_overflow_blocks);
+    MACRO_ADD(tests, cache_respects_byte_cap);
+    MACRO_ADD(tests, cache_trim);
+    MACRO_ADD(tests, cache_miss_keeps_requested_size);
+    MACRO_ADD(tests, cache_cross_thread_depot);
+
+    macro_run_all("a-memory-library/aml_pool_cache", tests, test_count);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_intern.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+MACRO_TEST(intern_returns_one_copy) {
+    aml_pool_t *p = aml_pool_init(1024);
+    char a[] = "hostname", b[] = "hostname";
+    const char *x = aml_pool_interns(p, a);
+    const char *y = aml_pool_interns(p, b);
+    MACRO_ASSERT_TRUE(x == y);
+    MACRO_ASSERT_TRUE(x != a);
+    MACRO_ASSERT_STREQ(x, "hostname");
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_length(x), 8);
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 1);
+
+    /* the length is part of the key, embedded zeros included */
+    const char *prefix = aml_pool_intern(p, "hostname", 4);
+    MACRO_ASSERT_TRUE(prefix != x);
+    MACRO_ASSERT_STREQ(prefix, "host");
+    const char *z1 = aml_pool_intern(p, "a\0b", 3);
+    const char *z2 = aml_pool_intern(p, "a\0c", 3);
+    MACRO_ASSERT_TRUE(z1 != z2);
+    MACRO_ASSERT_TRUE(aml_pool_intern(p, "", 0) == aml_pool_interns(p, ""));
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 5);
+    MACRO_ASSERT_TRUE(aml_pool_intern_hash(x) != aml_pool_intern_hash(prefix));
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(intern_many_strings) {
+    aml_pool_t *p = aml_pool_init(4096);
+    const char *first[20000];
+    char buf[64];
+    /* lengths on both sides of the hash's 16 and 48 byte cases */
+    for (int i = 0; i < 20000; i++) {
+        int n = snprintf(buf, sizeof(buf), "%d-%.*s", i, i % 50,
+                         "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+        first[i] = aml_pool_intern(p, buf, n);
+    }
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 20000);
+    for (int i = 0; i < 20000; i++) {
+        int n = snprintf(buf, sizeof(buf), "%d-%.*s", i, i % 50,
+                         "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+        MACRO_ASSERT_TRUE(aml_pool_intern(p, buf, n) == first[i]);
+        MACRO_ASSERT_EQ_SZ(aml_pool_intern_length(first[i]), (size_t)n);
+    }
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 20000);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(intern_all_split) {
+    aml_pool_t *p = aml_pool_init(1024);
+    size_t n = 0;
+    char **parts = aml_pool_split(p, &n, ',', "get,put,get,,delete,put,get");
+    MACRO_ASSERT_EQ_SZ(n, 7);
+    aml_pool_intern_all(p, parts, n);
+    MACRO_ASSERT_TRUE(parts[0] == parts[2]);
+    MACRO_ASSERT_TRUE(parts[0] == parts[6]);
+    MACRO_ASSERT_TRUE(parts[1] == parts[5]);
+    MACRO_ASSERT_TRUE(parts[0] != parts[1]);
+    MACRO_ASSERT_STREQ(parts[4], "delete");
+    MACRO_ASSERT_STREQ(parts[3], "");
+    MACRO_ASSERT_TRUE(parts[0] == aml_pool_interns(p, "get"));
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 4);
+
+    /* the NULL terminator (and any other NULL) is left alone */
+    aml_pool_intern_all(p, parts, n + 1);
+    MACRO_ASSERT_TRUE(parts[n] == NULL);
+
+    /* more than one batch */
+    char *many[100];
+    char buf[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(buf, sizeof(buf), "k%d", i % 10);
+        many[i] = aml_pool_strdup(p, buf);
+    }
+    aml_pool_intern_all(p, many, 100);
+    for (int i = 10; i < 100; i++)
+        MACRO_ASSERT_TRUE(many[i] == many[i % 10]);
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 14);
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(intern_clear_and_restore) {
+    aml_pool_t *p = aml_pool_init(256);
+    aml_pool_interns(p, "before");
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 1);
+    aml_pool_clear(p);
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 0);
+    const char *kept = aml_pool_interns(p, "kept");
+
+    /* a restore which changes nothing keeps the set */
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    aml_pool_alloc(p, 1000);
+    aml_pool_restore(p, &m);
+    MACRO_ASSERT_TRUE(aml_pool_interns(p, "kept") == kept);
+
+    /* one which releases interned strings starts over */
+    aml_pool_save(p, &m);
+    for (int i = 0; i < 200; i++)
+        aml_pool_intern(p, (const char *)&i, sizeof(i));
+    aml_pool_restore(p, &m);
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 0);
+    for (int i = 0; i < 200; i++)
+        aml_pool_intern(p, (const char *)&i, sizeof(i));
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 200);
+
+    /* as does one to before the set was created */
+    aml_pool_clear(p);
+    aml_pool_save(p, &m);
+    aml_pool_intern_all(p, NULL, 0);
+    aml_pool_restore(p, &m);
+    MACRO_ASSERT_EQ_SZ(aml_pool_intern_count(p), 0);
+    MACRO_ASSERT_STREQ(aml_pool_interns(p, "again"), "again");
+    aml_pool_destroy(p);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, intern_returns_one_copy);
+    MACRO_ADD(tests, intern_many_strings);
+    MACRO_ADD(tests, intern_all_split);
+    MACRO_ADD(tests, intern_clear_and_restore);
+
+    macro_run_all("a-memory-library/aml_pool_intern", tests, test_count);
+    return 0;
+}
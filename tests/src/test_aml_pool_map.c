@@ -0,0 +1,188 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_map.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/extras/aml_pool_map.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define KEYS 20000
+
+static size_t key_name(char *dest, int i) {
+    return (size_t)sprintf(dest, "key-%d", i);
+}
+
+MACRO_TEST(pool_map_insert_find) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_pool_map_t *m = aml_pool_map_init(pool, NULL);
+    char key[32];
+    MACRO_ASSERT_TRUE(aml_pool_map_find(m, "x", 1) == NULL);
+    MACRO_ASSERT_TRUE(!aml_pool_map_remove(m, "x", 1));
+
+    for (int i = 0; i < KEYS; i++) {
+        size_t len = key_name(key, i);
+        bool inserted = false;
+        aml_pool_map_entry_t *e = aml_pool_map_insert(m, key, len, &inserted);
+        MACRO_ASSERT_TRUE(inserted);
+        MACRO_ASSERT_TRUE(e->key != key);
+        MACRO_ASSERT_STREQ(e->key, key);
+        MACRO_ASSERT_EQ_SZ(e->len, len);
+        e->value = (void *)(uintptr_t)(i + 1);
+    }
+    MACRO_ASSERT_EQ_SZ(aml_pool_map_size(m), KEYS);
+
+    for (int i = 0; i < KEYS; i++) {
+        size_t len = key_name(key, i);
+        MACRO_ASSERT_TRUE(aml_pool_map_get(m, key, len) ==
+                          (void *)(uintptr_t)(i + 1));
+        /* a second insert finds the same entry */
+        bool inserted = true;
+        aml_pool_map_entry_t *e = aml_pool_map_insert(m, key, len, &inserted);
+        MACRO_ASSERT_TRUE(!inserted);
+        MACRO_ASSERT_TRUE(e == aml_pool_map_find(m, key, len));
+        /* prefixes aren't matches */
+        MACRO_ASSERT_TRUE(aml_pool_map_find(m, key, len - 1) == NULL ||
+                          aml_pool_map_find(m, key, len - 1)->len == len - 1);
+    }
+    MACRO_ASSERT_TRUE(aml_pool_map_get(m, "missing", 7) == NULL);
+
+    /* zero length and binary keys */
+    aml_pool_map_put(m, "", 0, m);
+    aml_pool_map_put(m, "a\0b", 3, pool);
+    MACRO_ASSERT_TRUE(aml_pool_map_get(m, "", 0) == m);
+    MACRO_ASSERT_TRUE(aml_pool_map_get(m, "a\0b", 3) == pool);
+    MACRO_ASSERT_TRUE(aml_pool_map_get(m, "a\0c", 3) == NULL);
+    MACRO_ASSERT_EQ_SZ(aml_pool_map_size(m), KEYS + 2);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(pool_map_remove_churn) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_pool_map_t *m = aml_pool_map_init(pool, NULL);
+    /* the reference: which keys are in the map */
+    bool *present = (bool *)aml_zalloc(KEYS);
+    size_t count = 0;
+    char key[32];
+    srand(7);
+    for (int round = 0; round < 200000; round++) {
+        int i = rand() % KEYS;
+        size_t len = key_name(key, i);
+        if (rand() & 1) {
+            bool inserted;
+            aml_pool_map_insert(m, key, len, &inserted)->value =
+                (void *)(uintptr_t)(i + 1);
+            MACRO_ASSERT_TRUE(inserted == !present[i]);
+            if (!present[i])
+                count++;
+            present[i] = true;
+        } else {
+            MACRO_ASSERT_TRUE(aml_pool_map_remove(m, key, len) == present[i]);
+            if (present[i])
+                count--;
+            present[i] = false;
+        }
+        MACRO_ASSERT_EQ_SZ(aml_pool_map_size(m), count);
+    }
+    for (int i = 0; i < KEYS; i++) {
+        size_t len = key_name(key, i);
+        void *v = aml_pool_map_get(m, key, len);
+        MACRO_ASSERT_TRUE(present[i] ? v == (void *)(uintptr_t)(i + 1) : !v);
+    }
+
+    /* iteration sees each key once */
+    size_t seen = 0, pos = 0;
+    aml_pool_map_entry_t *e;
+    while ((e = aml_pool_map_next(m, &pos)) != NULL) {
+        int i = atoi(e->key + 4);
+        MACRO_ASSERT_TRUE(present[i]);
+        present[i] = false;
+        seen++;
+    }
+    MACRO_ASSERT_EQ_SZ(seen, count);
+
+    aml_pool_map_clear(m);
+    MACRO_ASSERT_EQ_SZ(aml_pool_map_size(m), 0);
+    pos = 0;
+    MACRO_ASSERT_TRUE(aml_pool_map_next(m, &pos) == NULL);
+    MACRO_ASSERT_TRUE(aml_pool_map_get(m, "key-1", 5) == NULL);
+    aml_pool_map_put(m, "key-1", 5, m);
+    MACRO_ASSERT_TRUE(aml_pool_map_get(m, "key-1", 5) == m);
+    aml_free(present);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(pool_map_tombstones_dont_grow) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_pool_map_t *m = aml_pool_map_init(pool, NULL);
+    aml_pool_map_reserve(m, 100);
+    size_t used = aml_pool_used(pool);
+    char key[32];
+    /* insert and remove many distinct keys while keeping few live */
+    for (int i = 0; i < 100000; i++) {
+        size_t len = key_name(key, i);
+        aml_pool_map_put(m, key, len, m);
+        if (i >= 50) {
+            len = key_name(key, i - 50);
+            MACRO_ASSERT_TRUE(aml_pool_map_remove(m, key, len));
+        }
+    }
+    MACRO_ASSERT_EQ_SZ(aml_pool_map_size(m), 50);
+    /* the pool only grew by the copied keys (and same sized rehashes) */
+    size_t per_key = aml_pool_used(pool) - used;
+    MACRO_ASSERT_TRUE(per_key < 100000 * 64);
+    for (int i = 100000 - 50; i < 100000; i++) {
+        size_t len = key_name(key, i);
+        MACRO_ASSERT_TRUE(aml_pool_map_get(m, key, len) == m);
+    }
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(pool_map_reuses_tables) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_block_allocator_t *ba = aml_block_allocator_init(pool);
+    char key[32];
+    /* the first map's outgrown tables are released to the block allocator */
+    aml_pool_map_t *a = aml_pool_map_init(pool, ba);
+    for (int i = 0; i < 1000; i++) {
+        size_t len = key_name(key, i);
+        aml_pool_map_put(a, key, len, a);
+    }
+    /* and picked up again by the second map */
+    aml_pool_map_t *b = aml_pool_map_init(pool, ba);
+    for (int i = 0; i < 1000; i++) {
+        size_t len = key_name(key, i);
+        aml_pool_map_put(b, key, len, b);
+    }
+    size_t reused = 0;
+    for (uint32_t id = 0; id < AML_BLOCK_ALLOCATOR_CLASSES; id++) {
+        aml_block_allocator_stats_t st;
+        aml_block_allocator_stats(ba, id, &st);
+        reused += st.reused;
+    }
+    MACRO_ASSERT_TRUE(reused > 0);
+    for (int i = 0; i < 1000; i++) {
+        size_t len = key_name(key, i);
+        MACRO_ASSERT_TRUE(aml_pool_map_get(a, key, len) == a);
+        MACRO_ASSERT_TRUE(aml_pool_map_get(b, key, len) == b);
+    }
+    aml_pool_destroy(pool);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[8];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, pool_map_insert_find);
+    MACRO_ADD(tests, pool_map_remove_churn);
+    MACRO_ADD(tests, pool_map_tombstones_dont_grow);
+    MACRO_ADD(tests, pool_map_reuses_tables);
+
+    macro_run_all("a-memory-library/aml_pool_map", tests, test_count);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_ring.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_pool_ring.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+MACRO_TEST(pool_ring_generations_overlap) {
+    aml_pool_ring_t *r = aml_pool_ring_init(3, 4096);
+    MACRO_ASSERT_EQ_SZ(aml_pool_ring_generations(r), 3);
+    MACRO_ASSERT_EQ_SZ(aml_pool_ring_epoch(r), 0);
+
+    char *strs[16];
+    for (int e = 0; e < 16; e++) {
+        aml_pool_t *pool = aml_pool_ring_current(r);
+        strs[e] = aml_pool_strdupf(pool, "epoch %d", e);
+        /* what the last two epochs allocated is still there */
+        for (int back = 1; back <= 2 && back <= e; back++) {
+            char expect[32];
+            sprintf(expect, "epoch %d", e - back);
+            MACRO_ASSERT_STREQ(strs[e - back], expect);
+        }
+        aml_pool_t *next = aml_pool_ring_advance(r);
+        MACRO_ASSERT_TRUE(next == aml_pool_ring_current(r));
+        MACRO_ASSERT_TRUE(next != pool);
+        MACRO_ASSERT_EQ_SZ(aml_pool_ring_epoch(r), (size_t)e + 1);
+    }
+    /* the pools rotate */
+    aml_pool_t *p0 = aml_pool_ring_current(r);
+    aml_pool_ring_advance(r);
+    aml_pool_ring_advance(r);
+    aml_pool_ring_advance(r);
+    MACRO_ASSERT_TRUE(aml_pool_ring_current(r) == p0);
+    aml_pool_ring_destroy(r);
+}
+
+MACRO_TEST(pool_ring_recycles_blocks) {
+    aml_pool_ring_t *r = aml_pool_ring_init(2, 1024);
+    aml_pool_ring_stats_t st;
+    size_t misses = 0;
+    for (int e = 0; e < 50; e++) {
+        aml_pool_t *pool = aml_pool_ring_current(r);
+        /* well past the first block, so each generation grows */
+        for (int i = 0; i < 200; i++)
+            memset(aml_pool_alloc(pool, 100), e, 100);
+        aml_pool_ring_advance(r);
+        aml_pool_ring_stats(r, &st);
+        if (e == 5)
+            misses = st.misses;
+    }
+    /* once every generation has grown, blocks only come from the spares */
+    MACRO_ASSERT_TRUE(misses > 0);
+    MACRO_ASSERT_EQ_SZ(st.misses, misses);
+    MACRO_ASSERT_TRUE(st.reused > 0);
+    MACRO_ASSERT_TRUE(st.spare_blocks > 0);
+    MACRO_ASSERT_EQ_SZ(st.epoch, 50);
+
+    aml_pool_ring_set_max_spare(r, 0);
+    aml_pool_ring_stats(r, &st);
+    MACRO_ASSERT_EQ_SZ(st.spare_blocks, 0);
+    MACRO_ASSERT_EQ_SZ(st.spare_bytes, 0);
+    /* nothing is kept any more */
+    for (int i = 0; i < 200; i++)
+        aml_pool_alloc(aml_pool_ring_current(r), 100);
+    aml_pool_ring_advance(r);
+    aml_pool_ring_advance(r);
+    aml_pool_ring_stats(r, &st);
+    MACRO_ASSERT_EQ_SZ(st.spare_blocks, 0);
+    aml_pool_ring_destroy(r);
+}
+
+typedef struct {
+    aml_pool_ring_t *ring;
+    uint64_t epoch;
+    const char *data;
+    atomic_int done;
+} reader_t;
+
+static void *reader(void *arg) {
+    reader_t *rd = (reader_t *)arg;
+    usleep(50000);
+    /* the generation can't have been cleared */
+    if (!strcmp(rd->data, "shared"))
+        atomic_store(&rd->done, 1);
+    else
+        atomic_store(&rd->done, -1);
+    aml_pool_ring_release(rd->ring, rd->epoch);
+    return NULL;
+}
+
+MACRO_TEST(pool_ring_readers_hold_generation) {
+    aml_pool_ring_t *r = aml_pool_ring_init(2, 4096);
+    reader_t rd;
+    rd.ring = r;
+    rd.epoch = aml_pool_ring_epoch(r);
+    rd.data = aml_pool_strdup(aml_pool_ring_current(r), "shared");
+    atomic_init(&rd.done, 0);
+    aml_pool_ring_retain(r, rd.epoch);
+
+    pthread_t t;
+    pthread_create(&t, NULL, reader, &rd);
+    /* the first advance doesn't touch the reader's generation */
+    MACRO_ASSERT_TRUE(aml_pool_ring_try_advance(r) != NULL);
+    /* the second would recycle it */
+    MACRO_ASSERT_TRUE(aml_pool_ring_try_advance(r) == NULL);
+    MACRO_ASSERT_EQ_SZ(aml_pool_ring_epoch(r), 1);
+    /* so advance waits for the release */
+    aml_pool_ring_advance(r);
+    MACRO_ASSERT_EQ_INT(atomic_load(&rd.done), 1);
+    MACRO_ASSERT_EQ_SZ(aml_pool_ring_epoch(r), 2);
+    pthread_join(t, NULL);
+
+    /* retain and release on one thread */
+    aml_pool_ring_retain(r, 2);
+    aml_pool_ring_retain(r, 1);
+    aml_pool_ring_release(r, 1);
+    MACRO_ASSERT_TRUE(aml_pool_ring_try_advance(r) != NULL);
+    MACRO_ASSERT_TRUE(aml_pool_ring_try_advance(r) == NULL);
+    aml_pool_ring_release(r, 2);
+    MACRO_ASSERT_TRUE(aml_pool_ring_try_advance(r) != NULL);
+    aml_pool_ring_destroy(r);
+}
+
+MACRO_TEST(pool_ring_single_generation) {
+    /* one generation is a pool which is cleared on advance */
+    aml_pool_ring_t *r = aml_pool_ring_init(1, 4096);
+    aml_pool_t *pool = aml_pool_ring_current(r);
+    void *a = aml_pool_alloc(pool, 64);
+    MACRO_ASSERT_TRUE(aml_pool_ring_advance(r) == pool);
+    MACRO_ASSERT_TRUE(aml_pool_alloc(pool, 64) == a);
+    aml_pool_ring_destroy(r);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[8];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, pool_ring_generations_overlap);
+    MACRO_ADD(tests, pool_ring_recycles_blocks);
+    MACRO_ADD(tests, pool_ring_readers_hold_generation);
+    MACRO_ADD(tests, pool_ring_single_generation);
+
+    macro_run_all("a-memory-library/aml_pool_ring", tests, test_count);
+    return 0;
+}
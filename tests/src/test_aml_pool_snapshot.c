@@ -0,0 +1,218 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_snapshot.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_pool_snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    aml_rel_ptr_t key;
+    int value;
+    aml_rel_ptr_t next;
+} entry_t;
+
+typedef struct {
+    size_t count;
+    aml_rel_ptr_t head;
+    aml_rel_ptr_t aligned;
+} table_t;
+
+static aml_pool_t *snapshot_pool(void) {
+    aml_pool_options_t opts = {0};
+    opts.reserve_size = 64 << 20;
+    return aml_pool_init_ex(4096, &opts);
+}
+
+/* a list of count entries, the head being the last one added */
+static table_t *build(aml_pool_t *p, int count) {
+    table_t *t = (table_t *)aml_pool_zalloc(p, sizeof(*t));
+    for (int i = 0; i < count; i++) {
+        entry_t *e = (entry_t *)aml_pool_alloc(p, sizeof(*e));
+        aml_rel_ptr_set(&e->key, aml_pool_strdupf(p, "key-%d", i));
+        e->value = i * 3;
+        aml_rel_ptr_set(&e->next, aml_rel_ptr_get(&t->head));
+        aml_rel_ptr_set(&t->head, e);
+        t->count++;
+    }
+    char *a = (char *)aml_pool_aalloc(p, 64, 64);
+    memset(a, 'a', 64);
+    aml_rel_ptr_set(&t->aligned, a);
+    return t;
+}
+
+static void check(table_t *t, int count) {
+    MACRO_ASSERT_EQ_SZ(t->count, (size_t)count);
+    char expect[32];
+    int i = count - 1;
+    for (entry_t *e = (entry_t *)aml_rel_ptr_get(&t->head); e;
+         e = (entry_t *)aml_rel_ptr_get(&e->next), i--) {
+        snprintf(expect, sizeof(expect), "key-%d", i);
+        MACRO_ASSERT_STREQ((char *)aml_rel_ptr_get(&e->key), expect);
+        MACRO_ASSERT_EQ_INT(e->value, i * 3);
+    }
+    MACRO_ASSERT_EQ_INT(i, -1);
+    char *a = (char *)aml_rel_ptr_get(&t->aligned);
+    /* alignment survives the trip through the file */
+    MACRO_ASSERT_EQ_SZ((size_t)a & 63, 0);
+    MACRO_ASSERT_EQ_INT(a[63], 'a');
+}
+
+static void temp_path(char *path) {
+    char tmpl[] = "/tmp/aml_snapshot_XXXXXX";
+    int fd = mkstemp(tmpl);
+    close(fd);
+    strcpy(path, tmpl);
+}
+
+MACRO_TEST(snapshot_roundtrip) {
+    char path[64];
+    temp_path(path);
+    aml_pool_t *p = snapshot_pool();
+    table_t *t = build(p, 5000);
+    check(t, 5000);
+    MACRO_ASSERT_TRUE(aml_pool_write_snapshot(p, t, path));
+    aml_pool_destroy(p);
+    struct stat st;
+    MACRO_ASSERT_TRUE(stat(path, &st) == 0);
+    MACRO_ASSERT_TRUE((st.st_mode & 0777) == 0644);
+
+    aml_pool_snapshot_t *s =
+        aml_pool_map_snapshot(path, AML_POOL_SNAPSHOT_VERIFY);
+    MACRO_ASSERT_TRUE(s != NULL);
+    table_t *m = (table_t *)aml_pool_snapshot_root(s);
+    MACRO_ASSERT_TRUE(aml_pool_snapshot_contains(s, m));
+    MACRO_ASSERT_TRUE(aml_pool_snapshot_length(s) > 5000 * sizeof(entry_t));
+    check(m, 5000);
+    aml_pool_snapshot_unmap(s);
+
+    /* mapping twice gives two independent views of the same file */
+    aml_pool_snapshot_t *a = aml_pool_map_snapshot(path, 0);
+    aml_pool_snapshot_t *b = aml_pool_map_snapshot(path, 0);
+    MACRO_ASSERT_TRUE(aml_pool_snapshot_data(a) != aml_pool_snapshot_data(b));
+    check((table_t *)aml_pool_snapshot_root(a), 5000);
+    check((table_t *)aml_pool_snapshot_root(b), 5000);
+    aml_pool_snapshot_unmap(a);
+    aml_pool_snapshot_unmap(b);
+    unlink(path);
+}
+
+MACRO_TEST(snapshot_heap_pool_and_null_root) {
+    char path[64];
+    temp_path(path);
+    /* a heap pool works as long as it hasn't grown */
+    aml_pool_t *p = aml_pool_init(1 << 16);
+    table_t *t = build(p, 100);
+    MACRO_ASSERT_TRUE(aml_pool_write_snapshot(p, t, path));
+    aml_pool_snapshot_t *s = aml_pool_map_snapshot(path, 0);
+    check((table_t *)aml_pool_snapshot_root(s), 100);
+    aml_pool_snapshot_unmap(s);
+
+    /* once it has more than one block it can't be written */
+    build(p, 10000);
+    MACRO_ASSERT_FALSE(aml_pool_write_snapshot(p, t, path));
+    /* and the root has to be in the pool */
+    aml_pool_clear(p);
+    int outside = 0;
+    MACRO_ASSERT_FALSE(aml_pool_write_snapshot(p, &outside, path));
+
+    /* an empty pool with no root */
+    MACRO_ASSERT_TRUE(aml_pool_write_snapshot(p, NULL, path));
+    s = aml_pool_map_snapshot(path, AML_POOL_SNAPSHOT_VERIFY);
+    MACRO_ASSERT_TRUE(s != NULL);
+    MACRO_ASSERT_TRUE(aml_pool_snapshot_root(s) == NULL);
+    MACRO_ASSERT_EQ_SZ(aml_pool_snapshot_length(s), 0);
+    aml_pool_snapshot_unmap(s);
+    aml_pool_destroy(p);
+    unlink(path);
+}
+
+MACRO_TEST(snapshot_rejects_bad_files) {
+    char path[64];
+    temp_path(path);
+    MACRO_ASSERT_TRUE(aml_pool_map_snapshot("/nonexistent/snapshot", 0) == NULL);
+    /* too short to have a header */
+    MACRO_ASSERT_TRUE(aml_pool_map_snapshot(path, 0) == NULL);
+
+    aml_pool_t *p = snapshot_pool();
+    table_t *t = build(p, 100);
+    MACRO_ASSERT_TRUE(aml_pool_write_snapshot(p, t, path));
+    aml_pool_destroy(p);
+
+    /* flip a byte of the data: only the checksum notices */
+    int fd = open(path, O_RDWR);
+    off_t end = lseek(fd, 0, SEEK_END);
+    char c;
+    MACRO_ASSERT_EQ_INT((int)pread(fd, &c, 1, end - 10), 1);
+    c ^= 1;
+    MACRO_ASSERT_EQ_INT((int)pwrite(fd, &c, 1, end - 10), 1);
+    aml_pool_snapshot_t *s = aml_pool_map_snapshot(path, 0);
+    MACRO_ASSERT_TRUE(s != NULL);
+    aml_pool_snapshot_unmap(s);
+    MACRO_ASSERT_TRUE(aml_pool_map_snapshot(path, AML_POOL_SNAPSHOT_VERIFY) ==
+                      NULL);
+
+    /* a truncated file and a different version fail the header check */
+    MACRO_ASSERT_EQ_INT(ftruncate(fd, end - 1), 0);
+    MACRO_ASSERT_TRUE(aml_pool_map_snapshot(path, 0) == NULL);
+    MACRO_ASSERT_EQ_INT(ftruncate(fd, end), 0);
+    uint32_t version = AML_POOL_SNAPSHOT_VERSION + 1;
+    MACRO_ASSERT_EQ_INT((int)pwrite(fd, &version, 4, 8), 4);
+    MACRO_ASSERT_TRUE(aml_pool_map_snapshot(path, 0) == NULL);
+    close(fd);
+    unlink(path);
+}
+
+MACRO_TEST(snapshot_writable_layer) {
+    char path[64];
+    temp_path(path);
+    aml_pool_t *p = snapshot_pool();
+    table_t *t = build(p, 10);
+    MACRO_ASSERT_TRUE(aml_pool_write_snapshot(p, t, path));
+    aml_pool_destroy(p);
+
+    aml_pool_snapshot_t *s =
+        aml_pool_map_snapshot(path, AML_POOL_SNAPSHOT_WRITABLE);
+    table_t *m = (table_t *)aml_pool_snapshot_root(s);
+    aml_pool_t *layer = aml_pool_snapshot_pool(s);
+    MACRO_ASSERT_TRUE(aml_pool_snapshot_pool(s) == layer);
+
+    /* a new entry in the layer pointing at the old head */
+    entry_t *e = (entry_t *)aml_pool_alloc(layer, sizeof(*e));
+    aml_rel_ptr_set(&e->key, aml_pool_strdup(layer, "key-10"));
+    e->value = 30;
+    aml_rel_ptr_set(&e->next, aml_rel_ptr_get(&m->head));
+    aml_rel_ptr_set(&m->head, e);
+    m->count++;
+    MACRO_ASSERT_FALSE(aml_pool_snapshot_contains(s, e));
+    check(m, 11);
+    aml_pool_snapshot_unmap(s);
+
+    /* the changes were private to the mapping */
+    s = aml_pool_map_snapshot(path, AML_POOL_SNAPSHOT_VERIFY);
+    MACRO_ASSERT_TRUE(s != NULL);
+    check((table_t *)aml_pool_snapshot_root(s), 10);
+    aml_pool_snapshot_unmap(s);
+    unlink(path);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, snapshot_roundtrip);
+    MACRO_ADD(tests, snapshot_heap_pool_and_null_root);
+    MACRO_ADD(tests, snapshot_rejects_bad_files);
+    MACRO_ADD(tests, snapshot_writable_layer);
+
+    macro_run_all("a-memory-library/aml_pool_snapshot", tests, test_count);
+    return 0;
+}
@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_pool_vec.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/extras/aml_pool_vec.h"
+
+#include <string.h>
+#include <stdint.h>
+
+typedef struct {
+    int x, y;
+} point_t;
+
+typedef aml_pool_vec(int) int_vec_t;
+typedef aml_pool_vec(point_t) point_vec_t;
+
+MACRO_TEST(pool_vec_push_pop) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    int_vec_t v;
+    aml_pool_vec_init(&v, pool);
+    MACRO_ASSERT_EQ_SZ(v.len, 0);
+    for (int i = 0; i < 10000; i++)
+        aml_pool_vec_push(&v, i);
+    MACRO_ASSERT_EQ_SZ(v.len, 10000);
+    MACRO_ASSERT_TRUE(v.cap >= v.len);
+    for (int i = 0; i < 10000; i++)
+        MACRO_ASSERT_EQ_INT(v.data[i], i);
+    MACRO_ASSERT_EQ_INT(aml_pool_vec_last(&v), 9999);
+    MACRO_ASSERT_EQ_INT(aml_pool_vec_pop(&v), 9999);
+    MACRO_ASSERT_EQ_SZ(v.len, 9999);
+
+    size_t cap = v.cap;
+    aml_pool_vec_clear(&v);
+    MACRO_ASSERT_EQ_SZ(v.len, 0);
+    MACRO_ASSERT_EQ_SZ(v.cap, cap);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(pool_vec_append_alloc) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    point_vec_t v;
+    aml_pool_vec_init(&v, pool);
+    point_t pts[100];
+    for (int i = 0; i < 100; i++) {
+        pts[i].x = i;
+        pts[i].y = -i;
+    }
+    aml_pool_vec_append(&v, pts, 100);
+    aml_pool_vec_append(&v, pts, 0);
+    point_t *p = aml_pool_vec_alloc(&v, 3);
+    for (int i = 0; i < 3; i++)
+        p[i] = pts[i];
+    MACRO_ASSERT_EQ_SZ(v.len, 103);
+    MACRO_ASSERT_TRUE(!memcmp(v.data, pts, sizeof(pts)));
+    MACRO_ASSERT_EQ_INT(v.data[102].y, -2);
+
+    aml_pool_vec_reserve(&v, 5000);
+    MACRO_ASSERT_TRUE(v.cap >= 5000);
+    point_t *d = v.data;
+    for (int i = 0; i < 4000; i++)
+        aml_pool_vec_push(&v, pts[i % 100]);
+    /* no growth was needed */
+    MACRO_ASSERT_TRUE(v.data == d);
+    MACRO_ASSERT_TRUE(!memcmp(v.data, pts, sizeof(pts)));
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(pool_vec_grows_in_place) {
+    aml_pool_t *pool = aml_pool_init(1 << 20);
+    int_vec_t v;
+    aml_pool_vec_init(&v, pool);
+    aml_pool_vec_push(&v, 0);
+    int *first = v.data;
+    /* the vec is the pool's last allocation, so it is extended */
+    for (int i = 1; i < 50000; i++)
+        aml_pool_vec_push(&v, i);
+    MACRO_ASSERT_TRUE(v.data == first);
+
+    /* with something in the way, it moves */
+    aml_pool_alloc(pool, 8);
+    aml_pool_vec_reserve(&v, v.cap + 1);
+    MACRO_ASSERT_TRUE(v.data != first);
+    for (int i = 0; i < 50000; i++)
+        MACRO_ASSERT_EQ_INT(v.data[i], i);
+    aml_pool_destroy(pool);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[8];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, pool_vec_push_pop);
+    MACRO_ADD(tests, pool_vec_append_alloc);
+    MACRO_ADD(tests, pool_vec_grows_in_place);
+
+    macro_run_all("a-memory-library/aml_pool_vec", tests, test_count);
+    return 0;
+}
@@ -0,0 +1,248 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_rope.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_rope.h"
+#include "a-memory-library/aml_buffer.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* build the same contents in a rope and a buffer */
+static void build(aml_rope_t *r, aml_buffer_t *b, int count) {
+    for (int i = 0; i < count; i++) {
+        switch (i % 4) {
+        case 0:
+            aml_rope_appendf(r, "item %d,", i);
+            aml_buffer_appendf(b, "item %d,", i);
+            break;
+        case 1:
+            aml_rope_appendc(r, (char)('a' + i % 26));
+            aml_buffer_appendc(b, (char)('a' + i % 26));
+            break;
+        case 2:
+            aml_rope_appends(r, "some longer text to push things along ");
+            aml_buffer_appends(b, "some longer text to push things along ");
+            break;
+        default: {
+            char *p = (char *)aml_rope_append_alloc(r, 5);
+            memcpy(p, "12345", 5);
+            aml_buffer_append(b, "12345", 5);
+        }
+        }
+    }
+}
+
+static void check_matches(aml_rope_t *r, aml_buffer_t *b) {
+    size_t len = aml_buffer_length(b);
+    MACRO_ASSERT_EQ_SZ(aml_rope_length(r), len);
+
+    char *copy = (char *)aml_malloc(len + 1);
+    aml_rope_copy(r, copy);
+    MACRO_ASSERT_TRUE(memcmp(copy, aml_buffer_data(b), len) == 0);
+    aml_free(copy);
+
+    size_t n = aml_rope_segments(r);
+    struct iovec *iov = (struct iovec *)aml_malloc(sizeof(struct iovec) * (n + 1));
+    MACRO_ASSERT_EQ_SZ(aml_rope_iovec(r, iov, n + 1), n);
+    size_t off = 0;
+    for (size_t i = 0; i < n; i++) {
+        MACRO_ASSERT_TRUE(iov[i].iov_len > 0);
+        MACRO_ASSERT_TRUE(memcmp(iov[i].iov_base, aml_buffer_data(b) + off,
+                                 iov[i].iov_len) == 0);
+        off += iov[i].iov_len;
+    }
+    MACRO_ASSERT_EQ_SZ(off, len);
+    aml_free(iov);
+}
+
+MACRO_TEST(rope_appends_match_buffer) {
+    aml_rope_t *r = aml_rope_init(64);
+    aml_buffer_t *b = aml_buffer_init(16);
+    build(r, b, 5000);
+    check_matches(r, b);
+    /* segments double, so there aren't many of them */
+    MACRO_ASSERT_TRUE(aml_rope_segments(r) < 20);
+
+    char *d = aml_rope_data(r);
+    MACRO_ASSERT_STREQ(d, aml_buffer_data(b));
+    MACRO_ASSERT_EQ_SZ(aml_rope_segments(r), 1);
+    /* a second call doesn't copy again */
+    MACRO_ASSERT_TRUE(aml_rope_data(r) == d);
+
+    /* appends continue after the flattened data */
+    build(r, b, 100);
+    check_matches(r, b);
+
+    aml_buffer_destroy(b);
+    aml_rope_destroy(r);
+}
+
+MACRO_TEST(rope_bytes_never_move) {
+    aml_rope_t *r = aml_rope_init(32);
+    aml_rope_set_max_segment_size(r, 32);
+    char *first = (char *)aml_rope_append_alloc(r, 8);
+    memcpy(first, "abcdefgh", 8);
+    for (int i = 0; i < 1000; i++)
+        aml_rope_appends(r, "0123456789");
+    MACRO_ASSERT_TRUE(memcmp(first, "abcdefgh", 8) == 0);
+    /* fixed size segments */
+    MACRO_ASSERT_EQ_SZ(aml_rope_segments(r), (8 + 10000 + 31) / 32);
+
+    /* a large append still gets a segment */
+    char big[1000];
+    memset(big, 'x', sizeof(big));
+    aml_rope_append(r, big, sizeof(big));
+    MACRO_ASSERT_EQ_SZ(aml_rope_length(r), 8 + 10000 + 1000);
+    char *big_alloc = (char *)aml_rope_append_alloc(r, 500);
+    memset(big_alloc, 'y', 500);
+    char *d = aml_rope_data(r);
+    MACRO_ASSERT_TRUE(memcmp(d, "abcdefgh0123456789", 18) == 0);
+    MACRO_ASSERT_EQ_INT(d[8 + 10000 + 999], 'x');
+    MACRO_ASSERT_EQ_INT(d[8 + 10000 + 1000], 'y');
+    MACRO_ASSERT_EQ_INT(d[8 + 10000 + 1500], 0);
+    aml_rope_destroy(r);
+}
+
+MACRO_TEST(rope_pool_reuses_segments) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_rope_t *r = aml_rope_pool_init(pool, 128);
+    aml_buffer_t *b = aml_buffer_init(16);
+
+    build(r, b, 1000);
+    check_matches(r, b);
+    size_t used = aml_pool_used(pool);
+
+    /* after a clear the same segments are filled again */
+    aml_rope_clear(r);
+    aml_buffer_clear(b);
+    MACRO_ASSERT_EQ_SZ(aml_rope_length(r), 0);
+    MACRO_ASSERT_EQ_SZ(aml_rope_segments(r), 0);
+    build(r, b, 1000);
+    check_matches(r, b);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(pool), used);
+
+    /* flattening in a pool keeps the old segments as spares */
+    MACRO_ASSERT_STREQ(aml_rope_data(r), aml_buffer_data(b));
+    aml_rope_clear(r);
+    aml_buffer_clear(b);
+    build(r, b, 1000);
+    check_matches(r, b);
+
+    aml_buffer_destroy(b);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(rope_pool_tail_extends_in_place) {
+    aml_pool_t *pool = aml_pool_init(1 << 16);
+    aml_rope_t *r = aml_rope_pool_init(pool, 64);
+    /* nothing else is allocated from the pool, so the one segment grows */
+    for (int i = 0; i < 1000; i++)
+        aml_rope_appends(r, "0123456789");
+    MACRO_ASSERT_EQ_SZ(aml_rope_segments(r), 1);
+    MACRO_ASSERT_EQ_SZ(strlen(aml_rope_data(r)), 10000);
+
+    /* with something in the way it takes a new segment */
+    aml_pool_alloc(pool, 8);
+    for (int i = 0; i < 100; i++)
+        aml_rope_appends(r, "0123456789");
+    MACRO_ASSERT_EQ_SZ(aml_rope_segments(r), 2);
+    MACRO_ASSERT_EQ_SZ(aml_rope_length(r), 11000);
+    aml_pool_destroy(pool);
+}
+
+MACRO_TEST(rope_writev) {
+    aml_rope_t *r = aml_rope_init(0);
+    aml_buffer_t *b = aml_buffer_init(16);
+    build(r, b, 3000);
+
+    int fds[2];
+    MACRO_ASSERT_EQ_INT(pipe(fds), 0);
+    struct iovec iov[64];
+    size_t n = aml_rope_iovec(r, iov, 64);
+    MACRO_ASSERT_EQ_SZ(n, aml_rope_segments(r));
+
+    /* the pipe holds at least 64KB, which is more than this */
+    MACRO_ASSERT_TRUE(aml_rope_length(r) < 65536);
+    ssize_t w = writev(fds[1], iov, (int)n);
+    MACRO_ASSERT_EQ_SZ((size_t)w, aml_rope_length(r));
+    close(fds[1]);
+
+    char *got = (char *)aml_malloc(aml_rope_length(r));
+    size_t total = 0;
+    ssize_t rd;
+    while ((rd = read(fds[0], got + total, aml_rope_length(r) - total)) > 0)
+        total += rd;
+    close(fds[0]);
+    MACRO_ASSERT_EQ_SZ(total, aml_rope_length(r));
+    MACRO_ASSERT_TRUE(memcmp(got, aml_buffer_data(b), total) == 0);
+    aml_free(got);
+
+    /* iovec stops at max */
+    MACRO_ASSERT_EQ_SZ(aml_rope_iovec(r, iov, 1), 1);
+    aml_buffer_destroy(b);
+    aml_rope_destroy(r);
+}
+
+MACRO_TEST(rope_write_fd) {
+    aml_rope_t *r = aml_rope_init(16);
+    aml_buffer_t *b = aml_buffer_init(16);
+    /* more segments than one writev takes */
+    aml_rope_set_max_segment_size(r, 16);
+    build(r, b, 3000);
+    MACRO_ASSERT_TRUE(aml_rope_segments(r) > 64);
+
+    char path[] = "/tmp/aml_rope_XXXXXX";
+    int fd = mkstemp(path);
+    MACRO_ASSERT_TRUE(fd >= 0);
+    MACRO_ASSERT_TRUE(aml_rope_write_fd(r, fd));
+    close(fd);
+
+    aml_buffer_t *got = aml_buffer_init(0);
+    MACRO_ASSERT_TRUE(aml_buffer_append_file(got, path));
+    MACRO_ASSERT_EQ_SZ(aml_buffer_length(got), aml_buffer_length(b));
+    MACRO_ASSERT_TRUE(!memcmp(aml_buffer_data(got), aml_buffer_data(b),
+                              aml_buffer_length(b)));
+    unlink(path);
+
+    /* an empty rope writes nothing */
+    aml_rope_clear(r);
+    MACRO_ASSERT_TRUE(aml_rope_write_fd(r, -1));
+    aml_buffer_destroy(got);
+    aml_buffer_destroy(b);
+    aml_rope_destroy(r);
+}
+
+MACRO_TEST(rope_empty) {
+    aml_rope_t *r = aml_rope_init(16);
+    MACRO_ASSERT_EQ_SZ(aml_rope_length(r), 0);
+    MACRO_ASSERT_EQ_SZ(aml_rope_segments(r), 0);
+    MACRO_ASSERT_STREQ(aml_rope_data(r), "");
+    aml_rope_append(r, NULL, 0);
+    aml_rope_appendf(r, "%s", "");
+    MACRO_ASSERT_EQ_SZ(aml_rope_length(r), 0);
+    struct iovec iov[2];
+    MACRO_ASSERT_EQ_SZ(aml_rope_iovec(r, iov, 2), 0);
+    aml_rope_destroy(r);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, rope_appends_match_buffer);
+    MACRO_ADD(tests, rope_bytes_never_move);
+    MACRO_ADD(tests, rope_pool_reuses_segments);
+    MACRO_ADD(tests, rope_pool_tail_extends_in_place);
+    MACRO_ADD(tests, rope_writev);
+    MACRO_ADD(tests, rope_write_fd);
+    MACRO_ADD(tests, rope_empty);
+
+    macro_run_all("a-memory-library/aml_rope", tests, test_count);
+    return 0;
+}
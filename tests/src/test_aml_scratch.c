@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_scratch.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_scratch.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* a leaf which has temporaries but returns its result in out */
+static char *shout(aml_pool_t *out, const char *s) {
+    aml_scratch_t t = aml_scratch_begin(out);
+    MACRO_ASSERT_TRUE(t.pool != out);
+    char *tmp = aml_pool_strdupf(t.pool, "%s!", s);
+    for (char *p = tmp; *p; p++)
+        if (*p >= 'a' && *p <= 'z')
+            *p -= 'a' - 'A';
+    char *r = aml_pool_strdup(out, tmp);
+    aml_scratch_end(&t);
+    return r;
+}
+
+MACRO_TEST(scratch_scope_restores) {
+    aml_scratch_t s = aml_scratch_begin(NULL);
+    size_t used = aml_pool_used(s.pool);
+    size_t size = aml_pool_size(s.pool);
+    aml_pool_t *pool = s.pool;
+    char *a = (char *)aml_pool_alloc(s.pool, 100);
+    /* more than the arena's block */
+    memset(aml_pool_alloc(s.pool, 4 * AML_SCRATCH_SIZE), 'x',
+           4 * AML_SCRATCH_SIZE);
+    aml_scratch_end(&s);
+    MACRO_ASSERT_EQ_SZ(aml_pool_used(pool), used);
+    MACRO_ASSERT_EQ_SZ(aml_pool_size(pool), size);
+
+    /* the next scope gets the same arena and the same memory */
+    s = aml_scratch_begin(NULL);
+    MACRO_ASSERT_TRUE(s.pool == pool);
+    MACRO_ASSERT_TRUE(aml_pool_alloc(s.pool, 100) == a);
+    aml_scratch_end(&s);
+    aml_scratch_release();
+}
+
+MACRO_TEST(scratch_nesting_and_conflicts) {
+    aml_scratch_t outer = aml_scratch_begin(NULL);
+    char *kept = aml_pool_strdup(outer.pool, "outer");
+
+    /* a nested scope with no conflict shares the arena */
+    aml_scratch_t inner = aml_scratch_begin(NULL);
+    MACRO_ASSERT_TRUE(inner.pool == outer.pool);
+    aml_pool_alloc(inner.pool, 1000);
+    aml_scratch_end(&inner);
+    MACRO_ASSERT_STREQ(kept, "outer");
+
+    /* results for the outer scope are built on the other arena */
+    char *r = shout(outer.pool, "hello");
+    MACRO_ASSERT_STREQ(r, "HELLO!");
+    char *r2 = shout(outer.pool, "again");
+    MACRO_ASSERT_STREQ(r, "HELLO!");
+    MACRO_ASSERT_STREQ(r2, "AGAIN!");
+
+    /* and the other way around */
+    aml_scratch_t other = aml_scratch_begin(outer.pool);
+    MACRO_ASSERT_TRUE(other.pool != outer.pool);
+    char *r3 = shout(other.pool, "deep");
+    MACRO_ASSERT_STREQ(r3, "DEEP!");
+    inner = aml_scratch_begin(other.pool);
+    MACRO_ASSERT_TRUE(inner.pool == outer.pool);
+    aml_scratch_end(&inner);
+    aml_scratch_end(&other);
+
+    /* a pool which isn't an arena doesn't change anything */
+    aml_pool_t *mine = aml_pool_init(1024);
+    MACRO_ASSERT_STREQ(shout(mine, "mine"), "MINE!");
+    inner = aml_scratch_begin(mine);
+    MACRO_ASSERT_TRUE(inner.pool == outer.pool);
+    aml_scratch_end(&inner);
+    aml_pool_destroy(mine);
+
+    aml_scratch_end(&outer);
+    aml_scratch_release();
+}
+
+static void *thread_scratch(void *arg) {
+    aml_pool_t **seen = (aml_pool_t **)arg;
+    aml_scratch_t s = aml_scratch_begin(NULL);
+    *seen = s.pool;
+    for (int i = 0; i < 1000; i++) {
+        aml_scratch_t t = aml_scratch_begin(NULL);
+        memset(aml_pool_alloc(t.pool, 1000 + i), 'x', 1000 + i);
+        aml_scratch_end(&t);
+    }
+    aml_scratch_end(&s);
+    /* the arenas are destroyed when the thread exits */
+    return NULL;
+}
+
+MACRO_TEST(scratch_per_thread) {
+    aml_scratch_t s = aml_scratch_begin(NULL);
+    aml_pool_t *seen[4];
+    pthread_t t[4];
+    for (int i = 0; i < 4; i++)
+        pthread_create(&t[i], NULL, thread_scratch, seen + i);
+    for (int i = 0; i < 4; i++)
+        pthread_join(t[i], NULL);
+    for (int i = 0; i < 4; i++)
+        MACRO_ASSERT_TRUE(seen[i] != s.pool);
+    aml_scratch_end(&s);
+
+    /* arenas are created again after a release */
+    aml_scratch_release();
+    s = aml_scratch_begin(NULL);
+    MACRO_ASSERT_STREQ(aml_pool_strdup(s.pool, "new"), "new");
+    aml_scratch_end(&s);
+    aml_scratch_release();
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, scratch_scope_restores);
+    MACRO_ADD(tests, scratch_nesting_and_conflicts);
+    MACRO_ADD(tests, scratch_per_thread);
+
+    macro_run_all("a-memory-library/aml_scratch", tests, test_count);
+    return 0;
+}
@@ -0,0 +1,179 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_slice.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_slice.h"
+
+#include <string.h>
+#include <stdint.h>
+
+static const char *split_kernels[] = {"scalar", "sse2", "avx2", "neon"};
+
+MACRO_TEST(slice_split_matches_pool_split) {
+    aml_pool_t *p = aml_pool_init(1024);
+    static const char alphabet[] = "abc,,d,";
+    char input[600];
+    uint32_t seed = 4242;
+
+    for (size_t k = 0; k < sizeof(split_kernels) / sizeof(split_kernels[0]); k++) {
+        if (!aml_split_use(split_kernels[k]))
+            continue;
+        for (size_t len = 0; len < 300; len++) {
+            for (size_t off = 0; off < 3; off++) {
+                /* a delimiter just past the end must not be seen */
+                for (size_t i = 0; i < sizeof(input) - 1; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    input[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+                }
+                input[sizeof(input) - 1] = 0;
+                input[off + len] = ',';
+                const char *s = input + off;
+
+                aml_pool_clear(p);
+                char *copy = aml_pool_strndup(p, s, len);
+                size_t n = 0;
+                char **expected = aml_pool_split(p, &n, ',', copy);
+
+                aml_slice_iter_t it;
+                aml_slice_t piece;
+                size_t i = 0;
+                aml_slice_split_init(&it, s, len, ',');
+                while (aml_slice_next(&it, &piece)) {
+                    MACRO_ASSERT_TRUE(i < n);
+                    MACRO_ASSERT_TRUE(aml_slice_eq_str(piece, expected[i]));
+                    /* the pieces point into the input */
+                    MACRO_ASSERT_TRUE(piece.p >= s && piece.p + piece.len <= s + len);
+                    i++;
+                }
+                MACRO_ASSERT_EQ_SZ(i, n);
+                MACRO_ASSERT_FALSE(aml_slice_next(&it, &piece));
+
+                size_t num = 0;
+                aml_slice_t *r = aml_pool_split_slices(p, &num, ',', s, len);
+                MACRO_ASSERT_EQ_SZ(num, n);
+                for (i = 0; i < n; i++)
+                    MACRO_ASSERT_TRUE(aml_slice_eq_str(r[i], expected[i]));
+                MACRO_ASSERT_TRUE(r[n].p == NULL && r[n].len == 0);
+
+                char **e2 = aml_pool_split2(p, &n, ',', copy);
+                r = aml_pool_split_slices2(p, &num, ',', s, len);
+                MACRO_ASSERT_EQ_SZ(num, n);
+                for (i = 0; i < n; i++)
+                    MACRO_ASSERT_TRUE(aml_slice_eq_str(r[i], e2[i]));
+            }
+        }
+    }
+    MACRO_ASSERT_TRUE(aml_split_use(NULL));
+    aml_pool_destroy(p);
+}
+
+static void check_tokens(aml_pool_t *p, const char *s, const char *delims,
+                         const char **expected, size_t n_expected) {
+    size_t num = 0;
+    aml_slice_t *r = aml_pool_tokenize_slices(p, &num, delims, s, strlen(s));
+    MACRO_ASSERT_EQ_SZ(num, n_expected);
+    for (size_t i = 0; i < num; i++)
+        MACRO_ASSERT_TRUE(aml_slice_eq_str(r[i], expected[i]));
+    MACRO_ASSERT_TRUE(r[num].p == NULL);
+}
+
+MACRO_TEST(slice_tokenize) {
+    aml_pool_t *p = aml_pool_init(256);
+
+    const char *e1[] = {"a", "b"};
+    check_tokens(p, " a  b\n", " \n", e1, 2);
+    check_tokens(p, "a\tb", " \t\r\n", e1, 2);
+
+    /* more than four delimiters use the bitmap */
+    const char *e2[] = {"x", "y", "z"};
+    check_tokens(p, ";;x,y.z!", ";,.!?-", e2, 3);
+
+    const char *e3[] = {"ab c"};
+    check_tokens(p, "ab c", "", e3, 1);
+    check_tokens(p, "   ", " ", NULL, 0);
+    check_tokens(p, "", " ", NULL, 0);
+
+    /* long runs cross several blocks */
+    char big[1000];
+    memset(big, ' ', sizeof(big));
+    memcpy(big + 100, "first", 5);
+    memcpy(big + 500, "second", 6);
+    memcpy(big + 994, "third", 5);
+    big[999] = 0;
+    const char *e4[] = {"first", "second", "third"};
+    check_tokens(p, big, " ", e4, 3);
+    check_tokens(p, big, " \x01\x02\x03\x04", e4, 3);
+
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(slice_edge_cases) {
+    aml_pool_t *p = aml_pool_init(256);
+    aml_slice_iter_t it;
+    aml_slice_t s;
+
+    aml_slice_split_init(&it, NULL, 0, ',');
+    MACRO_ASSERT_FALSE(aml_slice_next(&it, &s));
+    size_t num = 99;
+    aml_slice_t *r = aml_pool_split_slices(p, &num, ',', NULL, 0);
+    MACRO_ASSERT_EQ_SZ(num, 0);
+    MACRO_ASSERT_TRUE(r[0].p == NULL);
+
+    /* an empty buffer is one empty piece, like aml_pool_split("") */
+    const char *empty = "";
+    aml_slice_split_init(&it, empty, 0, ',');
+    MACRO_ASSERT_TRUE(aml_slice_next(&it, &s));
+    MACRO_ASSERT_EQ_SZ(s.len, 0);
+    MACRO_ASSERT_FALSE(aml_slice_next(&it, &s));
+
+    /* embedded zeros are ordinary bytes */
+    const char bin[] = {'a', 0, 'b', ',', 0};
+    r = aml_pool_split_slices(p, &num, ',', bin, sizeof(bin));
+    MACRO_ASSERT_EQ_SZ(num, 2);
+    MACRO_ASSERT_TRUE(aml_slice_eq(r[0], aml_slice(bin, 3)));
+    MACRO_ASSERT_EQ_SZ(r[1].len, 1);
+
+    MACRO_ASSERT_TRUE(aml_slice_eq_str(aml_slice_str("abc"), "abc"));
+    MACRO_ASSERT_FALSE(aml_slice_eq_str(aml_slice("abc", 2), "abc"));
+    MACRO_ASSERT_TRUE(aml_slice_eq_str(aml_slice_str(NULL), ""));
+    aml_pool_destroy(p);
+}
+
+MACRO_TEST(slice_strdup_helpers) {
+    aml_pool_t *p = aml_pool_init(256);
+    const char *line = "key=value;other=thing";
+    size_t num = 0;
+    aml_slice_t *r = aml_pool_split_slices(p, &num, ';', line, strlen(line));
+    MACRO_ASSERT_EQ_SZ(num, 2);
+
+    char *s = aml_pool_slice_strdup(p, r[1]);
+    MACRO_ASSERT_STREQ(s, "other=thing");
+    MACRO_ASSERT_STREQ(aml_pool_slice_strdup(p, aml_slice("", 0)), "");
+
+    char **a = aml_pool_slice_strdupa(p, r, num);
+    MACRO_ASSERT_STREQ(a[0], "key=value");
+    MACRO_ASSERT_STREQ(a[1], "other=thing");
+    MACRO_ASSERT_TRUE(a[2] == NULL);
+    a = aml_pool_slice_strdupa(p, r, 0);
+    MACRO_ASSERT_TRUE(a[0] == NULL);
+
+    /* the input is untouched */
+    MACRO_ASSERT_STREQ(line, "key=value;other=thing");
+    aml_pool_destroy(p);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, slice_split_matches_pool_split);
+    MACRO_ADD(tests, slice_tokenize);
+    MACRO_ADD(tests, slice_edge_cases);
+    MACRO_ADD(tests, slice_strdup_helpers);
+
+    macro_run_all("a-memory-library/aml_slice", tests, test_count);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_spool.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_spool.h"
+#include "a-memory-library/aml_alloc.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+
+#define THREADS 4
+#define PER_THREAD 20000
+
+MACRO_TEST(spool_basic_alloc) {
+    aml_spool_t *s = aml_spool_init(256);
+    size_t used = aml_spool_used(s);
+
+    char *a = (char *)aml_spool_alloc(s, 3);
+    char *b = (char *)aml_spool_alloc(s, 8);
+    MACRO_ASSERT_EQ_SZ((uintptr_t)a & (sizeof(size_t) - 1), 0);
+    MACRO_ASSERT_TRUE(b == a + sizeof(size_t));
+
+    unsigned char *z = (unsigned char *)aml_spool_calloc(s, 10, 3);
+    for (int i = 0; i < 30; i++)
+        MACRO_ASSERT_EQ_INT(z[i], 0);
+    MACRO_ASSERT_STREQ(aml_spool_strdup(s, "hello"), "hello");
+    MACRO_ASSERT_EQ_SZ(aml_spool_used(s), used);
+
+    /* growth and large requests */
+    for (int i = 0; i < 20; i++)
+        memset(aml_spool_alloc(s, 100), 'x', 100);
+    char *big = (char *)aml_spool_alloc(s, 10000);
+    memset(big, 'y', 10000);
+    MACRO_ASSERT_TRUE(aml_spool_used(s) > used + 10000);
+
+    aml_spool_clear(s);
+    MACRO_ASSERT_EQ_SZ(aml_spool_used(s), used);
+    MACRO_ASSERT_TRUE(aml_spool_alloc(s, 3) == a);
+    aml_spool_destroy(s);
+}
+
+typedef struct {
+    aml_spool_t *spool;
+    int id;
+    bool use_chunk;
+    uint32_t **out;
+} worker_t;
+
+static void *worker(void *arg) {
+    worker_t *w = (worker_t *)arg;
+    aml_spool_chunk_t c;
+    aml_spool_chunk_init(w->spool, &c, 1024);
+    for (int i = 0; i < PER_THREAD; i++) {
+        size_t n = 1 + (i % 7);
+        uint32_t *p;
+        if (w->use_chunk)
+            p = (uint32_t *)aml_spool_chunk_alloc(&c, n * sizeof(uint32_t));
+        else
+            p = (uint32_t *)aml_spool_alloc(w->spool, n * sizeof(uint32_t));
+        for (size_t j = 0; j < n; j++)
+            p[j] = (uint32_t)(w->id * PER_THREAD + i);
+        w->out[i] = p;
+    }
+    return NULL;
+}
+
+static void run_threads(aml_spool_t *s, bool use_chunk) {
+    pthread_t t[THREADS];
+    worker_t w[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        w[i].spool = s;
+        w[i].id = i;
+        w[i].use_chunk = use_chunk;
+        w[i].out = (uint32_t **)aml_malloc(sizeof(uint32_t *) * PER_THREAD);
+        pthread_create(t + i, NULL, worker, w + i);
+    }
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(t[i], NULL);
+
+    /* no allocation may overlap another, so every value must survive */
+    for (int i = 0; i < THREADS; i++) {
+        for (int k = 0; k < PER_THREAD; k++) {
+            size_t n = 1 + (k % 7);
+            for (size_t j = 0; j < n; j++)
+                MACRO_ASSERT_EQ_INT(w[i].out[k][j], i * PER_THREAD + k);
+        }
+        aml_free(w[i].out);
+    }
+}
+
+MACRO_TEST(spool_concurrent_alloc) {
+    aml_spool_t *s = aml_spool_init(4096);
+    run_threads(s, false);
+    aml_spool_clear(s);
+    run_threads(s, false);
+    aml_spool_destroy(s);
+}
+
+MACRO_TEST(spool_concurrent_chunks) {
+    aml_spool_t *s = aml_spool_init(4096);
+    run_threads(s, true);
+    aml_spool_clear(s);
+    run_threads(s, true);
+    aml_spool_destroy(s);
+}
+
+MACRO_TEST(spool_chunk_refills_after_clear) {
+    aml_spool_t *s = aml_spool_init(1024);
+    aml_spool_chunk_t c;
+    aml_spool_chunk_init(s, &c, 128);
+
+    char *a = (char *)aml_spool_chunk_alloc(&c, 8);
+    char *b = (char *)aml_spool_chunk_alloc(&c, 8);
+    MACRO_ASSERT_TRUE(b == a + 8);
+    /* doesn't fit and is larger than half a chunk, so it goes straight to
+       the spool and the chunk is kept */
+    char *big = (char *)aml_spool_chunk_alloc(&c, 200);
+    MACRO_ASSERT_TRUE(big == a + 128);
+    char *d = (char *)aml_spool_chunk_alloc(&c, 8);
+    MACRO_ASSERT_TRUE(d == b + 8);
+    MACRO_ASSERT_STREQ(aml_spool_chunk_strdup(&c, "chunk"), "chunk");
+
+    aml_spool_clear(s);
+    char *e = (char *)aml_spool_chunk_zalloc(&c, 8);
+    MACRO_ASSERT_TRUE(e == a);
+    aml_spool_destroy(s);
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, spool_basic_alloc);
+    MACRO_ADD(tests, spool_concurrent_alloc);
+    MACRO_ADD(tests, spool_concurrent_chunks);
+    MACRO_ADD(tests, spool_chunk_refills_after_clear);
+
+    macro_run_all("a-memory-library/aml_spool", tests, test_count);
+    return 0;
+}
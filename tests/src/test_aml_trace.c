@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2019–2025 Andy Curtis <contactandyc@gmail.com>
+// SPDX-FileCopyrightText: 2024–2025 Knode.ai — technical questions: contact Andy (above)
+// SPDX-License-Identifier: Apache-2.0
+
+// test_aml_trace.c
+#include "the-macro-library/macro_test.h"
+#include "a-memory-library/aml_buffer.h"
+#include "a-memory-library/aml_pool.h"
+#include "a-memory-library/aml_trace.h"
+
+#include <string.h>
+
+typedef struct {
+    size_t count[AML_TRACE_EVENTS];
+    aml_trace_event_t last[AML_TRACE_EVENTS];
+} recorder_t;
+
+static void record(const aml_trace_event_t *ev, void *arg) {
+    recorder_t *r = (recorder_t *)arg;
+    MACRO_ASSERT_TRUE(ev->type < AML_TRACE_EVENTS);
+    r->count[ev->type]++;
+    r->last[ev->type] = *ev;
+}
+
+MACRO_TEST(trace_names) {
+    MACRO_ASSERT_STREQ(aml_trace_name(AML_TRACE_POOL_GROW), "pool_grow");
+    MACRO_ASSERT_STREQ(aml_trace_name(AML_TRACE_BUFFER_DETACH), "buffer_detach");
+    MACRO_ASSERT_STREQ(aml_trace_name(AML_TRACE_EVENTS), "unknown");
+}
+
+MACRO_TEST(trace_pool_events) {
+    recorder_t r;
+    memset(&r, 0, sizeof(r));
+#ifndef _AML_TRACE_
+    /* compiled out */
+    MACRO_ASSERT_FALSE(aml_trace_set_callback(record, &r));
+    return;
+#else
+    MACRO_ASSERT_TRUE(aml_trace_set_callback(record, &r));
+    aml_pool_t *p = aml_pool_init(1024);
+    for (int i = 0; i < 100; i++)
+        aml_pool_alloc(p, 100);
+    MACRO_ASSERT_TRUE(r.count[AML_TRACE_POOL_GROW] > 0);
+    aml_trace_event_t g = r.last[AML_TRACE_POOL_GROW];
+    MACRO_ASSERT_TRUE(g.object == p);
+    MACRO_ASSERT_TRUE(g.after > g.before);
+    MACRO_ASSERT_EQ_SZ(g.after, aml_pool_used(p));
+
+    aml_pool_marker_t m;
+    aml_pool_save(p, &m);
+    size_t grows = r.count[AML_TRACE_POOL_GROW];
+    aml_pool_alloc(p, 100000);
+    MACRO_ASSERT_EQ_SZ(r.count[AML_TRACE_POOL_GROW], grows + 1);
+    size_t used = aml_pool_used(p);
+    aml_pool_restore(p, &m);
+    MACRO_ASSERT_EQ_SZ(r.count[AML_TRACE_POOL_RESTORE], 1);
+    MACRO_ASSERT_EQ_SZ(r.last[AML_TRACE_POOL_RESTORE].before, used);
+    MACRO_ASSERT_EQ_SZ(r.last[AML_TRACE_POOL_RESTORE].after, aml_pool_used(p));
+
+    used = aml_pool_used(p);
+    aml_pool_clear(p);
+    MACRO_ASSERT_EQ_SZ(r.count[AML_TRACE_POOL_CLEAR], 1);
+    MACRO_ASSERT_EQ_SZ(r.last[AML_TRACE_POOL_CLEAR].before, used);
+    MACRO_ASSERT_TRUE(r.last[AML_TRACE_POOL_CLEAR].after < used);
+
+    /* nothing once the callback is gone */
+    aml_trace_set_callback(NULL, NULL);
+    aml_pool_clear(p);
+    MACRO_ASSERT_EQ_SZ(r.count[AML_TRACE_POOL_CLEAR], 1);
+    aml_pool_destroy(p);
+#endif
+}
+
+MACRO_TEST(trace_buffer_events) {
+#ifdef _AML_TRACE_
+    recorder_t r;
+    memset(&r, 0, sizeof(r));
+    aml_trace_set_callback(record, &r);
+    aml_buffer_t *b = aml_buffer_init(16);
+    aml_buffer_appendn(b, 'x', 100000);
+    MACRO_ASSERT_TRUE(r.count[AML_TRACE_BUFFER_GROW] > 0);
+    aml_trace_event_t g = r.last[AML_TRACE_BUFFER_GROW];
+    MACRO_ASSERT_TRUE(g.object == b);
+    MACRO_ASSERT_TRUE(g.before < 100000);
+    MACRO_ASSERT_EQ_SZ(g.after, aml_buffer_capacity(b));
+
+    size_t len = 0;
+    char *d = aml_buffer_detach(b, &len);
+    MACRO_ASSERT_EQ_SZ(r.count[AML_TRACE_BUFFER_DETACH], 1);
+    MACRO_ASSERT_EQ_SZ(r.last[AML_TRACE_BUFFER_DETACH].before, 100000);
+    MACRO_ASSERT_EQ_SZ(r.last[AML_TRACE_BUFFER_DETACH].after, 0);
+    aml_free(d);
+    aml_trace_set_callback(NULL, NULL);
+    aml_buffer_destroy(b);
+#endif
+}
+
+/* --- runner --- */
+int main(void) {
+    macro_test_case tests[16];
+    size_t test_count = 0;
+
+    MACRO_ADD(tests, trace_names);
+    MACRO_ADD(tests, trace_pool_events);
+    MACRO_ADD(tests, trace_buffer_events);
+
+    macro_run_all("a-memory-library/aml_trace", tests, test_count);
+    return 0;
+}